@@ -1,6 +1,7 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
 #include <vector>
 #include <tuple>
 #include <numeric>
@@ -40,6 +41,7 @@ struct Options {
     bool bm_rng;
     bool bm_sort;
     bool bm_scan;
+    bool bm_launch;
     bool bm_cpu;
 
     Options() :
@@ -51,6 +53,7 @@ struct Options {
         bm_rng(true),
         bm_sort(true),
         bm_scan(true),
+        bm_launch(true),
         bm_cpu(true)
     {}
 
@@ -63,6 +66,7 @@ struct Options {
         bm_rng      = !bm_rng;
         bm_sort     = !bm_sort;
         bm_scan     = !bm_scan;
+        bm_launch   = !bm_launch;
         bm_cpu      = !bm_cpu;
     }
 } options;
@@ -705,6 +709,26 @@ void benchmark_sort(
         << "Sort (" << vex::type_name<key_type>() << ")\n"
         << "    VexCL:         " << N * M / tot_time << " keys/sec\n";
 
+    // A comparator other than the standard ones is not radix-sortable, so
+    // this times the merge sort (the default on GPUs) on the same queues.
+    struct merge_less : vex::less<key_type> {};
+
+    X1 = X0;
+    vex::sort(X1, merge_less());
+
+    tot_time = 0;
+    for(size_t i = 0; i < M; i++) {
+        X1 = X0;
+        ctx.finish();
+        prof.tic_cpu("VexCL (merge)");
+        vex::sort(X1, merge_less());
+        ctx.finish();
+        tot_time += prof.toc("VexCL (merge)");
+    }
+
+    std::cout
+        << "    VexCL (merge): " << N * M / tot_time << " keys/sec\n";
+
 #ifdef VEXCL_HAVE_BOOST_COMPUTE
     X1 = X0;
     vex::compute::sort(X1);
@@ -845,6 +869,47 @@ void benchmark_scan(
     std::cout << std::endl;
 }
 
+//---------------------------------------------------------------------------
+template <typename real>
+void benchmark_launch(
+        const vex::Context &ctx, vex::profiler<> &prof
+        )
+{
+    // Total number of processed elements for each vector size:
+    const size_t T = 64 * 1024 * 1024;
+
+    std::cout
+        << "Kernel launch latency (" << vex::type_name<real>() << ")\n"
+        << "  " << std::setw(10) << "size"
+        << std::setw(16) << "usec/launch"
+        << std::setw(16) << "Bandwidth" << std::endl;
+
+    for(size_t N = 64; N <= 16 * 1024 * 1024; N *= 4) {
+        const size_t M = std::max<size_t>(16, T / N);
+
+        vex::vector<real> a(ctx, N);
+        vex::vector<real> b(ctx, random_vector<real>(N));
+        vex::vector<real> c(ctx, random_vector<real>(N));
+
+        a = b + c;
+        ctx.finish();
+
+        prof.tic_cpu("Launch");
+        for(size_t i = 0; i < M; i++)
+            a = b + c;
+        ctx.finish();
+        double time_elapsed = prof.toc("Launch");
+
+        std::cout
+            << "  " << std::setw(10) << N
+            << std::setw(16) << 1e6 * time_elapsed / M
+            << std::setw(16) << (3.0 * N * M * sizeof(real)) / time_elapsed / 1e9
+            << std::endl;
+    }
+
+    std::cout << std::endl;
+}
+
 //---------------------------------------------------------------------------
 template <typename real>
 void run_tests(const vex::Context &ctx, vex::profiler<> &prof)
@@ -927,6 +992,12 @@ void run_tests(const vex::Context &ctx, vex::profiler<> &prof)
         prof.toc("Scanning");
     }
 
+    if (options.bm_launch) {
+        prof.tic_cpu("Launch latency");
+        benchmark_launch<real>(ctx, prof);
+        prof.toc("Launch latency");
+    }
+
     prof.toc( vex::type_name<real>() );
 
     std::cout << std::endl << std::endl;
@@ -972,6 +1043,10 @@ int main(int argc, char *argv[]) {
             po::value<bool>(&options.bm_sort)->default_value(true),
             "benchmark exclusive scan (on/off)"
             )
+        ("bm_lat",
+            po::value<bool>(&options.bm_launch)->default_value(true),
+            "benchmark kernel launch latency (on/off)"
+            )
         ("bm_cpu",
             po::value<bool>(&options.bm_cpu)->default_value(true),
             "benchmark host CPU performance (on/off)"
@@ -0,0 +1,128 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <string>
+
+#include <boost/thread.hpp>
+
+#include <vexcl/devlist.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/cache.hpp>
+#include <vexcl/profiler.hpp>
+
+// Contention benchmark for the object cache lookups.
+//
+// Compares the lookups in vex::detail::object_cache with the lookups in a
+// mutex-protected map (the way object_cache used to work), and measures the
+// rate of small vector assignments (each doing a kernel cache lookup) from
+// the increasing number of host threads sharing a single context.
+
+typedef vex::detail::object_cache<vex::detail::index_by_context, int> cache_type;
+
+// Mutex-protected map, for reference.
+struct locked_cache {
+    typedef std::map<vex::backend::context, int, vex::backend::compare_contexts> store_type;
+
+    store_type   store;
+    boost::mutex mx;
+
+    void insert(const vex::backend::command_queue &q, int v) {
+        boost::lock_guard<boost::mutex> lock(mx);
+        store.insert(std::make_pair(vex::backend::get_context(q), v));
+    }
+
+    store_type::iterator find(const vex::backend::command_queue &q) {
+        boost::lock_guard<boost::mutex> lock(mx);
+        return store.find(vex::backend::get_context(q));
+    }
+};
+
+// Runs f(t) in nt threads and returns the number of calls per second.
+template <class F>
+double rate(int nt, size_t calls_per_thread, F &&f) {
+    boost::thread_group threads;
+    std::atomic<bool> go(false);
+
+    for(int t = 0; t < nt; ++t)
+        threads.create_thread([&, t]() {
+                while(!go) boost::this_thread::yield();
+                f(t);
+                });
+
+    vex::stopwatch<> w;
+    go = true;
+    threads.join_all();
+
+    return nt * calls_per_thread / w.toc();
+}
+
+int main(int argc, char *argv[]) {
+    const int    max_threads = argc < 2 ? boost::thread::hardware_concurrency() : std::stoi(argv[1]);
+    const size_t lookups     = 1 << 20;
+    const size_t assignments = 1 << 12;
+    const size_t n           = 256;
+
+    vex::Context ctx( vex::Filter::Env && vex::Filter::Count(1) );
+    std::cout << ctx << std::endl;
+
+    const vex::backend::command_queue &q = ctx.queue(0);
+
+    cache_type   cache;
+    locked_cache locked;
+
+    cache.insert(q, 42);
+    locked.insert(q, 42);
+
+    std::cout
+        << std::setw(8)  << "threads"
+        << std::setw(16) << "locked (M/s)"
+        << std::setw(16) << "cache (M/s)"
+        << std::setw(16) << "assign (K/s)"
+        << std::endl;
+
+    for(int nt = 1; nt <= std::max(1, max_threads); nt *= 2) {
+        std::atomic<long> sum(0);
+
+        double r_locked = rate(nt, lookups, [&](int) {
+                long s = 0;
+                for(size_t i = 0; i < lookups; ++i) s += locked.find(q)->second;
+                sum += s;
+                });
+
+        double r_cache = rate(nt, lookups, [&](int) {
+                long s = 0;
+                for(size_t i = 0; i < lookups; ++i) s += cache.find(q)->second;
+                sum += s;
+                });
+
+        std::vector< vex::vector<double> > x, y;
+        for(int t = 0; t < nt; ++t) {
+            x.emplace_back(ctx, n);
+            y.emplace_back(ctx, n);
+            y.back() = t;
+
+            // Compile the kernel outside of the measurement:
+            x.back() = 2 * y.back() + 1;
+        }
+
+        double r_assign = rate(nt, assignments, [&](int t) {
+                for(size_t i = 0; i < assignments; ++i)
+                    x[t] = 2 * y[t] + 1;
+                ctx.finish();
+                });
+
+        if (sum != static_cast<long>(2 * 42 * nt * lookups)) {
+            std::cerr << "Wrong lookup result" << std::endl;
+            return 1;
+        }
+
+        std::cout
+            << std::setw(8)  << nt
+            << std::setw(16) << std::fixed << std::setprecision(2) << r_locked * 1e-6
+            << std::setw(16) << r_cache  * 1e-6
+            << std::setw(16) << r_assign * 1e-3
+            << std::endl;
+    }
+}
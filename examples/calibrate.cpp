@@ -0,0 +1,79 @@
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <string>
+
+#include <boost/program_options.hpp>
+
+#include <vexcl/devlist.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/calibration.hpp>
+
+// Refreshes the persistent calibration data (see vex::calibration) of the
+// devices selected with the usual environment variables (OCL_DEVICE,
+// OCL_PLATFORM, etc.), or shows the stored data.
+
+void show(const vex::backend::command_queue &q) {
+    std::map<std::string, double> params = vex::calibration::list(q);
+
+    std::cout << q << std::endl
+              << "  " << vex::calibration::path(q) << std::endl;
+
+    if (params.empty())
+        std::cout << "  not calibrated" << std::endl;
+
+    for(auto p = params.begin(); p != params.end(); ++p)
+        std::cout << "  " << std::left << std::setw(24) << p->first
+                  << " = " << p->second << std::endl;
+
+    std::cout << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    namespace po = boost::program_options;
+    po::options_description desc("Options");
+
+    desc.add_options()
+        ("help,h", "show help")
+        ("show,s", "show the stored calibration data without recalibrating")
+        ("clear,c", "remove the stored calibration data")
+        ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    try {
+        vex::Context ctx(vex::Filter::Env);
+
+        if (!ctx) {
+            std::cerr << "No compute devices found" << std::endl;
+            return 1;
+        }
+
+        if (!vex::calibration::enabled()) {
+            std::cerr << "Calibration store is disabled (VEXCL_CALIBRATION=0)" << std::endl;
+            return 1;
+        }
+
+        for(unsigned d = 0; d < ctx.size(); ++d) {
+            const vex::backend::command_queue &q = ctx.queue(d);
+
+            if (!vm.count("show")) {
+                vex::calibration::clear(q);
+
+                if (!vm.count("clear")) vex::device_vector_perf(q);
+            }
+
+            show(q);
+        }
+    } catch (const vex::error &e) {
+        std::cerr << "VexCL error: " << e << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,67 @@
+#define BOOST_TEST_MODULE Calibration
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/calibration.hpp>
+#include "context_setup.hpp"
+
+BOOST_AUTO_TEST_CASE(store_parameters)
+{
+    const vex::backend::command_queue &q = ctx.queue(0);
+
+    vex::calibration::clear(q);
+    BOOST_CHECK(!vex::calibration::get(q, "block_size"));
+
+    vex::calibration::set(q, "block_size", 256);
+    vex::calibration::set(q, "ratio", 0.1);
+
+    // The data survives the restart:
+    vex::calibration::reload();
+
+    BOOST_CHECK(boost::filesystem::exists(vex::calibration::path(q)));
+    BOOST_CHECK_EQUAL(*vex::calibration::get(q, "block_size"), 256);
+    BOOST_CHECK_EQUAL(*vex::calibration::get(q, "ratio"), 0.1);
+    BOOST_CHECK_EQUAL(vex::calibration::list(q).size(), 2);
+
+    // The measurement is only done when there is no stored value:
+    int calls = 0;
+    auto measure = [&calls]() { ++calls; return 42.0; };
+
+    BOOST_CHECK_EQUAL(vex::calibration::get(q, "block_size", measure), 256);
+    BOOST_CHECK_EQUAL(vex::calibration::get(q, "threads", measure), 42);
+    BOOST_CHECK_EQUAL(vex::calibration::get(q, "threads", measure), 42);
+    BOOST_CHECK_EQUAL(calls, 1);
+
+    vex::calibration::clear(q);
+    BOOST_CHECK(vex::calibration::list(q).empty());
+    BOOST_CHECK(!boost::filesystem::exists(vex::calibration::path(q)));
+}
+
+BOOST_AUTO_TEST_CASE(device_weights)
+{
+    const vex::backend::command_queue &q = ctx.queue(0);
+
+    vex::calibration::clear(q);
+
+    // The benchmark results are stored:
+    double perf = vex::device_vector_perf(q);
+    BOOST_CHECK_GT(perf, 0);
+
+    vex::calibration::reload();
+    BOOST_CHECK_EQUAL(*vex::calibration::get(q, "vector_perf"), perf);
+    BOOST_CHECK_GT(*vex::calibration::get(q, "bandwidth"), 0);
+
+    // and reused instead of running the benchmark:
+    vex::calibration::set(q, "vector_perf", 42);
+    BOOST_CHECK_EQUAL(vex::device_vector_perf(q), 42);
+
+    // unless the store is disabled:
+    vex::calibration::enabled(false);
+    BOOST_CHECK(!vex::calibration::get(q, "vector_perf"));
+    BOOST_CHECK_NE(vex::device_vector_perf(q), 42);
+    vex::calibration::enabled(true);
+
+    vex::calibration::clear(q);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
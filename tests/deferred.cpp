@@ -0,0 +1,177 @@
+#define BOOST_TEST_MODULE DeferredExecution
+#include <numeric>
+#include <boost/test/unit_test.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/reductor.hpp>
+#include <vexcl/element_index.hpp>
+#include <vexcl/function.hpp>
+#ifndef VEXCL_BACKEND_CUDA
+#include <vexcl/vector_view.hpp>
+#endif
+#include <vexcl/deferred.hpp>
+#include "context_setup.hpp"
+
+BOOST_AUTO_TEST_CASE(fused_statements)
+{
+    const size_t n = 1024;
+
+    vex::vector<double> x(ctx, n);
+    vex::vector<double> y(ctx, n);
+    vex::vector<double> z(ctx, n);
+
+    {
+        vex::deferred_scope deferred;
+
+        x = vex::element_index();
+        y = 2 * x + 1;      // Reads x computed above.
+        z = sin(y) - x;
+        x += y;             // Overwrites x read above.
+
+        BOOST_CHECK_EQUAL(deferred.pending(), 4);
+        BOOST_CHECK_EQUAL(deferred.kernels(), 0);
+    }
+
+    check_sample(x, y, [](size_t idx, double a, double b) {
+            BOOST_CHECK_EQUAL(b, 2.0 * idx + 1);
+            BOOST_CHECK_EQUAL(a, 3.0 * idx + 1);
+            });
+
+    check_sample(z, [](size_t idx, double a) {
+            BOOST_CHECK_CLOSE(a, sin(2.0 * idx + 1) - idx, 1e-8);
+            });
+}
+
+BOOST_AUTO_TEST_CASE(flush_on_access)
+{
+    const size_t n = 1024;
+
+    vex::vector<double> x(ctx, n);
+    vex::vector<double> y(ctx, n);
+    vex::vector<double> z(ctx, n);
+
+    vex::Reductor<double, vex::SUM> sum(ctx);
+
+    vex::deferred_scope deferred;
+
+    x = 1;
+    y = 2 * x;
+
+    // Unrelated vector does not trigger the flush:
+    z = 3;
+    BOOST_CHECK_EQUAL(deferred.pending(), 3);
+
+    // Reductions flush the pending statements:
+    BOOST_CHECK_EQUAL(sum(y), 2.0 * n);
+    BOOST_CHECK_EQUAL(deferred.pending(), 0);
+    BOOST_CHECK_EQUAL(deferred.kernels(), 1);
+
+    // So do host reads:
+    y = x + z;
+    std::vector<double> h(n);
+    vex::copy(y, h);
+    BOOST_CHECK_EQUAL(deferred.pending(), 0);
+    for(size_t i = 0; i < n; ++i) BOOST_CHECK_EQUAL(h[i], 4);
+
+    // ... and element access:
+    x = 5;
+    BOOST_CHECK_EQUAL(x[42], 5);
+
+#ifndef VEXCL_BACKEND_CUDA
+    // Non-deferrable statements are executed in order:
+    y = vex::element_index();
+    vex::slicer<1> slice(vex::extents[n]);
+    z = slice[vex::range(0, 1, n)](y) + 1;
+    BOOST_CHECK_EQUAL(deferred.pending(), 0);
+
+    check_sample(z, [](size_t idx, double a) { BOOST_CHECK_EQUAL(a, idx + 1.0); });
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(flush_on_iterator_access)
+{
+    const size_t n = 1024;
+
+    vex::vector<int> x(ctx, n);
+
+    vex::deferred_scope deferred;
+
+    // Reads through the iterators see the pending statements:
+    x = 1;
+    BOOST_CHECK_EQUAL(*x.begin(), 1);
+    BOOST_CHECK_EQUAL(deferred.pending(), 0);
+
+    x = 2;
+    BOOST_CHECK_EQUAL(*(x.begin() + n / 2), 2);
+
+    x = 3;
+    BOOST_CHECK_EQUAL(std::accumulate(x.begin(), x.begin() + 16, 0), 3 * 16);
+
+    // The writes are not overwritten by the pending statements:
+    x = 4;
+    *x.begin() = 42;
+    *(x.begin() + n - 1) = 43;
+    BOOST_CHECK_EQUAL(deferred.pending(), 0);
+
+    std::vector<int> h(n);
+    vex::copy(x, h);
+
+    BOOST_CHECK_EQUAL(h[0], 42);
+    BOOST_CHECK_EQUAL(h[1], 4);
+    BOOST_CHECK_EQUAL(h[n - 1], 43);
+}
+
+BOOST_AUTO_TEST_CASE(kernel_reuse)
+{
+    const size_t n = 1024;
+
+    vex::vector<double> x(ctx, n);
+    vex::vector<double> y(ctx, n);
+
+    x = 0;
+    y = 1;
+
+    VEX_FUNCTION(double, axpy, (double, a)(double, x)(double, y),
+            return a * x + y;
+            );
+
+    vex::deferred_scope deferred(2);
+
+    for(int i = 0; i < 10; ++i) {
+        x = axpy(0.5, y, x);
+        y = axpy(2.0, y, 0);
+    }
+
+    deferred.flush();
+
+    // Each pair of statements fills a batch:
+    BOOST_CHECK_EQUAL(deferred.kernels(), 10);
+
+    check_sample(x, y, [](size_t, double a, double b) {
+            BOOST_CHECK_EQUAL(a, 511.5);
+            BOOST_CHECK_EQUAL(b, 1024);
+            });
+}
+
+BOOST_AUTO_TEST_CASE(temporary_vectors)
+{
+    const size_t n = 1024;
+
+    vex::vector<double> x(ctx, n);
+
+    vex::deferred_scope deferred;
+
+    {
+        vex::vector<double> tmp(ctx, n);
+        tmp = 21;
+        x = 2 * tmp;
+
+        // The pending statements referencing tmp are executed when it goes
+        // out of scope.
+    }
+
+    BOOST_CHECK_EQUAL(deferred.pending(), 0);
+
+    check_sample(x, [](size_t, double a) { BOOST_CHECK_EQUAL(a, 42); });
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,93 @@
+#define BOOST_TEST_MODULE DeviceScalar
+#include <numeric>
+#include <algorithm>
+#include <boost/test/unit_test.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/reductor.hpp>
+#include <vexcl/device_scalar.hpp>
+#include <vexcl/deferred.hpp>
+#include "context_setup.hpp"
+
+BOOST_AUTO_TEST_CASE(async_reduction)
+{
+    const size_t n = 1024;
+
+    std::vector<double> x = random_vector<double>(n);
+    vex::vector<double> X(ctx, x);
+
+    vex::Reductor<double, vex::SUM>     sum(ctx);
+    vex::Reductor<double, vex::MAX>     max(ctx);
+    vex::Reductor<double, vex::MIN_MAX> minmax(ctx);
+
+    vex::device_scalar<double> s = sum.async(X);
+    vex::device_scalar<double> m = max.async(X);
+
+    BOOST_CHECK_CLOSE(s.get(), std::accumulate(x.begin(), x.end(), 0.0), 1e-8);
+    BOOST_CHECK_EQUAL(m.get(), *std::max_element(x.begin(), x.end()));
+
+    cl_double2 mm = minmax.async(X).get();
+    BOOST_CHECK_EQUAL(mm.s[0], *std::min_element(x.begin(), x.end()));
+    BOOST_CHECK_EQUAL(mm.s[1], *std::max_element(x.begin(), x.end()));
+
+    // Reduction of an empty expression:
+    vex::vector<double> e;
+    BOOST_CHECK_EQUAL(sum.async(e).get(), 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(device_scalar_in_expression)
+{
+    const size_t n = 1024;
+
+    std::vector<double> p = random_vector<double>(n);
+    std::vector<double> q = random_vector<double>(n);
+
+    vex::vector<double> P(ctx, p);
+    vex::vector<double> Q(ctx, q);
+    vex::vector<double> X(ctx, n);
+
+    vex::Reductor<double, vex::SUM> sum(ctx);
+
+    X = 1;
+
+    vex::device_scalar<double> pp = sum.async(P * P);
+    vex::device_scalar<double> pq = sum.async(P * Q);
+
+    X += (pp / pq) * P;
+
+    double alpha = std::inner_product(p.begin(), p.end(), p.begin(), 0.0)
+                 / std::inner_product(p.begin(), p.end(), q.begin(), 0.0);
+
+    check_sample(X, [&](size_t idx, double a) {
+            BOOST_CHECK_CLOSE(a, 1 + alpha * p[idx], 1e-6);
+            });
+}
+
+BOOST_AUTO_TEST_CASE(device_scalar_deferred)
+{
+    const size_t n = 1024;
+
+    vex::vector<double> x(ctx, n);
+    vex::vector<double> y(ctx, n);
+
+    y = 1;
+
+    vex::device_scalar<double> a(ctx, 2.0);
+
+    {
+        vex::deferred_scope deferred;
+
+        // The pending statement keeps the old value of the scalar:
+        x = a * y;
+        a = vex::device_scalar<double>(ctx, 3.0);
+        x += a;
+
+        BOOST_CHECK_EQUAL(deferred.pending(), 2);
+    }
+
+    check_sample(x, [](size_t, double v) { BOOST_CHECK_EQUAL(v, 5); });
+
+    a.set(4);
+    BOOST_CHECK_EQUAL(a.get(), 4);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
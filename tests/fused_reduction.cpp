@@ -0,0 +1,258 @@
+#define BOOST_TEST_MODULE FusedReduction
+#include <numeric>
+#include <cmath>
+#include <boost/test/unit_test.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/multivector.hpp>
+#include <vexcl/reductor.hpp>
+#include <vexcl/element_index.hpp>
+#include <vexcl/function.hpp>
+#ifndef VEXCL_BACKEND_CUDA
+#include <vexcl/vector_view.hpp>
+#endif
+#include "context_setup.hpp"
+
+BOOST_AUTO_TEST_CASE(assign_and_reduce_vector)
+{
+    const size_t n = 1024;
+
+    vex::vector<double> r(ctx, random_vector<double>(n));
+    vex::vector<double> q(ctx, random_vector<double>(n));
+
+    std::vector<double> R(n), Q(n);
+    vex::copy(r, R);
+    vex::copy(q, Q);
+
+    const double alpha = 0.5;
+
+    double rr = vex::assign_and_reduce<vex::assign::SUB>(r, alpha * q,
+            vex::reduction<double>(r * r));
+
+    double sum = 0;
+    for(size_t i = 0; i < n; ++i) {
+        R[i] -= alpha * Q[i];
+        sum += R[i] * R[i];
+    }
+
+    BOOST_CHECK_CLOSE(rr, sum, 1e-8);
+
+    check_sample(r, [&](size_t idx, double a) {
+            BOOST_CHECK_CLOSE(a, R[idx], 1e-8);
+            });
+}
+
+BOOST_AUTO_TEST_CASE(assign_and_reduce_tuple)
+{
+    const size_t n = 1024;
+
+    vex::vector<double> x(ctx, random_vector<double>(n));
+    vex::vector<double> r(ctx, random_vector<double>(n));
+    vex::vector<double> p(ctx, random_vector<double>(n));
+    vex::vector<double> q(ctx, random_vector<double>(n));
+
+    std::vector<double> X(n), R(n), P(n), Q(n);
+    vex::copy(x, X);
+    vex::copy(r, R);
+    vex::copy(p, P);
+    vex::copy(q, Q);
+
+    const double alpha = 0.25;
+
+    double rr, rmax;
+    int npos;
+
+    std::tie(rr, rmax, npos) = vex::assign_and_reduce(std::tie(x, r),
+            std::make_tuple(x + alpha * p, r - alpha * q),
+            vex::reduction<double, vex::SUM_Kahan>(r * r),
+            vex::reduction<double, vex::MAX>(fabs(r)),
+            vex::reduction<int>(r > 0)
+            );
+
+    double sum = 0, amax = 0;
+    int cnt = 0;
+    for(size_t i = 0; i < n; ++i) {
+        X[i] += alpha * P[i];
+        R[i] -= alpha * Q[i];
+
+        sum += R[i] * R[i];
+        amax = std::max(amax, std::abs(R[i]));
+        cnt += R[i] > 0;
+    }
+
+    BOOST_CHECK_CLOSE(rr, sum, 1e-8);
+    BOOST_CHECK_EQUAL(rmax, amax);
+    BOOST_CHECK_EQUAL(npos, cnt);
+
+    check_sample(x, r, [&](size_t idx, double a, double b) {
+            BOOST_CHECK_CLOSE(a, X[idx], 1e-8);
+            BOOST_CHECK_CLOSE(b, R[idx], 1e-8);
+            });
+
+    // vex::tie() works as well:
+    double xsum = vex::assign_and_reduce(vex::tie(x, r), std::make_tuple(r, x),
+            vex::reduction<double>(x));
+
+    BOOST_CHECK_CLOSE(xsum, std::accumulate(R.begin(), R.end(), 0.0), 1e-8);
+}
+
+BOOST_AUTO_TEST_CASE(assign_and_reduce_multivector)
+{
+    const size_t n = 1024;
+
+    typedef std::array<double, 2> elem_t;
+
+    vex::multivector<double, 2> x(ctx, n);
+    vex::vector<double> y(ctx, n);
+
+    x(0) = vex::element_index();
+    x(1) = 1;
+    y = 2;
+
+    double s0, s1;
+    std::tie(s0, s1) = vex::assign_and_reduce<vex::assign::ADD>(x, std::make_tuple(y, 2 * y),
+            vex::reduction<double>(x(0)), vex::reduction<double>(x(1)));
+
+    BOOST_CHECK_CLOSE(s0, n * (n - 1) / 2.0 + 2.0 * n, 1e-8);
+    BOOST_CHECK_CLOSE(s1, 5.0 * n, 1e-8);
+
+    check_sample(x, [](size_t idx, elem_t a) {
+            BOOST_CHECK_EQUAL(a[0], idx + 2.0);
+            BOOST_CHECK_EQUAL(a[1], 5.0);
+            });
+}
+
+#ifndef VEXCL_BACKEND_CUDA
+BOOST_AUTO_TEST_CASE(assign_and_reduce_not_fused)
+{
+    const size_t n = 1024;
+
+    vex::vector<double> x(ctx, n);
+
+    x = vex::element_index();
+
+    // The reduction reads the assigned vector at other elements, so the
+    // assignment is done first:
+    auto reverse = vex::permutation(n - 1 - vex::element_index(0, n));
+
+    double s = vex::assign_and_reduce(x, 2 * x,
+            vex::reduction<double>(reverse(x) * vex::element_index()));
+
+    double sum = 0;
+    for(size_t i = 0; i < n; ++i) sum += 2.0 * (n - 1 - i) * i;
+
+    BOOST_CHECK_CLOSE(s, sum, 1e-8);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(reduce_all)
+{
+    const size_t n = 1024;
+
+    vex::vector<double> x(ctx, random_vector<double>(n));
+    vex::vector<double> y(ctx, random_vector<double>(n));
+    vex::vector<float>  r(ctx, random_vector<float>(n));
+
+    std::vector<double> X(n), Y(n);
+    std::vector<float>  R(n);
+    vex::copy(x, X);
+    vex::copy(y, Y);
+    vex::copy(r, R);
+
+    double xy, rr;
+    float  rmax;
+    int    npos;
+
+    std::tie(xy, rmax, rr, npos) = vex::reduce_all(
+            vex::reduction<double>(x * y),
+            vex::reduction<float, vex::MAX>(fabs(r)),
+            vex::reduction<double, vex::SUM_Kahan>(r * r),
+            vex::reduction<int>(x > y)
+            );
+
+    double sxy = 0, srr = 0;
+    float  smax = 0;
+    int    cnt = 0;
+    for(size_t i = 0; i < n; ++i) {
+        sxy += X[i] * Y[i];
+        srr += R[i] * R[i];
+        smax = std::max(smax, std::abs(R[i]));
+        cnt += X[i] > Y[i];
+    }
+
+    BOOST_CHECK_CLOSE(xy, sxy, 1e-8);
+    BOOST_CHECK_CLOSE(rr, srr, 1e-4);
+    BOOST_CHECK_EQUAL(rmax, smax);
+    BOOST_CHECK_EQUAL(npos, cnt);
+
+    // A single reduction returns the value:
+    double s = vex::reduce_all(vex::reduction<double>(x));
+    BOOST_CHECK_CLOSE(s, std::accumulate(X.begin(), X.end(), 0.0), 1e-8);
+}
+
+BOOST_AUTO_TEST_CASE(reduce_all_queues)
+{
+    const size_t n = 1024;
+
+    // The kernel is shared by the queues of a context, the scratch buffers
+    // are not:
+    std::vector<vex::command_queue> q2;
+    for(unsigned d = 0; d < ctx.size(); ++d)
+        q2.push_back(vex::backend::duplicate_queue(ctx.queue(d)));
+
+    vex::vector<double> x(ctx, n);
+    vex::vector<double> y(q2,  n);
+
+    x = 1;
+    y = 2;
+
+    double sx, mx, sy, my;
+
+    std::tie(sx, mx) = vex::reduce_all(
+            vex::reduction<double>(x), vex::reduction<double, vex::MAX>(x));
+    std::tie(sy, my) = vex::reduce_all(
+            vex::reduction<double>(y), vex::reduction<double, vex::MAX>(y));
+
+    BOOST_CHECK_EQUAL(sx, n);
+    BOOST_CHECK_EQUAL(mx, 1);
+    BOOST_CHECK_EQUAL(sy, 2.0 * n);
+    BOOST_CHECK_EQUAL(my, 2);
+
+    // The scratch buffers are released with the caches of the queue:
+    vex::purge_caches(q2);
+
+    std::tie(sy, my) = vex::reduce_all(
+            vex::reduction<double>(y), vex::reduction<double, vex::MAX>(y));
+
+    BOOST_CHECK_EQUAL(sy, 2.0 * n);
+    BOOST_CHECK_EQUAL(my, 2);
+}
+
+BOOST_AUTO_TEST_CASE(reduce_multivector)
+{
+    const size_t n = 1024;
+
+    vex::multivector<double, 3> x(ctx, n);
+
+    x(0) = vex::element_index();
+    x(1) = 1;
+    x(2) = -1.0 * vex::element_index();
+
+    vex::Reductor<double, vex::SUM> sum(ctx);
+    std::array<double, 3> s = sum(2 * x);
+
+    BOOST_CHECK_CLOSE(s[0], 1.0 * n * (n - 1), 1e-8);
+    BOOST_CHECK_CLOSE(s[1], 2.0 * n, 1e-8);
+    BOOST_CHECK_CLOSE(s[2], -1.0 * n * (n - 1), 1e-8);
+
+    vex::Reductor<double, vex::MIN_MAX> minmax(ctx);
+    std::array<cl_double2, 3> m = minmax(x);
+
+    BOOST_CHECK_EQUAL(m[0].s[0], 0);
+    BOOST_CHECK_EQUAL(m[0].s[1], n - 1.0);
+    BOOST_CHECK_EQUAL(m[1].s[0], 1);
+    BOOST_CHECK_EQUAL(m[1].s[1], 1);
+    BOOST_CHECK_EQUAL(m[2].s[0], 1.0 - n);
+    BOOST_CHECK_EQUAL(m[2].s[1], 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
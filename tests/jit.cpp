@@ -0,0 +1,519 @@
+#define BOOST_TEST_MODULE JIT
+#include <chrono>
+#include <algorithm>
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/enqueue.hpp>
+#include <vexcl/reductor.hpp>
+#include <vexcl/element_index.hpp>
+#include <vexcl/function.hpp>
+#include <vexcl/vector_view.hpp>
+#include <vexcl/deferred.hpp>
+#include <vexcl/kernel_registry.hpp>
+#include "context_setup.hpp"
+
+// Each run generates unique sources, so that the offline cache does not
+// hide the compilation.
+std::string fill_kernel(const vex::command_queue &q, int value) {
+    static const long long seed = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+
+    vex::backend::source_generator src(q);
+
+    src.new_line() << "// seed: " << seed;
+    src.begin_kernel("fill");
+    src.begin_kernel_parameters();
+    src.parameter<size_t>("n");
+    src.parameter<int*>("x");
+    src.end_kernel_parameters();
+    src.grid_stride_loop("idx", "n").open("{");
+    src.new_line() << "x[idx] = " << value << ";";
+    src.close("}");
+    src.end_kernel();
+
+    return src.str();
+}
+
+BOOST_AUTO_TEST_CASE(background_compilation)
+{
+    const size_t n = 1024;
+    const int m = 8;
+
+    std::vector<vex::command_queue> queue(1, ctx.queue(0));
+    vex::vector<int> x(queue, n);
+
+    // Kernels are compiled concurrently; the constructors do not block.
+    std::vector<vex::backend::kernel> fill;
+    for(int i = 0; i < m; ++i)
+        fill.emplace_back(queue[0], fill_kernel(queue[0], i), "fill");
+
+    for(int i = 0; i < m; ++i) {
+        fill[i](queue[0], n, x(0));
+        check_sample(x, [i](size_t, int v) { BOOST_CHECK_EQUAL(v, i); });
+    }
+}
+
+BOOST_AUTO_TEST_CASE(precompile)
+{
+    const size_t n = 1024;
+    const int m = 4;
+
+    std::vector<vex::command_queue> queue(1, ctx.queue(0));
+    vex::vector<int> x(queue, n);
+
+    std::vector<std::string> sources;
+    for(int i = 0; i < m; ++i)
+        sources.push_back(fill_kernel(queue[0], 100 + i));
+
+    auto programs = vex::backend::jit::precompile(queue[0], sources);
+    BOOST_REQUIRE_EQUAL(programs.size(), sources.size());
+
+    // Requests for the same source share the ongoing compilation:
+    auto p = vex::backend::jit::build_sources_async(queue[0], sources[0]);
+
+    for(int i = 0; i < m; ++i) {
+        vex::backend::kernel fill(queue[0], programs[i].get(), "fill");
+
+        fill(queue[0], n, x(0));
+        check_sample(x, [i](size_t, int v) { BOOST_CHECK_EQUAL(v, 100 + i); });
+    }
+
+    BOOST_CHECK(p.get().location() == programs[0].get().location());
+}
+
+BOOST_AUTO_TEST_CASE(compilation_error)
+{
+    std::vector<vex::command_queue> queue(1, ctx.queue(0));
+
+    auto p = vex::backend::jit::build_sources_async(queue[0],
+            fill_kernel(queue[0], 0) + "\nthis is not a valid c++ code;\n");
+
+    BOOST_CHECK_THROW(p.get(), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(kernel_bundle)
+{
+    const size_t n = 1024;
+    const int m = 4;
+
+    std::vector<vex::command_queue> queue(1, ctx.queue(0));
+    vex::vector<int> x(queue, n);
+
+    std::ostringstream name;
+    name << "test-" << std::chrono::high_resolution_clock::now().time_since_epoch().count();
+
+    std::string bundle_dir;
+
+    {
+        vex::backend::jit::kernel_bundle bundle(queue[0], name.str());
+
+        // Explicitly declared kernels:
+        for(int i = 0; i < m; ++i)
+            bundle.add(fill_kernel(queue[0], 200 + i));
+
+        // A kernel recorded during the warm-up phase:
+        vex::backend::kernel warmup(queue[0], fill_kernel(queue[0], 200 + m), "fill");
+        warmup(queue[0], n, x(0));
+        check_sample(x, [](size_t, int v) { BOOST_CHECK_EQUAL(v, 200 + m); });
+
+        BOOST_CHECK_EQUAL(bundle.pending_size(), m + 1);
+
+        bundle.build();
+
+        BOOST_CHECK_EQUAL(bundle.pending_size(), 0);
+        BOOST_CHECK_EQUAL(bundle.size(), m + 1);
+
+        for(int i = 0; i <= m; ++i) {
+            auto p = vex::backend::jit::build_sources_async(queue[0], fill_kernel(queue[0], 200 + i));
+            BOOST_REQUIRE(p.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+
+            bundle_dir = p.get().location().parent_path().string();
+
+            vex::backend::kernel fill(queue[0], p.get(), "fill");
+            fill(queue[0], n, x(0));
+            check_sample(x, [i](size_t, int v) { BOOST_CHECK_EQUAL(v, 200 + i); });
+        }
+    }
+
+    // The bundle is reloaded from disk:
+    {
+        vex::backend::jit::kernel_bundle bundle(queue[0], name.str(), false);
+        BOOST_CHECK_EQUAL(bundle.size(), m + 1);
+
+        vex::backend::kernel fill(queue[0], fill_kernel(queue[0], 200), "fill");
+        fill(queue[0], n, x(0));
+        check_sample(x, [](size_t, int v) { BOOST_CHECK_EQUAL(v, 200); });
+    }
+
+    boost::filesystem::remove_all(bundle_dir);
+}
+
+BOOST_AUTO_TEST_CASE(async_queues)
+{
+    const size_t n = 1 << 20;
+
+    vex::backend::command_queue q1 = ctx.queue(0);
+    vex::backend::command_queue q2 = vex::backend::duplicate_queue(q1);
+
+    std::vector<vex::backend::command_queue> Q1(1, q1), Q2(1, q2);
+
+    vex::vector<int> x(Q1, n);
+    vex::vector<int> y(Q2, n);
+
+    x = 1;
+    y = 0;
+
+    // Make q2 wait for the assignment to x in q1:
+    vex::backend::wait_list w(1, vex::backend::enqueue_marker(q1));
+    vex::backend::enqueue_barrier(q2, w);
+
+    vex::enqueue(Q2, y) = x * 2;
+
+    std::vector<int> h(n);
+    vex::copy(y, h, /*blocking=*/false);
+
+    auto e = vex::backend::enqueue_marker(q2);
+    e.wait();
+
+    BOOST_CHECK(e.complete());
+    BOOST_CHECK(std::all_of(h.begin(), h.end(), [](int v) { return v == 2; }));
+}
+
+BOOST_AUTO_TEST_CASE(device_topology)
+{
+    using vex::backend::jit::detail::parse_cpulist;
+
+    std::vector<int> cpus = parse_cpulist("0-3,8,10-11\n");
+    std::vector<int> ref  = {0, 1, 2, 3, 8, 10, 11};
+
+    BOOST_CHECK(cpus == ref);
+
+    // Each JIT device has its own thread team:
+    for(unsigned d = 0; d < ctx.size(); ++d) {
+        BOOST_CHECK_EQUAL(vex::backend::get_device_id(ctx.queue(d)), d);
+        BOOST_CHECK(vex::backend::jit::detail::thread_team::get(d).size() >= 1);
+
+        // The queue caches the team of its device:
+        BOOST_CHECK_EQUAL(&vex::backend::jit::detail::get_team(ctx.queue(d)),
+                &vex::backend::jit::detail::thread_team::get(d));
+    }
+
+    const size_t n = 1 << 20;
+
+    vex::vector<double> x(ctx, n);
+    x = 1;
+
+    vex::Reductor<double, vex::SUM> sum(ctx);
+    BOOST_CHECK_EQUAL(sum(x), n);
+}
+
+BOOST_AUTO_TEST_CASE(aligned_first_touch)
+{
+    const size_t n = 1 << 20;
+
+    std::vector<vex::command_queue> queue(1, ctx.queue(0));
+
+    std::vector<double> h = random_vector<double>(n);
+
+    vex::backend::device_vector<double> small(queue[0], 3);
+    vex::backend::device_vector<double> large(queue[0], n, h.data());
+
+    BOOST_CHECK(reinterpret_cast<size_t>(small.raw()) % 64   == 0);
+    BOOST_CHECK(reinterpret_cast<size_t>(large.raw()) % 4096 == 0);
+
+    BOOST_CHECK(std::equal(h.begin(), h.end(), large.raw()));
+}
+
+BOOST_AUTO_TEST_CASE(vectorizable_loops)
+{
+    const size_t n = 1027;
+
+    std::vector<vex::command_queue> queue(1, ctx.queue(0));
+
+    vex::backend::source_generator src(queue[0]);
+
+    src.begin_kernel("axpy");
+    src.begin_kernel_parameters();
+    src.parameter<size_t>("n");
+    src.parameter<double>("a");
+    src.parameter<const double*>("x");
+    src.parameter<double*>("y");
+    src.end_kernel_parameters();
+    src.elementwise_loop("idx", "n").open("{");
+    src.new_line() << "y[idx] += a * x[idx];";
+    src.close("}");
+    src.end_kernel();
+
+    if (std::stoi(vex::getenv("VEXCL_JIT_SIMD", "1"))) {
+        BOOST_CHECK(src.str().find("KERNEL_PARAMETER(double, a)") != std::string::npos);
+        BOOST_CHECK(src.str().find("KERNEL_POINTER_PARAMETER(const double *, x)") != std::string::npos);
+        BOOST_CHECK(src.str().find("KERNEL_POINTER_PARAMETER(double *, y)") != std::string::npos);
+    }
+
+    vex::backend::kernel axpy(queue[0], src.str(), "axpy");
+
+    vex::vector<double> x(queue, n);
+    vex::vector<double> y(queue, n);
+
+    x = 1;
+    y = 2;
+
+    axpy(queue[0], n, 3.0, x(0), y(0));
+    check_sample(y, [](size_t, double v) { BOOST_CHECK_EQUAL(v, 5); });
+
+    // Terminals may alias each other at the same index:
+    y = y + y * x;
+    check_sample(y, [](size_t, double v) { BOOST_CHECK_EQUAL(v, 10); });
+}
+
+BOOST_AUTO_TEST_CASE(launch_graph)
+{
+    const size_t n = 1024;
+
+    std::vector<vex::command_queue> queue(1, ctx.queue(0));
+
+    vex::vector<double> x(queue, n);
+    vex::vector<double> y(queue, n);
+    vex::vector<double> z(queue, n);
+
+    vex::Reductor<double, vex::SUM> sum(queue);
+    vex::device_scalar<double> s;
+
+    x = 1;
+
+    vex::backend::jit::launch_graph graph;
+
+    graph.capture([&]() {
+            y = 2 * x;
+            s = sum.async(y);
+            z = y + s;
+            });
+
+    // Assignments, the reduction, and the final step of the reduction:
+    BOOST_CHECK_EQUAL(graph.size(), 4);
+    check_sample(z, [n](size_t, double v) { BOOST_CHECK_EQUAL(v, 2.0 + 2.0 * n); });
+
+    x = 3;
+    graph.replay();
+
+    BOOST_CHECK_EQUAL(s.get(), 6.0 * n);
+    check_sample(z, [n](size_t, double v) { BOOST_CHECK_EQUAL(v, 6.0 + 6.0 * n); });
+
+    // Rebind the input:
+    vex::vector<double> x2(queue, n);
+    x2 = 5;
+
+    BOOST_CHECK_EQUAL(graph.rebind(x(0), x2(0)), 1);
+    graph.replay();
+
+    check_sample(z, [n](size_t, double v) { BOOST_CHECK_EQUAL(v, 10.0 + 10.0 * n); });
+
+    graph.clear();
+    BOOST_CHECK_EQUAL(graph.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(kernel_registry)
+{
+    const size_t n = 1024;
+
+    std::vector<vex::command_queue> queue(1, ctx.queue(0));
+    vex::vector<int>    x(queue, n);
+    vex::vector<double> y(queue, n);
+
+    vex::kernel_registry::profiling(true);
+
+    auto find = [](const std::string &subsystem, const std::string &name) {
+        std::vector<vex::kernel_record> records = vex::kernel_registry::list();
+        return std::find_if(records.begin(), records.end(),
+                [&](const vex::kernel_record &r) {
+                    return r.subsystem == subsystem && r.name == name && r.launches;
+                }) != records.end();
+    };
+
+    // The kernels built outside of the kernel caches have no subsystem.
+    // The source is unique, so it is actually compiled:
+    {
+        vex::backend::kernel fill(queue[0], fill_kernel(queue[0], 300), "fill");
+
+        auto stats = fill.statistics();
+        BOOST_REQUIRE(stats);
+
+        for(int i = 0; i < 3; ++i) fill(queue[0], n, x(0));
+        queue[0].finish();
+
+        BOOST_CHECK_EQUAL(stats->builds.load(),   1);
+        BOOST_CHECK_EQUAL(stats->compiles.load(), 1);
+        BOOST_CHECK_EQUAL(stats->launches.load(), 3);
+        BOOST_CHECK(stats->compile_ns > 0);
+        BOOST_CHECK(stats->run_ns > 0);
+
+        BOOST_CHECK(find("", "fill"));
+    }
+
+    // The kernels from the kernel caches are entered with the subsystem:
+    y = 2 * y + 1;
+
+    vex::Reductor<double, vex::SUM> sum(queue);
+    sum(y);
+
+    queue[0].finish();
+
+    BOOST_CHECK(find("vector",   "vexcl_vector_kernel"));
+    BOOST_CHECK(find("reductor", "vexcl_reductor_kernel"));
+
+    std::string json = vex::kernel_registry::json();
+    BOOST_CHECK(json.find("\"subsystem\": \"reductor\"") != std::string::npos);
+    BOOST_CHECK(json.find("\"compile_time\": ") != std::string::npos);
+
+    vex::kernel_registry::profiling(false);
+}
+
+BOOST_AUTO_TEST_CASE(kernel_traffic)
+{
+    const size_t n = 1024;
+
+    std::vector<vex::command_queue> queue(1, ctx.queue(0));
+    vex::vector<double> x(queue, n);
+    vex::vector<double> y(queue, n);
+    vex::vector<float>  z(queue, n);
+
+    x = 1;
+    y = 2;
+
+    vex::kernel_registry::profiling(true);
+
+    // x is read once, and there are three arithmetic operations:
+    z = 2 * x + y * x;
+
+    vex::Reductor<double, vex::SUM> sum(queue);
+    sum(x * y);
+
+    queue[0].finish();
+
+    auto find = [](const std::string &subsystem,
+            size_t bytes_read, size_t bytes_written, size_t flops)
+    {
+        std::vector<vex::kernel_record> records = vex::kernel_registry::list();
+        return std::find_if(records.begin(), records.end(),
+                [&](const vex::kernel_record &r) {
+                    return r.subsystem == subsystem && r.has_traffic &&
+                        r.bytes_read == bytes_read &&
+                        r.bytes_written == bytes_written &&
+                        r.flops == flops &&
+                        r.elements >= n && r.bandwidth() > 0;
+                }) != records.end();
+    };
+
+    BOOST_CHECK(find("vector",   16, 4, 3));
+    BOOST_CHECK(find("reductor", 16, 0, 2));
+
+    std::ostringstream report;
+    vex::kernel_registry::report(report);
+    BOOST_CHECK(report.str().find("GB/s") != std::string::npos);
+    BOOST_CHECK(report.str().find("vexcl_vector_kernel") != std::string::npos);
+
+    vex::kernel_registry::profiling(false);
+}
+
+BOOST_AUTO_TEST_CASE(fused_kernel_traffic)
+{
+    const size_t n = 1024;
+
+    std::vector<vex::command_queue> queue(1, ctx.queue(0));
+    vex::vector<double> x(queue, n);
+    vex::vector<double> y(queue, n);
+    vex::vector<double> z(queue, n);
+    vex::vector<float>  w(queue, n);
+    vex::vector<int>    p(queue, n);
+
+    x = 1;
+    y = 2;
+    p = n - 1 - vex::element_index();
+
+    vex::kernel_registry::profiling(true);
+
+    {
+        vex::deferred_scope deferred;
+
+        z = x + y;
+        w = z * 2;
+    }
+
+    vex::reduce_all(
+            vex::reduction<double>(x * y),
+            vex::reduction<double, vex::MAX>(fabs(x)));
+
+    vex::assign_and_reduce<vex::assign::SUB>(x, 2 * y, vex::reduction<double>(x * x));
+
+    // The permutation reads the gathered vector and the indices:
+    w = 2 * vex::permutation(p)(x);
+
+    queue[0].finish();
+
+    auto find = [](const std::string &subsystem,
+            size_t bytes_read, size_t bytes_written, size_t flops)
+    {
+        std::vector<vex::kernel_record> records = vex::kernel_registry::list();
+        return std::find_if(records.begin(), records.end(),
+                [&](const vex::kernel_record &r) {
+                    return r.subsystem == subsystem && r.has_traffic &&
+                        r.bytes_read == bytes_read &&
+                        r.bytes_written == bytes_written &&
+                        r.flops == flops;
+                }) != records.end();
+    };
+
+    BOOST_CHECK(find("deferred",    24, 12, 2));
+    BOOST_CHECK(find("reductor",    16,  0, 4));
+    BOOST_CHECK(find("reductor",    16,  8, 4));
+    BOOST_CHECK(find("vector",      12,  4, 1));
+
+    vex::kernel_registry::profiling(false);
+}
+
+BOOST_AUTO_TEST_CASE(program_cache)
+{
+    const size_t n = 1024;
+
+    std::vector<vex::command_queue> queue(1, ctx.queue(0));
+    vex::vector<int> x(queue, n);
+
+    std::string src = fill_kernel(queue[0], 400);
+
+    vex::backend::kernel k1(queue[0], src, "fill");
+    k1(queue[0], n, x(0));
+    check_sample(x, [](size_t, int v) { BOOST_CHECK_EQUAL(v, 400); });
+
+    // Remove the library from the offline cache; identical sources are
+    // still served by the program loaded in this process:
+    boost::filesystem::remove_all(vex::program_binaries_path(
+                vex::backend::jit::detail::program_hash(queue[0], src, "")));
+
+    auto p = vex::backend::jit::build_sources_async(queue[0], src);
+    BOOST_CHECK(p.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+
+    vex::backend::kernel k2(queue[0], src, "fill");
+    BOOST_CHECK(k1.statistics() == k2.statistics());
+    BOOST_CHECK_EQUAL(k2.statistics()->compiles.load(), 1);
+
+    x = 0;
+    k2(queue[0], n, x(0));
+    check_sample(x, [](size_t, int v) { BOOST_CHECK_EQUAL(v, 400); });
+
+    // The programs of the context are released by vex::purge_caches(), so
+    // the source is compiled again. The existing kernels still work:
+    vex::purge_caches(queue[0]);
+
+    vex::backend::kernel k3(queue[0], src, "fill");
+
+    x = 0;
+    k3(queue[0], n, x(0));
+    check_sample(x, [](size_t, int v) { BOOST_CHECK_EQUAL(v, 400); });
+    BOOST_CHECK_EQUAL(k3.statistics()->compiles.load(), 2);
+
+    x = 0;
+    k1(queue[0], n, x(0));
+    check_sample(x, [](size_t, int v) { BOOST_CHECK_EQUAL(v, 400); });
+}
+
+BOOST_AUTO_TEST_SUITE_END()
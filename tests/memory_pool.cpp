@@ -0,0 +1,81 @@
+#define BOOST_TEST_MODULE MemoryPool
+#include <boost/test/unit_test.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/reductor.hpp>
+#include <vexcl/element_index.hpp>
+#include <vexcl/memory_pool.hpp>
+#include "context_setup.hpp"
+
+BOOST_AUTO_TEST_CASE(reuse_released_memory)
+{
+    const size_t n = 1024;
+
+    vex::memory_pool::enable(ctx);
+    vex::memory_pool::trim();
+
+    vex::memory_pool_stats s0 = vex::memory_pool::stats();
+
+    for(int i = 0; i < 8; ++i) {
+        vex::vector<double> x(ctx, n);
+        x = i;
+        check_sample(x, [i](size_t, double v) { BOOST_CHECK_EQUAL(v, i); });
+    }
+
+    vex::memory_pool_stats s1 = vex::memory_pool::stats();
+
+    // Only the first iteration needs to allocate memory:
+    BOOST_CHECK_EQUAL(s1.misses - s0.misses, ctx.size());
+    BOOST_CHECK_EQUAL(s1.hits   - s0.hits,   7 * ctx.size());
+    BOOST_CHECK_EQUAL(s1.in_use, s0.in_use);
+    BOOST_CHECK(s1.cached > 0);
+
+    BOOST_CHECK_EQUAL(vex::memory_pool::trim(ctx), s1.cached);
+    BOOST_CHECK_EQUAL(vex::memory_pool::stats().cached, 0);
+
+    vex::memory_pool::enable(false);
+}
+
+BOOST_AUTO_TEST_CASE(pooled_vector_size)
+{
+    vex::memory_pool::enable(ctx);
+
+    // The blocks are rounded up to a size class; vectors keep their size.
+    for(size_t n = 1000; n < 1010; ++n) {
+        vex::vector<int> x(ctx, n);
+        BOOST_CHECK_EQUAL(x.size(), n);
+
+        x = vex::element_index();
+
+        vex::Reductor<int, vex::SUM> sum(ctx);
+        BOOST_CHECK_EQUAL(sum(x), static_cast<int>(n * (n - 1) / 2));
+    }
+
+    // The buffers of reinterpreted vectors stay leased:
+    std::vector<cl_int2> h(512);
+    {
+        vex::vector<cl_int2> x(ctx, h.size());
+        vex::vector<int> y(ctx, x.reinterpret<int>().size());
+
+        {
+            vex::vector<cl_int2> z(ctx, h.size());
+            y = 42;
+            z.reinterpret<int>() = y;
+            x = z;
+        }
+
+        vex::vector<cl_int2> w(ctx, h.size());
+        w.reinterpret<int>() = 0;
+
+        vex::copy(x, h);
+    }
+
+    for(auto v : h) {
+        BOOST_CHECK_EQUAL(v.s[0], 42);
+        BOOST_CHECK_EQUAL(v.s[1], 42);
+    }
+
+    vex::memory_pool::enable(false);
+    vex::memory_pool::trim();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
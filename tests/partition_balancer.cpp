@@ -0,0 +1,129 @@
+#define BOOST_TEST_MODULE PartitionBalancer
+#include <boost/test/unit_test.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/multivector.hpp>
+#include <vexcl/spmat.hpp>
+#include <vexcl/partition_balancer.hpp>
+#include "context_setup.hpp"
+#include "random_matrix.hpp"
+
+BOOST_AUTO_TEST_CASE(repartition_vector)
+{
+    const size_t n = 1024;
+
+    std::vector<double> x = random_vector<double>(n);
+
+    vex::vector<double> X(ctx, x);
+    vex::multivector<double, 2> M(ctx, n);
+
+    M(0) = X;
+    M(1) = 2 * X;
+
+    // Load the first device three times more than the others:
+    std::vector<double> w(ctx.size(), 1.0);
+    w[0] = 3;
+
+    std::vector<size_t> part = vex::detail::weighted_partition(n, w);
+
+    X.repartition(part);
+    M.repartition(part);
+
+    BOOST_CHECK(X.partition() == part);
+    BOOST_CHECK(M.partition() == part);
+
+    check_sample(X, [&](size_t idx, double a) { BOOST_CHECK_EQUAL(a, x[idx]); });
+    check_sample(M(1), [&](size_t idx, double a) { BOOST_CHECK_EQUAL(a, 2 * x[idx]); });
+
+    // Expressions work with the repartitioned containers:
+    vex::vector<double> Y(ctx.queue(), n);
+    Y.repartition(part);
+    Y = X + M(1);
+
+    check_sample(Y, [&](size_t idx, double a) { BOOST_CHECK_CLOSE(a, 3 * x[idx], 1e-8); });
+}
+
+BOOST_AUTO_TEST_CASE(balance_weights)
+{
+    const size_t n = 1024;
+
+    std::vector<double> x = random_vector<double>(n);
+
+    vex::vector<double> X(ctx, x);
+    vex::vector<double> Y(ctx, n);
+
+    vex::partition_balancer balance(ctx, /*relaxation=*/1);
+
+    // The first device took twice as long as the others for the same work:
+    std::vector<size_t> part = vex::detail::weighted_partition(n,
+            std::vector<double>(ctx.size(), 1.0));
+
+    std::vector<double> t(ctx.size(), 1.0);
+    t[0] = 2;
+
+    balance.record(part, t);
+
+    if (ctx.size() > 1) {
+        BOOST_CHECK(!balance.balanced());
+        BOOST_CHECK_CLOSE(balance.imbalance(), 0.5, 1e-8);
+        BOOST_CHECK_CLOSE(
+                balance.weights()[0] / balance.weights()[1],
+                0.5 * (part[1] - part[0]) / (part[2] - part[1]), 1e-8);
+    }
+
+    BOOST_CHECK_EQUAL(balance.rebalance(X, Y), ctx.size() > 1);
+    BOOST_CHECK(X.partition() == balance.partition(n));
+    BOOST_CHECK(Y.partition() == balance.partition(n));
+
+    check_sample(X, [&](size_t idx, double a) { BOOST_CHECK_EQUAL(a, x[idx]); });
+
+    // The measurement is reset after the migration:
+    BOOST_CHECK(balance.balanced());
+    BOOST_CHECK(!balance.rebalance(X, Y));
+
+    // Measure the actual work:
+    for(int iter = 0; iter < 3; ++iter) {
+        balance.start();
+        Y = 2 * X + Y / 2;
+        balance.stop(X.partition());
+        balance.rebalance(X, Y);
+    }
+
+    check_sample(X, [&](size_t idx, double a) { BOOST_CHECK_EQUAL(a, x[idx]); });
+}
+
+BOOST_AUTO_TEST_CASE(balanced_spmat)
+{
+    const size_t n = 1024;
+
+    std::vector<size_t> row;
+    std::vector<size_t> col;
+    std::vector<double> val;
+
+    random_matrix(n, n, 16, row, col, val);
+
+    std::vector<double> x = random_vector<double>(n);
+
+    std::vector<double> w(ctx.size(), 1.0);
+    w[0] = 3;
+
+    std::vector<size_t> part = vex::detail::weighted_partition(n, w);
+
+    vex::SpMat <double> A(ctx, n, n, row.data(), col.data(), val.data(), part, part);
+    vex::vector<double> X(ctx, x);
+    vex::vector<double> Y(ctx, n);
+
+    X.repartition(part);
+    Y.repartition(part);
+
+    Y = A * X;
+
+    check_sample(Y, [&](size_t idx, double a) {
+            double sum = 0;
+            for(size_t j = row[idx]; j < row[idx + 1]; j++)
+                sum += val[j] * x[col[j]];
+
+            BOOST_CHECK_CLOSE(a, sum, 1e-8);
+            });
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,5 +1,6 @@
 #define BOOST_TEST_MODULE Sort
 #include <algorithm>
+#include <random>
 #include <boost/iterator/counting_iterator.hpp>
 #include <boost/test/unit_test.hpp>
 #include <vexcl/vector.hpp>
@@ -170,4 +171,93 @@ BOOST_AUTO_TEST_CASE(sort_keys_vals_tuple)
             });
 }
 
+// Keys spanning the whole range of the type (including negative numbers).
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value, std::vector<T>>::type
+full_range_keys(size_t n, T lo = std::numeric_limits<T>::min(), T hi = std::numeric_limits<T>::max()) {
+    std::mt19937 rng(static_cast<unsigned>(std::rand()));
+    std::uniform_int_distribution<long long> rnd(lo, hi);
+
+    std::vector<T> k(n);
+    for(auto &v : k) v = static_cast<T>(rnd(rng));
+    return k;
+}
+
+template <typename T>
+typename std::enable_if<std::is_floating_point<T>::value, std::vector<T>>::type
+full_range_keys(size_t n) {
+    std::mt19937 rng(static_cast<unsigned>(std::rand()));
+    std::uniform_real_distribution<T> rnd(-1e6, 1e6);
+
+    std::vector<T> k(n);
+    for(auto &v : k) v = rnd(rng);
+    return k;
+}
+
+template <typename T, class Comp>
+void check_sort(const std::vector<T> &k, Comp comp) {
+    vex::vector<T> keys(vex::current_context(), k);
+    vex::sort(keys, comp);
+
+    std::vector<T> r(k.size());
+    vex::copy(keys, r);
+
+    std::vector<T> s(k);
+    std::stable_sort(s.begin(), s.end(), comp);
+
+    BOOST_CHECK(r == s);
+}
+
+template <typename T>
+void check_sort(const std::vector<T> &k) {
+    check_sort(k, vex::less<T>());
+    check_sort(k, vex::greater<T>());
+}
+
+BOOST_AUTO_TEST_CASE(sort_keys_radix)
+{
+    // The radix sort is used for the standard comparison functors on CPUs.
+    const size_t n = 100003;
+
+    check_sort(full_range_keys<cl_char> (n));
+    check_sort(full_range_keys<cl_uchar>(n));
+    check_sort(full_range_keys<cl_short>(n));
+    check_sort(full_range_keys<cl_int>  (n));
+    check_sort(full_range_keys<cl_uint> (n));
+    check_sort(full_range_keys<cl_long> (n));
+    check_sort(full_range_keys<float>   (n));
+    check_sort(full_range_keys<double>  (n));
+
+    // Sorting is consistent for the ranges not spanning several chunks:
+    check_sort(full_range_keys<cl_int>(100));
+}
+
+BOOST_AUTO_TEST_CASE(sort_keys_vals_radix_stable)
+{
+    const size_t n = 100003;
+
+    // Lots of equal keys:
+    std::vector<cl_short> k = full_range_keys<cl_short>(n, -100, 100);
+    std::vector<int>      v(n);
+    for(size_t i = 0; i < n; ++i) v[i] = static_cast<int>(i);
+
+    vex::vector<cl_short> keys(ctx, k);
+    vex::vector<int>      vals(ctx, v);
+
+    vex::sort_by_key(keys, vals, vex::greater<cl_short>());
+
+    std::vector<int> p(v);
+    std::stable_sort(p.begin(), p.end(), [&](int i, int j) { return k[i] > k[j]; });
+
+    std::vector<cl_short> kr(n);
+    std::vector<int>      vr(n);
+    vex::copy(keys, kr);
+    vex::copy(vals, vr);
+
+    for(size_t i = 0; i < n; ++i) {
+        BOOST_CHECK_EQUAL(kr[i], k[p[i]]);
+        BOOST_CHECK_EQUAL(vr[i], p[i]);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
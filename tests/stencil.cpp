@@ -181,6 +181,45 @@ BOOST_AUTO_TEST_CASE(big_stencil)
     });
 }
 
+BOOST_AUTO_TEST_CASE(overlapped_halo_exchange)
+{
+    // The interior of the partitions is computed before the halos arrive,
+    // so check every element (the boundary ones are the interesting).
+    const size_t n = 256;
+
+    std::vector<double> s = random_vector<double>(rand() % 64 + 1);
+    int center = rand() % s.size();
+
+    vex::stencil<double> S(ctx, s, center);
+
+    std::vector<double> x = random_vector<double>(n);
+
+    vex::vector<double> X(ctx, x);
+    vex::vector<double> Y(ctx, n);
+
+    index idx(n);
+
+    for(int iter = 0; iter < 3; ++iter) {
+        // The halos should be read after X is updated:
+        X = 2 * X;
+        for(size_t i = 0; i < n; ++i) x[i] *= 2;
+
+        Y = X * S;
+
+        std::vector<double> y(n);
+        vex::copy(Y, y);
+
+        for(size_t i = 0; i < n; ++i) {
+            double sum = 0;
+            size_t j = 0;
+            int k = -center;
+            for(; j < s.size(); k++, j++)
+                sum += s[j] * x[idx(i, k)];
+            BOOST_CHECK_CLOSE(y[i], sum, 1e-8);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(user_defined_stencil)
 {
     const size_t n = 1024;
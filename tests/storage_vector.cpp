@@ -0,0 +1,97 @@
+#define BOOST_TEST_MODULE StorageVector
+#include <cmath>
+#include <boost/test/unit_test.hpp>
+#include <vexcl/vector.hpp>
+#include <vexcl/storage_vector.hpp>
+#include <vexcl/element_index.hpp>
+#include <vexcl/function.hpp>
+#include <vexcl/reductor.hpp>
+#include "context_setup.hpp"
+
+BOOST_AUTO_TEST_CASE(narrow_storage)
+{
+    const size_t n = 1024;
+
+    std::vector<double> x = random_vector<double>(n);
+
+    vex::storage_vector<double, vex::storage::narrow<float>> X(ctx, x);
+    vex::vector<double> Y(ctx, n);
+
+    BOOST_CHECK_EQUAL(X.stored().size(), n);
+
+    Y = 2 * X;
+    check_sample(Y, [&](size_t idx, double a) {
+            BOOST_CHECK_EQUAL(a, 2.0 * static_cast<float>(x[idx]));
+            });
+
+    X = vex::element_index();
+    X += 0.5;
+    X *= Y - Y + 2;
+
+    std::vector<double> h(n);
+    vex::copy(X, h);
+
+    for(size_t i = 0; i < n; ++i)
+        BOOST_CHECK_EQUAL(h[i], 2 * (i + 0.5));
+
+    vex::Reductor<double, vex::SUM> sum(ctx);
+    BOOST_CHECK_CLOSE(sum(X), 1.0 * n * n, 1e-8);
+}
+
+BOOST_AUTO_TEST_CASE(bfloat16_storage)
+{
+    const size_t n = 1024;
+
+    std::vector<float> x = random_vector<float>(n);
+
+    typedef vex::storage_vector<float, vex::storage::bfloat16> bf16_vector;
+
+    BOOST_CHECK_EQUAL(sizeof(bf16_vector::storage_type), 2);
+
+    bf16_vector X(ctx, x);
+    bf16_vector Y(ctx, n);
+
+    Y = X * X;
+
+    std::vector<float> h(n);
+    vex::copy(Y, h);
+
+    // bfloat16 has 8 significant bits, and both the input and the result
+    // are rounded.
+    for(size_t i = 0; i < n; ++i)
+        BOOST_CHECK_SMALL(h[i] - x[i] * x[i], 2e-2f * x[i] * x[i] + 1e-6f);
+
+    // The host and the device conversions agree:
+    vex::vector<float> Z(ctx, n);
+    Z = Y;
+
+    std::vector<float> z(n);
+    vex::copy(Z, z);
+
+    for(size_t i = 0; i < n; ++i)
+        BOOST_CHECK_EQUAL(z[i], h[i]);
+}
+
+BOOST_AUTO_TEST_CASE(scaled_storage)
+{
+    const size_t n = 1024;
+
+    vex::storage::scaled<cl_short> fmt(1e-3);
+    vex::storage_vector<double, vex::storage::scaled<cl_short>> X(ctx, n, fmt);
+
+    X = sin(vex::element_index());
+
+    std::vector<double> h(n);
+    vex::copy(X, h);
+
+    for(size_t i = 0; i < n; ++i)
+        BOOST_CHECK_SMALL(h[i] - std::sin(static_cast<double>(i)), 5e-4);
+
+    vex::vector<cl_short> S(ctx, n);
+    S = X.stored();
+    check_sample(S, [](size_t idx, cl_short v) {
+            BOOST_CHECK_EQUAL(v, static_cast<cl_short>(std::rint(std::sin(static_cast<double>(idx)) / 1e-3)));
+            });
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,9 +1,12 @@
 #define BOOST_TEST_MODULE Sort
+#include <atomic>
 #include <boost/thread.hpp>
 #include <boost/test/unit_test.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
 #include <vexcl/vector.hpp>
 #include <vexcl/reductor.hpp>
+#include <vexcl/scan.hpp>
+#include <vexcl/cache.hpp>
 #include "context_setup.hpp"
 
 BOOST_AUTO_TEST_CASE(threads)
@@ -34,4 +37,145 @@ BOOST_AUTO_TEST_CASE(threads)
     BOOST_CHECK_EQUAL(sum, n * ctx.size());
 }
 
+BOOST_AUTO_TEST_CASE(shared_kernels)
+{
+    // The threads evaluate the same expressions on the same context, so
+    // they launch the same cached kernels concurrently.
+    const int nt = 8;
+    const int iters = 32;
+
+    auto run = [&](int t, int *errors) {
+        for(int i = 0; i < iters; ++i) {
+            const size_t n = 1000 + 37 * t + i;
+
+            vex::vector<int> x(ctx, n);
+            vex::vector<int> y(ctx, n);
+
+            x = t;
+            y = 2 * x + i;
+
+            vex::Reductor<int, vex::SUM> sum(ctx);
+            if (sum(y) != static_cast<int>(n) * (2 * t + i)) ++(*errors);
+
+            vex::inclusive_scan(y, x);
+
+            int last = x[n - 1];
+            if (last != static_cast<int>(n) * (2 * t + i)) ++(*errors);
+        }
+    };
+
+    boost::ptr_vector< boost::thread > threads;
+    std::vector<int> errors(nt, 0);
+
+    for(int t = 0; t < nt; ++t)
+        threads.push_back( new boost::thread(run, t, &errors[t]) );
+
+    for(int t = 0; t < nt; ++t) {
+        threads[t].join();
+        BOOST_CHECK_EQUAL(errors[t], 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(interleaved_arguments)
+{
+    const cl_ulong n = 1024;
+
+    std::vector<vex::command_queue> queue(1, ctx.queue(0));
+
+    vex::backend::source_generator src(queue[0]);
+
+    src.begin_kernel("fill");
+    src.begin_kernel_parameters();
+    src.parameter<size_t>("n");
+    src.parameter<int>("v");
+    src.parameter<int*>("x");
+    src.end_kernel_parameters();
+    src.grid_stride_loop("idx", "n").open("{");
+    src.new_line() << "x[idx] = v;";
+    src.close("}");
+    src.end_kernel();
+
+    vex::backend::kernel fill(queue[0], src.str(), "fill");
+
+    vex::vector<int> x(queue, n);
+    vex::vector<int> y(queue, n);
+
+    // Another thread launches the kernel while this thread is half way
+    // through setting the arguments:
+    fill.push_arg(n);
+    fill.push_arg(1);
+
+    boost::thread t([&]() {
+            fill.push_arg(n);
+            fill.push_arg(2);
+            fill.push_arg(y(0));
+            fill(queue[0]);
+            });
+    t.join();
+
+    fill.push_arg(x(0));
+    fill(queue[0]);
+
+    check_sample(x, [](size_t, int v) { BOOST_CHECK_EQUAL(v, 1); });
+    check_sample(y, [](size_t, int v) { BOOST_CHECK_EQUAL(v, 2); });
+}
+
+
+BOOST_AUTO_TEST_CASE(concurrent_cache)
+{
+    typedef vex::detail::object_cache<vex::detail::index_by_queue, int> cache_type;
+
+    const int nq = 8;
+    const int nt = 4;
+
+    cache_type cache;
+
+    std::vector<vex::backend::command_queue> q;
+    for(int i = 0; i < nq; ++i)
+        q.push_back(vex::backend::duplicate_queue(ctx.queue(0)));
+
+    cache.insert(q[0], 42);
+
+    // The readers look up the entry that is never removed, while the
+    // entries of the other queues come and go.
+    std::atomic<bool> done(false);
+
+    auto read = [&](int *errors) {
+        while(!done) {
+            auto i = cache.find(q[0]);
+            if (i == cache.end() || i->second != 42) ++(*errors);
+        }
+    };
+
+    boost::ptr_vector< boost::thread > threads;
+    std::vector<int> errors(nt, 0);
+
+    for(int t = 0; t < nt; ++t)
+        threads.push_back( new boost::thread(read, &errors[t]) );
+
+    int missing = 0;
+    for(int k = 0; k < 100; ++k) {
+        for(int i = 1; i < nq; ++i) cache.insert(q[i], i);
+
+        for(int i = 1; i < nq; ++i) {
+            auto e = cache.find(q[i]);
+            if (e == cache.end() || e->second != i) ++missing;
+            cache.erase(q[i]);
+            if (cache.find(q[i]) != cache.end()) ++missing;
+        }
+    }
+
+    done = true;
+
+    for(int t = 0; t < nt; ++t) {
+        threads[t].join();
+        BOOST_CHECK_EQUAL(errors[t], 0);
+    }
+
+    BOOST_CHECK_EQUAL(missing, 0);
+
+    cache.clear();
+    BOOST_CHECK(cache.find(q[0]) == cache.end());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
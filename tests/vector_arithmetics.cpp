@@ -312,4 +312,167 @@ BOOST_AUTO_TEST_CASE(expression_size_check)
 }
 #endif
 
+BOOST_AUTO_TEST_CASE(common_subexpressions)
+{
+    const size_t n = 1024;
+
+    vex::vector<double> x(ctx, random_vector<double>(n));
+    vex::vector<double> y(ctx, random_vector<double>(n));
+    vex::vector<double> u(ctx, random_vector<double>(n));
+    vex::vector<double> z(ctx, n);
+
+    vex::Reductor<double, vex::SUM> sum(ctx);
+
+    // The same expression type with different patterns of repeated terminals
+    // generates different kernels:
+    z = sqrt(x * x + y * y) + sqrt(x * x + y * y);
+    check_sample(x, y, z, [](size_t, double a, double b, double c) {
+            BOOST_CHECK_CLOSE(c, 2 * sqrt(a * a + b * b), 1e-8);
+            });
+
+    z = sqrt(x * x + y * y) + sqrt(u * u + y * y);
+    check_sample(x, u, z, [&](size_t i, double a, double b, double c) {
+            double d = y[i];
+            BOOST_CHECK_CLOSE(c, sqrt(a * a + d * d) + sqrt(b * b + d * d), 1e-8);
+            });
+
+    z = sqrt(x * x + y * y) + sqrt(x * x + u * u);
+    check_sample(x, u, z, [&](size_t i, double a, double b, double c) {
+            double d = y[i];
+            BOOST_CHECK_CLOSE(c, sqrt(a * a + d * d) + sqrt(a * a + b * b), 1e-8);
+            });
+
+    // Scalars are never merged, so their values do not affect the plan:
+    BOOST_CHECK(vex::detail::cse_plan(z, 2 * x + 2 * y).empty());
+    BOOST_CHECK(vex::detail::cse_plan(z, 0.0 * x + (-0.0) * y).empty());
+
+    z = 2 * x + 2 * y;
+    check_sample(x, y, z, [](size_t, double a, double b, double c) {
+            BOOST_CHECK_CLOSE(c, 2 * a + 2 * b, 1e-8);
+            });
+
+    z = 2 * x + 3 * y;
+    check_sample(x, y, z, [](size_t, double a, double b, double c) {
+            BOOST_CHECK_CLOSE(c, 2 * a + 3 * b, 1e-8);
+            });
+
+    // The left hand side may be repeated in the expression:
+    z = x;
+    z = z * z - sin(z * z);
+    check_sample(x, z, [](size_t, double a, double b) {
+            BOOST_CHECK_CLOSE(b, a * a - sin(a * a), 1e-8);
+            });
+
+    // Reductions:
+    double s = sum(fabs(x - y) * fabs(x - y));
+    BOOST_CHECK_CLOSE(s, sum((x - y) * (x - y)), 1e-8);
+}
+
+// Source of the assignment with common subexpression elimination.
+template <class LHS, class RHS>
+std::string cse_source(const vex::command_queue &q, const LHS &z, const RHS &expr)
+{
+    std::vector<vex::command_queue> queue(1, q);
+
+    vex::detail::cse_plan cse(z, expr);
+
+    vex::backend::source_generator src(queue[0]);
+    src.begin_kernel("cse");
+    src.begin_kernel_parameters();
+    vex::detail::declare_expression_parameter declare(src, queue[0], "prm", cse.state("prm"));
+    vex::detail::extract_terminals()(boost::proto::as_child(z), declare);
+    vex::detail::extract_terminals()(boost::proto::as_child(expr), declare);
+    src.end_kernel_parameters();
+
+    vex::detail::output_local_preamble loc_init(src, queue[0], "prm", cse.state("prm"));
+    boost::proto::eval(boost::proto::as_child(z), loc_init);
+    boost::proto::eval(boost::proto::as_child(expr), loc_init);
+
+    vex::detail::vector_expr_context expr_ctx(src, queue[0], "prm", cse.state("prm"));
+    src.new_line();
+    boost::proto::eval(boost::proto::as_child(z), expr_ctx);
+    src << " = ";
+    boost::proto::eval(boost::proto::as_child(expr), expr_ctx);
+    src << ";";
+    src.end_kernel();
+
+    return src.str();
+}
+
+BOOST_AUTO_TEST_CASE(common_subexpressions_source)
+{
+    const size_t n = 16;
+
+    std::vector<vex::command_queue> queue(1, ctx.queue(0));
+
+    vex::vector<double> x(queue, n);
+    vex::vector<double> y(queue, n);
+    vex::vector<double> z(queue, n);
+
+    auto expr = sqrt(x * x + y * y) + sqrt(x * x + y * y) + y;
+
+    BOOST_CHECK(!vex::detail::cse_plan(z, expr).empty());
+
+    std::string s = cse_source(queue[0], z, expr);
+
+    // x and y are passed once (as the first occurrences, prm_2 and prm_4):
+    BOOST_CHECK(s.find("prm_2") != std::string::npos);
+    BOOST_CHECK(s.find("prm_3") == std::string::npos);
+    BOOST_CHECK(s.find("prm_4") != std::string::npos);
+    BOOST_CHECK(s.find("prm_5") == std::string::npos);
+
+    // sqrt(x * x + y * y) is computed once:
+    size_t nsqrt = 0;
+    for(size_t p = s.find("sqrt("); p != std::string::npos; p = s.find("sqrt(", p + 1))
+        ++nsqrt;
+    BOOST_CHECK_EQUAL(nsqrt, 1);
+
+    // The layout is shared by the expressions of the same type, but the
+    // terminals are compared for each one:
+    BOOST_CHECK( vex::detail::cse_plan(z, x * y).empty());
+    BOOST_CHECK(!vex::detail::cse_plan(z, x * x).empty());
+    BOOST_CHECK( vex::detail::cse_plan(z, y * x).empty());
+
+    z = x * y;
+    x = 2;
+    y = 3;
+    z = x * x;
+    check_sample(z, [](size_t, double v) { BOOST_CHECK_EQUAL(v, 4.0); });
+    z = y * x;
+    check_sample(z, [](size_t, double v) { BOOST_CHECK_EQUAL(v, 6.0); });
+}
+
+BOOST_AUTO_TEST_CASE(common_subexpressions_guarded)
+{
+    const size_t n = 1024;
+
+    vex::vector<int> x(ctx, n);
+    vex::vector<int> y(ctx, n);
+    vex::vector<int> z(ctx, n);
+
+    x = vex::element_index();
+    y = vex::element_index() % 3;
+
+    // The subexpressions in the conditional operands are not hoisted:
+    BOOST_CHECK(cse_source(ctx.queue(0), z,
+                if_else(y != 0, x / y + x / y, 0)).find("_cse_") == std::string::npos);
+    BOOST_CHECK(cse_source(ctx.queue(0), z,
+                (y != 0) && (x / y + x / y > 2)).find("_cse_") == std::string::npos);
+
+    // Unless they are also computed unconditionally:
+    BOOST_CHECK(cse_source(ctx.queue(0), z,
+                x * y + if_else(y != 0, x * y, 0)).find("_cse_") != std::string::npos);
+
+    // The repeated divisions are only evaluated where y is nonzero:
+    z = if_else(y != 0, x / y + x / y, 0);
+    check_sample(x, y, z, [](size_t, int a, int b, int c) {
+            BOOST_CHECK_EQUAL(c, b ? 2 * (a / b) : 0);
+            });
+
+    z = (y != 0) && (x / y + x / y > 2);
+    check_sample(x, y, z, [](size_t, int a, int b, int c) {
+            BOOST_CHECK_EQUAL(c, b && 2 * (a / b) > 2);
+            });
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -98,6 +98,45 @@ BOOST_AUTO_TEST_CASE(gather)
         BOOST_CHECK(data[p] == x[i[p]]);
 }
 
+BOOST_AUTO_TEST_CASE(copy_between_devices)
+{
+    const size_t N = 1024;
+    const unsigned n = static_cast<unsigned>(ctx.size());
+
+    std::vector<double> x = random_vector<double>(N);
+    vex::vector<double> X(ctx, x);
+    vex::vector<double> Y(ctx, N);
+
+    Y = 0;
+
+    // Copy the first half of each partition of X to the second half of the
+    // next partition of Y. The copies should follow the assignment above.
+    std::vector<size_t> m(n);
+    for(unsigned s = 0; s < n; ++s) {
+        unsigned d = (s + 1) % n;
+        m[s] = std::min(X.part_size(s), Y.part_size(d)) / 2;
+
+        vex::backend::copy_peer(
+                ctx.queue(s), X(s), 0,
+                ctx.queue(d), Y(d), m[s],
+                m[s]);
+    }
+
+    for(unsigned d = 0; d < n; ++d) ctx.queue(d).finish();
+
+    std::vector<double> y(N);
+    vex::copy(Y, y);
+
+    for(unsigned s = 0; s < n; ++s) {
+        unsigned d = (s + 1) % n;
+
+        for(size_t i = 0; i < m[s]; ++i) {
+            BOOST_CHECK_EQUAL(y[Y.part_start(d) + i], 0);
+            BOOST_CHECK_EQUAL(y[Y.part_start(d) + m[s] + i], x[X.part_start(s) + i]);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(std_sort_vex_vector)
 {
     const size_t n = 1 << 10;
@@ -56,5 +56,6 @@ namespace vex {
 #include <vexcl/backend/compute/compiler.hpp>
 #include <vexcl/backend/compute/kernel.hpp>
 #include <vexcl/backend/compute/event.hpp>
+#include <vexcl/backend/compute/peer_copy.hpp>
 
 #endif
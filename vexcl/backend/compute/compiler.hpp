@@ -38,15 +38,33 @@ THE SOFTWARE.
 
 #include <vexcl/backend/common.hpp>
 #include <vexcl/detail/backtrace.hpp>
+#include <vexcl/detail/program_cache.hpp>
 
 namespace vex {
 namespace backend {
 namespace compute {
 
+/// Identifies the device, its driver, and the compiler options.
+/**
+ * Used as the key of the calibration data.
+ */
+inline std::string device_signature(const boost::compute::command_queue &queue) {
+    boost::compute::device d = queue.get_device();
+
+    std::ostringstream s;
+    s << d.name()
+      << "; " << d.platform().name()
+      << "; " << d.driver_version()
+      << "; " << get_compile_options(queue);
+    return s.str();
+}
+
 /// Create and build a program from source string.
 /**
- * If VEXCL_CACHE_KERNELS macro is defined, then program binaries are cached
- * in filesystem and reused in the following runs.
+ * The programs are cached for each context (see vex::detail::program_cache),
+ * so that identical sources are only built once. If VEXCL_CACHE_KERNELS macro
+ * is defined, then program binaries are also cached in filesystem and reused
+ * in the following runs.
  */
 inline boost::compute::program build_sources(
         const boost::compute::command_queue &queue,
@@ -61,10 +79,20 @@ inline boost::compute::program build_sources(
         std::cout << source << std::endl;
 #endif
 
-    return boost::compute::program::build_with_source(
-            source, queue.get_context(),
-            options + " " + get_compile_options(queue)
-            );
+    std::string compile_options = options + " " + get_compile_options(queue);
+
+    typedef vex::detail::program_cache<boost::compute::program> cache;
+
+    std::string key = sha1_hasher(source).process(compile_options);
+
+    boost::compute::program program;
+    if (cache::get().find(queue, key, program)) return program;
+
+    program = boost::compute::program::build_with_source(
+            source, queue.get_context(), compile_options);
+
+    cache::get().insert(queue, key, program);
+    return program;
 }
 
 } // namespace compute
@@ -31,8 +31,11 @@ THE SOFTWARE.
  * \brief  Device vector for Boost.Compute backend.
  */
 
+#include <memory>
 #include <boost/compute/core.hpp>
 
+#include <vexcl/backend/memory_pool.hpp>
+
 namespace vex {
 namespace backend {
 namespace compute {
@@ -43,6 +46,15 @@ static const mem_flags MEM_READ_ONLY  = CL_MEM_READ_ONLY;
 static const mem_flags MEM_WRITE_ONLY = CL_MEM_WRITE_ONLY;
 static const mem_flags MEM_READ_WRITE = CL_MEM_READ_WRITE;
 
+namespace detail {
+
+/// Owner of the memory cached in the pool.
+inline vex::detail::memory_pool::key_type pool_key(const boost::compute::command_queue &q) {
+    return vex::detail::memory_pool::key_type(q.get(), q.get_context().get());
+}
+
+} // namespace detail
+
 template <typename T>
 class device_vector {
     public:
@@ -54,19 +66,42 @@ class device_vector {
         device_vector(const boost::compute::command_queue &q, size_t n,
                 const T *host = 0, mem_flags flags = MEM_READ_WRITE)
         {
-            if (host && !(flags & CL_MEM_USE_HOST_PTR))
-                flags |= CL_MEM_COPY_HOST_PTR;
+            if (!n) return;
+
+            auto key   = detail::pool_key(q);
+            auto &pool = vex::detail::memory_pool::get();
+
+            if ((flags & CL_MEM_USE_HOST_PTR) || !pool.enabled(key)) {
+                if (host && !(flags & CL_MEM_USE_HOST_PTR))
+                    flags |= CL_MEM_COPY_HOST_PTR;
 
-            if (n)
                 buffer = boost::compute::buffer(q.get_context(), n * sizeof(T),
                         flags, static_cast<void*>(const_cast<T*>(host)));
+                return;
+            }
+
+            // Pooled blocks are rounded up to a size class; the vector uses
+            // a sub-buffer of the exact size.
+            boost::compute::context ctx = q.get_context();
+
+            lease = pool.allocate(key, static_cast<unsigned>(flags), n * sizeof(T),
+                    [&ctx, flags](size_t m) {
+                        return std::shared_ptr<void>(std::make_shared<boost::compute::buffer>(ctx, m, flags));
+                    });
+
+            buffer = static_cast<boost::compute::buffer*>(lease.get())->create_subbuffer(
+                    0, 0, n * sizeof(T));
+
+            if (host) write(q, 0, n, host, true);
         }
 
         device_vector(boost::compute::buffer buffer) : buffer( std::move(buffer) ) {}
 
         template <typename U>
         device_vector<U> reinterpret() const {
-            return device_vector<U>(buffer);
+            device_vector<U> r(buffer);
+            r.lease = lease;
+            return r;
         }
 
         void write(boost::compute::command_queue q, size_t offset,
@@ -157,6 +192,12 @@ class device_vector {
         }
     private:
         boost::compute::buffer buffer;
+
+        // Keeps the pooled memory block from returning to the pool.
+        std::shared_ptr<void> lease;
+
+        template <typename U>
+        friend class device_vector;
 };
 
 } // namespace compute
@@ -31,6 +31,12 @@ THE SOFTWARE.
  * \brief  An abstraction over Boost.Compute kernel.
  */
 
+#include <map>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
 #include <functional>
 
 #include <boost/compute/core.hpp>
@@ -42,9 +48,16 @@ namespace backend {
 namespace compute {
 
 /// An abstraction over OpenCL compute kernel.
+/**
+ * OpenCL kernel arguments are a state of the kernel object, so the kernels
+ * shared between host threads (e.g. the kernels in the static kernel caches)
+ * are cloned for each thread other than the one that created the kernel.
+ * The arguments and the launch configuration of a call are collected in an
+ * argument pack private to the calling thread.
+ */
 class kernel {
     public:
-        kernel() : argpos(0), w_size(0), g_size(0) {}
+        kernel() : uid(next_uid()), w_size(0), g_size(0) {}
 
         /// Constructor. Creates a backend::kernel instance from source.
         kernel(const boost::compute::command_queue &queue,
@@ -53,7 +66,7 @@ class kernel {
                size_t smem_per_thread = 0,
                const std::string &options = ""
                )
-            : argpos(0), K(build_sources(queue, src, options), name)
+            : uid(next_uid()), creator(std::this_thread::get_id()), K(build_sources(queue, src, options), name)
         {
             config(queue,
                     [smem_per_thread](size_t wgs){ return wgs * smem_per_thread; });
@@ -65,7 +78,7 @@ class kernel {
                std::function<size_t(size_t)> smem,
                const std::string &options = ""
                )
-            : argpos(0), K(build_sources(queue, src, options), name)
+            : uid(next_uid()), creator(std::this_thread::get_id()), K(build_sources(queue, src, options), name)
         {
             config(queue, smem);
         }
@@ -76,7 +89,7 @@ class kernel {
                const std::string &name,
                size_t smem_per_thread = 0
                )
-            : argpos(0), K(program, name)
+            : uid(next_uid()), creator(std::this_thread::get_id()), K(program, name)
         {
             config(queue,
                     [smem_per_thread](size_t wgs){ return wgs * smem_per_thread; });
@@ -88,7 +101,7 @@ class kernel {
                const std::string &name,
                std::function<size_t(size_t)> smem
                )
-            : argpos(0), K(program, name)
+            : uid(next_uid()), creator(std::this_thread::get_id()), K(program, name)
         {
             config(queue, smem);
         }
@@ -96,19 +109,22 @@ class kernel {
         /// Adds an argument to the kernel.
         template <typename T>
         void push_arg(device_vector<T> arg) {
-            K.set_arg(argpos++, arg.raw());
+            arg_pack &a = args();
+            a.K.set_arg(a.argpos++, arg.raw());
         }
 
         /// Adds an argument to the kernel.
         template <class Arg>
         void push_arg(Arg &&arg) {
-            K.set_arg(argpos++, arg);
+            arg_pack &a = args();
+            a.K.set_arg(a.argpos++, arg);
         }
 
         /// Adds local memory to the kernel.
         void set_smem(size_t smem_per_thread) {
-            K.set_arg(
-                    argpos++,
+            arg_pack &a = args();
+            a.K.set_arg(
+                    a.argpos++,
                     boost::compute::local_buffer<char>(smem_per_thread * workgroup_size())
                     );
         }
@@ -116,16 +132,20 @@ class kernel {
         /// Adds local memory to the kernel.
         template <class F>
         void set_smem(F &&f) {
-            K.set_arg(
-                    argpos++,
+            arg_pack &a = args();
+            a.K.set_arg(
+                    a.argpos++,
                     boost::compute::local_buffer<char>( f(workgroup_size()) )
                     );
         }
 
         /// Enqueue the kernel to the specified command queue.
         void operator()(boost::compute::command_queue q) {
-            q.enqueue_nd_range_kernel(K, 3, NULL, g_size.dim, w_size.dim);
-            argpos = 0;
+            arg_pack &a = args();
+            q.enqueue_nd_range_kernel(a.K, 3, NULL,
+                    a.own_grid ? a.g_size.dim : g_size.dim,
+                    a.own_grid ? a.w_size.dim : w_size.dim);
+            reset();
         }
 
 #ifndef BOOST_NO_VARIADIC_TEMPLATES
@@ -140,7 +160,9 @@ class kernel {
 
         /// Workgroup size.
         size_t workgroup_size() const {
-            return w_size.x * w_size.y * w_size.z;
+            const arg_pack *a = pending_args();
+            const ndrange  &w = a && a->own_grid ? a->w_size : w_size;
+            return w.x * w.y * w.z;
         }
 
         /// Standard number of workgroups to launch on a device.
@@ -186,6 +208,11 @@ class kernel {
         }
 
         /// Set launch configuration.
+        /**
+         * The configuration applies to the next launch from the calling
+         * thread, and becomes the default for the launches that are not
+         * configured explicitly.
+         */
         kernel& config(ndrange blocks, ndrange threads) {
             const size_t *b = blocks.dim;
             const size_t *t = threads.dim;
@@ -193,6 +220,11 @@ class kernel {
             g_size = ndrange(b[0] * t[0], b[1] * t[1], b[2] * t[2]);
             w_size = threads;
 
+            arg_pack &a = args();
+            a.g_size   = g_size;
+            a.w_size   = w_size;
+            a.own_grid = true;
+
             return *this;
         }
 
@@ -211,15 +243,145 @@ class kernel {
 
         /// Reset argument counter.
         void reset() {
-            argpos = 0;
+            if (arg_pack *a = pending_args()) {
+                a->owner    = nullptr;
+                a->argpos   = 0;
+                a->own_grid = false;
+                a->K        = boost::compute::kernel();
+            }
+        }
+
+        kernel(const kernel &k)
+            : uid(next_uid()), creator(k.creator), K(k.K), w_size(k.w_size), g_size(k.g_size)
+        {
+            copy_args(k);
+        }
+
+        kernel& operator=(const kernel &k) {
+            if (this != &k) {
+                reset();
+                clones.clear();
+                uid     = next_uid();
+                creator = k.creator;
+                K       = k.K;
+                w_size  = k.w_size;
+                g_size  = k.g_size;
+                copy_args(k);
+            }
+            return *this;
+        }
+
+        ~kernel() {
+            reset();
         }
     private:
-        unsigned argpos;
+        // Unique (never reused) identifier of the kernel instance.
+        size_t uid;
+
+        std::thread::id creator;
 
         boost::compute::kernel K;
 
         backend::ndrange w_size;
         backend::ndrange g_size;
+
+        // Arguments of a kernel call being prepared by the current thread.
+        struct arg_pack {
+            const kernel *owner;
+            boost::compute::kernel K;
+            unsigned argpos;
+
+            backend::ndrange w_size;
+            backend::ndrange g_size;
+            bool own_grid;
+
+            arg_pack() : owner(nullptr), argpos(0), own_grid(false) {}
+        };
+
+        // Argument packs of the current thread. There is usually at most
+        // one pack in use at a time; the released packs are reused.
+        static std::vector< std::unique_ptr<arg_pack> >& thread_packs() {
+            static thread_local std::vector< std::unique_ptr<arg_pack> > packs;
+            return packs;
+        }
+
+        arg_pack* pending_args() const {
+            for(auto &p : thread_packs())
+                if (p->owner == this) return p.get();
+            return nullptr;
+        }
+
+        // The arguments pushed to a kernel by the current thread are copied
+        // along with the kernel.
+        void copy_args(const kernel &k) {
+            if (const arg_pack *src = k.pending_args()) {
+                arg_pack &dst = args();
+                dst = *src;
+                dst.owner = this;
+            }
+        }
+
+        arg_pack& args() const {
+            if (arg_pack *a = pending_args()) return *a;
+
+            auto &packs = thread_packs();
+
+            arg_pack *free = nullptr;
+            for(auto &p : packs) {
+                if (!p->owner) { free = p.get(); break; }
+            }
+
+            if (!free) {
+                packs.emplace_back(new arg_pack());
+                free = packs.back().get();
+            }
+
+            free->owner = this;
+            free->K     = instance();
+            return *free;
+        }
+
+        // Clones of the kernel for the threads other than the creator. The
+        // clones are owned by the kernel instance, and are released along
+        // with it (e.g. when the kernel caches are purged).
+        mutable std::map<std::thread::id, boost::compute::kernel> clones;
+
+        static size_t next_uid() {
+            static std::atomic<size_t> last(0);
+            return ++last;
+        }
+
+        static std::mutex& clone_mutex() {
+            static std::mutex mx;
+            return mx;
+        }
+
+        // The kernel object the current thread sets the arguments of: the
+        // kernel itself in the thread that created it, or a clone of the
+        // kernel in any other thread. The thread remembers the clones it
+        // used by the instance uid, so that the lookup does not take the
+        // lock; the uids are never reused, so the entries of the destroyed
+        // instances are never dereferenced.
+        boost::compute::kernel instance() const {
+            if (std::this_thread::get_id() == creator) return K;
+
+            static thread_local std::map<size_t, const boost::compute::kernel*> known;
+
+            auto c = known.find(uid);
+            if (c != known.end()) return *c->second;
+
+            if (known.size() > 256) known.clear();
+
+            std::lock_guard<std::mutex> lock(clone_mutex());
+
+            auto k = clones.find(std::this_thread::get_id());
+            if (k == clones.end())
+                k = clones.insert(std::make_pair(std::this_thread::get_id(),
+                            boost::compute::kernel(K.get_program(), K.name()))).first;
+
+            known.insert(std::make_pair(uid, &k->second));
+            return k->second;
+        }
 };
 
 } // namespace compute
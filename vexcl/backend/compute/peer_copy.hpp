@@ -0,0 +1,169 @@
+#ifndef VEXCL_BACKEND_COMPUTE_PEER_COPY_HPP
+#define VEXCL_BACKEND_COMPUTE_PEER_COPY_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2017 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/backend/compute/peer_copy.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Copies between the device vectors on different devices.
+ */
+
+#include <map>
+#include <list>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/compute/core.hpp>
+#include <boost/compute/user_event.hpp>
+
+#include <vexcl/backend/compute/device_vector.hpp>
+
+namespace vex {
+namespace backend {
+namespace compute {
+
+namespace detail {
+
+/// Pinned host memory for the copies between the contexts.
+/**
+ * See vex::backend::opencl::detail::staging_buffer.
+ */
+template <bool dummy = true>
+struct staging_buffer {
+    static_assert(dummy, "Dummy parameter should be true");
+
+    struct block {
+        block() : ptr(0), size(0) {}
+
+        boost::compute::buffer buf;
+        void  *ptr;
+        size_t size;
+        boost::compute::event done;
+    };
+
+    static boost::mutex mx;
+    static std::map<cl_context, std::list<block> > blocks;
+
+    // Should be called under the lock.
+    static block& get(boost::compute::command_queue q, size_t bytes) {
+        boost::compute::context ctx = q.get_context();
+        std::list<block> &pool = blocks[ctx.get()];
+
+        for(auto b = pool.begin(); b != pool.end(); ++b)
+            if (b->size >= bytes && idle(*b)) return *b;
+
+        pool.push_back(block());
+        block &b = pool.back();
+
+        boost::compute::event mapped;
+        b.buf  = boost::compute::buffer(ctx, bytes, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR);
+        b.ptr  = q.enqueue_map_buffer_async(b.buf, CL_MAP_READ | CL_MAP_WRITE, 0, bytes, mapped);
+        b.size = bytes;
+
+        return b;
+    }
+
+    static bool idle(const block &b) {
+        return !b.done.get() || b.done.status() <= CL_COMPLETE;
+    }
+};
+
+template <bool dummy>
+boost::mutex staging_buffer<dummy>::mx;
+
+template <bool dummy>
+std::map<cl_context, std::list<typename staging_buffer<dummy>::block> >
+staging_buffer<dummy>::blocks;
+
+// Completes the user event passed as the callback data.
+inline void BOOST_COMPUTE_CL_CALLBACK complete_user_event(cl_event, cl_int status, void *data) {
+    boost::compute::user_event *e = static_cast<boost::compute::user_event*>(data);
+    clSetUserEventStatus(e->get(), status < 0 ? status : CL_COMPLETE);
+    delete e;
+}
+
+} // namespace detail
+
+/// Checks if the data may be copied between the devices without host staging.
+/**
+ * The buffers may be copied directly between the devices sharing an OpenCL
+ * context.
+ */
+inline bool peer_access(const boost::compute::command_queue &src_q,
+        const boost::compute::command_queue &dst_q)
+{
+    return src_q.get_context() == dst_q.get_context();
+}
+
+/// Copies data between device vectors that may reside on different devices.
+/**
+ * The copy is ordered after the commands already submitted to both src_q
+ * and dst_q; dst may be used once both queues are finished. See
+ * vex::backend::opencl::copy_peer().
+ */
+template <typename T>
+void copy_peer(
+        boost::compute::command_queue src_q, const device_vector<T> &src, size_t src_offset,
+        boost::compute::command_queue dst_q, const device_vector<T> &dst, size_t dst_offset,
+        size_t size
+        )
+{
+    if (!size) return;
+
+    if (peer_access(src_q, dst_q)) {
+        boost::compute::wait_list ready;
+        if (src_q != dst_q) ready.insert(dst_q.enqueue_marker());
+
+        src_q.enqueue_copy_buffer(src.raw_buffer(), dst.raw_buffer(),
+                sizeof(T) * src_offset, sizeof(T) * dst_offset, sizeof(T) * size,
+                ready);
+        return;
+    }
+
+    typedef detail::staging_buffer<> staging;
+    boost::lock_guard<boost::mutex> lock(staging::mx);
+
+    staging::block &b = staging::get(src_q, sizeof(T) * size);
+
+    boost::compute::event read = src_q.enqueue_read_buffer_async(src.raw_buffer(),
+            sizeof(T) * src_offset, sizeof(T) * size, b.ptr);
+
+    boost::compute::user_event *done = new boost::compute::user_event(dst_q.get_context());
+    boost::compute::wait_list ready(*done);
+    read.set_callback(detail::complete_user_event, CL_COMPLETE, done);
+
+    // The write on dst_q waits for the read, so src_q has to be flushed.
+    src_q.flush();
+
+    b.done = dst_q.enqueue_write_buffer_async(dst.raw_buffer(),
+            sizeof(T) * dst_offset, sizeof(T) * size, b.ptr, ready);
+}
+
+} // namespace compute
+} // namespace backend
+} // namespace vex
+
+#endif
@@ -45,5 +45,6 @@ THE SOFTWARE.
 #include <vexcl/backend/cuda/compiler.hpp>
 #include <vexcl/backend/cuda/kernel.hpp>
 #include <vexcl/backend/cuda/event.hpp>
+#include <vexcl/backend/cuda/peer_copy.hpp>
 
 #endif
@@ -36,12 +36,35 @@ THE SOFTWARE.
 
 #include <vexcl/backend/common.hpp>
 #include <vexcl/detail/backtrace.hpp>
+#include <vexcl/detail/program_cache.hpp>
 
 namespace vex {
 namespace backend {
 namespace cuda {
 
+/// Identifies the device, its driver, and the compiler options.
+/**
+ * Used as the key of the calibration data.
+ */
+inline std::string device_signature(const command_queue &queue) {
+    int driver;
+    cuda_check( cuDriverGetVersion(&driver) );
+
+    auto cc = queue.device().compute_capability();
+
+    std::ostringstream s;
+    s << queue.device().name()
+      << "; sm_" << std::get<0>(cc) << std::get<1>(cc)
+      << "; driver " << driver
+      << "; " << get_compile_options(queue);
+    return s.str();
+}
+
 /// Create and build a program from source string.
+/**
+ * The programs are cached for each context (see vex::detail::program_cache),
+ * so that identical sources are only compiled and loaded once.
+ */
 inline vex::backend::program build_sources(
         const command_queue &queue, const std::string &source,
         const std::string &options = ""
@@ -71,6 +94,13 @@ inline vex::backend::program build_sources(
 
     std::string hash = static_cast<std::string>(sha1);
 
+    typedef vex::detail::program_cache<program> cache;
+
+    {
+        program p;
+        if (cache::get().find(queue, hash, p)) return p;
+    }
+
     // Write source to a .cu file
     std::string basename = program_binaries_path(hash, true) + "kernel";
     std::string ptxfile  = basename + ".ptx";
@@ -104,7 +134,9 @@ inline vex::backend::program build_sources(
     CUmodule prg;
     cuda_check( cuModuleLoad(&prg, ptxfile.c_str()) );
 
-    return program(queue.context(), prg);
+    program p(queue.context(), prg);
+    cache::get().insert(queue, hash, p);
+    return p;
 }
 
 } // namespace cuda
@@ -31,8 +31,10 @@ THE SOFTWARE.
  * \brief  CUDA device vector.
  */
 
+#include <memory>
 #include <cuda.h>
 
+#include <vexcl/backend/memory_pool.hpp>
 #include <vexcl/backend/cuda/context.hpp>
 
 namespace vex {
@@ -59,6 +61,41 @@ struct deleter_impl<char*> {
     }
 };
 
+/// Owner of the memory cached in the pool.
+inline vex::detail::memory_pool::key_type pool_key(const command_queue &q) {
+    return vex::detail::memory_pool::key_type(q.raw(), q.context().raw());
+}
+
+/// Allocates device memory, possibly reusing the memory cached in the pool.
+inline std::shared_ptr<char> allocate_buffer(const command_queue &q, size_t bytes) {
+    auto alloc = [&q](size_t m) {
+        CUdeviceptr ptr;
+        cuda_check( cuMemAlloc(&ptr, m) );
+
+        return std::shared_ptr<char>(
+                reinterpret_cast<char*>(static_cast<size_t>(ptr)),
+                deleter(q.context().raw()));
+    };
+
+    auto key   = pool_key(q);
+    auto &pool = vex::detail::memory_pool::get();
+
+    if (!pool.enabled(key)) return alloc(bytes);
+
+    // Cached blocks keep their context alive.
+    context ctx = q.context();
+
+    return std::static_pointer_cast<char>(
+            pool.allocate(key, 0, bytes, [&](size_t m) {
+                std::shared_ptr<char> p = alloc(m);
+                return std::shared_ptr<void>(p.get(), [p, ctx](void*) mutable {
+                        ctx.set_current();
+                        p.reset();
+                        });
+                })
+            );
+}
+
 } // namespace detail
 
 /// Wrapper around CUdeviceptr.
@@ -77,11 +114,7 @@ class device_vector {
         {
             if (n) {
                 ctx.set_current();
-
-                CUdeviceptr ptr;
-                cuda_check( cuMemAlloc(&ptr, n * sizeof(T)) );
-
-                buffer.reset(reinterpret_cast<char*>(static_cast<size_t>(ptr)), detail::deleter(q.context().raw()) );
+                buffer = detail::allocate_buffer(q, n * sizeof(T));
             }
         }
 
@@ -93,11 +126,7 @@ class device_vector {
         {
             if (n) {
                 ctx.set_current();
-
-                CUdeviceptr ptr;
-                cuda_check( cuMemAlloc(&ptr, n * sizeof(T)) );
-
-                buffer.reset(reinterpret_cast<char*>(static_cast<size_t>(ptr)), detail::deleter(q.context().raw()) );
+                buffer = detail::allocate_buffer(q, n * sizeof(T));
 
                 if (host) {
                     if (std::is_same<T, H>::value)
@@ -31,6 +31,8 @@ THE SOFTWARE.
  * \brief  An abstraction over CUDA compute kernel.
  */
 
+#include <vector>
+#include <memory>
 #include <functional>
 
 #include <cuda.h>
@@ -42,6 +44,12 @@ namespace backend {
 namespace cuda {
 
 /// An abstraction over CUDA compute kernel.
+/**
+ * The arguments and the launch configuration of a call are collected in an
+ * argument pack private to the calling thread, so that the kernels shared
+ * between host threads (e.g. the kernels in the static kernel caches) may be
+ * launched concurrently.
+ */
 class kernel {
     public:
         kernel() : w_size(0), g_size(0), smem(0) {}
@@ -99,12 +107,38 @@ class kernel {
             config(queue, smem);
         }
 
+        kernel(const kernel &k)
+            : ctx(k.ctx), P(k.P), K(k.K),
+              w_size(k.w_size), g_size(k.g_size), smem(k.smem)
+        {
+            copy_args(k);
+        }
+
+        kernel& operator=(const kernel &k) {
+            if (this != &k) {
+                reset();
+                ctx    = k.ctx;
+                P      = k.P;
+                K      = k.K;
+                w_size = k.w_size;
+                g_size = k.g_size;
+                smem   = k.smem;
+                copy_args(k);
+            }
+            return *this;
+        }
+
+        ~kernel() {
+            reset();
+        }
+
         /// Adds an argument to the kernel.
         template <class Arg>
         void push_arg(const Arg &arg) {
             char *c = (char*)&arg;
-            prm_pos.push_back(stack.size());
-            stack.insert(stack.end(), c, c + sizeof(arg));
+            arg_pack &a = args();
+            a.prm_pos.push_back(a.stack.size());
+            a.stack.insert(a.stack.end(), c, c + sizeof(arg));
         }
 
         /// Adds an argument to the kernel.
@@ -115,29 +149,35 @@ class kernel {
 
         /// Adds local memory to the kernel.
         void set_smem(size_t smem_per_thread) {
-            smem = workgroup_size() * smem_per_thread;
+            set_smem_bytes(workgroup_size() * smem_per_thread);
         }
 
         /// Adds local memory to the kernel.
         template <class F>
         void set_smem(F &&f) {
-            smem = f(workgroup_size());
+            set_smem_bytes(f(workgroup_size()));
         }
 
         /// Enqueue the kernel to the specified command queue.
         void operator()(const command_queue &q) {
-            prm_addr.clear();
-            for(auto p = prm_pos.begin(); p != prm_pos.end(); ++p)
-                prm_addr.push_back(stack.data() + *p);
+            arg_pack &a = args();
+
+            const ndrange &g = a.own_grid ? a.g_size : g_size;
+            const ndrange &w = a.own_grid ? a.w_size : w_size;
+            const size_t   s = a.own_smem ? a.smem   : smem;
+
+            a.prm_addr.clear();
+            for(auto p = a.prm_pos.begin(); p != a.prm_pos.end(); ++p)
+                a.prm_addr.push_back(a.stack.data() + *p);
 
             cuda_check(
                     cuLaunchKernel(
                         K,
-                        static_cast<unsigned>(g_size.x), static_cast<unsigned>(g_size.y), static_cast<unsigned>(g_size.z),
-                        static_cast<unsigned>(w_size.x), static_cast<unsigned>(w_size.y), static_cast<unsigned>(w_size.z),
-                        static_cast<unsigned>(smem),
+                        static_cast<unsigned>(g.x), static_cast<unsigned>(g.y), static_cast<unsigned>(g.z),
+                        static_cast<unsigned>(w.x), static_cast<unsigned>(w.y), static_cast<unsigned>(w.z),
+                        static_cast<unsigned>(s),
                         q.raw(),
-                        prm_addr.data(),
+                        a.prm_addr.data(),
                         0
                         )
                     );
@@ -157,7 +197,9 @@ class kernel {
 
         /// Workgroup size.
         size_t workgroup_size() const {
-            return w_size.x * w_size.y * w_size.z;
+            const arg_pack *a = pending_args();
+            const ndrange  &w = a && a->own_grid ? a->w_size : w_size;
+            return w.x * w.y * w.z;
         }
 
         /// Standard number of workgroups to launch on a device.
@@ -194,10 +236,20 @@ class kernel {
         }
 
         /// Set launch configuration.
+        /**
+         * The configuration applies to the next launch from the calling
+         * thread, and becomes the default for the launches that are not
+         * configured explicitly.
+         */
         kernel& config(ndrange blocks, ndrange threads) {
             g_size = blocks;
             w_size = threads;
 
+            arg_pack &a = args();
+            a.g_size   = blocks;
+            a.w_size   = threads;
+            a.own_grid = true;
+
             return *this;
         }
 
@@ -215,8 +267,13 @@ class kernel {
 
         /// Reset argument counter.
         void reset() {
-            stack.clear();
-            prm_pos.clear();
+            if (arg_pack *p = pending_args()) {
+                p->owner    = nullptr;
+                p->own_grid = false;
+                p->own_smem = false;
+                p->stack.clear();
+                p->prm_pos.clear();
+            }
         }
     private:
         context ctx;
@@ -227,9 +284,72 @@ class kernel {
         ndrange  g_size;
         size_t   smem;
 
-        std::vector<char>   stack;
-        std::vector<size_t> prm_pos;
-        std::vector<void*>  prm_addr;
+        // Arguments of a kernel call being prepared by the current thread.
+        struct arg_pack {
+            const kernel *owner;
+
+            std::vector<char>   stack;
+            std::vector<size_t> prm_pos;
+            std::vector<void*>  prm_addr;
+
+            ndrange w_size;
+            ndrange g_size;
+            size_t  smem;
+            bool    own_grid;
+            bool    own_smem;
+
+            arg_pack() : owner(nullptr), smem(0), own_grid(false), own_smem(false) {}
+        };
+
+        // Argument packs of the current thread. There is usually at most
+        // one pack in use at a time; the released packs are reused.
+        static std::vector< std::unique_ptr<arg_pack> >& thread_packs() {
+            static thread_local std::vector< std::unique_ptr<arg_pack> > packs;
+            return packs;
+        }
+
+        arg_pack* pending_args() const {
+            for(auto &p : thread_packs())
+                if (p->owner == this) return p.get();
+            return nullptr;
+        }
+
+        // The arguments pushed to a kernel by the current thread are copied
+        // along with the kernel.
+        void copy_args(const kernel &k) {
+            if (const arg_pack *src = k.pending_args()) {
+                arg_pack &dst = args();
+                dst = *src;
+                dst.owner = this;
+            }
+        }
+
+        arg_pack& args() const {
+            if (arg_pack *a = pending_args()) return *a;
+
+            auto &packs = thread_packs();
+
+            arg_pack *free = nullptr;
+            for(auto &p : packs) {
+                if (!p->owner) { free = p.get(); break; }
+            }
+
+            if (!free) {
+                packs.emplace_back(new arg_pack());
+                free = packs.back().get();
+            }
+
+            free->owner = this;
+            return *free;
+        }
+
+        void set_smem_bytes(size_t bytes) {
+            smem = bytes;
+
+            arg_pack &a = args();
+            a.smem     = bytes;
+            a.own_smem = true;
+        }
 
         size_t shared_size_bytes() const {
             int n;
@@ -0,0 +1,140 @@
+#ifndef VEXCL_BACKEND_CUDA_PEER_COPY_HPP
+#define VEXCL_BACKEND_CUDA_PEER_COPY_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2017 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/backend/cuda/peer_copy.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Copies between the device vectors on different devices.
+ */
+
+#include <set>
+#include <utility>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <cuda.h>
+
+#include <vexcl/backend/cuda/error.hpp>
+#include <vexcl/backend/cuda/context.hpp>
+#include <vexcl/backend/cuda/device_vector.hpp>
+
+namespace vex {
+namespace backend {
+namespace cuda {
+
+namespace detail {
+
+/// Enables the access of the src context to the memory of the dst context.
+/**
+ * Peer access is enabled once per pair of contexts. Returns false if the
+ * devices do not support peer access.
+ */
+template <bool dummy = true>
+bool enable_peer_access(const command_queue &src_q, const command_queue &dst_q) {
+    static_assert(dummy, "Dummy parameter should be true");
+
+    static boost::mutex mx;
+    static std::set< std::pair<CUcontext, CUcontext> > enabled;
+
+    CUcontext src = src_q.context().raw();
+    CUcontext dst = dst_q.context().raw();
+
+    if (src == dst) return true;
+
+    boost::lock_guard<boost::mutex> lock(mx);
+
+    if (enabled.count(std::make_pair(src, dst))) return true;
+
+    int can_access = 0;
+    cuda_check( cuDeviceCanAccessPeer(&can_access, src_q.device().raw(), dst_q.device().raw()) );
+    if (!can_access) return false;
+
+    src_q.context().set_current();
+    CUresult rc = cuCtxEnablePeerAccess(dst, 0);
+    if (rc != CUDA_ERROR_PEER_ACCESS_ALREADY_ENABLED) cuda_check(rc);
+
+    enabled.insert(std::make_pair(src, dst));
+    return true;
+}
+
+} // namespace detail
+
+/// Checks if the data may be copied between the devices without host staging.
+inline bool peer_access(const command_queue &src_q, const command_queue &dst_q) {
+    return detail::enable_peer_access(src_q, dst_q);
+}
+
+/// Copies data between device vectors that may reside on different devices.
+/**
+ * The copy is submitted to src_q and starts after the commands already
+ * submitted to both src_q and dst_q are complete; dst may be used once both
+ * queues are finished. The devices without peer access are served by
+ * cuMemcpyPeerAsync() through the driver's pinned staging buffers.
+ */
+template <typename T>
+void copy_peer(
+        const command_queue &src_q, const device_vector<T> &src, size_t src_offset,
+        const command_queue &dst_q, const device_vector<T> &dst, size_t dst_offset,
+        size_t size
+        )
+{
+    if (!size) return;
+
+    if (src_q.raw() != dst_q.raw()) {
+        dst_q.context().set_current();
+
+        CUevent ready;
+        cuda_check( cuEventCreate(&ready, CU_EVENT_DISABLE_TIMING) );
+        cuda_check( cuEventRecord(ready, dst_q.raw()) );
+
+        src_q.context().set_current();
+        cuda_check( cuStreamWaitEvent(src_q.raw(), ready, 0) );
+
+        // The event is released once it is complete.
+        cuda_check( cuEventDestroy(ready) );
+    }
+
+    src_q.context().set_current();
+
+    CUdeviceptr s = src.raw() + sizeof(T) * src_offset;
+    CUdeviceptr d = dst.raw() + sizeof(T) * dst_offset;
+
+    if (src_q.context().raw() == dst_q.context().raw()) {
+        cuda_check( cuMemcpyDtoDAsync(d, s, sizeof(T) * size, src_q.raw()) );
+    } else {
+        detail::enable_peer_access(src_q, dst_q);
+
+        cuda_check( cuMemcpyPeerAsync(d, dst_q.context().raw(),
+                    s, src_q.context().raw(), sizeof(T) * size, src_q.raw()) );
+    }
+}
+
+} // namespace cuda
+} // namespace backend
+} // namespace vex
+
+#endif
@@ -221,6 +221,18 @@ class source_generator {
             return *this;
         }
 
+        /// Loop over the elements of an element-wise kernel.
+        /**
+         * The loop iterations are independent. Only makes a difference for
+         * the JIT backend, where the loop is vectorized.
+         */
+        source_generator& elementwise_loop(
+                const std::string &idx = "idx", const std::string &bnd = "n"
+                )
+        {
+            return grid_stride_loop(idx, bnd);
+        }
+
         source_generator& barrier(bool /*global*/ = false) {
             src << "__syncthreads();";
             return *this;
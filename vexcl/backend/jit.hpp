@@ -40,6 +40,9 @@ THE SOFTWARE.
 #include <vexcl/backend/jit/device_vector.hpp>
 #include <vexcl/backend/jit/source.hpp>
 #include <vexcl/backend/jit/kernel.hpp>
+#include <vexcl/backend/jit/bundle.hpp>
+#include <vexcl/backend/jit/graph.hpp>
 #include <vexcl/backend/jit/event.hpp>
+#include <vexcl/backend/jit/peer_copy.hpp>
 
 #endif
@@ -0,0 +1,255 @@
+#ifndef VEXCL_BACKEND_JIT_BUNDLE_HPP
+#define VEXCL_BACKEND_JIT_BUNDLE_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2017 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/backend/jit/bundle.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Kernel bundles: many JIT kernels compiled into a single library.
+ */
+
+#include <string>
+#include <map>
+#include <set>
+#include <sstream>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+#include <vexcl/backend/common.hpp>
+#include <vexcl/backend/jit/source.hpp>
+#include <vexcl/backend/jit/compiler.hpp>
+
+namespace vex {
+namespace backend {
+namespace jit {
+
+/// A set of kernels compiled into a single shared library.
+/**
+ * Each JIT program is normally compiled into its own shared library, which
+ * means a compiler launch and a dlopen per kernel. A kernel bundle collects
+ * the sources of many programs and compiles them into a single library. The
+ * bundle is stored under the given name in the VexCL appdata folder, and the
+ * SHA1 hashes of the original programs are used as the lookup index.
+ *
+ * While the bundle is alive, the programs requested with build_sources() or
+ * build_sources_async() are first looked up in the bundle. Programs that are
+ * not found there are compiled as usual and, unless recording is disabled,
+ * remembered by the bundle. A call to build() compiles the recorded
+ * programs together with the ones explicitly added with add(), so that the
+ * next run of the application loads everything with a single dlopen:
+ *
+ * \code
+ * vex::backend::jit::kernel_bundle bundle(ctx.queue(0), "solver");
+ * // ... warm-up phase: the kernels are compiled individually ...
+ * bundle.build();
+ * \endcode
+ *
+ * Only the programs that start with the standard kernel header and that
+ * share compile options of the bundle are bundled; others are compiled
+ * individually.
+ */
+class kernel_bundle : public detail::bundle_base {
+    public:
+        kernel_bundle(const command_queue &q, const std::string &name, bool record = true)
+            : q(q), recording(record),
+              dir(appdata_path() + path_delim() + "bundles" + path_delim() + name + path_delim()),
+              options(" " + get_compile_options(q))
+        {
+            boost::filesystem::create_directories(dir);
+            load();
+            detail::bundle_registry<>::insert(this);
+        }
+
+        ~kernel_bundle() {
+            detail::bundle_registry<>::erase(this);
+        }
+
+        kernel_bundle(const kernel_bundle&) = delete;
+        kernel_bundle& operator=(const kernel_bundle&) = delete;
+
+        /// Enables or disables recording of the programs missing from the bundle.
+        void record(bool enable) {
+            boost::lock_guard<boost::mutex> lock(mx);
+            recording = enable;
+        }
+
+        /// Adds a program source to the bundle.
+        /** The source is compiled on the next call to build(). */
+        void add(const std::string &source, const std::string &opt = "") {
+            std::string compile_options = opt + " " + get_compile_options(q);
+            std::string hash = detail::program_hash(source, compile_options);
+
+            boost::lock_guard<boost::mutex> lock(mx);
+            if (!hashes.count(hash)) pending[hash] = entry(source, compile_options);
+        }
+
+        /// Compiles the bundled and the pending programs into a single library.
+        void build() {
+            namespace fs = boost::filesystem;
+
+            boost::lock_guard<boost::mutex> lock(mx);
+
+            const std::string header = standard_kernel_header(q);
+
+            std::set<std::string> bundled;
+            std::ostringstream src;
+
+            src << header;
+
+            auto append = [&](const std::string &hash, const std::string &source) {
+                if (source.compare(0, header.size(), header) != 0) return;
+
+                src << "\n#undef VEXCL_JIT_KERNEL_SYMBOL"
+                       "\n#define VEXCL_JIT_KERNEL_SYMBOL(name) " << prefix(hash) << " ## name"
+                       "\nnamespace vexcl_" << hash << " {"
+                    << source.substr(header.size())
+                    << "\n} // namespace vexcl_" << hash << "\n";
+
+                bundled.insert(hash);
+            };
+
+            for(auto h = hashes.begin(); h != hashes.end(); ++h) {
+                std::ifstream f(dir + *h + ".cpp");
+                std::string source(
+                        (std::istreambuf_iterator<char>(f)),
+                        std::istreambuf_iterator<char>());
+                if (f) append(*h, source);
+            }
+
+            for(auto p = pending.begin(); p != pending.end(); ++p) {
+                if (p->second.options != options || bundled.count(p->first)) continue;
+
+                std::ofstream f(dir + p->first + ".cpp");
+                f << p->second.source;
+                append(p->first, p->second.source);
+            }
+
+            pending.clear();
+
+            if (bundled.empty() || bundled == hashes) return;
+
+            // The library name depends on its contents, so that a rebuilt
+            // bundle is never confused with the one that is already loaded.
+            std::string libname = "bundle-"
+                + static_cast<std::string>(sha1_hasher(src.str()).process(options))
+                + detail::library_extension();
+
+            detail::compile_library(src.str(), options, dir + libname);
+
+            {
+                std::ofstream f(dir + "index");
+                f << libname << "\n";
+                for(auto h = bundled.begin(); h != bundled.end(); ++h)
+                    f << *h << "\n";
+            }
+
+            if (!library.empty() && library != libname) {
+                boost::system::error_code ec;
+                fs::remove(dir + library, ec);
+                fs::path cpp(dir + library);
+                fs::remove(cpp.replace_extension(".cpp"), ec);
+            }
+
+            library = libname;
+            lib     = boost::dll::shared_library(dir + libname);
+            hashes.swap(bundled);
+        }
+
+        /// Number of programs in the bundle library.
+        size_t size() const {
+            boost::lock_guard<boost::mutex> lock(mx);
+            return hashes.size();
+        }
+
+        /// Number of programs waiting for the next build().
+        size_t pending_size() const {
+            boost::lock_guard<boost::mutex> lock(mx);
+            return pending.size();
+        }
+
+        bool find(const std::string &hash, program &p) const {
+            boost::lock_guard<boost::mutex> lock(mx);
+
+            if (!lib.is_loaded() || !hashes.count(hash)) return false;
+
+            p = program(lib, prefix(hash));
+            return true;
+        }
+
+        void miss(const std::string &hash,
+                const std::string &source, const std::string &compile_options)
+        {
+            boost::lock_guard<boost::mutex> lock(mx);
+            if (recording) pending[hash] = entry(source, compile_options);
+        }
+    private:
+        struct entry {
+            std::string source;
+            std::string options;
+
+            entry() {}
+            entry(const std::string &source, const std::string &options)
+                : source(source), options(options) {}
+        };
+
+        command_queue q;
+        bool recording;
+
+        std::string dir;
+        std::string options;
+        std::string library;
+
+        boost::dll::shared_library lib;
+        std::set<std::string> hashes;
+        std::map<std::string, entry> pending;
+
+        mutable boost::mutex mx;
+
+        static std::string prefix(const std::string &hash) {
+            return "vexcl_" + hash + "_";
+        }
+
+        void load() {
+            std::ifstream f(dir + "index");
+            if (!(f >> library)) return;
+
+            if (!boost::filesystem::exists(dir + library)) {
+                library.clear();
+                return;
+            }
+
+            for(std::string h; f >> h; ) hashes.insert(h);
+
+            lib = boost::dll::shared_library(dir + library);
+        }
+};
+
+} // namespace jit
+} // namespace backend
+} // namespace vex
+
+#endif
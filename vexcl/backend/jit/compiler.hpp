@@ -34,18 +34,37 @@ THE SOFTWARE.
 #include <string>
 #include <sstream>
 #include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <vector>
+#include <future>
+#include <functional>
+#include <memory>
+#include <algorithm>
+#include <chrono>
 #include <boost/dll/shared_library.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
 
 #include <vexcl/backend/common.hpp>
 #include <vexcl/detail/backtrace.hpp>
+#include <vexcl/kernel_registry.hpp>
+#include <vexcl/detail/program_cache.hpp>
 
 #ifndef VEXCL_JIT_COMPILER
 #  define VEXCL_JIT_COMPILER "g++"
 #endif
 
 #ifndef VEXCL_JIT_COMPILER_OPTIONS
+#  if defined(__x86_64__) || defined(__i386__)
+#    define VEXCL_JIT_TARGET_OPTIONS " -march=native"
+#  else
+#    define VEXCL_JIT_TARGET_OPTIONS ""
+#  endif
 #  ifdef NDEBUG
-#    define VEXCL_JIT_COMPILER_OPTIONS "-O3 -fPIC -shared -fopenmp"
+#    define VEXCL_JIT_COMPILER_OPTIONS "-O3 -fPIC -shared -fopenmp" VEXCL_JIT_TARGET_OPTIONS
 #  else
 #    define VEXCL_JIT_COMPILER_OPTIONS "-g -fPIC -shared -fopenmp"
 #  endif
@@ -55,69 +74,483 @@ namespace vex {
 namespace backend {
 namespace jit {
 
-/// Compile and load a program from source string.
-inline vex::backend::program build_sources(const command_queue &q,
-        const std::string &source, const std::string &options = ""
-        )
-{
-#ifdef VEXCL_SHOW_KERNELS
-    std::cout << source << std::endl;
+/// Result of a (possibly ongoing) background compilation.
+typedef std::shared_future<program> program_future;
+
+namespace detail {
+
+/// Runs compiler jobs on a bounded set of background threads.
+/**
+ * The number of concurrent compiler processes is limited by the
+ * VEXCL_JIT_COMPILE_THREADS environment variable (clamped to [1, number of
+ * cores]), and defaults to the number of available cores. A new thread is
+ * started when there is no idle worker that is not already woken up for an
+ * earlier job, so that a burst of jobs is spread between the threads.
+ */
+class compiler_pool {
+    public:
+        static compiler_pool& get() {
+            static compiler_pool pool;
+            return pool;
+        }
+
+        void enqueue(std::function<void()> job) {
+            boost::lock_guard<boost::mutex> lock(mx);
+
+            jobs.push_back(std::move(job));
+
+            if (idle) {
+                --idle;
+                ++wakeups;
+                cond.notify_one();
+            } else if (workers.size() < max_workers) {
+                workers.create_thread([this]() { this->work(); });
+            }
+        }
+
+        ~compiler_pool() {
+            {
+                boost::lock_guard<boost::mutex> lock(mx);
+                stop = true;
+                jobs.clear();
+            }
+            cond.notify_all();
+            workers.join_all();
+        }
+    private:
+        bool stop;
+        unsigned idle;    // waiting workers that are not woken up yet
+        unsigned wakeups; // pending notifications of the waiting workers
+        unsigned max_workers;
+
+        boost::mutex mx;
+        boost::condition_variable cond;
+        boost::thread_group workers;
+        std::deque< std::function<void()> > jobs;
+
+        compiler_pool() : stop(false), idle(0), wakeups(0) {
+            long ncores = std::max(1u, boost::thread::hardware_concurrency());
+            long n = getenv_int("VEXCL_JIT_COMPILE_THREADS", ncores);
+            max_workers = static_cast<unsigned>(std::min(std::max(n, 1L), ncores));
+        }
+
+        void work() {
+            boost::unique_lock<boost::mutex> lock(mx);
+
+            while(true) {
+                if (!stop && jobs.empty()) {
+                    ++idle;
+                    while(!stop && !wakeups) cond.wait(lock);
+                    if (stop) return;
+                    --wakeups;
+
+                    // The job may have been taken by a worker that finished
+                    // its previous job in the meantime.
+                    continue;
+                }
+
+                if (stop) return;
+
+                std::function<void()> job = std::move(jobs.front());
+                jobs.pop_front();
+
+                lock.unlock();
+                job();
+                lock.lock();
+            }
+        }
+};
+
+inline const std::string& jit_compiler() {
+    static const std::string cxx = getenv("CXX", VEXCL_JIT_COMPILER);
+    return cxx;
+}
+
+inline const std::string& jit_compiler_options() {
+    static const std::string cxxflags = getenv("CXXFLAGS", VEXCL_JIT_COMPILER_OPTIONS);
+    return cxxflags;
+}
+
+/// First line of the output of a shell command (empty if the command fails).
+inline std::string command_output(const std::string &cmd) {
+#if BOOST_OS_WINDOWS
+    FILE *f = _popen((cmd + " 2>NUL").c_str(), "r");
 #else
-    if (getenv("VEXCL_SHOW_KERNELS"))
-        std::cout << source << std::endl;
+    FILE *f = popen((cmd + " 2>/dev/null").c_str(), "r");
 #endif
+    if (!f) return "";
 
-    static const std::string cxx      = getenv("CXX",      VEXCL_JIT_COMPILER);
-    static const std::string cxxflags = getenv("CXXFLAGS", VEXCL_JIT_COMPILER_OPTIONS);
+    std::string out;
+    char buf[256];
+    while(fgets(buf, sizeof(buf), f)) {
+        out += buf;
+        if (!out.empty() && out.back() == '\n') break;
+    }
+    while(fgets(buf, sizeof(buf), f)) {}
 
-    std::string compile_options = options + " " + get_compile_options(q);
+#if BOOST_OS_WINDOWS
+    _pclose(f);
+#else
+    pclose(f);
+#endif
+
+    while(!out.empty() && (out.back() == '\n' || out.back() == '\r')) out.pop_back();
+    return out;
+}
+
+/// Version string of the JIT compiler.
+inline const std::string& jit_compiler_version() {
+    static const std::string version = command_output(jit_compiler() + " --version");
+    return version;
+}
+
+/// Model name and features of the host CPU.
+/**
+ * Read from /proc/cpuinfo; empty on the systems without it.
+ */
+inline const std::pair<std::string, std::string>& host_cpu() {
+    static const std::pair<std::string, std::string> cpu = []() {
+        std::pair<std::string, std::string> cpu;
+
+        std::ifstream f("/proc/cpuinfo");
+        std::string line;
+
+        auto value = [&line]() {
+            size_t p = line.find(':');
+            if (p == std::string::npos) return std::string();
+            p = line.find_first_not_of(" \t", p + 1);
+            return p == std::string::npos ? std::string() : line.substr(p);
+        };
+
+        auto starts_with = [&line](const char *key) {
+            return line.compare(0, strlen(key), key) == 0;
+        };
+
+        while(std::getline(f, line) && (cpu.first.empty() || cpu.second.empty())) {
+            if (cpu.first.empty() && (starts_with("model name") || starts_with("CPU part")))
+                cpu.first = value();
+            else if (cpu.second.empty() && (starts_with("flags") || starts_with("Features")))
+                cpu.second = value();
+        }
+
+        return cpu;
+    }();
+
+    return cpu;
+}
 
+/// Whether the options make the compiled code specific to the host CPU.
+inline bool host_specific(const std::string &options) {
+    return options.find("=native") != std::string::npos;
+}
+
+/// Whether the compiler should report vectorized loops.
+/**
+ * Set VEXCL_JIT_VECTORIZE_REPORT=1 to see which loops of the compiled kernels
+ * were vectorized, and with what vector width. The report is written to
+ * std::cerr and is kept next to the compiled library. Libraries compiled
+ * without the report are not reused while the report is enabled.
+ */
+inline bool vectorize_report() {
+    static const bool report = getenv_int("VEXCL_JIT_VECTORIZE_REPORT", 0) != 0;
+    return report;
+}
+
+/// Unique identifier of the compiled program.
+/**
+ * The offline cache may be shared between hosts (e.g. a home directory on a
+ * cluster), so the hash includes the compiler version, and, when the code is
+ * compiled for the host CPU (-march=native), the CPU model and features.
+ */
+inline std::string program_hash(const std::string &source, const std::string &compile_options) {
     sha1_hasher sha1;
     sha1.process(source)
         .process(compile_options)
-        .process(cxx)
-        .process(cxxflags);
+        .process(jit_compiler())
+        .process(jit_compiler_options())
+        .process(jit_compiler_version());
 
-    std::string hash = static_cast<std::string>(sha1);
+    if (host_specific(jit_compiler_options() + " " + compile_options))
+        sha1.process(host_cpu().first).process(host_cpu().second);
 
-    // Write source to a .cpp file
-    std::string basename = program_binaries_path(hash, true) + "kernel";
+    if (vectorize_report()) sha1.process("vectorize_report");
+
+    return static_cast<std::string>(sha1);
+}
+
+/// Unique identifier of the program compiled for the given queue.
+inline std::string program_hash(const command_queue &q,
+        const std::string &source, const std::string &options)
+{
+    return program_hash(source, options + " " + get_compile_options(q));
+}
+
+/// Extension of shared library files.
+inline std::string library_extension() {
 #if BOOST_OS_WINDOWS
-    std::string sofile = basename + ".dll";
+    return ".dll";
 #elif BOOST_OS_MACOS || BOOST_OS_IOS
-    std::string sofile = basename + ".dylib";
+    return ".dylib";
 #else
-    std::string sofile = basename + ".so";
+    return ".so";
 #endif
+}
 
-    if ( !boost::filesystem::exists(sofile) ) {
-        std::string cppfile = basename + ".cpp";
+/// Name of the shared library file for a program with the given hash.
+inline std::string program_library(const std::string &hash, bool create = false) {
+    return program_binaries_path(hash, create) + "kernel" + library_extension();
+}
 
-        {
-            std::ofstream f(cppfile);
-            f << source;
-        }
+/// Compiles the source into the shared library.
+/**
+ * The source and the library are written under temporary names first, and
+ * are renamed after successful compilation. This way concurrent processes
+ * never see a partially written library.
+ */
+inline void compile_library(const std::string &source,
+        const std::string &compile_options, const std::string &sofile)
+{
+    namespace fs = boost::filesystem;
+
+    fs::path so(sofile);
+    fs::path dir = so.parent_path();
+    fs::path tmp = dir / fs::unique_path("tmp-%%%%-%%%%-%%%%");
+
+    fs::path tmp_cpp = tmp; tmp_cpp += ".cpp";
+    fs::path tmp_so  = tmp; tmp_so  += so.extension();
+
+    {
+        std::ofstream f(tmp_cpp.string());
+        f << source;
+    }
 
-        // Compile the source.
-        std::ostringstream cmdline;
-        cmdline << cxx << " -o " << sofile << " " << cppfile << " "
-                << cxxflags << " " << compile_options;
+    fs::path tmp_vec = tmp; tmp_vec += ".vec";
 
-        if (0 != system(cmdline.str().c_str()) ) {
+    std::ostringstream cmdline;
+    cmdline << jit_compiler() << " -o " << tmp_so.string() << " " << tmp_cpp.string() << " "
+            << jit_compiler_options() << " " << compile_options;
+
+    if (vectorize_report()) {
+        if (jit_compiler().find("clang") != std::string::npos)
+            cmdline << " -Rpass=loop-vectorize -Rpass-missed=loop-vectorize 2> " << tmp_vec.string();
+        else
+            cmdline << " -fopt-info-vec-optimized=" << tmp_vec.string();
+    }
+
+    if (0 != system(cmdline.str().c_str()) ) {
 #ifndef VEXCL_SHOW_KERNELS
-            std::cerr << source << std::endl;
+        std::cerr << source << std::endl;
 #endif
+        boost::system::error_code ec;
+        fs::remove(tmp_cpp, ec);
+        fs::remove(tmp_so,  ec);
+        fs::remove(tmp_vec, ec);
+
+        vex::detail::print_backtrace();
+        throw std::runtime_error("Kernel compilation failed");
+    }
+
+    fs::path cpp = so; cpp.replace_extension(".cpp");
+
+    fs::rename(tmp_cpp, cpp);
+    fs::rename(tmp_so,  so);
+
+    if (vectorize_report() && fs::exists(tmp_vec)) {
+        fs::path vec = so; vec.replace_extension(".vec");
+        fs::rename(tmp_vec, vec);
+
+        std::ifstream f(vec.string());
+        std::ostringstream report;
+        report << f.rdbuf();
+
+        static boost::mutex report_mx;
+        boost::lock_guard<boost::mutex> lock(report_mx);
+        std::cerr << "Vectorization report for " << cpp.string() << ":\n"
+                  << (report.str().empty() ? "no loops were vectorized\n" : report.str())
+                  << std::endl;
+    }
+}
+
+/// Interface of a kernel bundle (see jit::kernel_bundle).
+struct bundle_base {
+    virtual ~bundle_base() {}
+
+    /// Looks up the program with the given hash in the bundle.
+    virtual bool find(const std::string &hash, program &p) const = 0;
+
+    /// Notifies the bundle about a program that was not found in any bundle.
+    virtual void miss(const std::string &hash,
+            const std::string &source, const std::string &compile_options) = 0;
+};
 
-            vex::detail::print_backtrace();
-            throw std::runtime_error("Kernel compilation failed");
+/// Kernel bundles that are currently alive.
+template <bool dummy = true>
+struct bundle_registry {
+    static_assert(dummy, "dummy parameter should be true");
+
+    static std::vector<bundle_base*> bundles;
+    static boost::mutex mx;
+
+    static void insert(bundle_base *b) {
+        boost::lock_guard<boost::mutex> lock(mx);
+        bundles.push_back(b);
+    }
+
+    static void erase(bundle_base *b) {
+        boost::lock_guard<boost::mutex> lock(mx);
+        bundles.erase(std::remove(bundles.begin(), bundles.end(), b), bundles.end());
+    }
+
+    static bool find(const std::string &hash,
+            const std::string &source, const std::string &compile_options,
+            program &p)
+    {
+        boost::lock_guard<boost::mutex> lock(mx);
+
+        for(auto b = bundles.begin(); b != bundles.end(); ++b)
+            if ((*b)->find(hash, p)) return true;
+
+        for(auto b = bundles.begin(); b != bundles.end(); ++b)
+            (*b)->miss(hash, source, compile_options);
+
+        return false;
+    }
+};
+
+template <bool dummy>
+std::vector<bundle_base*> bundle_registry<dummy>::bundles;
+
+template <bool dummy>
+boost::mutex bundle_registry<dummy>::mx;
+
+} // namespace detail
+
+/// Identifies the device and the compiler (used as the calibration data key).
+/**
+ * Includes the host CPU model and the compiler version, so that the hosts
+ * sharing the home directory do not share the calibration data, and the
+ * compiler upgrades start a fresh calibration.
+ */
+inline std::string device_signature(const command_queue &q) {
+    std::ostringstream s;
+    s << q.device().name()
+      << "; " << detail::host_cpu().first
+      << "; threads: " << detail::devices()[q.device().id].cpus.size()
+      << "/" << boost::thread::hardware_concurrency()
+      << "; " << detail::jit_compiler_version()
+      << "; " << detail::jit_compiler() << " " << detail::jit_compiler_options()
+      << " " << get_compile_options(q);
+    return s.str();
+}
+
+/// Start compilation of a program in background.
+/**
+ * Returns a future for the loaded program. If the program is found in one of
+ * the active kernel bundles, among the programs already loaded for the
+ * context (see vex::detail::program_cache), or in the offline cache, the
+ * returned future is ready immediately. Otherwise the program is compiled by
+ * one of the background compiler threads (see detail::compiler_pool).
+ * Simultaneous requests for the same source share the same compilation. The
+ * loaded libraries are released by vex::purge_caches() once the kernels
+ * using them are destroyed.
+ */
+inline program_future build_sources_async(const command_queue &q,
+        const std::string &source, const std::string &options = ""
+        )
+{
+#ifdef VEXCL_SHOW_KERNELS
+    std::cout << source << std::endl;
+#else
+    if (getenv("VEXCL_SHOW_KERNELS"))
+        std::cout << source << std::endl;
+#endif
+
+    std::string compile_options = options + " " + get_compile_options(q);
+    std::string hash   = detail::program_hash(source, compile_options);
+
+    {
+        program p;
+        if (detail::bundle_registry<>::find(hash, source, compile_options, p)) {
+            std::promise<program> loaded;
+            loaded.set_value(p);
+            return loaded.get_future().share();
         }
     }
 
-    // Load the compiled shared library.
-    return boost::dll::shared_library(sofile);
+    typedef vex::detail::program_cache<program_future> cache;
+
+    {
+        program_future f;
+        if (cache::get().find(q, hash, f)) return f;
+    }
+
+    std::string sofile = detail::program_library(hash, true);
+
+    if ( boost::filesystem::exists(sofile) ) {
+        std::promise<program> loaded;
+        loaded.set_value(boost::dll::shared_library(sofile));
+
+        program_future f = loaded.get_future().share();
+        cache::get().insert(q, hash, f);
+        return f;
+    }
+
+    auto task = std::make_shared< std::packaged_task<program()> >(
+            [q, source, compile_options, sofile, hash]() {
+                try {
+                    auto start = std::chrono::high_resolution_clock::now();
+                    detail::compile_library(source, compile_options, sofile);
+                    vex::kernel_registry::compiled(hash,
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::high_resolution_clock::now() - start));
+                } catch(...) {
+                    // Failed compilations are not cached:
+                    cache::get().erase(q, hash);
+                    throw;
+                }
+
+                return boost::dll::shared_library(sofile);
+            });
+
+    program_future f = task->get_future().share();
+
+    // Another thread may have started the same compilation meanwhile:
+    if (!cache::get().insert(q, hash, f)) return f;
+
+    detail::compiler_pool::get().enqueue([task]() { (*task)(); });
+
+    return f;
+}
+
+/// Compile and load a program from source string.
+inline vex::backend::program build_sources(const command_queue &q,
+        const std::string &source, const std::string &options = ""
+        )
+{
+    return build_sources_async(q, source, options).get();
+}
+
+/// Compile the programs in background.
+/**
+ * May be used to warm up the offline kernel cache: the programs are compiled
+ * concurrently, and the following requests for the same sources (e.g. from
+ * kernel caches) either reuse the ongoing compilation or find the compiled
+ * library in the offline cache.
+ */
+inline std::vector<program_future> precompile(const command_queue &q,
+        const std::vector<std::string> &sources, const std::string &options = ""
+        )
+{
+    std::vector<program_future> programs;
+    programs.reserve(sources.size());
+
+    for(auto s = sources.begin(); s != sources.end(); ++s)
+        programs.push_back(build_sources_async(q, *s, options));
+
+    return programs;
 }
 
-} // namespace cuda
+} // namespace jit
 } // namespace backend
 } // namespace vex
 
@@ -32,70 +32,133 @@ THE SOFTWARE.
  */
 
 #include <string>
+#include <memory>
 #include <stdexcept>
 
 #include <boost/dll/shared_library.hpp>
 
+#include <vexcl/backend/jit/queue.hpp>
+#include <vexcl/backend/jit/topology.hpp>
+
 namespace vex {
 namespace backend {
 
 /// JIT backend with OpenMP support
 namespace jit {
 
+/// Compute device.
+/**
+ * By default, all host cores form a single device. VEXCL_JIT_DEVICES
+ * environment variable allows to split the cores into several devices (e.g.
+ * one per NUMA node, see detail::split_devices()), each with its own thread
+ * team and node-local memory, so that the multi-device partitioning of
+ * vectors and matrices is used on multi-socket hosts.
+ */
 struct device {
-    device(unsigned id = 0) {}
+    device(unsigned id = 0) : id(id) {}
 
     std::string name() const {
-        return "CPU";
+        return detail::devices()[id].name;
     }
 
+    unsigned id;
+
     // Took the constants from Intel OpenCL:
     size_t max_shared_memory_per_block() const { return 32768UL; }
     size_t max_threads_per_block()       const { return 1L; }
 };
 
-struct context {};
+struct context {
+    context(unsigned id = 0) : id(id) {}
 
-typedef unsigned command_queue_properties;
-
-struct command_queue {
-    void finish() const {}
+    unsigned id;
+};
 
-    vex::backend::context context() const {
-        return vex::backend::context();
-    }
+typedef unsigned command_queue_properties;
 
-    vex::backend::device device() const {
-        return vex::backend::device();
-    }
+/// Command queue.
+/**
+ * An in-order asynchronous queue. Kernels and memory transfers are executed
+ * by the queue's own host thread, so that the host, the transfers, and the
+ * kernels submitted to different queues may overlap. Copies of the
+ * command_queue object refer to the same queue.
+ */
+class command_queue {
+    public:
+        command_queue(unsigned device = 0)
+            : q(std::make_shared<detail::queue_impl>(detail::devices()[device].cpus)),
+              dev(device) {}
+
+        void finish() const {
+            q->finish();
+        }
+
+        vex::backend::context context() const {
+            return vex::backend::context(dev);
+        }
+
+        vex::backend::device device() const {
+            return vex::backend::device(dev);
+        }
+
+        detail::queue_impl& raw() const {
+            return *q;
+        }
+
+        const std::shared_ptr<detail::queue_impl>& raw_ptr() const {
+            return q;
+        }
+    private:
+        std::shared_ptr<detail::queue_impl> q;
+        unsigned dev;
 };
 
-typedef boost::dll::shared_library program;
+/// Compiled program.
+/**
+ * The program is a shared library with the kernel symbols. Programs from a
+ * kernel bundle share the same library, and the symbols of each program are
+ * distinguished by a prefix.
+ */
+class program : public boost::dll::shared_library {
+    public:
+        program() {}
+
+        program(const boost::dll::shared_library &lib, std::string prefix = "")
+            : boost::dll::shared_library(lib), prefix(std::move(prefix))
+        {}
+
+        /// Name of the exported symbol for the given kernel.
+        std::string symbol(const std::string &name) const {
+            return prefix + name;
+        }
+    private:
+        std::string prefix;
+};
 
 typedef unsigned device_id;
 
-inline device get_device(const command_queue&) {
-    return device();
+inline device get_device(const command_queue &q) {
+    return q.device();
 }
 
-inline device_id get_device_id(const command_queue&) {
-    return 0;
+inline device_id get_device_id(const command_queue &q) {
+    return q.device().id;
 }
 
 typedef unsigned context_id;
 
-inline context_id get_context_id(const command_queue&) {
-    return 0;
+inline context_id get_context_id(const command_queue &q) {
+    return q.context().id;
 }
 
-inline context get_context(const command_queue&) {
-    return context();
+inline context get_context(const command_queue &q) {
+    return q.context();
 }
 
 inline void select_context(const command_queue&) {}
 
 inline command_queue duplicate_queue(const command_queue &q) {
-    return command_queue();
+    return command_queue(q.device().id);
 }
 
 inline bool is_cpu(const command_queue &q) {
@@ -103,14 +166,14 @@ inline bool is_cpu(const command_queue &q) {
 }
 
 struct compare_contexts {
-    bool operator()(const context&, const context&) const {
-        return false;
+    bool operator()(const context &a, const context &b) const {
+        return a.id < b.id;
     }
 };
 
 struct compare_queues {
-    bool operator()(const command_queue&, const command_queue&) const {
-        return false;
+    bool operator()(const command_queue &a, const command_queue &b) const {
+        return a.raw_ptr() < b.raw_ptr();
     }
 };
 
@@ -118,8 +181,10 @@ template<class DevFilter>
 std::vector<device> device_list(DevFilter&& filter) {
     std::vector<device> dev;
 
-    device d;
-    if (filter(d)) dev.push_back(d);
+    for(unsigned id = 0; id < detail::devices().size(); ++id) {
+        device d(id);
+        if (filter(d)) dev.push_back(d);
+    }
 
     return dev;
 }
@@ -131,11 +196,13 @@ queue_list(DevFilter &&filter, unsigned queue_flags = 0)
     std::vector<context>       ctx;
     std::vector<command_queue> queue;
 
-    device d;
+    for(unsigned id = 0; id < detail::devices().size(); ++id) {
+        device d(id);
 
-    if (filter(d)) {
-        ctx.push_back(context());
-        queue.push_back(command_queue());
+        if (filter(d)) {
+            ctx.push_back(context(id));
+            queue.push_back(command_queue(id));
+        }
     }
 
     return std::make_pair(ctx, queue);
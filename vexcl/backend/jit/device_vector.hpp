@@ -32,6 +32,18 @@ THE SOFTWARE.
  */
 
 #include <vector>
+#include <memory>
+#include <new>
+#include <algorithm>
+#include <cstdlib>
+
+#ifndef _WIN32
+#  include <sys/mman.h>
+#endif
+
+#include <vexcl/backend/memory_pool.hpp>
+#include <vexcl/backend/jit/context.hpp>
+#include <vexcl/backend/jit/thread_pool.hpp>
 
 namespace vex {
 namespace backend {
@@ -44,14 +56,61 @@ static const mem_flags MEM_WRITE_ONLY = 2;
 static const mem_flags MEM_READ_WRITE = 4;
 
 namespace detail {
+
+/// Allocates aligned host memory for device buffers.
+/**
+ * Small buffers are aligned to the cache line, large ones to the page
+ * boundary. With VEXCL_JIT_HUGE_PAGES=1, buffers larger than a huge page are
+ * aligned to the huge page boundary and marked as eligible for transparent
+ * huge pages.
+ */
+inline unsigned char* allocate_bytes(size_t n) {
+    const size_t page = 4096;
+    const size_t huge_page = 2 * 1024 * 1024;
+
+    static const bool huge = std::atoi(getenv("VEXCL_JIT_HUGE_PAGES", "0")) != 0;
+
+    size_t align = 64;
+    if (n >= page) align = page;
+    if (huge && n >= huge_page) align = huge_page;
+
+    void *ptr = nullptr;
+#ifdef _WIN32
+    ptr = _aligned_malloc(std::max<size_t>(n, 1), align);
+#else
+    if (posix_memalign(&ptr, align, std::max<size_t>(n, 1))) ptr = nullptr;
+#endif
+    if (!ptr) throw std::bad_alloc();
+
+#ifdef MADV_HUGEPAGE
+    if (align == huge_page) madvise(ptr, n, MADV_HUGEPAGE);
+#endif
+
+    return static_cast<unsigned char*>(ptr);
+}
+
+struct aligned_free {
+    void operator()(unsigned char *ptr) const {
+#ifdef _WIN32
+        _aligned_free(ptr);
+#else
+        free(ptr);
+#endif
+    }
+};
+
 struct shared_bytes {
     shared_bytes() : size(0) {}
 
     shared_bytes(size_t n)
-        : data(std::shared_ptr<unsigned char>(new unsigned char[n], std::default_delete<unsigned char[]>())),
+        : data(std::shared_ptr<unsigned char>(allocate_bytes(n), aligned_free())),
           size(n)
     {}
 
+    shared_bytes(std::shared_ptr<unsigned char> data, size_t n)
+        : data(std::move(data)), size(n)
+    {}
+
     shared_bytes(const shared_bytes &c)
         : data(c.data), size(c.size)
     {}
@@ -67,6 +126,73 @@ struct shared_bytes {
     std::shared_ptr<unsigned char> data;
     size_t size;
 };
+
+/// Owner of the memory cached in the pool.
+inline vex::detail::memory_pool::key_type pool_key(const command_queue &q) {
+    return vex::detail::memory_pool::key_type(
+            q.raw_ptr().get(), &devices()[q.device().id]);
+}
+
+/// Allocates a buffer, possibly reusing the memory cached in the pool.
+inline shared_bytes allocate_buffer(const command_queue &q, size_t n) {
+    auto key = pool_key(q);
+    auto &pool = vex::detail::memory_pool::get();
+
+    if (!n || !pool.enabled(key)) return shared_bytes(n);
+
+    return shared_bytes(
+            std::static_pointer_cast<unsigned char>(
+                pool.allocate(key, 0, n, [](size_t m) {
+                    return std::shared_ptr<void>(allocate_bytes(m), aligned_free());
+                    })
+                ), n);
+}
+
+/// Initializes a freshly allocated buffer.
+/**
+ * The buffers larger than VEXCL_JIT_FIRST_TOUCH bytes (1MB by default) are
+ * initialized in parallel by the thread team of the queue's device. Each
+ * team member touches (or copies from the host) exactly the elements it will
+ * process in the grid-stride loops of the kernels, so that on NUMA systems
+ * every page is placed on the node of the core that streams it. The smaller
+ * buffers are initialized by the calling thread.
+ */
+template <typename T>
+void first_touch(const command_queue &q, shared_bytes &buf, const T *host) {
+    static const size_t min_size = std::stoul(getenv("VEXCL_JIT_FIRST_TOUCH", "1048576"));
+
+    T *ptr = buf.get<T>();
+    const size_t n = buf.size / sizeof(T);
+
+    if (buf.size < min_size) {
+        if (host) std::copy(host, host + n, ptr);
+        return;
+    }
+
+    thread_team &team = get_team(q);
+
+    size_t ticket = q.raw().enqueue([&team, ptr, n, host]() {
+            const size_t groups = team.num_workgroups();
+            const size_t chunk  = (n + groups - 1) / groups;
+
+            team.run([=](unsigned slot, unsigned nslots) {
+                // Same split as in thread_team::run() and grid_stride_loop():
+                size_t beg = std::min(n, chunk * (groups * slot / nslots));
+                size_t end = std::min(n, chunk * (groups * (slot + 1) / nslots));
+
+                if (host) {
+                    std::copy(host + beg, host + end, ptr + beg);
+                } else {
+                    const size_t stride = std::max<size_t>(1, 4096 / sizeof(T));
+                    char *p = reinterpret_cast<char*>(ptr);
+                    for(size_t i = beg; i < end; i += stride)
+                        p[i * sizeof(T)] = 0;
+                }
+                });
+            });
+
+    q.raw().wait(ticket);
+}
 } // namespace detail
 
 template <typename T>
@@ -79,9 +205,9 @@ class device_vector {
         device_vector() {}
 
         device_vector(const command_queue &q, size_t n, const T *host = 0, mem_flags = MEM_READ_WRITE)
-            : buffer(sizeof(T) * n)
+            : buffer(detail::allocate_buffer(q, sizeof(T) * n))
         {
-            if (host) std::copy(host, host + n, buffer.get<T>());
+            detail::first_touch(q, buffer, host);
         }
 
         device_vector(buffer_type buffer) : buffer(buffer) {}
@@ -91,14 +217,38 @@ class device_vector {
             return device_vector<U>(buffer);
         }
 
-        void write(const command_queue&, size_t offset, size_t size, const T *host, bool /*blocking*/ = false) const
+        void write(const command_queue &q, size_t offset, size_t size, const T *host, bool blocking = false) const
         {
-            std::copy(host, host + size, buffer.get<T>() + offset);
+            T *dst = buffer.get<T>() + offset;
+
+            if (copy_inline(q, size, blocking)) {
+                std::copy(host, host + size, dst);
+                return;
+            }
+
+            buffer_type keep = buffer;
+            size_t ticket = q.raw().enqueue([keep, host, size, dst]() {
+                    std::copy(host, host + size, dst);
+                    });
+
+            if (blocking) q.raw().wait(ticket);
         }
 
-        void read(const command_queue&, size_t offset, size_t size, T *host, bool /*blocking*/ = false) const
+        void read(const command_queue &q, size_t offset, size_t size, T *host, bool blocking = false) const
         {
-            std::copy_n(buffer.get<T>() + offset, size, host);
+            const T *src = buffer.get<T>() + offset;
+
+            if (copy_inline(q, size, blocking)) {
+                std::copy_n(src, size, host);
+                return;
+            }
+
+            buffer_type keep = buffer;
+            size_t ticket = q.raw().enqueue([keep, src, size, host]() {
+                    std::copy_n(src, size, host);
+                    });
+
+            if (blocking) q.raw().wait(ticket);
         }
 
         size_t size() const {
@@ -107,11 +257,13 @@ class device_vector {
 
         typedef T* mapped_array;
 
-        T* map(const command_queue&) {
+        T* map(const command_queue &q) {
+            q.finish();
             return buffer.data ? buffer.get<T>() : nullptr;
         }
 
-        T* map(const command_queue&) const {
+        T* map(const command_queue &q) const {
+            q.finish();
             return buffer.data ? buffer.get<T>() : nullptr;
         }
 
@@ -128,6 +280,12 @@ class device_vector {
         }
     private:
         mutable buffer_type buffer;
+
+        // Small transfers and the blocking ones are done by the calling
+        // thread, unless there are pending commands in the queue.
+        static bool copy_inline(const command_queue &q, size_t size, bool blocking) {
+            return q.raw().idle() && (blocking || size * sizeof(T) <= 65536);
+        }
 };
 
 } // namespace jit
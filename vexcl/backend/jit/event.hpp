@@ -28,53 +28,102 @@ THE SOFTWARE.
 /**
  * \file   vexcl/backend/jit/event.hpp
  * \author Denis Demidov <dennis.demidov@gmail.com>
- * \brief  Define dummy events for the JIT backend.
+ * \brief  Events for the JIT backend.
  */
 
+#include <vector>
+#include <memory>
+
 #include <vexcl/backend/jit/context.hpp>
 
 namespace vex {
 namespace backend {
 namespace jit {
 
-struct event {
-    event() {}
-    event(const command_queue&) {}
-    void wait() const {}
-    vex::backend::context context() const {
-        return vex::backend::context();
-    }
+/// Marker in a command queue.
+/**
+ * The event is complete when all the commands submitted to the queue before
+ * the event are complete.
+ */
+class event {
+    public:
+        event() : ticket(0), ctx(0) {}
+
+        event(const command_queue &q)
+            : q(q.raw_ptr()), ticket(q.raw().last()), ctx(q.context()) {}
+
+        event(const command_queue &q, size_t ticket)
+            : q(q.raw_ptr()), ticket(ticket), ctx(q.context()) {}
+
+        /// Blocks until the event is complete.
+        void wait() const {
+            if (q) q->wait(ticket);
+        }
+
+        bool complete() const {
+            return !q || q->complete(ticket);
+        }
+
+        vex::backend::context context() const {
+            return ctx;
+        }
+
+        /// Queue the event belongs to.
+        const detail::queue_impl* queue() const {
+            return q.get();
+        }
+    private:
+        std::shared_ptr<detail::queue_impl> q;
+        size_t ticket;
+        vex::backend::context ctx;
 };
 
-struct wait_list {
-    template <class... T>
-    wait_list(T&&... t) {}
-};
+typedef std::vector<event> wait_list;
 
 /// Append event to wait list
-inline void wait_list_append(wait_list&, const event&) { }
+inline void wait_list_append(wait_list &dst, const event &e) {
+    dst.push_back(e);
+}
 
 /// Append wait list to wait list
-inline void wait_list_append(wait_list&, const wait_list&) {}
+inline void wait_list_append(wait_list &dst, const wait_list &src) {
+    dst.insert(dst.end(), src.begin(), src.end());
+}
 
 /// Get id of the context the event was submitted into
 inline context_id get_context_id(const event&) {
     return 0;
 }
 
+/// Wait for events in the list
+inline void wait_for_events(const wait_list &events) {
+    for(auto e = events.begin(); e != events.end(); ++e)
+        e->wait();
+}
+
 /// Enqueue marker (with wait list) into the queue
-inline event enqueue_marker(const command_queue&, const wait_list& = wait_list()) {
-    return event();
+/**
+ * Commands submitted to the queue are executed in order, so the events from
+ * the same queue are satisfied automatically. When the list contains pending
+ * events from other queues, the queue waits for them before proceeding with
+ * the following commands.
+ */
+inline event enqueue_marker(const command_queue &q, const wait_list &events = wait_list()) {
+    wait_list foreign;
+
+    for(auto e = events.begin(); e != events.end(); ++e)
+        if (e->queue() != &q.raw() && !e->complete()) foreign.push_back(*e);
+
+    if (foreign.empty()) return event(q);
+
+    return event(q, q.raw().enqueue([foreign]() { wait_for_events(foreign); }));
 }
 
 /// Enqueue barrier (with wait list) into the queue
-inline event enqueue_barrier(command_queue&, const wait_list& = wait_list()) {
-    return event();
+inline event enqueue_barrier(command_queue &q, const wait_list &events = wait_list()) {
+    return enqueue_marker(q, events);
 }
 
-/// Wait for events in the list
-inline void wait_for_events(const wait_list&) {}
-
 } // namespace jit
 } // namespace backend
 } // namespace vex
@@ -0,0 +1,173 @@
+#ifndef VEXCL_BACKEND_JIT_GRAPH_HPP
+#define VEXCL_BACKEND_JIT_GRAPH_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2017 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/backend/jit/graph.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Capture and replay of JIT kernel launches.
+ */
+
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <utility>
+
+#include <vexcl/util.hpp>
+#include <vexcl/backend/jit/device_vector.hpp>
+#include <vexcl/backend/jit/kernel.hpp>
+
+namespace vex {
+namespace backend {
+namespace jit {
+
+/// A recorded sequence of kernel launches.
+/**
+ * A launch graph records the kernels launched by the current thread during
+ * capture() together with their arguments. replay() relaunches the recorded
+ * kernels in the same order and to the same queues, skipping everything the
+ * host normally does for an operation: expression traversals, kernel cache
+ * lookups, and argument setup:
+ * \code
+ * vex::backend::jit::launch_graph iteration;
+ * vex::device_scalar<double> rho;
+ *
+ * iteration.capture([&]() {
+ *     q = A * p;
+ *     rho = sum.async(p * q);
+ *     x += p / rho;
+ *     // ...
+ * });
+ *
+ * for(int i = 0; i < niters; ++i) iteration.replay();
+ * \endcode
+ *
+ * The operations are executed while they are captured. Only the kernel
+ * launches are recorded; host reads and writes, and the host parts of the
+ * operations (e.g. the final step of a vex::Reductor call that returns a
+ * host value) are not. Use vex::Reductor::async() to keep reductions on the
+ * device.
+ *
+ * The graph refers to the buffers that the kernels were launched with and
+ * keeps them alive. rebind() replaces a buffer in the recorded arguments
+ * with another buffer of the same size.
+ */
+class launch_graph : private detail::launch_recorder {
+    public:
+        launch_graph() {}
+
+        launch_graph(const launch_graph&) = delete;
+        launch_graph& operator=(const launch_graph&) = delete;
+
+        /// Executes the function and appends the kernels it launches to the graph.
+        template <class F>
+        void capture(F &&f) {
+            detail::launch_recorder *&current = detail::launch_recorder::current();
+
+            precondition(current != this, "Recursive capture of a launch graph");
+
+            detail::launch_recorder *prev = current;
+            current = this;
+
+            try {
+                f();
+            } catch(...) {
+                current = prev;
+                throw;
+            }
+
+            current = prev;
+        }
+
+        /// Relaunches the recorded kernels.
+        void replay() const {
+            for(auto l = launches.begin(); l != launches.end(); ++l)
+                detail::kernel_launch::submit(l->first, l->second);
+        }
+
+        /// Replaces a buffer in the arguments of the recorded kernels.
+        /**
+         * Returns the number of replaced arguments. The launches that are
+         * still in flight keep the old arguments.
+         */
+        template <typename T>
+        size_t rebind(const device_vector<T> &from, const device_vector<T> &to) {
+            precondition(from.size() == to.size(),
+                    "Rebound buffers should have the same size");
+
+            const T *old_ptr = from.raw();
+            const T *new_ptr = to.raw();
+
+            size_t count = 0;
+
+            for(auto l = launches.begin(); l != launches.end(); ++l) {
+                std::shared_ptr<detail::kernel_launch> copy;
+
+                for(size_t i = 0; i < l->second->pointers.size(); ++i) {
+                    size_t pos = l->second->pointers[i];
+
+                    if (std::memcmp(l->second->stack.data() + pos, &old_ptr, sizeof(old_ptr)))
+                        continue;
+
+                    // The arguments are copied on write, so that the
+                    // queued launches are not affected.
+                    if (!copy) copy = std::make_shared<detail::kernel_launch>(*l->second);
+
+                    std::memcpy(copy->stack.data() + pos, &new_ptr, sizeof(new_ptr));
+                    copy->buffers[i] = to.raw_buffer().data;
+                    ++count;
+                }
+
+                if (copy) l->second = copy;
+            }
+
+            return count;
+        }
+
+        /// Number of the recorded kernel launches.
+        size_t size() const {
+            return launches.size();
+        }
+
+        /// Removes the recorded launches.
+        void clear() {
+            launches.clear();
+        }
+    private:
+        std::vector<
+            std::pair<command_queue, std::shared_ptr<detail::kernel_launch> >
+            > launches;
+
+        void record(const command_queue &q, std::shared_ptr<detail::kernel_launch> l) {
+            launches.push_back(std::make_pair(q, l));
+        }
+};
+
+} // namespace jit
+} // namespace backend
+} // namespace vex
+
+#endif
@@ -32,14 +32,16 @@ THE SOFTWARE.
  */
 
 #include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
 #include <boost/dll/import.hpp>
 
-#ifdef _OPENMP
-#  include <omp.h>
-#endif
-
 #include <vexcl/util.hpp>
+#include <vexcl/kernel_registry.hpp>
 #include <vexcl/backend/jit/compiler.hpp>
+#include <vexcl/backend/jit/thread_pool.hpp>
 
 namespace vex {
 namespace backend {
@@ -47,14 +49,88 @@ namespace jit {
 
 namespace detail {
 
-struct kernel_api {
-    virtual void execute(
-            const ndrange *dim, size_t smem_size, char *prm
-            ) const = 0;
+// Executes the kernel and updates its statistics in vex::kernel_registry.
+inline void execute(thread_team &team, const kernel_api *K, const ndrange &grid,
+        size_t smem_size, char *stack, vex::detail::kernel_stats *stats)
+{
+    if (!stats) {
+        team.run(K, grid, smem_size, stack);
+        return;
+    }
+
+    size_t n = K->size_hint(stack);
+    stats->launched(n == static_cast<size_t>(-1) ? 0 : n);
+
+    if (vex::kernel_registry::profiling()) {
+        auto start = std::chrono::high_resolution_clock::now();
+        team.run(K, grid, smem_size, stack);
+        stats->ran(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::high_resolution_clock::now() - start));
+    } else {
+        team.run(K, grid, smem_size, stack);
+    }
+}
+
+// A kernel launch with its arguments (see jit::launch_graph).
+struct kernel_launch {
+    boost::shared_ptr<kernel_api> K;
+    ndrange grid;
+    size_t smem_size;
+    std::vector<char> stack;
+    std::shared_ptr<vex::detail::kernel_stats> stats;
+
+    // Buffers referenced by the arguments, and the offsets of the
+    // corresponding pointers in the argument stack.
+    std::vector< std::shared_ptr<void> > buffers;
+    std::vector<size_t> pointers;
+
+    kernel_launch(boost::shared_ptr<kernel_api> K, ndrange grid,
+            size_t smem_size, std::vector<char> &stack,
+            std::shared_ptr<vex::detail::kernel_stats> stats)
+        : K(K), grid(grid), smem_size(smem_size), stats(stats)
+    {
+        this->stack.swap(stack);
+    }
+
+    // Small launches submitted to an idle queue are executed right away,
+    // the rest are executed by the queue's thread.
+    static void submit(const command_queue &q, std::shared_ptr<kernel_launch> l) {
+        queue_impl  &queue = q.raw();
+        thread_team &team  = get_team(q);
+
+        if (queue.idle() && l->K->size_hint(l->stack.data()) < thread_team::serial_size()) {
+            execute(team, l->K.get(), l->grid, l->smem_size, l->stack.data(), l->stats.get());
+        } else {
+            queue.enqueue([l, &team]() {
+                    execute(team, l->K.get(), l->grid, l->smem_size, l->stack.data(), l->stats.get());
+                    });
+        }
+    }
+};
+
+// Receives the kernel launches made by the current thread while a launch
+// graph is being captured.
+struct launch_recorder {
+    virtual ~launch_recorder() {}
+
+    virtual void record(const command_queue &q, std::shared_ptr<kernel_launch> l) = 0;
+
+    static launch_recorder*& current() {
+        static thread_local launch_recorder *r = nullptr;
+        return r;
+    }
 };
 
 } // namespace detail
 
+/// Compute kernel.
+/**
+ * The kernel objects are shared between host threads (e.g. the kernels in
+ * the static kernel caches), so the arguments and the launch configuration
+ * of a call are collected in an argument pack private to the calling thread.
+ * Concurrent launches of the same kernel from several threads never see each
+ * other's arguments.
+ */
 class kernel {
     public:
         kernel() : smem_size(0) {}
@@ -65,71 +141,115 @@ class kernel {
                 size_t smem_per_thread = 0,
                 const std::string &options = ""
               )
-            : K(boost::dll::import<detail::kernel_api>(build_sources(q, src, options), name)),
+            : S(make_symbol(q, src, name, options)),
               grid(num_workgroups(q)), smem_size(smem_per_thread)
-        {
-            stack.reserve(256);
-        }
+        {}
 
         kernel(const command_queue &q,
                const std::string &src, const std::string &name,
                std::function<size_t(size_t)> smem,
                const std::string &options = ""
                )
-            : K(boost::dll::import<detail::kernel_api>(build_sources(q, src, options), name)),
+            : S(make_symbol(q, src, name, options)),
               grid(num_workgroups(q)), smem_size(smem(1))
-        {
-            stack.reserve(256);
-        }
+        {}
 
         kernel(const command_queue &q,
                const program &P,
                const std::string &name,
                size_t smem_per_thread = 0
                )
-            : K(boost::dll::import<detail::kernel_api>(P, name)),
+            : S(std::make_shared<symbol>(P, name)),
               grid(num_workgroups(q)), smem_size(smem_per_thread)
-        {
-            stack.reserve(256);
-        }
+        {}
 
         /// Constructor. Extracts a backend::kernel instance from backend::program.
         kernel(const command_queue &q, const program &P,
                const std::string &name,
                std::function<size_t(size_t)> smem
                )
-            : K(boost::dll::import<detail::kernel_api>(P, name)),
+            : S(std::make_shared<symbol>(P, name)),
               grid(num_workgroups(q)), smem_size(smem(1))
-        {
-            stack.reserve(256);
+        {}
+
+        kernel(const kernel &k) : S(k.S), grid(k.grid), smem_size(k.smem_size) {
+            copy_args(k);
+        }
+
+        kernel& operator=(const kernel &k) {
+            if (this != &k) {
+                release_args();
+                S = k.S;
+                grid = k.grid;
+                smem_size = k.smem_size;
+                copy_args(k);
+            }
+            return *this;
+        }
+
+        ~kernel() {
+            release_args();
         }
 
         template <class Arg>
         void push_arg(const Arg &arg) {
             char *c = (char*)&arg;
+            std::vector<char> &stack = args().stack;
             stack.insert(stack.end(), c, c + sizeof(arg));
         }
 
         template <typename T>
         void push_arg(const device_vector<T> &arg) {
+            arg_pack &a = args();
+            a.pointers.push_back(a.stack.size());
+            a.buffers.push_back(arg.raw_buffer().data);
             push_arg(arg.raw());
         }
 
         void set_smem(size_t smem_per_thread) {
             smem_size = smem_per_thread;
+
+            arg_pack &a = args();
+            a.smem_size = smem_per_thread;
+            a.own_smem  = true;
         }
 
         template <class F>
         void set_smem(F &&f) {
-            smem_size = f(1);
+            set_smem(f(1));
         }
 
-        void operator()(const command_queue&) {
-            // All parameters have been pushed; time to call the kernel:
-            K->execute(&grid, smem_size, stack.data());
+        void operator()(const command_queue &q) {
+            // The kernel is being compiled in background; wait for it:
+            const boost::shared_ptr<detail::kernel_api> &K = S->get();
+
+            // All parameters have been pushed; time to call the kernel.
+            // Small kernels submitted to an idle queue are executed right
+            // away, the rest are executed by the queue's thread.
+            arg_pack &a = args();
+
+            const ndrange g = a.own_grid ? a.grid      : grid;
+            const size_t  s = a.own_smem ? a.smem_size : smem_size;
+
+            detail::queue_impl  &queue = q.raw();
+            detail::thread_team &team  = detail::get_team(q);
+
+            detail::launch_recorder *recorder = detail::launch_recorder::current();
+
+            if (!recorder && queue.idle() && K->size_hint(a.stack.data()) < detail::thread_team::serial_size()) {
+                detail::execute(team, K.get(), g, s, a.stack.data(), S->stats.get());
+            } else {
+                auto l = std::make_shared<detail::kernel_launch>(K, g, s, a.stack, S->stats);
+                l->buffers.swap(a.buffers);
+                l->pointers.swap(a.pointers);
+
+                if (recorder) recorder->record(q, l);
+
+                detail::kernel_launch::submit(q, l);
+            }
 
             // Reset parameter stack:
-            stack.clear();
+            release_args();
         }
 
 #ifndef BOOST_NO_VARIADIC_TEMPLATES
@@ -143,12 +263,8 @@ class kernel {
             return 1UL;
         }
 
-        static inline size_t num_workgroups(const command_queue&) {
-#ifdef _OPENMP
-            return omp_get_num_procs() * 8;
-#else
-            return 1UL;
-#endif
+        static inline size_t num_workgroups(const command_queue &q) {
+            return detail::get_team(q).num_workgroups();
         }
 
         size_t max_threads_per_block(const command_queue&) const {
@@ -167,9 +283,22 @@ class kernel {
             return config(num_workgroups(q), 1);
         }
 
+        /// Sets the launch configuration.
+        /**
+         * The configuration applies to the next launch from the calling
+         * thread, and becomes the default for the launches that are not
+         * configured explicitly. The kernels shared between threads should
+         * either be configured once before they are shared, or before each
+         * launch.
+         */
         kernel& config(ndrange blocks, ndrange threads) {
             precondition(threads == ndrange(), "Maximum workgroup size for the JIT backend is 1");
             grid = blocks;
+
+            arg_pack &a = args();
+            a.grid     = blocks;
+            a.own_grid = true;
+
             return *this;
         }
 
@@ -179,13 +308,142 @@ class kernel {
         }
 
         void reset() {
-            stack.clear();
+            release_args();
+        }
+
+        /// Waits for the kernel compilation to finish.
+        void wait() {
+            S->get();
+        }
+
+        /// Returns the entry of the kernel in vex::kernel_registry.
+        /**
+         * Only the kernels built from source are registered.
+         */
+        std::shared_ptr<vex::detail::kernel_stats> statistics() const {
+            return S ? S->stats : std::shared_ptr<vex::detail::kernel_stats>();
         }
     private:
-        boost::shared_ptr<detail::kernel_api> K;
+        // The compiled kernel. Shared between the copies of the kernel
+        // object, and resolved once the background compilation completes.
+        struct symbol {
+            program_future P;
+            std::string name;
+            boost::shared_ptr<detail::kernel_api> K;
+            std::shared_ptr<vex::detail::kernel_stats> stats;
+            std::once_flag resolved;
+
+            symbol(program_future P, const std::string &name)
+                : P(std::move(P)), name(name) {}
+
+            symbol(const program &p, const std::string &name)
+                : K(boost::dll::import<detail::kernel_api>(p, p.symbol(name)))
+            {
+                std::call_once(resolved, []{});
+            }
+
+            const boost::shared_ptr<detail::kernel_api>& get() {
+                std::call_once(resolved, [this]() {
+                        const program &p = P.get();
+                        K = boost::dll::import<detail::kernel_api>(p, p.symbol(name));
+                        P = program_future();
+                        });
+                return K;
+            }
+        };
+
+        // The kernel is entered into the registry before its compilation
+        // starts, so that the compile time is attributed to it.
+        static std::shared_ptr<symbol> make_symbol(const command_queue &q,
+                const std::string &src, const std::string &name,
+                const std::string &options)
+        {
+            auto stats = vex::kernel_registry::acquire(
+                    detail::program_hash(q, src, options), name);
+
+            auto s = std::make_shared<symbol>(build_sources_async(q, src, options), name);
+            s->stats = stats;
+            return s;
+        }
+
+        // Arguments of a kernel call being prepared by the current thread.
+        struct arg_pack {
+            const kernel *owner;
+            std::vector<char> stack;
+
+            // Buffers referenced by the kernel arguments are kept alive
+            // until the kernel is executed.
+            std::vector< std::shared_ptr<void> > buffers;
+            std::vector<size_t> pointers;
+
+            ndrange grid;
+            size_t  smem_size;
+            bool    own_grid;
+            bool    own_smem;
+
+            arg_pack() : owner(nullptr), smem_size(0), own_grid(false), own_smem(false) {
+                stack.reserve(256);
+            }
+        };
+
+        std::shared_ptr<symbol> S;
         ndrange grid;
-        std::vector<char> stack;
         size_t smem_size;
+
+        // Argument packs of the current thread. There is usually at most
+        // one pack in use at a time; the released packs are reused.
+        static std::vector< std::unique_ptr<arg_pack> >& thread_packs() {
+            static thread_local std::vector< std::unique_ptr<arg_pack> > packs;
+            return packs;
+        }
+
+        arg_pack* pending_args() const {
+            for(auto &p : thread_packs())
+                if (p->owner == this) return p.get();
+            return nullptr;
+        }
+
+        // The arguments pushed to a kernel by the current thread are copied
+        // along with the kernel.
+        void copy_args(const kernel &k) {
+            if (const arg_pack *src = k.pending_args()) {
+                arg_pack &dst = args();
+                dst = *src;
+                dst.owner = this;
+            }
+        }
+
+        arg_pack& args() const {
+            if (arg_pack *a = pending_args()) return *a;
+
+            auto &packs = thread_packs();
+
+            arg_pack *free = nullptr;
+            for(auto &p : packs) {
+                if (!p->owner) { free = p.get(); break; }
+            }
+
+            if (!free) {
+                packs.emplace_back(new arg_pack());
+                free = packs.back().get();
+            }
+
+            free->owner = this;
+            return *free;
+        }
+
+        void release_args() const {
+            if (arg_pack *p = pending_args()) {
+                p->owner = nullptr;
+                p->stack.clear();
+                p->buffers.clear();
+                p->pointers.clear();
+                p->own_grid = false;
+                p->own_smem = false;
+
+                if (p->stack.capacity() < 256) p->stack.reserve(256);
+            }
+        }
 };
 
 } // namespace jit
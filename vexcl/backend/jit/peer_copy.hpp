@@ -0,0 +1,99 @@
+#ifndef VEXCL_BACKEND_JIT_PEER_COPY_HPP
+#define VEXCL_BACKEND_JIT_PEER_COPY_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2017 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/backend/jit/peer_copy.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Copies between the device vectors on different devices.
+ */
+
+#include <algorithm>
+
+#include <vexcl/backend/jit/context.hpp>
+#include <vexcl/backend/jit/device_vector.hpp>
+#include <vexcl/backend/jit/event.hpp>
+
+namespace vex {
+namespace backend {
+namespace jit {
+
+/// Checks if the data may be copied between the devices without host staging.
+/**
+ * All JIT devices share the host memory.
+ */
+inline bool peer_access(const command_queue&, const command_queue&) {
+    return true;
+}
+
+/// Copies data between device vectors that may reside on different devices.
+/**
+ * The copy is submitted to src_q and starts after the commands already
+ * submitted to both src_q and dst_q are complete; dst may be used once both
+ * queues are finished. The JIT devices share the host memory, so this is a plain
+ * memcpy done by the thread of src_q.
+ */
+template <typename T>
+void copy_peer(
+        const command_queue &src_q, const device_vector<T> &src, size_t src_offset,
+        const command_queue &dst_q, const device_vector<T> &dst, size_t dst_offset,
+        size_t size
+        )
+{
+    if (!size) return;
+
+    detail::shared_bytes s = src.raw_buffer();
+    detail::shared_bytes d = dst.raw_buffer();
+
+    auto copy = [s, d, src_offset, dst_offset, size]() mutable {
+        std::copy_n(s.get<T>() + src_offset, size, d.get<T>() + dst_offset);
+    };
+
+    bool same_queue = &src_q.raw() == &dst_q.raw();
+    bool dst_idle   = same_queue || dst_q.raw().idle();
+
+    // Small transfers between the idle queues are done by the calling thread.
+    if (dst_idle && src_q.raw().idle() && size * sizeof(T) <= 65536) {
+        copy();
+        return;
+    }
+
+    if (dst_idle) {
+        src_q.raw().enqueue(copy);
+    } else {
+        event ready(dst_q);
+        src_q.raw().enqueue([ready, copy]() mutable {
+                ready.wait();
+                copy();
+                });
+    }
+}
+
+} // namespace jit
+} // namespace backend
+} // namespace vex
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef VEXCL_BACKEND_JIT_QUEUE_HPP
+#define VEXCL_BACKEND_JIT_QUEUE_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2017 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/backend/jit/queue.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  In-order asynchronous command queue for the JIT backend.
+ */
+
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <cstdlib>
+#include <functional>
+#include <boost/thread.hpp>
+
+#ifdef __linux__
+#  include <pthread.h>
+#  include <sched.h>
+#endif
+
+#include <vexcl/util.hpp>
+
+namespace vex {
+namespace backend {
+namespace jit {
+namespace detail {
+
+class thread_team;
+
+/// In-order queue of commands executed by a dedicated host thread.
+/**
+ * Every enqueued command gets a ticket (its sequence number). Since the
+ * commands are executed in order, the command is complete once the number of
+ * completed commands reaches its ticket. The worker thread is only started
+ * when the first command is enqueued, and is bound to the given set of cores
+ * (the cores of the queue's device) unless VEXCL_JIT_PIN=0.
+ */
+class queue_impl {
+    public:
+        queue_impl(const std::vector<int> &cpus = std::vector<int>())
+            : submitted(0), completed(0), failed(false), stop(false),
+              cpus(cpus), thread_team_ptr(nullptr) {}
+
+        ~queue_impl() {
+            {
+                boost::lock_guard<boost::mutex> lock(mx);
+                stop = true;
+            }
+            cond.notify_all();
+            if (worker) worker->join();
+        }
+
+        queue_impl(const queue_impl&) = delete;
+        queue_impl& operator=(const queue_impl&) = delete;
+
+        /// Enqueues the command and returns its ticket.
+        size_t enqueue(std::function<void()> cmd) {
+            boost::lock_guard<boost::mutex> lock(mx);
+
+            if (!worker) start();
+
+            tasks.push_back(std::move(cmd));
+            size_t ticket = ++submitted;
+
+            cond.notify_one();
+            return ticket;
+        }
+
+        /// Ticket of the last enqueued command.
+        size_t last() const {
+            return submitted.load();
+        }
+
+        /// True if the queue has no pending commands.
+        /**
+         * Commands submitted to an idle queue may be executed right away by
+         * the calling thread without breaking the order of execution.
+         */
+        bool idle() const {
+            return completed.load() == submitted.load();
+        }
+
+        /// True if the command with the given ticket is complete.
+        bool complete(size_t ticket) const {
+            return completed.load() >= ticket;
+        }
+
+        /// Blocks until the command with the given ticket is complete.
+        void wait(size_t ticket) {
+            if (!complete(ticket)) {
+                boost::unique_lock<boost::mutex> lock(mx);
+                while(completed.load() < ticket) done.wait(lock);
+            }
+
+            rethrow();
+        }
+
+        /// Blocks until all enqueued commands are complete.
+        void finish() {
+            wait(last());
+        }
+
+        /// Cached thread team of the queue's device (see detail::get_team()).
+        thread_team* team() const {
+            return thread_team_ptr.load(std::memory_order_acquire);
+        }
+
+        void team(thread_team *t) {
+            thread_team_ptr.store(t, std::memory_order_release);
+        }
+    private:
+        std::atomic<size_t> submitted;
+        std::atomic<size_t> completed;
+        std::atomic<bool>   failed;
+        bool stop;
+
+        boost::mutex mx;
+        boost::condition_variable cond, done;
+        std::deque< std::function<void()> > tasks;
+        std::unique_ptr<boost::thread> worker;
+
+        std::exception_ptr error;
+
+        std::vector<int> cpus;
+
+        std::atomic<thread_team*> thread_team_ptr;
+
+        void start() {
+            worker.reset(new boost::thread([this]() { this->work(); }));
+
+#ifdef __linux__
+            if (!cpus.empty() && std::atoi(getenv("VEXCL_JIT_PIN", "1"))) {
+                cpu_set_t mask;
+                CPU_ZERO(&mask);
+                for(int c : cpus) CPU_SET(c, &mask);
+                pthread_setaffinity_np(worker->native_handle(), sizeof(mask), &mask);
+            }
+#endif
+        }
+
+        // Errors are reported to the host on the next synchronization.
+        void rethrow() {
+            if (!failed.load()) return;
+
+            boost::lock_guard<boost::mutex> lock(mx);
+            if (error) {
+                std::exception_ptr e = error;
+                error = std::exception_ptr();
+                failed = false;
+                std::rethrow_exception(e);
+            }
+        }
+
+        void work() {
+            boost::unique_lock<boost::mutex> lock(mx);
+
+            while(true) {
+                while(!stop && tasks.empty()) cond.wait(lock);
+                if (tasks.empty()) return;
+
+                std::function<void()> cmd = std::move(tasks.front());
+                tasks.pop_front();
+
+                lock.unlock();
+
+                std::exception_ptr e;
+                try {
+                    cmd();
+                } catch(...) {
+                    e = std::current_exception();
+                }
+                cmd = std::function<void()>();
+
+                lock.lock();
+
+                if (e && !error) {
+                    error  = e;
+                    failed = true;
+                }
+
+                ++completed;
+                done.notify_all();
+            }
+        }
+};
+
+} // namespace detail
+} // namespace jit
+} // namespace backend
+} // namespace vex
+
+#endif
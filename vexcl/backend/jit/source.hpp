@@ -32,6 +32,8 @@ THE SOFTWARE.
  */
 
 #include <map>
+#include <vector>
+#include <utility>
 #include <string>
 #include <iostream>
 #include <sstream>
@@ -189,12 +191,25 @@ T atomic_sub(T *p, T val) {
 }
 
 struct kernel_api {
-    virtual void execute(const ndrange*, size_t, char*) const = 0;
+    virtual void execute(const ndrange*, const ndrange*, char*, char*) const = 0;
+    virtual size_t size_hint(char*) const = 0;
 };
 
 #define KERNEL_PARAMETER(type, name) \
     type name = *reinterpret_cast<type*>(_p); _p+= sizeof(type)
 
+// Pointer parameter of an element-wise kernel. Device buffers are aligned at
+// least to the cache line. The parameters are not restrict: the same buffer
+// may be passed as several terminals of an expression (as in x = x + y).
+#define KERNEL_POINTER_PARAMETER(type, name) \
+    type name = static_cast<type>( \
+        __builtin_assume_aligned(*reinterpret_cast<type*>(_p), 64)); \
+    _p+= sizeof(type)
+
+#ifndef VEXCL_JIT_KERNEL_SYMBOL
+#  define VEXCL_JIT_KERNEL_SYMBOL(name) name
+#endif
+
 )") + get_program_header(q);
 }
 
@@ -211,12 +226,20 @@ class source_generator {
 
         std::ostringstream src;
 
+        std::string kernel_name;
+        std::string size_bound;
+        std::vector< std::pair<std::string, std::string> > kernel_prm;
+
+        // Position of the kernel parameter declarations in the source.
+        std::streamoff prm_begin, prm_end;
+
     public:
-        source_generator() : indent(0), first_prm(true), prm_state(undefined)
+        source_generator()
+            : indent(0), first_prm(true), prm_state(undefined), prm_begin(-1), prm_end(-1)
         { }
 
         source_generator(const command_queue &q, bool include_standard_header = true)
-            : indent(0), first_prm(true), prm_state(undefined)
+            : indent(0), first_prm(true), prm_state(undefined), prm_begin(-1), prm_end(-1)
         {
             if (include_standard_header) src << standard_kernel_header(q);
         }
@@ -266,35 +289,48 @@ class source_generator {
         }
 
         source_generator& begin_kernel(const std::string &name) {
+            kernel_name = name;
+            kernel_prm.clear();
+            size_bound.clear();
+            prm_begin = prm_end = -1;
+
             new_line() << "struct " << name << "_t : public kernel_api"; open("{");
-            new_line() << "void work(const ndrange*, const ndrange*, char*, char*) const;";
-            new_line() << "void execute(const ndrange *dim, size_t smem_size, char *prm) const"; open("{");
-            new_line() << "std::vector<char> smem(smem_size);";
-            new_line() << "#pragma omp parallel for collapse(3) firstprivate(smem)";
-            new_line() << "for(size_t id_z = 0; id_z < dim->z; ++id_z)"; open("{");
-            new_line() << "for(size_t id_y = 0; id_y < dim->y; ++id_y)"; open("{");
-            new_line() << "for(size_t id_x = 0; id_x < dim->x; ++id_x)"; open("{");
-            new_line() << "ndrange id = {id_x, id_y, id_z};";
-            new_line() << "work(dim, &id, smem.data(), prm);";
-            close("}").close("}").close("}").close("}").close("};");
-            new_line() << "extern \"C\" BOOST_SYMBOL_EXPORT " << name << "_t " << name << ";";
-            new_line() << name << "_t " << name << ";";
-            new_line() << "void " << name << "_t::work(const ndrange *_dim, const ndrange *_id, char *_smem, char *_p) const";
+            new_line() << "void execute(const ndrange*, const ndrange*, char*, char*) const;";
+            new_line() << "size_t size_hint(char*) const;";
+            close("};");
+            new_line() << "extern \"C\" BOOST_SYMBOL_EXPORT " << name << "_t VEXCL_JIT_KERNEL_SYMBOL(" << name << ");";
+            new_line() << name << "_t VEXCL_JIT_KERNEL_SYMBOL(" << name << ");";
+            new_line() << "void " << name << "_t::execute(const ndrange *_dim, const ndrange *_id, char *_smem, char *_p) const";
             open("{");
             return *this;
         }
 
         source_generator& begin_kernel_parameters() {
             prm_state = inside_kernel;
+            prm_begin = src.tellp();
             return *this;
         }
 
         source_generator& end_kernel_parameters() {
             prm_state = undefined;
+            prm_end = src.tellp();
             return *this;
         }
 
         source_generator& end_kernel() {
+            close("}");
+
+            // The problem size lets the host run small kernels serially.
+            new_line() << "size_t " << kernel_name << "_t::size_hint(char *_p) const";
+            open("{");
+            for(auto p = kernel_prm.begin(); p != kernel_prm.end(); ++p) {
+                if (p->second == size_bound) {
+                    new_line() << "return static_cast<size_t>(*reinterpret_cast<" << p->first << "*>(_p));";
+                    return close("}");
+                }
+                new_line() << "_p += sizeof(" << p->first << ");";
+            }
+            new_line() << "return static_cast<size_t>(-1);";
             return close("}");
         }
 
@@ -331,6 +367,8 @@ class source_generator {
                 const std::string &idx = "idx", const std::string &bnd = "n"
                 )
         {
+            if (size_bound.empty()) size_bound = bnd;
+
             new_line() << "size_t chunk_size = (" << bnd << " + " << global_size(0) << " - 1) / " << global_size(0) << ";";
             new_line() << "size_t chunk_start = chunk_size * " << global_id(0) << ";";
             new_line() << "size_t chunk_end = chunk_start + chunk_size;";
@@ -340,6 +378,60 @@ class source_generator {
             return *this;
         }
 
+        /// Loop over the elements of an element-wise kernel.
+        /**
+         * Same as grid_stride_loop(), but the loop iterations are known to be
+         * independent (as in any vector expression), and the loop is
+         * generated so that the compiler could vectorize it: when the loop
+         * directly follows the kernel parameters, pointer parameters are
+         * declared aligned, and the loop is marked with "omp simd" pragma
+         * (which also tells the compiler not to check the pointers for
+         * aliasing). VEXCL_JIT_SIMD=0 disables the hints.
+         * VEXCL_JIT_UNROLL=n asks the compiler to unroll the loop n times
+         * instead (GCC does not allow to combine the two pragmas).
+         */
+        source_generator& elementwise_loop(
+                const std::string &idx = "idx", const std::string &bnd = "n"
+                )
+        {
+            static const bool simd   = getenv_int("VEXCL_JIT_SIMD", 1) != 0;
+            static const long unroll = getenv_int("VEXCL_JIT_UNROLL", 0);
+
+            if (!simd) return grid_stride_loop(idx, bnd);
+
+            // Terminals of an expression may only alias each other at the
+            // same index (as in x = x + y), so the iterations are still
+            // independent.
+            if (prm_end >= 0 && src.tellp() == prm_end) {
+                std::string s = src.str();
+                s.resize(static_cast<size_t>(prm_begin));
+                src.str(s);
+                src.seekp(0, std::ios_base::end);
+
+                for(auto p = kernel_prm.begin(); p != kernel_prm.end(); ++p)
+                    new_line() << (is_pointer(p->first) ? "KERNEL_POINTER_PARAMETER(" : "KERNEL_PARAMETER(")
+                        << p->first << ", " << p->second << ");";
+
+                prm_end = src.tellp();
+            }
+
+            if (size_bound.empty()) size_bound = bnd;
+
+            new_line() << "size_t chunk_size = (" << bnd << " + " << global_size(0) << " - 1) / " << global_size(0) << ";";
+            new_line() << "size_t chunk_start = chunk_size * " << global_id(0) << ";";
+            new_line() << "size_t chunk_end = chunk_start + chunk_size;";
+            new_line() << "if (" << bnd << " < chunk_end) chunk_end = " << bnd << ";";
+            if (unroll > 1) {
+                new_line() << "#pragma GCC ivdep";
+                new_line() << "#pragma GCC unroll " << unroll;
+            } else {
+                new_line() << "#pragma omp simd";
+            }
+            new_line() << "for(size_t " << idx << " = chunk_start; " << idx << " < chunk_end; ++" << idx << ")";
+
+            return *this;
+        }
+
         std::string global_id(int d) const {
             const char dim[] = {'x', 'y', 'z'};
             std::ostringstream s;
@@ -405,7 +497,12 @@ class source_generator {
             return *this;
         }
 
+        static bool is_pointer(const std::string &type) {
+            return !type.empty() && type[type.size() - 1] == '*';
+        }
+
         source_generator& kernel_parameter(const std::string &prm_type, const std::string &name) {
+            kernel_prm.push_back(std::make_pair(prm_type, name));
             new_line() << "KERNEL_PARAMETER(" << prm_type << ", " << name << ");";
             return *this;
         }
@@ -0,0 +1,320 @@
+#ifndef VEXCL_BACKEND_JIT_THREAD_POOL_HPP
+#define VEXCL_BACKEND_JIT_THREAD_POOL_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2017 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/backend/jit/thread_pool.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Persistent thread team executing JIT kernels.
+ */
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <cstdlib>
+#include <boost/thread.hpp>
+
+#ifdef __linux__
+#  include <pthread.h>
+#  include <sched.h>
+#endif
+
+#include <vexcl/util.hpp>
+#include <vexcl/backend/jit/context.hpp>
+#include <vexcl/backend/jit/topology.hpp>
+
+namespace vex {
+namespace backend {
+namespace jit {
+namespace detail {
+
+/// Interface of the compiled kernels.
+/**
+ * Should match the kernel_api struct in the standard kernel header.
+ */
+struct kernel_api {
+    /// Executes single work-group with the given id.
+    virtual void execute(
+            const ndrange *dim, const ndrange *id, char *smem, char *prm
+            ) const = 0;
+
+    /// Size of the problem (upper bound of the grid-stride loop).
+    /** Returns size_t(-1) when unknown. */
+    virtual size_t size_hint(char *prm) const = 0;
+};
+
+/// Busy-wait step. Yields the core once in a while in case it is oversubscribed.
+inline void cpu_relax(unsigned spin) {
+    if (spin % 64 == 63) {
+        boost::this_thread::yield();
+    } else {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+}
+
+/// Scratch (shared) memory of the current thread.
+inline std::vector<char>& thread_scratch() {
+    static thread_local std::vector<char> smem;
+    return smem;
+}
+
+/// Whether the current thread is a member of a thread team.
+inline bool& inside_team() {
+    static thread_local bool inside = false;
+    return inside;
+}
+
+/// Team of persistent worker threads.
+/**
+ * Kernel work-groups are distributed between the team members with a static
+ * contiguous schedule. The thread that launches the kernel takes the first
+ * share of the work itself, the rest is picked up by the workers. The workers
+ * are pinned to CPU cores (unless VEXCL_JIT_PIN=0) and spin for a while
+ * before going to sleep between the launches. The number of threads is
+ * controlled with VEXCL_JIT_THREADS and defaults to the number of the
+ * available cores. Each JIT device (see detail::devices()) has its own team
+ * pinned to the cores of the device.
+ *
+ * Kernels with the problem size below VEXCL_JIT_SERIAL_SIZE (4096 by
+ * default) are executed on the launching thread alone.
+ */
+class thread_team {
+    public:
+        explicit thread_team(const std::vector<int> &cpus)
+            : nthreads(std::max<unsigned>(1, static_cast<unsigned>(cpus.size()))),
+              epoch(0), done(0), sleeping(0), stop(false)
+        {
+            bool pin = std::atoi(getenv("VEXCL_JIT_PIN", "1")) != 0;
+
+            for(unsigned i = 1; i < nthreads; ++i) {
+                workers.emplace_back(new boost::thread([this, i]() { this->work(i); }));
+#ifdef __linux__
+                if (pin) {
+                    cpu_set_t mask;
+                    CPU_ZERO(&mask);
+                    CPU_SET(cpus[i], &mask);
+                    pthread_setaffinity_np(workers.back()->native_handle(), sizeof(mask), &mask);
+                }
+#else
+                (void)pin;
+#endif
+            }
+        }
+
+        ~thread_team() {
+            {
+                boost::lock_guard<boost::mutex> lock(mx);
+                stop = true;
+                epoch.fetch_add(1);
+                cond.notify_all();
+            }
+
+            for(auto w = workers.begin(); w != workers.end(); ++w)
+                (*w)->join();
+        }
+
+        thread_team(const thread_team&) = delete;
+        thread_team& operator=(const thread_team&) = delete;
+
+        /// The team of the given device.
+        /**
+         * Takes a global lock; use detail::get_team() on the hot paths.
+         */
+        static thread_team& get(unsigned dev = 0) {
+            static std::vector< std::unique_ptr<thread_team> > team(devices().size());
+            static boost::mutex team_mx;
+
+            precondition(dev < team.size(), "Wrong JIT device id");
+
+            boost::lock_guard<boost::mutex> lock(team_mx);
+            if (!team[dev]) team[dev].reset(new thread_team(devices()[dev].cpus));
+            return *team[dev];
+        }
+
+        unsigned size() const {
+            return nthreads;
+        }
+
+        /// Number of work-groups in the kernel launch grid.
+        size_t num_workgroups() const {
+            return nthreads * 8;
+        }
+
+        /// Problem size below which the kernels are executed serially.
+        static size_t serial_size() {
+            static const size_t n = std::stoul(getenv("VEXCL_JIT_SERIAL_SIZE", "4096"));
+            return n;
+        }
+
+        /// Executes the kernel over the grid of work-groups.
+        void run(const kernel_api *K, const ndrange &grid, size_t smem, char *prm) {
+            job j = {K, grid, smem, prm, nullptr};
+
+            if (nthreads == 1 || inside_team() || K->size_hint(prm) < serial_size()) {
+                execute(j, 0, 1);
+                return;
+            }
+
+            launch(j);
+        }
+
+        /// Executes the host function on every team member.
+        /**
+         * The function receives the slot of the calling thread and the total
+         * number of slots. Used for the work that has to be done by the
+         * cores of the device, such as the first touch of the allocated
+         * memory.
+         */
+        void run(const std::function<void(unsigned, unsigned)> &f) {
+            job j = {nullptr, ndrange(), 0, nullptr, &f};
+
+            if (nthreads == 1 || inside_team()) {
+                execute(j, 0, 1);
+                return;
+            }
+
+            launch(j);
+        }
+    private:
+        struct job {
+            const kernel_api *K;
+            ndrange grid;
+            size_t smem;
+            char *prm;
+            const std::function<void(unsigned, unsigned)> *host;
+        };
+
+        unsigned nthreads;
+
+        job current;
+        std::atomic<size_t>   epoch;
+        std::atomic<unsigned> done;
+        std::atomic<unsigned> sleeping;
+        bool stop;
+
+        boost::mutex mx;
+        boost::mutex launch_mx;
+        boost::condition_variable cond;
+
+        std::vector< std::unique_ptr<boost::thread> > workers;
+
+        void launch(const job &j) {
+            boost::lock_guard<boost::mutex> launch_lock(launch_mx);
+
+            current = j;
+            done.store(0, std::memory_order_relaxed);
+            epoch.fetch_add(1);
+
+            if (sleeping.load()) {
+                boost::lock_guard<boost::mutex> lock(mx);
+                cond.notify_all();
+            }
+
+            execute(j, 0, nthreads);
+
+            for(unsigned spin = 0; done.load(std::memory_order_acquire) != nthreads - 1; ++spin)
+                cpu_relax(spin);
+        }
+
+        // Executes the share of work-groups that belongs to the given slot.
+        static void execute(const job &j, unsigned slot, unsigned nslots) {
+            if (j.host) {
+                (*j.host)(slot, nslots);
+                return;
+            }
+
+            const size_t nx = j.grid.x, ny = j.grid.y;
+            const size_t ng = nx * ny * j.grid.z;
+
+            const size_t beg = ng * slot / nslots;
+            const size_t end = ng * (slot + 1) / nslots;
+
+            if (beg == end) return;
+
+            std::vector<char> &smem = thread_scratch();
+            if (smem.size() < j.smem) smem.resize(j.smem);
+
+            for(size_t g = beg; g < end; ++g) {
+                ndrange id(g % nx, (g / nx) % ny, g / (nx * ny));
+                j.K->execute(&j.grid, &id, smem.data(), j.prm);
+            }
+        }
+
+        void work(unsigned slot) {
+            static const unsigned spin_count = std::stoul(getenv("VEXCL_JIT_SPIN", "20000"));
+
+            inside_team() = true;
+
+            for(size_t seen = 0;;) {
+                size_t e;
+
+                for(unsigned spin = 0; (e = epoch.load()) == seen; ++spin) {
+                    if (spin < spin_count) {
+                        cpu_relax(spin);
+                        continue;
+                    }
+
+                    boost::unique_lock<boost::mutex> lock(mx);
+                    sleeping.fetch_add(1);
+                    while(!stop && epoch.load() == seen) cond.wait(lock);
+                    sleeping.fetch_sub(1);
+                }
+
+                if (stop) return;
+
+                seen = e;
+                execute(current, slot, nthreads);
+                done.fetch_add(1, std::memory_order_release);
+            }
+        }
+};
+
+/// Thread team of the queue's device.
+/**
+ * The team is looked up once per queue and cached in the queue, so that
+ * kernel launches do not contend for the lock in thread_team::get().
+ */
+inline thread_team& get_team(const command_queue &q) {
+    queue_impl &impl = q.raw();
+
+    thread_team *t = impl.team();
+    if (!t) {
+        t = &thread_team::get(q.device().id);
+        impl.team(t);
+    }
+
+    return *t;
+}
+
+} // namespace detail
+} // namespace jit
+} // namespace backend
+} // namespace vex
+
+#endif
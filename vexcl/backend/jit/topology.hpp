@@ -0,0 +1,203 @@
+#ifndef VEXCL_BACKEND_JIT_TOPOLOGY_HPP
+#define VEXCL_BACKEND_JIT_TOPOLOGY_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2017 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/backend/jit/topology.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Split of the host CPU cores into JIT devices.
+ */
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <cstdlib>
+#include <boost/thread.hpp>
+
+#ifdef __linux__
+#  include <sched.h>
+#endif
+
+#include <vexcl/util.hpp>
+
+namespace vex {
+namespace backend {
+namespace jit {
+namespace detail {
+
+/// Cores available to the process.
+/**
+ * VEXCL_JIT_THREADS environment variable overrides the number of cores. The
+ * threads are then assigned round-robin to the cores of the process affinity
+ * mask, so that the workers are never pinned outside of the mask.
+ */
+inline std::vector<int> available_cpus() {
+    std::vector<int> cpus;
+
+#ifdef __linux__
+    cpu_set_t mask;
+    if (0 == sched_getaffinity(0, sizeof(mask), &mask)) {
+        for(int i = 0; i < CPU_SETSIZE; ++i)
+            if (CPU_ISSET(i, &mask)) cpus.push_back(i);
+    }
+#endif
+
+    if (cpus.empty()) {
+        const int hw = std::max(1u, boost::thread::hardware_concurrency());
+        for(int i = 0; i < hw; ++i) cpus.push_back(i);
+    }
+
+    if (const char *n = getenv("VEXCL_JIT_THREADS")) {
+        std::vector<int> threads;
+        for(int i = 0, m = std::max(1, std::atoi(n)); i < m; ++i)
+            threads.push_back(cpus[i % cpus.size()]);
+        return threads;
+    }
+
+    return cpus;
+}
+
+/// Parses linux cpulist format ("0-3,8,10-11"), also used for node lists.
+inline std::vector<int> parse_cpulist(const std::string &list) {
+    std::vector<int> cpus;
+    std::istringstream s(list);
+
+    for(std::string range; std::getline(s, range, ',');) {
+        if (range.empty()) continue;
+
+        size_t dash = range.find('-');
+        int beg = std::atoi(range.substr(0, dash).c_str());
+        int end = dash == std::string::npos ? beg : std::atoi(range.substr(dash + 1).c_str());
+
+        for(int i = beg; i <= end; ++i) cpus.push_back(i);
+    }
+
+    return cpus;
+}
+
+/// Description of a JIT device: a subset of host cores.
+struct device_info {
+    std::string name;
+    std::vector<int> cpus;
+};
+
+/// Splits the available cores into devices.
+/**
+ * The split is controlled by the VEXCL_JIT_DEVICES environment variable:
+ *
+ * - not set (default): all cores form a single device;
+ * - "numa": each online NUMA node with available cores is a separate device;
+ * - a number n: the available cores are split into n equal devices.
+ */
+inline std::vector<device_info> split_devices() {
+    std::vector<int> cpus = available_cpus();
+    std::vector<device_info> dev;
+
+    std::string mode = getenv("VEXCL_JIT_DEVICES", "");
+
+    if (mode == "numa") {
+#ifdef __linux__
+        // Node numbers may be sparse, so the online nodes are read from the
+        // node list instead of probing node0, node1, ... until a gap.
+        std::string online;
+        {
+            std::ifstream f("/sys/devices/system/node/online");
+            std::getline(f, online);
+        }
+
+        for(int node : parse_cpulist(online)) {
+            std::ostringstream fname;
+            fname << "/sys/devices/system/node/node" << node << "/cpulist";
+
+            std::ifstream f(fname.str());
+            if (!f) continue;
+
+            std::string list;
+            std::getline(f, list);
+
+            device_info d;
+            for(int c : parse_cpulist(list))
+                if (std::find(cpus.begin(), cpus.end(), c) != cpus.end())
+                    d.cpus.push_back(c);
+
+            if (d.cpus.empty()) continue;
+
+            std::ostringstream name;
+            name << "CPU (NUMA node " << node << ")";
+            d.name = name.str();
+
+            dev.push_back(d);
+        }
+#endif
+    } else if (int n = std::atoi(mode.c_str())) {
+        if (n > 1) {
+            const size_t m = cpus.size();
+
+            for(int i = 0; i < n; ++i) {
+                device_info d;
+
+                size_t beg = m * i / n;
+                size_t end = m * (i + 1) / n;
+
+                // There may be less cores than devices; share them then.
+                if (beg == end) end = beg + 1;
+
+                for(size_t j = beg; j < end; ++j)
+                    d.cpus.push_back(cpus[j % m]);
+
+                std::ostringstream name;
+                name << "CPU (partition " << i << ")";
+                d.name = name.str();
+
+                dev.push_back(d);
+            }
+        }
+    }
+
+    if (dev.empty()) {
+        device_info d;
+        d.name = "CPU";
+        d.cpus = cpus;
+        dev.push_back(d);
+    }
+
+    return dev;
+}
+
+/// JIT devices of the current process.
+inline const std::vector<device_info>& devices() {
+    static const std::vector<device_info> dev = split_devices();
+    return dev;
+}
+
+} // namespace detail
+} // namespace jit
+} // namespace backend
+} // namespace vex
+
+#endif
@@ -0,0 +1,256 @@
+#ifndef VEXCL_BACKEND_MEMORY_POOL_HPP
+#define VEXCL_BACKEND_MEMORY_POOL_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2017 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/backend/memory_pool.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Caching allocator of device memory shared by the backends.
+ */
+
+#include <map>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <iterator>
+#include <cstdlib>
+#include <boost/thread.hpp>
+
+#include <vexcl/util.hpp>
+
+namespace vex {
+
+/// Statistics of the device memory pool.
+struct memory_pool_stats {
+    size_t hits;    ///< Allocations served from the pool.
+    size_t misses;  ///< Allocations that had to go to the backend.
+    size_t in_use;  ///< Bytes held by the live pooled buffers.
+    size_t cached;  ///< Bytes kept in the pool for reuse.
+
+    memory_pool_stats() : hits(0), misses(0), in_use(0), cached(0) {}
+};
+
+namespace detail {
+
+/// Caching allocator of device memory.
+/**
+ * Memory blocks are rounded up to a size class (four classes per power of
+ * two) and, once released, are kept in the pool for reuse by the next
+ * allocation of the same class. The blocks are cached per command queue, so
+ * that a block is only reused by the commands that are ordered after the
+ * ones that used it before. The backends supply the allocation function
+ * and hold the returned lease for as long as the memory is in use.
+ *
+ * The pool is disabled by default. It may be switched on globally (also with
+ * the VEXCL_MEMORY_POOL=1 environment variable), or for the given queues
+ * only.
+ */
+class memory_pool {
+    public:
+        /// Identifies the owner of the cached memory: the queue and its context.
+        typedef std::pair<const void*, const void*> key_type;
+
+        /// The pool is never destroyed, since the leases may outlive static objects.
+        static memory_pool& get() {
+            static memory_pool *pool = new memory_pool();
+            return *pool;
+        }
+
+        bool enabled(const key_type &key) const {
+            boost::lock_guard<boost::mutex> lock(mx);
+            return is_enabled(key);
+        }
+
+        void enable(bool on) {
+            boost::lock_guard<boost::mutex> lock(mx);
+            global = on;
+            local.clear();
+        }
+
+        void enable(const key_type &key, bool on) {
+            boost::lock_guard<boost::mutex> lock(mx);
+            local[key] = on;
+        }
+
+        /// Allocates a block of at least the given size.
+        /**
+         * Returns the lease of the block. The block returns to the pool when
+         * the last copy of the lease is destroyed. Alloc is a functor that
+         * takes the size in bytes and returns shared pointer to a new block.
+         * When the allocation fails, the cached blocks are released and the
+         * allocation is retried.
+         */
+        template <class Alloc>
+        std::shared_ptr<void> allocate(const key_type &key, unsigned flags,
+                size_t bytes, Alloc &&alloc)
+        {
+            bucket_key k = {key, flags, size_class(bytes)};
+            std::shared_ptr<void> b;
+
+            {
+                boost::lock_guard<boost::mutex> lock(mx);
+
+                auto f = free.find(k);
+                if (f != free.end() && !f->second.empty()) {
+                    b = std::move(f->second.back());
+                    f->second.pop_back();
+
+                    ++s.hits;
+                    s.cached -= k.size;
+                } else {
+                    ++s.misses;
+                }
+
+                s.in_use += k.size;
+            }
+
+            if (!b) {
+                try {
+                    b = alloc(k.size);
+                } catch(...) {
+                    if (!trim()) {
+                        boost::lock_guard<boost::mutex> lock(mx);
+                        s.in_use -= k.size;
+                        throw;
+                    }
+                    b = alloc(k.size);
+                }
+            }
+
+            return std::shared_ptr<void>(b.get(), release_lease(this, k, b));
+        }
+
+        /// Releases all cached blocks.
+        size_t trim() {
+            std::map< bucket_key, std::vector< std::shared_ptr<void> > > tmp;
+
+            boost::lock_guard<boost::mutex> lock(mx);
+            size_t bytes = s.cached;
+            free.swap(tmp);
+            s.cached = 0;
+
+            return bytes;
+        }
+
+        /// Releases the blocks cached for the given owner.
+        size_t trim(const key_type &key) {
+            std::vector< std::shared_ptr<void> > tmp;
+
+            boost::lock_guard<boost::mutex> lock(mx);
+            size_t bytes = 0;
+            for(auto f = free.begin(); f != free.end(); ) {
+                if (f->first.key == key) {
+                    bytes += f->first.size * f->second.size();
+                    std::move(f->second.begin(), f->second.end(), std::back_inserter(tmp));
+                    free.erase(f++);
+                } else {
+                    ++f;
+                }
+            }
+            s.cached -= bytes;
+
+            return bytes;
+        }
+
+        memory_pool_stats stats() const {
+            boost::lock_guard<boost::mutex> lock(mx);
+            return s;
+        }
+
+        /// Size class of the allocation.
+        static size_t size_class(size_t bytes) {
+            const size_t min_size = 256;
+            if (bytes <= min_size) return min_size;
+
+            size_t p = min_size;
+            while(2 * p <= bytes) p *= 2;
+
+            size_t step = p / 4;
+            return (bytes + step - 1) / step * step;
+        }
+    private:
+        struct bucket_key {
+            key_type key;
+            unsigned flags;
+            size_t   size;
+
+            bool operator<(const bucket_key &o) const {
+                if (key   != o.key)   return key   < o.key;
+                if (flags != o.flags) return flags < o.flags;
+                return size < o.size;
+            }
+        };
+
+        struct release_lease {
+            memory_pool *pool;
+            bucket_key   key;
+            std::shared_ptr<void> block;
+
+            release_lease(memory_pool *pool, const bucket_key &key, std::shared_ptr<void> block)
+                : pool(pool), key(key), block(std::move(block)) {}
+
+            void operator()(void*) {
+                pool->release(key, std::move(block));
+            }
+        };
+
+        mutable boost::mutex mx;
+
+        bool global;
+        std::map<key_type, bool> local;
+
+        std::map< bucket_key, std::vector< std::shared_ptr<void> > > free;
+        memory_pool_stats s;
+
+        memory_pool() : global(std::atoi(getenv("VEXCL_MEMORY_POOL", "0")) != 0) {}
+
+        bool is_enabled(const key_type &key) const {
+            auto l = local.find(key);
+            return l == local.end() ? global : l->second;
+        }
+
+        void release(const bucket_key &k, std::shared_ptr<void> b) {
+            // The block is dropped (outside of the lock) when the pool has
+            // been switched off since the allocation.
+            std::shared_ptr<void> drop;
+
+            boost::lock_guard<boost::mutex> lock(mx);
+
+            s.in_use -= k.size;
+
+            if (is_enabled(k.key)) {
+                free[k].push_back(std::move(b));
+                s.cached += k.size;
+            } else {
+                drop = std::move(b);
+            }
+        }
+};
+
+} // namespace detail
+} // namespace vex
+
+#endif
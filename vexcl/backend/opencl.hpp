@@ -46,5 +46,6 @@ THE SOFTWARE.
 #include <vexcl/backend/opencl/compiler.hpp>
 #include <vexcl/backend/opencl/kernel.hpp>
 #include <vexcl/backend/opencl/event.hpp>
+#include <vexcl/backend/opencl/peer_copy.hpp>
 
 #endif
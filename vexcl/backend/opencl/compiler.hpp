@@ -37,6 +37,7 @@ THE SOFTWARE.
 
 #include <vexcl/backend/common.hpp>
 #include <vexcl/detail/backtrace.hpp>
+#include <vexcl/detail/program_cache.hpp>
 
 #include <vexcl/backend/opencl/defines.hpp>
 #include <CL/cl.hpp>
@@ -99,10 +100,28 @@ inline boost::optional<cl::Program> load_program_binaries(
     return boost::optional<cl::Program>(program);
 }
 
+/// Identifies the device, its driver, and the compiler options.
+/**
+ * Used as the key of the calibration data.
+ */
+inline std::string device_signature(const cl::CommandQueue &queue) {
+    cl::Device   d(queue.getInfo<CL_QUEUE_DEVICE>());
+    cl::Platform p(d.getInfo<CL_DEVICE_PLATFORM>());
+
+    std::ostringstream s;
+    s << d.getInfo<CL_DEVICE_NAME>()
+      << "; " << p.getInfo<CL_PLATFORM_NAME>()
+      << "; " << d.getInfo<CL_DRIVER_VERSION>()
+      << "; " << get_compile_options(queue);
+    return s.str();
+}
+
 /// Create and build a program from source string.
 /**
- * If VEXCL_CACHE_KERNELS macro is defined, then program binaries are cached
- * in filesystem and reused in the following runs.
+ * The programs are cached for each context (see vex::detail::program_cache),
+ * so that identical sources are only built once. If VEXCL_CACHE_KERNELS macro
+ * is defined, then program binaries are also cached in filesystem and reused
+ * in the following runs.
  */
 inline cl::Program build_sources(
         const cl::CommandQueue &queue, const std::string &source,
@@ -121,6 +140,15 @@ inline cl::Program build_sources(
 
     std::string compile_options = options + " " + get_compile_options(queue);
 
+    typedef vex::detail::program_cache<cl::Program> cache;
+
+    std::string key = sha1_hasher(source).process(compile_options);
+
+    {
+        cl::Program program;
+        if (cache::get().find(queue, key, program)) return program;
+    }
+
 #ifdef VEXCL_CACHE_KERNELS
     // Get unique (hopefully) hash string for the kernel.
     std::ostringstream compiler_tag;
@@ -148,8 +176,10 @@ inline cl::Program build_sources(
 
     // Try to get cached program binaries:
     try {
-        if (boost::optional<cl::Program> program = load_program_binaries(hash, context, device, compile_options))
+        if (boost::optional<cl::Program> program = load_program_binaries(hash, context, device, compile_options)) {
+            cache::get().insert(queue, key, *program);
             return *program;
+        }
     } catch (...) {
         // Shit happens.
         std::cerr << "Failed to load precompiled binaries" << std::endl;
@@ -176,6 +206,7 @@ inline cl::Program build_sources(
     save_program_binaries(hash, program);
 #endif
 
+    cache::get().insert(queue, key, program);
     return program;
 }
 
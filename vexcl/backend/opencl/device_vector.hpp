@@ -31,9 +31,13 @@ THE SOFTWARE.
  * \brief  OpenCL device vector.
  */
 
+#include <memory>
+
 #include <vexcl/backend/opencl/defines.hpp>
 #include <CL/cl.hpp>
 
+#include <vexcl/backend/memory_pool.hpp>
+
 namespace vex {
 namespace backend {
 namespace opencl {
@@ -44,6 +48,15 @@ static const mem_flags MEM_READ_ONLY  = CL_MEM_READ_ONLY;
 static const mem_flags MEM_WRITE_ONLY = CL_MEM_WRITE_ONLY;
 static const mem_flags MEM_READ_WRITE = CL_MEM_READ_WRITE;
 
+namespace detail {
+
+/// Owner of the memory cached in the pool.
+inline vex::detail::memory_pool::key_type pool_key(const cl::CommandQueue &q) {
+    return vex::detail::memory_pool::key_type(q(), q.getInfo<CL_QUEUE_CONTEXT>()());
+}
+
+} // namespace detail
+
 template <typename T>
 class device_vector {
     public:
@@ -55,19 +68,43 @@ class device_vector {
         device_vector(const cl::CommandQueue &q, size_t n,
                 const T *host = 0, mem_flags flags = MEM_READ_WRITE)
         {
-            if (host && !(flags & CL_MEM_USE_HOST_PTR))
-                flags |= CL_MEM_COPY_HOST_PTR;
+            if (!n) return;
+
+            auto key   = detail::pool_key(q);
+            auto &pool = vex::detail::memory_pool::get();
+
+            if ((flags & CL_MEM_USE_HOST_PTR) || !pool.enabled(key)) {
+                if (host && !(flags & CL_MEM_USE_HOST_PTR))
+                    flags |= CL_MEM_COPY_HOST_PTR;
 
-            if (n)
                 buffer = cl::Buffer(q.getInfo<CL_QUEUE_CONTEXT>(), flags,
                         n * sizeof(T), static_cast<void*>(const_cast<T*>(host)));
+                return;
+            }
+
+            // Pooled blocks are rounded up to a size class; the vector uses
+            // a sub-buffer of the exact size.
+            cl::Context ctx = q.getInfo<CL_QUEUE_CONTEXT>();
+
+            lease = pool.allocate(key, static_cast<unsigned>(flags), n * sizeof(T),
+                    [&ctx, flags](size_t m) {
+                        return std::shared_ptr<void>(std::make_shared<cl::Buffer>(ctx, flags, m));
+                    });
+
+            cl_buffer_region region = {0, n * sizeof(T)};
+            buffer = static_cast<cl::Buffer*>(lease.get())->createSubBuffer(
+                    0, CL_BUFFER_CREATE_TYPE_REGION, &region);
+
+            if (host) write(q, 0, n, host, true);
         }
 
         device_vector(cl::Buffer buffer) : buffer( std::move(buffer) ) {}
 
         template <typename U>
         device_vector<U> reinterpret() const {
-            return device_vector<U>(buffer);
+            device_vector<U> r(buffer);
+            r.lease = lease;
+            return r;
         }
 
         void write(const cl::CommandQueue &q, size_t offset, size_t size, const T *host,
@@ -142,6 +179,12 @@ class device_vector {
         }
     private:
         cl::Buffer buffer;
+
+        // Keeps the pooled memory block from returning to the pool.
+        std::shared_ptr<void> lease;
+
+        template <typename U>
+        friend class device_vector;
 };
 
 } // namespace opencl
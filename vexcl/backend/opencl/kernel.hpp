@@ -31,6 +31,12 @@ THE SOFTWARE.
  * \brief  An abstraction over OpenCL compute kernel.
  */
 
+#include <map>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
 #include <functional>
 
 #include <vexcl/backend/opencl/defines.hpp>
@@ -50,9 +56,16 @@ struct kernel_arg_pusher {
 };
 
 /// An abstraction over OpenCL compute kernel.
+/**
+ * OpenCL kernel arguments are a state of the kernel object, so the kernels
+ * shared between host threads (e.g. the kernels in the static kernel caches)
+ * are cloned for each thread other than the one that created the kernel.
+ * The arguments and the launch configuration of a call are collected in an
+ * argument pack private to the calling thread.
+ */
 class kernel {
     public:
-        kernel() : argpos(0), w_size(0), g_size(0) {}
+        kernel() : uid(next_uid()), w_size(0), g_size(0) {}
 
         /// Constructor. Creates a backend::kernel instance from source.
         kernel(const cl::CommandQueue &queue,
@@ -61,7 +74,7 @@ class kernel {
                size_t smem_per_thread = 0,
                const std::string &options = ""
                )
-            : argpos(0), K(build_sources(queue, src, options), name.c_str())
+            : uid(next_uid()), creator(std::this_thread::get_id()), K(build_sources(queue, src, options), name.c_str())
         {
             config(queue,
                     [smem_per_thread](size_t wgs){ return wgs * smem_per_thread; });
@@ -73,7 +86,7 @@ class kernel {
                std::function<size_t(size_t)> smem,
                const std::string &options = ""
                )
-            : argpos(0), K(build_sources(queue, src, options), name.c_str())
+            : uid(next_uid()), creator(std::this_thread::get_id()), K(build_sources(queue, src, options), name.c_str())
         {
             config(queue, smem);
         }
@@ -84,7 +97,7 @@ class kernel {
                const std::string &name,
                size_t smem_per_thread = 0
                )
-            : argpos(0), K(program, name.c_str())
+            : uid(next_uid()), creator(std::this_thread::get_id()), K(program, name.c_str())
         {
             config(queue,
                     [smem_per_thread](size_t wgs){ return wgs * smem_per_thread; });
@@ -95,7 +108,7 @@ class kernel {
                const std::string &name,
                std::function<size_t(size_t)> smem
                )
-            : argpos(0), K(program, name.c_str())
+            : uid(next_uid()), creator(std::this_thread::get_id()), K(program, name.c_str())
         {
             config(queue, smem);
         }
@@ -103,32 +116,39 @@ class kernel {
         /// Adds an argument to the kernel.
         template <class Arg>
         void push_arg(const Arg &arg) {
-            kernel_arg_pusher<Arg>::set(K, argpos++, arg);
+            arg_pack &a = args();
+            kernel_arg_pusher<Arg>::set(a.K, a.argpos++, arg);
         }
 
         /// Adds an argument to the kernel.
         template <typename T>
         void push_arg(device_vector<T> &&arg) {
-            K.setArg(argpos++, arg.raw());
+            arg_pack &a = args();
+            a.K.setArg(a.argpos++, arg.raw());
         }
 
         /// Adds local memory to the kernel.
         void set_smem(size_t smem_per_thread) {
             cl::LocalSpaceArg smem = { smem_per_thread * workgroup_size() };
-            K.setArg(argpos++, smem);
+            arg_pack &a = args();
+            a.K.setArg(a.argpos++, smem);
         }
 
         /// Adds local memory to the kernel.
         template <class F>
         void set_smem(F &&f) {
             cl::LocalSpaceArg smem = { f(workgroup_size()) };
-            K.setArg(argpos++, smem);
+            arg_pack &a = args();
+            a.K.setArg(a.argpos++, smem);
         }
 
         /// Enqueue the kernel to the specified command queue.
         void operator()(const cl::CommandQueue &q) {
-            q.enqueueNDRangeKernel(K, cl::NullRange, g_size, w_size);
-            argpos = 0;
+            arg_pack &a = args();
+            q.enqueueNDRangeKernel(a.K, cl::NullRange,
+                    a.own_grid ? a.g_size : g_size,
+                    a.own_grid ? a.w_size : w_size);
+            reset();
         }
 
 #ifndef BOOST_NO_VARIADIC_TEMPLATES
@@ -143,9 +163,12 @@ class kernel {
 
         /// Workgroup size.
         size_t workgroup_size() const {
+            const arg_pack *a = pending_args();
+            const ndrange  &w = a && a->own_grid ? a->w_size : w_size;
+
             size_t threads = 1;
-            for(size_t i = 0; i < w_size.dimensions(); ++i)
-                threads *= static_cast<const size_t*>(w_size)[i];
+            for(size_t i = 0; i < w.dimensions(); ++i)
+                threads *= static_cast<const size_t*>(w)[i];
             return threads;
         }
 
@@ -195,6 +218,11 @@ class kernel {
         }
 
         /// Set launch configuration.
+        /**
+         * The configuration applies to the next launch from the calling
+         * thread, and becomes the default for the launches that are not
+         * configured explicitly.
+         */
         kernel& config(ndrange blocks, ndrange threads) {
             size_t dim = std::max(blocks.dimensions(), threads.dimensions());
 
@@ -216,6 +244,11 @@ class kernel {
 
             w_size = threads;
 
+            arg_pack &a = args();
+            a.g_size   = g_size;
+            a.w_size   = w_size;
+            a.own_grid = true;
+
             return *this;
         }
 
@@ -236,15 +269,146 @@ class kernel {
 
         /// Reset argument counter.
         void reset() {
-            argpos = 0;
+            if (arg_pack *a = pending_args()) {
+                a->owner    = nullptr;
+                a->argpos   = 0;
+                a->own_grid = false;
+                a->K        = cl::Kernel();
+            }
+        }
+
+        kernel(const kernel &k)
+            : uid(next_uid()), creator(k.creator), K(k.K), w_size(k.w_size), g_size(k.g_size)
+        {
+            copy_args(k);
+        }
+
+        kernel& operator=(const kernel &k) {
+            if (this != &k) {
+                reset();
+                clones.clear();
+                uid     = next_uid();
+                creator = k.creator;
+                K       = k.K;
+                w_size  = k.w_size;
+                g_size  = k.g_size;
+                copy_args(k);
+            }
+            return *this;
+        }
+
+        ~kernel() {
+            reset();
         }
     private:
-        unsigned argpos;
+        // Unique (never reused) identifier of the kernel instance.
+        size_t uid;
+
+        std::thread::id creator;
 
         cl::Kernel K;
 
         backend::ndrange w_size;
         backend::ndrange g_size;
+
+        // Arguments of a kernel call being prepared by the current thread.
+        struct arg_pack {
+            const kernel *owner;
+            cl::Kernel    K;
+            unsigned      argpos;
+
+            backend::ndrange w_size;
+            backend::ndrange g_size;
+            bool own_grid;
+
+            arg_pack() : owner(nullptr), argpos(0), own_grid(false) {}
+        };
+
+        // Argument packs of the current thread. There is usually at most
+        // one pack in use at a time; the released packs are reused.
+        static std::vector< std::unique_ptr<arg_pack> >& thread_packs() {
+            static thread_local std::vector< std::unique_ptr<arg_pack> > packs;
+            return packs;
+        }
+
+        arg_pack* pending_args() const {
+            for(auto &p : thread_packs())
+                if (p->owner == this) return p.get();
+            return nullptr;
+        }
+
+        // The arguments pushed to a kernel by the current thread are copied
+        // along with the kernel.
+        void copy_args(const kernel &k) {
+            if (const arg_pack *src = k.pending_args()) {
+                arg_pack &dst = args();
+                dst = *src;
+                dst.owner = this;
+            }
+        }
+
+        arg_pack& args() const {
+            if (arg_pack *a = pending_args()) return *a;
+
+            auto &packs = thread_packs();
+
+            arg_pack *free = nullptr;
+            for(auto &p : packs) {
+                if (!p->owner) { free = p.get(); break; }
+            }
+
+            if (!free) {
+                packs.emplace_back(new arg_pack());
+                free = packs.back().get();
+            }
+
+            free->owner = this;
+            free->K     = instance();
+            return *free;
+        }
+
+        // Clones of the kernel for the threads other than the creator. The
+        // clones are owned by the kernel instance, and are released along
+        // with it (e.g. when the kernel caches are purged).
+        mutable std::map<std::thread::id, cl::Kernel> clones;
+
+        static size_t next_uid() {
+            static std::atomic<size_t> last(0);
+            return ++last;
+        }
+
+        static std::mutex& clone_mutex() {
+            static std::mutex mx;
+            return mx;
+        }
+
+        // The kernel object the current thread sets the arguments of: the
+        // kernel itself in the thread that created it, or a clone of the
+        // kernel in any other thread. The thread remembers the clones it
+        // used by the instance uid, so that the lookup does not take the
+        // lock; the uids are never reused, so the entries of the destroyed
+        // instances are never dereferenced.
+        cl::Kernel instance() const {
+            if (std::this_thread::get_id() == creator) return K;
+
+            static thread_local std::map<size_t, const cl::Kernel*> known;
+
+            auto c = known.find(uid);
+            if (c != known.end()) return *c->second;
+
+            if (known.size() > 256) known.clear();
+
+            std::lock_guard<std::mutex> lock(clone_mutex());
+
+            auto k = clones.find(std::this_thread::get_id());
+            if (k == clones.end())
+                k = clones.insert(std::make_pair(std::this_thread::get_id(),
+                            cl::Kernel(K.getInfo<CL_KERNEL_PROGRAM>(),
+                                K.getInfo<CL_KERNEL_FUNCTION_NAME>().c_str()))).first;
+
+            known.insert(std::make_pair(uid, &k->second));
+            return k->second;
+        }
 };
 
 } // namespace opencl
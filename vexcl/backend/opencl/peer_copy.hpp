@@ -0,0 +1,189 @@
+#ifndef VEXCL_BACKEND_OPENCL_PEER_COPY_HPP
+#define VEXCL_BACKEND_OPENCL_PEER_COPY_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2017 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/backend/opencl/peer_copy.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Copies between the device vectors on different devices.
+ */
+
+#include <map>
+#include <list>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+
+#include <vexcl/backend/opencl/defines.hpp>
+#include <CL/cl.hpp>
+
+#include <vexcl/backend/opencl/device_vector.hpp>
+
+namespace vex {
+namespace backend {
+namespace opencl {
+
+namespace detail {
+
+/// Pinned host memory for the copies between the contexts.
+/**
+ * The buffers allocated with CL_MEM_ALLOC_HOST_PTR are page-locked by most
+ * implementations, so that the transfers to and from their mapped memory
+ * are done by DMA. The buffers are kept mapped, and each one is reused once
+ * the last transfer through it is complete.
+ */
+template <bool dummy = true>
+struct staging_buffer {
+    static_assert(dummy, "Dummy parameter should be true");
+
+    struct block {
+        block() : ptr(0), size(0) {}
+
+        cl::Buffer buf;
+        void      *ptr;
+        size_t     size;
+        cl::Event  done; // Completion of the last transfer through the block.
+    };
+
+    static boost::mutex mx;
+    static std::map<cl_context, std::list<block> > blocks;
+
+    // Should be called under the lock. The cached buffers keep the context
+    // alive, so the context handle may be used as the key. The returned
+    // block should be marked with the event of the transfer before the lock
+    // is released.
+    static block& get(const cl::CommandQueue &q, size_t bytes) {
+        cl::Context ctx = q.getInfo<CL_QUEUE_CONTEXT>();
+        std::list<block> &pool = blocks[ctx()];
+
+        for(auto b = pool.begin(); b != pool.end(); ++b)
+            if (b->size >= bytes && idle(*b)) return *b;
+
+        // The buffer is mapped asynchronously; the transfers submitted to q
+        // after the map are ordered after it.
+        pool.push_back(block());
+        block &b = pool.back();
+
+        b.buf  = cl::Buffer(ctx, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes);
+        b.ptr  = q.enqueueMapBuffer(b.buf, CL_FALSE, CL_MAP_READ | CL_MAP_WRITE, 0, bytes);
+        b.size = bytes;
+
+        return b;
+    }
+
+    static bool idle(const block &b) {
+        return !b.done() || b.done.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() <= CL_COMPLETE;
+    }
+};
+
+template <bool dummy>
+boost::mutex staging_buffer<dummy>::mx;
+
+template <bool dummy>
+std::map<cl_context, std::list<typename staging_buffer<dummy>::block> >
+staging_buffer<dummy>::blocks;
+
+// Completes the user event passed as the callback data. Is called by the
+// OpenCL runtime, so it should not throw.
+inline void CL_CALLBACK complete_user_event(cl_event, cl_int status, void *data) {
+    cl::UserEvent *e = static_cast<cl::UserEvent*>(data);
+    clSetUserEventStatus((*e)(), status < 0 ? status : CL_COMPLETE);
+    delete e;
+}
+
+} // namespace detail
+
+/// Checks if the data may be copied between the devices without host staging.
+/**
+ * The buffers may be copied directly between the devices sharing an OpenCL
+ * context.
+ */
+inline bool peer_access(const cl::CommandQueue &src_q, const cl::CommandQueue &dst_q) {
+    return src_q.getInfo<CL_QUEUE_CONTEXT>()() == dst_q.getInfo<CL_QUEUE_CONTEXT>()();
+}
+
+/// Copies data between device vectors that may reside on different devices.
+/**
+ * The copy is ordered after the commands already submitted to both src_q
+ * and dst_q; dst may be used once both queues are finished. The call does
+ * not block. When the queues share a context, the buffer is copied directly
+ * by src_q. Otherwise the data is read into pinned host memory by src_q and
+ * written from there by dst_q; the write waits for the read through a user
+ * event, since the events may not be shared between the contexts.
+ */
+template <typename T>
+void copy_peer(
+        const cl::CommandQueue &src_q, const device_vector<T> &src, size_t src_offset,
+        const cl::CommandQueue &dst_q, const device_vector<T> &dst, size_t dst_offset,
+        size_t size
+        )
+{
+    if (!size) return;
+
+    if (peer_access(src_q, dst_q)) {
+        std::vector<cl::Event> ready;
+
+        if (src_q() != dst_q()) {
+            ready.resize(1);
+#ifdef CL_VERSION_1_2
+            dst_q.enqueueMarkerWithWaitList(0, &ready[0]);
+#else
+            dst_q.enqueueMarker(&ready[0]);
+#endif
+        }
+
+        src_q.enqueueCopyBuffer(src.raw_buffer(), dst.raw_buffer(),
+                sizeof(T) * src_offset, sizeof(T) * dst_offset, sizeof(T) * size,
+                ready.empty() ? 0 : &ready);
+        return;
+    }
+
+    typedef detail::staging_buffer<> staging;
+    boost::lock_guard<boost::mutex> lock(staging::mx);
+
+    staging::block &b = staging::get(src_q, sizeof(T) * size);
+
+    cl::Event read;
+    src_q.enqueueReadBuffer(src.raw_buffer(), CL_FALSE,
+            sizeof(T) * src_offset, sizeof(T) * size, b.ptr, 0, &read);
+
+    cl::UserEvent *done = new cl::UserEvent(dst_q.getInfo<CL_QUEUE_CONTEXT>());
+    std::vector<cl::Event> ready(1, *done);
+    read.setCallback(CL_COMPLETE, detail::complete_user_event, done);
+
+    // The write on dst_q waits for the read, so src_q has to be flushed.
+    src_q.flush();
+
+    dst_q.enqueueWriteBuffer(dst.raw_buffer(), CL_FALSE,
+            sizeof(T) * dst_offset, sizeof(T) * size, b.ptr, &ready, &b.done);
+}
+
+} // namespace opencl
+} // namespace backend
+} // namespace vex
+
+#endif
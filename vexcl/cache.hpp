@@ -32,66 +32,23 @@ THE SOFTWARE.
  */
 
 #include <set>
+#include <string>
 #include <map>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
 
 #include <boost/thread.hpp>
 #include <boost/utility.hpp>
 
 #include <vexcl/backend.hpp>
+#include <vexcl/kernel_registry.hpp>
+#include <vexcl/detail/cache_register.hpp>
 
 namespace vex {
 namespace detail {
 
-// Abstract base class for object cache.
-struct object_cache_base;
-
-// List of all active caches.
-template <bool dummy = true>
-struct cache_register {
-    static_assert(dummy, "Dummy parameter should be true");
-
-    static std::set<object_cache_base*> caches;
-    static boost::mutex caches_mx;
-
-    static void add(object_cache_base *cache) {
-        boost::lock_guard<boost::mutex> lock(caches_mx);
-        caches.insert(cache);
-    }
-
-    static void remove(object_cache_base *cache) {
-        boost::lock_guard<boost::mutex> lock(caches_mx);
-        caches.erase(cache);
-    }
-
-    static void clear();
-    static void erase(const backend::command_queue &q);
-};
-
-template <bool dummy>
-std::set<object_cache_base*> cache_register<dummy>::caches;
-
-template <bool dummy>
-boost::mutex cache_register<dummy>::caches_mx;
-
-// Abstract base class for object cache.
-struct object_cache_base {
-    virtual void clear() = 0;
-    virtual void erase(const backend::command_queue &q) = 0;
-    virtual ~object_cache_base() {}
-};
-
-template <bool dummy>
-void cache_register<dummy>::clear() {
-    for(auto c = caches.begin(); c != caches.end(); ++c)
-        (*c)->clear();
-}
-
-template <bool dummy>
-void cache_register<dummy>::erase(const backend::command_queue &q) {
-    for(auto c = caches.begin(); c != caches.end(); ++c)
-        (*c)->erase(q);
-}
-
 // Indexes cache objects by context
 struct index_by_context {
     typedef backend::context          type;
@@ -115,54 +72,170 @@ struct index_by_queue {
 // Online cache. Stores Objects indexed by Key::type.
 // Note that from the user standpoint everything is indexed by
 // `const backend::command_queue&`.
+//
+// Lookups do not lock: the readers search an immutable sorted snapshot of
+// the cache contents. The writers (insert, erase, clear) are serialized by a
+// mutex, publish a new snapshot, and release the old one once the readers
+// that could see it are done. The readers announce themselves in one of two
+// counters selected by the current epoch; a writer flips the epoch and waits
+// for the counter of the previous epoch to drain, so that it is never
+// starved by the continuous stream of new readers.
+//
+// The returned iterators stay valid until the entry is erased from the
+// cache, which should not happen while the object is in use.
 template <class Key, class Object>
 struct object_cache : public object_cache_base, boost::noncopyable {
-    typedef std::map<typename Key::type, Object, typename Key::compare> store_type;
+    typedef typename Key::type                key_type;
+    typedef std::pair<const key_type, Object> value_type;
+
+    class iterator {
+        public:
+            iterator(value_type *p = nullptr) : p(p) {}
+
+            value_type& operator*()  const { return *p; }
+            value_type* operator->() const { return p; }
 
-    store_type store;
-    mutable boost::mutex store_mx;
+            bool operator==(const iterator &o) const { return p == o.p; }
+            bool operator!=(const iterator &o) const { return p != o.p; }
+        private:
+            value_type *p;
+    };
 
-    object_cache() {
+    typedef iterator const_iterator;
+
+    object_cache() : snap(new snapshot), epoch(0) {
+        readers[0] = 0;
+        readers[1] = 0;
         cache_register<true>::add(this);
     }
 
     ~object_cache() {
         cache_register<true>::remove(this);
+        delete snap.load();
     }
 
     template <class I>
-    typename store_type::iterator
-    insert(const backend::command_queue &q, I &&item) {
+    iterator insert(const backend::command_queue &q, I &&item) {
         boost::lock_guard<boost::mutex> lock(store_mx);
 
-        return store.insert( std::make_pair(
+        auto s = store.insert( std::make_pair(
                     Key::get(q), std::forward<I>(item)
-                    ) ).first;
+                    ) );
+
+        if (s.second) publish(make_snapshot());
+
+        return iterator(&*s.first);
     }
 
-    typename store_type::const_iterator end() const {
-        boost::lock_guard<boost::mutex> lock(store_mx);
-        return store.end();
+    iterator end() const {
+        return iterator();
     }
 
-    typename store_type::iterator find(const backend::command_queue &q) {
-        boost::lock_guard<boost::mutex> lock(store_mx);
-        return store.find( Key::get(q) );
+    iterator find(const backend::command_queue &q) const {
+        const key_type key = Key::get(q);
+
+        // Register as a reader of the current epoch. If a writer flips
+        // the epoch in the meantime, it may have missed us; retry then.
+        unsigned e;
+        for(;;) {
+            e = epoch.load();
+            ++readers[e & 1];
+            if (epoch.load() == e) break;
+            --readers[e & 1];
+        }
+
+        iterator i = snap.load()->find(key);
+
+        --readers[e & 1];
+
+        return i;
     }
 
     void clear() {
         boost::lock_guard<boost::mutex> lock(store_mx);
+
+        publish(std::unique_ptr<snapshot>(new snapshot));
         store.clear();
     }
 
     void erase(const backend::command_queue &q) {
         boost::lock_guard<boost::mutex> lock(store_mx);
-        store.erase( Key::get(q) );
+
+        auto i = store.find( Key::get(q) );
+        if (i == store.end()) return;
+
+        // The entry may only be destroyed once the readers can not see it.
+        publish(make_snapshot(&*i));
+        store.erase(i);
     }
+
+    private:
+        typedef std::map<key_type, Object, typename Key::compare> store_type;
+
+        // Immutable sorted view of the store.
+        struct snapshot {
+            std::vector<value_type*> items;
+
+            iterator find(const key_type &key) const {
+                typename Key::compare cmp;
+
+                auto i = std::lower_bound(items.begin(), items.end(), key,
+                        [&cmp](const value_type *a, const key_type &b) {
+                            return cmp(a->first, b);
+                        });
+
+                if (i == items.end() || cmp(key, (*i)->first)) return iterator();
+                return iterator(*i);
+            }
+        };
+
+        store_type   store;
+        boost::mutex store_mx;
+
+        std::atomic<snapshot*> snap;
+        std::atomic<unsigned>  epoch;
+        mutable std::atomic<int> readers[2];
+
+        // Snapshot of the store contents, optionally without the given entry.
+        // Should be called with the store mutex locked.
+        std::unique_ptr<snapshot> make_snapshot(const value_type *skip = nullptr) {
+            std::unique_ptr<snapshot> s(new snapshot);
+
+            s->items.reserve(store.size());
+            for(auto i = store.begin(); i != store.end(); ++i)
+                if (&*i != skip) s->items.push_back(&*i);
+
+            return s;
+        }
+
+        // Replaces the current snapshot and waits until the readers are
+        // done with the old one.
+        void publish(std::unique_ptr<snapshot> s) {
+            std::unique_ptr<snapshot> old(snap.exchange(s.release()));
+
+            // New readers go to the other counter; wait for the old ones.
+            unsigned e = epoch++;
+            while(readers[e & 1].load() != 0) boost::this_thread::yield();
+        }
 };
 
-// The most common type of object cache is kernel cache:
-typedef object_cache<index_by_context, backend::kernel> kernel_cache;
+// The most common type of object cache is kernel cache. The kernels are
+// entered into vex::kernel_registry under the name of the subsystem that
+// owns the cache.
+struct kernel_cache : public object_cache<index_by_context, backend::kernel> {
+    typedef object_cache<index_by_context, backend::kernel> base_type;
+
+    const std::string subsystem;
+
+    kernel_cache(const std::string &subsystem = "") : subsystem(subsystem) {}
+
+    template <class I>
+    iterator insert(const backend::command_queue &q, I &&item) {
+        iterator k = base_type::insert(q, std::forward<I>(item));
+        tag_kernel(k->second, subsystem);
+        return k;
+    }
+};
 
 }
 
@@ -0,0 +1,249 @@
+#ifndef VEXCL_CALIBRATION_HPP
+#define VEXCL_CALIBRATION_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2017 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/calibration.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Persistent store of the device calibration data.
+ */
+
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <atomic>
+
+#include <boost/optional.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+#include <vexcl/backend.hpp>
+#include <vexcl/util.hpp>
+
+namespace vex {
+namespace detail {
+
+template <bool dummy = true>
+struct calibration_data {
+    static_assert(dummy, "Dummy parameter should be true");
+
+    typedef std::map<std::string, double> params;
+
+    // Parameters of the devices, indexed by the device key. The devices are
+    // loaded from disk on the first access.
+    static std::map<std::string, params> devices;
+    static boost::mutex mx;
+
+    static std::atomic<bool> enabled;
+};
+
+template <bool dummy>
+std::map<std::string, typename calibration_data<dummy>::params>
+calibration_data<dummy>::devices;
+
+template <bool dummy>
+boost::mutex calibration_data<dummy>::mx;
+
+template <bool dummy>
+std::atomic<bool> calibration_data<dummy>::enabled(
+        std::string(vex::getenv("VEXCL_CALIBRATION", "1")) != "0");
+
+} // namespace detail
+
+/// Persistent store of the device calibration data.
+/**
+ * The results of the start-up benchmarks (e.g. the device weights used by
+ * the default partitioning, see vex::device_vector_perf()) are kept on disk
+ * under vex::appdata_path(), so that the benchmarks are run once per device
+ * instead of once per process. The data is keyed by the hash of the device
+ * name, the driver version, and the compiler (see
+ * backend::device_signature()), so that it is invalidated on driver or
+ * compiler upgrades. Each parameter is a named number:
+ * \code
+ * double bw = vex::calibration::get(q, "bandwidth").get_value_or(0);
+ * vex::calibration::set(q, "my_tuned_block_size", 256);
+ * \endcode
+ * The store may be disabled with VEXCL_CALIBRATION=0 environment variable or
+ * with vex::calibration::enabled(false); the benchmarks are then run on every
+ * start. The examples/calibrate utility refreshes the stored data.
+ */
+class calibration {
+    public:
+        /// Whether the calibration data is loaded from and saved to disk.
+        static bool enabled() {
+            return data::enabled;
+        }
+
+        /// Enables or disables the calibration store.
+        static void enabled(bool on) {
+            data::enabled = on;
+        }
+
+        /// Returns the stored value of the parameter, if any.
+        static boost::optional<double> get(const backend::command_queue &q,
+                const std::string &param)
+        {
+            if (!enabled()) return boost::none;
+
+            boost::lock_guard<boost::mutex> lock(data::mx);
+            const params &p = load(key(q));
+
+            auto v = p.find(param);
+            if (v == p.end()) return boost::none;
+            return v->second;
+        }
+
+        /// Returns the stored value of the parameter, or measures and stores it.
+        /**
+         * The measurement is done outside of the lock, so it may use the
+         * calibration store itself.
+         */
+        template <class Measure>
+        static double get(const backend::command_queue &q,
+                const std::string &param, Measure &&measure)
+        {
+            if (boost::optional<double> v = get(q, param)) return *v;
+
+            double v = measure();
+            set(q, param, v);
+            return v;
+        }
+
+        /// Stores the value of the parameter.
+        static void set(const backend::command_queue &q,
+                const std::string &param, double value)
+        {
+            if (!enabled()) return;
+
+            std::string k = key(q);
+
+            boost::lock_guard<boost::mutex> lock(data::mx);
+            params &p = load(k);
+            p[param] = value;
+            save(k, backend::device_signature(q), p);
+        }
+
+        /// Forgets the calibration data of the device.
+        /**
+         * The start-up benchmarks for the device will be rerun on the next
+         * use.
+         */
+        static void clear(const backend::command_queue &q) {
+            std::string k = key(q);
+
+            boost::lock_guard<boost::mutex> lock(data::mx);
+            data::devices[k].clear();
+
+            boost::system::error_code ec;
+            boost::filesystem::remove(file(k), ec);
+        }
+
+        /// Drops the loaded data, so that it is reread from disk on the next access.
+        static void reload() {
+            boost::lock_guard<boost::mutex> lock(data::mx);
+            data::devices.clear();
+        }
+
+        /// Returns all stored parameters of the device.
+        static std::map<std::string, double> list(const backend::command_queue &q) {
+            if (!enabled()) return std::map<std::string, double>();
+
+            boost::lock_guard<boost::mutex> lock(data::mx);
+            return load(key(q));
+        }
+
+        /// Path to the file with the calibration data of the device.
+        static std::string path(const backend::command_queue &q) {
+            return file(key(q));
+        }
+    private:
+        typedef detail::calibration_data<> data;
+        typedef data::params params;
+
+        static std::string key(const backend::command_queue &q) {
+            return sha1_hasher(backend::device_signature(q));
+        }
+
+        static std::string file(const std::string &key) {
+            return appdata_path() + path_delim() + "calibration" + path_delim() + key;
+        }
+
+        // Should be called under the lock.
+        static params& load(const std::string &key) {
+            auto d = data::devices.find(key);
+            if (d != data::devices.end()) return d->second;
+
+            params &p = data::devices[key];
+
+            // The first line holds the device signature.
+            std::ifstream f(file(key));
+            std::string line;
+            std::getline(f, line);
+
+            std::string name;
+            double value;
+            while(f >> name >> value) p[name] = value;
+
+            return p;
+        }
+
+        // Should be called under the lock. The file is replaced atomically,
+        // so that the concurrent processes never see a partially written
+        // file. Failures to write (e.g. a read-only home directory) are
+        // ignored: the data is then only kept for the lifetime of the process.
+        static void save(const std::string &key, const std::string &signature,
+                const params &p)
+        {
+            try {
+                boost::filesystem::path fname(file(key));
+                boost::filesystem::create_directories(fname.parent_path());
+
+                boost::filesystem::path tmp = fname;
+                tmp += boost::filesystem::unique_path(".%%%%-%%%%-%%%%");
+
+                bool written;
+                {
+                    std::ofstream f(tmp.string());
+                    f << "# " << signature << "\n" << std::setprecision(17);
+                    for(auto v = p.begin(); v != p.end(); ++v)
+                        f << v->first << " " << v->second << "\n";
+                    written = static_cast<bool>(f);
+                }
+
+                if (written)
+                    boost::filesystem::rename(tmp, fname);
+                else
+                    boost::filesystem::remove(tmp);
+            } catch(...) {
+            }
+        }
+};
+
+} // namespace vex
+
+#endif
@@ -88,6 +88,15 @@ struct terminal_preamble< casted_expession<T, Expr> > {
     }
 };
 
+template <typename T, class Expr>
+struct terminal_traffic< casted_expession<T, Expr> > {
+    static void get(const casted_expession<T, Expr> &term,
+            detail::expression_traffic &ctx)
+    {
+        boost::proto::eval(boost::proto::as_child(term.expr), ctx);
+    }
+};
+
 template <typename T, class Expr>
 struct kernel_param_declaration< casted_expession<T, Expr> > {
     static void get(backend::source_generator &src,
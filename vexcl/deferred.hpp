@@ -0,0 +1,267 @@
+#ifndef VEXCL_DEFERRED_HPP
+#define VEXCL_DEFERRED_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2017 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/deferred.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Deferred execution of vector assignments with loop fusion.
+ */
+
+#include <map>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <memory>
+#include <exception>
+#include <algorithm>
+
+#include <boost/thread.hpp>
+#include <boost/utility.hpp>
+
+#include <vexcl/backend.hpp>
+#include <vexcl/operations.hpp>
+#include <vexcl/cache.hpp>
+
+namespace vex {
+
+/// Deferred execution scope.
+/**
+ * While an instance of the class is alive, the element-wise assignments to
+ * vex::vector instances made by the current thread are not executed
+ * immediately. Instead, the consecutive assignments with the same queue list
+ * and partitioning are collected and executed by a single fused kernel, so
+ * that each vector is loaded from (and stored to) the device memory once per
+ * batch instead of once per statement:
+ * \code
+ * {
+ *     vex::deferred_scope deferred;
+ *
+ *     r = b - r;
+ *     p = r + beta * p;   // Reads r computed above.
+ *     x += alpha * p;
+ * }   // A single kernel is launched here.
+ * \endcode
+ *
+ * An assignment is deferred when its expression consists of vectors,
+ * scalars, element indices, and builtin or user-defined functions. Each
+ * statement of the fused kernel is computed for the same element index as
+ * the statements before it, so the read-after-write dependencies between the
+ * statements are preserved. Any other statements (e.g. the ones involving
+ * sparse matrices, stencils, permutations, or reductions) are executed
+ * immediately.
+ *
+ * The pending statements are executed (flushed) when the scope ends, when
+ * flush() is called, when the batch is full, or when any other operation
+ * touches a vector referenced by the pending statements: a reduction or a
+ * kernel that takes the vector as an argument, a host read or write, an
+ * element access, a resize, or the destruction of the vector.
+ *
+ * The fused kernels are cached by the sequence of the statement types, so
+ * a loop body executed repeatedly is only compiled once.
+ */
+class deferred_scope : public detail::deferred_recorder, boost::noncopyable {
+    public:
+        /// Starts the deferred scope for the current thread.
+        /**
+         * \param max_statements The maximum number of statements fused
+         *                       into a single kernel.
+         */
+        explicit deferred_scope(size_t max_statements = 16)
+            : prev(current()), max_statements(std::max<size_t>(1, max_statements)),
+              nflush(0)
+        {
+            // The statements pending in the enclosing scope are not visible
+            // from this one.
+            if (prev) prev->flush(nullptr);
+            current() = this;
+        }
+
+        /// Executes the pending statements and ends the scope.
+        /**
+         * The pending statements are discarded when the scope is left due
+         * to an exception.
+         */
+        ~deferred_scope() noexcept(false) {
+            current() = prev;
+
+#ifdef __cpp_lib_uncaught_exceptions
+            if (std::uncaught_exceptions())
+#else
+            if (std::uncaught_exception())
+#endif
+                batch.clear();
+            else
+                execute();
+        }
+
+        /// Executes the pending statements.
+        void flush() {
+            execute();
+        }
+
+        /// Number of pending statements.
+        size_t pending() const {
+            return batch.size();
+        }
+
+        /// Number of fused kernels launched by the scope so far.
+        size_t kernels() const {
+            return nflush;
+        }
+
+        void record(std::unique_ptr<detail::deferred_statement> s) {
+            if (!batch.empty() && (batch.size() >= max_statements || !compatible(*batch.front(), *s)))
+                execute();
+
+            batch.push_back(std::move(s));
+        }
+
+        void flush(const void *term) {
+            if (batch.empty()) return;
+
+            if (term) {
+                bool referenced = std::any_of(batch.begin(), batch.end(),
+                        [term](const std::unique_ptr<detail::deferred_statement> &s) {
+                            return s->references(term);
+                        });
+
+                if (!referenced) return;
+            }
+
+            execute();
+        }
+    private:
+        detail::deferred_recorder *prev;
+        size_t max_statements;
+        size_t nflush;
+
+        std::vector< std::unique_ptr<detail::deferred_statement> > batch;
+
+        static bool compatible(const detail::deferred_statement &a, const detail::deferred_statement &b) {
+            if (a.part != b.part || a.queue.size() != b.queue.size()) return false;
+
+            backend::compare_queues less;
+            for(size_t i = 0; i < a.queue.size(); ++i)
+                if (less(a.queue[i], b.queue[i]) || less(b.queue[i], a.queue[i]))
+                    return false;
+
+            return true;
+        }
+
+        // Fused kernels are cached by the statement sequence signature.
+        static detail::kernel_cache& fused_cache(const std::string &signature) {
+            static std::map< std::string, std::unique_ptr<detail::kernel_cache> > caches;
+            static boost::mutex mx;
+
+            boost::lock_guard<boost::mutex> lock(mx);
+
+            std::unique_ptr<detail::kernel_cache> &c = caches[signature];
+            if (!c) c.reset(new detail::kernel_cache("deferred"));
+            return *c;
+        }
+
+        static std::string prefix(size_t k) {
+            std::ostringstream s;
+            s << "prm" << k + 1;
+            return s.str();
+        }
+
+        void execute() {
+            if (batch.empty()) return;
+
+            // The statements are taken out of the scope first, so that
+            // setting the kernel arguments does not trigger another flush.
+            std::vector< std::unique_ptr<detail::deferred_statement> > b;
+            b.swap(batch);
+
+            ++nflush;
+
+            std::string signature;
+            for(auto s = b.begin(); s != b.end(); ++s)
+                signature += (*s)->signature() + ";";
+
+            detail::kernel_cache &cache = fused_cache(signature);
+
+            const std::vector<backend::command_queue> &queue = b.front()->queue;
+            const std::vector<size_t>                 &part  = b.front()->part;
+
+            for(unsigned d = 0; d < queue.size(); d++) {
+                auto kernel = cache.find(queue[d]);
+
+                backend::select_context(queue[d]);
+
+                if (kernel == cache.end()) {
+                    backend::source_generator source(queue[d]);
+
+                    auto pre_state = detail::empty_state();
+                    for(size_t k = 0; k < b.size(); ++k)
+                        b[k]->preamble(source, queue[d], prefix(k), pre_state);
+
+                    source.begin_kernel("vexcl_deferred_kernel");
+                    source.begin_kernel_parameters();
+                    source.parameter<size_t>("n");
+
+                    auto prm_state = detail::empty_state();
+                    for(size_t k = 0; k < b.size(); ++k)
+                        b[k]->parameters(source, queue[d], prefix(k), prm_state);
+
+                    source.end_kernel_parameters();
+
+                    // The statements may write to the vectors that the next
+                    // statements read, so the pointers may alias here.
+                    source.grid_stride_loop().open("{");
+
+                    auto loc_state = detail::empty_state();
+                    for(size_t k = 0; k < b.size(); ++k)
+                        b[k]->body(source, queue[d], prefix(k), loc_state);
+
+                    source.close("}").end_kernel();
+
+                    kernel = cache.insert(queue[d], backend::kernel(
+                                queue[d], source.str(), "vexcl_deferred_kernel"));
+
+                    detail::kernel_traffic t;
+                    for(size_t k = 0; k < b.size(); ++k)
+                        b[k]->traffic(t);
+                    t.set(kernel->second);
+                }
+
+                if (size_t psize = part[d + 1] - part[d]) {
+                    kernel->second.push_arg(psize);
+
+                    for(size_t k = 0; k < b.size(); ++k)
+                        b[k]->arguments(kernel->second, d, part[d]);
+
+                    kernel->second(queue[d]);
+                }
+            }
+        }
+};
+
+} // namespace vex
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef VEXCL_DETAIL_CACHE_REGISTER_HPP
+#define VEXCL_DETAIL_CACHE_REGISTER_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2017 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/detail/cache_register.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Register of the caches cleared by vex::purge_caches().
+ *
+ * \note Included by the backends as well, so it only relies on the
+ * vex::backend::command_queue being declared.
+ */
+
+#include <set>
+
+#include <boost/thread.hpp>
+
+namespace vex {
+namespace detail {
+
+// Abstract base class for object cache.
+struct object_cache_base;
+
+// List of all active caches.
+template <bool dummy = true>
+struct cache_register {
+    static_assert(dummy, "Dummy parameter should be true");
+
+    static std::set<object_cache_base*> caches;
+    static boost::mutex caches_mx;
+
+    static void add(object_cache_base *cache) {
+        boost::lock_guard<boost::mutex> lock(caches_mx);
+        caches.insert(cache);
+    }
+
+    static void remove(object_cache_base *cache) {
+        boost::lock_guard<boost::mutex> lock(caches_mx);
+        caches.erase(cache);
+    }
+
+    static void clear();
+    static void erase(const backend::command_queue &q);
+};
+
+template <bool dummy>
+std::set<object_cache_base*> cache_register<dummy>::caches;
+
+template <bool dummy>
+boost::mutex cache_register<dummy>::caches_mx;
+
+// Abstract base class for object cache.
+struct object_cache_base {
+    virtual void clear() = 0;
+    virtual void erase(const backend::command_queue &q) = 0;
+    virtual ~object_cache_base() {}
+};
+
+template <bool dummy>
+void cache_register<dummy>::clear() {
+    boost::lock_guard<boost::mutex> lock(caches_mx);
+    for(auto c = caches.begin(); c != caches.end(); ++c)
+        (*c)->clear();
+}
+
+template <bool dummy>
+void cache_register<dummy>::erase(const backend::command_queue &q) {
+    boost::lock_guard<boost::mutex> lock(caches_mx);
+    for(auto c = caches.begin(); c != caches.end(); ++c)
+        (*c)->erase(q);
+}
+
+} // namespace detail
+} // namespace vex
+
+#endif
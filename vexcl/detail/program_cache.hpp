@@ -0,0 +1,146 @@
+#ifndef VEXCL_DETAIL_PROGRAM_CACHE_HPP
+#define VEXCL_DETAIL_PROGRAM_CACHE_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2017 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/detail/program_cache.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Online cache of the programs built by the backends.
+ */
+
+#include <map>
+#include <string>
+#include <utility>
+
+#include <boost/thread.hpp>
+#include <boost/utility.hpp>
+
+#include <vexcl/detail/cache_register.hpp>
+
+namespace vex {
+namespace detail {
+
+// Programs built from the sources, indexed by the context and the hash of the
+// source and the compile options. Identical sources generated by different
+// kernel caches (e.g. for the expression types that only differ in the
+// terminal types) share a single program. The cache is cleared by
+// vex::purge_caches(), so that the contexts held by the programs may be
+// released.
+template <class Program>
+class program_cache : public object_cache_base, boost::noncopyable {
+    public:
+        static program_cache& get() {
+            static program_cache cache;
+            return cache;
+        }
+
+        bool find(const backend::command_queue &q, const std::string &hash,
+                Program &program) const
+        {
+            boost::lock_guard<boost::mutex> lock(mx);
+
+            auto p = programs.find(std::make_pair(backend::get_context(q), hash));
+            if (p == programs.end()) return false;
+
+            program = p->second;
+            return true;
+        }
+
+        // Returns false and replaces the program with the cached one if
+        // another thread got there first.
+        bool insert(const backend::command_queue &q, const std::string &hash,
+                Program &program)
+        {
+            boost::lock_guard<boost::mutex> lock(mx);
+
+            auto p = programs.insert(std::make_pair(
+                        std::make_pair(backend::get_context(q), hash), program));
+
+            if (!p.second) program = p.first->second;
+            return p.second;
+        }
+
+        void erase(const backend::command_queue &q, const std::string &hash) {
+            boost::lock_guard<boost::mutex> lock(mx);
+            programs.erase(std::make_pair(backend::get_context(q), hash));
+        }
+
+        void clear() {
+            store_type released;
+            {
+                boost::lock_guard<boost::mutex> lock(mx);
+                released.swap(programs);
+            }
+        }
+
+        void erase(const backend::command_queue &q) {
+            backend::context ctx = backend::get_context(q);
+            backend::compare_contexts cmp;
+
+            store_type released;
+            {
+                boost::lock_guard<boost::mutex> lock(mx);
+
+                for(auto p = programs.begin(); p != programs.end(); ) {
+                    if (!cmp(p->first.first, ctx) && !cmp(ctx, p->first.first)) {
+                        released.insert(*p);
+                        programs.erase(p++);
+                    } else {
+                        ++p;
+                    }
+                }
+            }
+        }
+    private:
+        typedef std::pair<backend::context, std::string> key_type;
+
+        struct compare {
+            bool operator()(const key_type &a, const key_type &b) const {
+                backend::compare_contexts cmp;
+                if (cmp(a.first, b.first)) return true;
+                if (cmp(b.first, a.first)) return false;
+                return a.second < b.second;
+            }
+        };
+
+        typedef std::map<key_type, Program, compare> store_type;
+
+        store_type programs;
+        mutable boost::mutex mx;
+
+        program_cache() {
+            cache_register<true>::add(this);
+        }
+
+        ~program_cache() {
+            cache_register<true>::remove(this);
+        }
+};
+
+} // namespace detail
+} // namespace vex
+
+#endif
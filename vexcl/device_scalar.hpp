@@ -0,0 +1,182 @@
+#ifndef VEXCL_DEVICE_SCALAR_HPP
+#define VEXCL_DEVICE_SCALAR_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2017 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/device_scalar.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Scalar value residing in device memory.
+ */
+
+#include <vector>
+
+#include <vexcl/backend.hpp>
+#include <vexcl/operations.hpp>
+
+namespace vex {
+
+struct device_scalar_terminal {};
+
+typedef vector_expression<
+    typename boost::proto::terminal< device_scalar_terminal >::type
+    > device_scalar_terminal_expression;
+
+/// Scalar value residing in device memory.
+/**
+ * The value is replicated on each device in the queue list. Device scalars
+ * are returned by vex::Reductor::async() and may be used in vector
+ * expressions without reading the value back to the host:
+ * \code
+ * vex::Reductor<double> sum(ctx);
+ *
+ * vex::device_scalar<double> rr = sum.async(r * r);
+ * vex::device_scalar<double> pq = sum.async(p * q);
+ *
+ * x += (rr / pq) * p;
+ * \endcode
+ * The instances are cheap to copy: the copies share the device memory.
+ */
+template <typename T>
+class device_scalar : public device_scalar_terminal_expression {
+    public:
+        typedef T value_type;
+
+        /// Empty constructor.
+        device_scalar() {}
+
+        /// Allocates the scalar on each of the given queues.
+        explicit device_scalar(const std::vector<backend::command_queue> &queue)
+            : queue(queue)
+        {
+            for(auto q = queue.begin(); q != queue.end(); ++q)
+                buf.push_back(backend::device_vector<T>(*q, 1));
+        }
+
+        /// Allocates the scalar and sets its value on each of the given queues.
+        device_scalar(const std::vector<backend::command_queue> &queue, const T &value)
+            : queue(queue)
+        {
+            for(auto q = queue.begin(); q != queue.end(); ++q)
+                buf.push_back(backend::device_vector<T>(*q, 1, &value));
+        }
+
+        device_scalar(const device_scalar&) = default;
+        device_scalar& operator=(const device_scalar&) = default;
+
+        /// Reads the value back to the host.
+        /**
+         * Waits for the operations computing the value to finish.
+         */
+        T get() const {
+            precondition(!buf.empty(), "Empty device scalar");
+
+            T val;
+            buf[0].read(queue[0], 0, 1, &val, true);
+            return val;
+        }
+
+        /// Sets the value on each device.
+        void set(const T &value) {
+            for(unsigned d = 0; d < queue.size(); ++d)
+                buf[d].write(queue[d], 0, 1, &value, true);
+        }
+
+        /// Returns the device memory of the scalar on the given device.
+        const backend::device_vector<T>& operator()(unsigned d = 0) const {
+            return buf[d];
+        }
+
+        /// Returns the queue list of the scalar.
+        const std::vector<backend::command_queue>& queue_list() const {
+            return queue;
+        }
+
+        /// Returns the number of devices the scalar is allocated on.
+        size_t nparts() const {
+            return buf.size();
+        }
+    private:
+        std::vector<backend::command_queue> queue;
+        std::vector< backend::device_vector<T> > buf;
+};
+
+namespace traits {
+
+template <>
+struct is_vector_expr_terminal< device_scalar_terminal > : std::true_type {};
+
+template <>
+struct proto_terminal_is_value< device_scalar_terminal > : std::true_type {};
+
+// The expressions hold device scalars by value, and the copies share the
+// device memory, so that deferred statements keep the scalars alive.
+template <typename T>
+struct is_deferrable_terminal< device_scalar<T> > : std::true_type {};
+
+template <typename T>
+struct kernel_param_declaration< device_scalar<T> >
+{
+    static void get(backend::source_generator &src,
+            const device_scalar<T>&,
+            const backend::command_queue&, const std::string &prm_name,
+            detail::kernel_generator_state_ptr)
+    {
+        src.parameter< global_ptr<const T> >(prm_name);
+    }
+};
+
+template <typename T>
+struct partial_vector_expr< device_scalar<T> >
+{
+    static void get(backend::source_generator &src,
+            const device_scalar<T>&,
+            const backend::command_queue&, const std::string &prm_name,
+            detail::kernel_generator_state_ptr)
+    {
+        src << prm_name << "[0]";
+    }
+};
+
+template <typename T>
+struct kernel_arg_setter< device_scalar<T> >
+{
+    static void set(const device_scalar<T> &term,
+            backend::kernel &kernel, unsigned device, size_t/*index_offset*/,
+            detail::kernel_generator_state_ptr)
+    {
+        precondition(device < term.nparts(),
+                "Device scalar is not allocated on the device");
+
+        kernel.push_arg(term(device));
+    }
+};
+
+// Device scalars, as host scalars, do not have size or partitioning.
+
+} // namespace traits
+} // namespace vex
+
+#endif
@@ -60,6 +60,9 @@ namespace traits {
 template <>
 struct is_vector_expr_terminal< elem_index > : std::true_type {};
 
+template <>
+struct is_deferrable_terminal< elem_index > : std::true_type {};
+
 template <>
 struct is_multivector_expr_terminal< elem_index > : std::true_type {};
 
@@ -59,7 +59,7 @@ void eval(const Expr &expr,
                 );
     }
 #endif
-    static kernel_cache cache;
+    static kernel_cache cache("eval");
 
     for(unsigned d = 0; d < queue.size(); d++) {
         auto kernel = cache.find(queue[d]);
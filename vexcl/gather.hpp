@@ -107,7 +107,7 @@ class gather : protected detail::index_partition<T> {
         void operator()(const vex::vector<T> &src, HostVector &dst) {
             using namespace detail;
 
-            static kernel_cache cache;
+            static kernel_cache cache("gather");
 
             for(unsigned d = 0; d < Base::queue.size(); d++) {
                 if (size_t n = Base::ptr[d + 1] - Base::ptr[d]) {
@@ -148,7 +148,7 @@ class scatter : protected detail::index_partition<T> {
         void operator()(const HostVector &src, vex::vector<T> &dst) {
             using namespace detail;
 
-            static kernel_cache cache;
+            static kernel_cache cache("gather");
 
             for(unsigned d = 0; d < Base::queue.size(); d++) {
                 if (size_t n = Base::ptr[d + 1] - Base::ptr[d]) {
@@ -0,0 +1,485 @@
+#ifndef VEXCL_KERNEL_REGISTRY_HPP
+#define VEXCL_KERNEL_REGISTRY_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2017 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/kernel_registry.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Registry of the compiled kernels with compile and launch statistics.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <algorithm>
+#include <cstdio>
+
+#include <boost/thread.hpp>
+#include <boost/io/ios_state.hpp>
+
+#include <vexcl/util.hpp>
+
+namespace vex {
+
+/// Statistics of a kernel in vex::kernel_registry.
+struct kernel_record {
+    /// Subsystem that created the kernel (e.g. "vector", "reductor", "sort").
+    std::string subsystem;
+
+    /// Kernel name.
+    std::string name;
+
+    /// Hash of the kernel source and compile options.
+    std::string hash;
+
+    /// Number of times the kernel was built from source in this process.
+    size_t builds;
+
+    /// Number of times the kernel source was compiled.
+    /**
+     * Kernels loaded from the offline cache are built, but not compiled.
+     */
+    size_t compiles;
+
+    /// Number of kernel launches.
+    size_t launches;
+
+    /// Total compilation time, in seconds.
+    double compile_time;
+
+    /// Total execution time, in seconds.
+    /**
+     * Only measured while vex::kernel_registry::profiling() is enabled.
+     */
+    double run_time;
+
+    /// Estimated bytes read from device memory per element.
+    size_t bytes_read;
+
+    /// Estimated bytes written to device memory per element.
+    size_t bytes_written;
+
+    /// Estimated arithmetic operations per element.
+    size_t flops;
+
+    /// Number of elements processed by the kernel launches.
+    size_t elements;
+
+    /// Whether the traffic of the kernel is known.
+    /**
+     * The traffic is estimated for the kernels generated from vector
+     * expressions: assignments (including multiexpressions and the fused
+     * kernels of vex::deferred), reductions, and fused reductions. Terminals
+     * without the traffic information (e.g. sparse matrices, stencils, or the
+     * buffers read by user functions) are not counted, and the estimate is
+     * taken at the first launch of the kernel.
+     */
+    bool has_traffic;
+
+    /// Achieved memory bandwidth, in GB/s.
+    double bandwidth() const {
+        return run_time > 0 ? 1e-9 * (bytes_read + bytes_written) * elements / run_time : 0;
+    }
+
+    /// Achieved arithmetic performance, in GFLOP/s.
+    double performance() const {
+        return run_time > 0 ? 1e-9 * flops * elements / run_time : 0;
+    }
+};
+
+namespace detail {
+
+// Counters of a kernel registry entry. Shared by the kernel objects built
+// from the same source, and updated without locking.
+struct kernel_stats {
+    const std::string name;
+    const std::string hash;
+
+    std::atomic<size_t> builds;
+    std::atomic<size_t> compiles;
+    std::atomic<size_t> launches;
+    std::atomic<size_t> elements;
+
+    std::atomic<long long> compile_ns;
+    std::atomic<long long> run_ns;
+
+    kernel_stats(const std::string &name, const std::string &hash)
+        : name(name), hash(hash),
+          builds(0), compiles(0), launches(0), elements(0),
+          compile_ns(0), run_ns(0)
+    {}
+
+    void compiled(std::chrono::nanoseconds t) {
+        ++compiles;
+        compile_ns += t.count();
+    }
+
+    void launched(size_t n) {
+        launches.fetch_add(1, std::memory_order_relaxed);
+        elements.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void ran(std::chrono::nanoseconds t) {
+        run_ns.fetch_add(t.count(), std::memory_order_relaxed);
+    }
+};
+
+template <bool dummy = true>
+struct kernel_registry_data {
+    static_assert(dummy, "Dummy parameter should be true");
+
+    struct entry {
+        std::string subsystem;
+        std::shared_ptr<kernel_stats> stats;
+
+        // Estimated traffic per element.
+        bool   has_traffic;
+        size_t bytes_read;
+        size_t bytes_written;
+        size_t flops;
+
+        entry() : has_traffic(false), bytes_read(0), bytes_written(0), flops(0) {}
+    };
+
+    // Entries are indexed by hash and name, so that the entries of a
+    // program are adjacent.
+    static std::map<std::pair<std::string, std::string>, entry> entries;
+    static boost::mutex mx;
+
+    static std::atomic<bool> profiling;
+};
+
+template <bool dummy>
+std::map<std::pair<std::string, std::string>, typename kernel_registry_data<dummy>::entry>
+kernel_registry_data<dummy>::entries;
+
+template <bool dummy>
+boost::mutex kernel_registry_data<dummy>::mx;
+
+template <bool dummy>
+std::atomic<bool> kernel_registry_data<dummy>::profiling(
+        vex::getenv("VEXCL_PROFILE_KERNELS") != nullptr);
+
+} // namespace detail
+
+/// Registry of the kernels built by VexCL.
+/**
+ * Every kernel built from source is entered into the registry together with
+ * the hash of its source, the subsystem that created it (the name of the
+ * kernel cache it is stored in), the number of builds and compilations with
+ * the total compile time, the number of launches, and the total execution
+ * time. The kernels built from the same source share the entry, so that
+ * kernels that are rebuilt too often (e.g. after vex::purge_caches()) are
+ * easy to spot:
+ * \code
+ * for(const auto &k : vex::kernel_registry::list())
+ *     if (k.builds > 1) std::cout << k.subsystem << ": " << k.name << std::endl;
+ *
+ * vex::kernel_registry::json(std::cout);
+ * \endcode
+ * The execution time is only measured while profiling is enabled either
+ * with vex::kernel_registry::profiling(true) or with the
+ * VEXCL_PROFILE_KERNELS environment variable.
+ *
+ * The statistics are collected by the backends that support them (currently
+ * the JIT backend).
+ */
+class kernel_registry {
+    public:
+        /// Returns the statistics of all registered kernels.
+        static std::vector<kernel_record> list() {
+            boost::lock_guard<boost::mutex> lock(data::mx);
+
+            std::vector<kernel_record> records;
+            records.reserve(data::entries.size());
+
+            for(auto e = data::entries.begin(); e != data::entries.end(); ++e) {
+                const detail::kernel_stats &s = *e->second.stats;
+
+                kernel_record r;
+                r.subsystem    = e->second.subsystem;
+                r.name         = s.name;
+                r.hash         = s.hash;
+                r.builds       = s.builds;
+                r.compiles     = s.compiles;
+                r.launches     = s.launches;
+                r.compile_time = 1e-9 * s.compile_ns;
+                r.run_time     = 1e-9 * s.run_ns;
+
+                r.has_traffic   = e->second.has_traffic;
+                r.bytes_read    = e->second.bytes_read;
+                r.bytes_written = e->second.bytes_written;
+                r.flops         = e->second.flops;
+                r.elements      = s.elements;
+
+                records.push_back(r);
+            }
+
+            return records;
+        }
+
+        /// Writes the statistics of all registered kernels as a JSON array.
+        static void json(std::ostream &os) {
+            std::vector<kernel_record> records = list();
+
+            os << "[";
+            for(auto r = records.begin(); r != records.end(); ++r) {
+                if (r != records.begin()) os << ",";
+                os << "\n  {"
+                   << "\"subsystem\": " << quoted(r->subsystem) << ", "
+                   << "\"name\": "      << quoted(r->name)      << ", "
+                   << "\"hash\": "      << quoted(r->hash)      << ", "
+                   << "\"builds\": "        << r->builds        << ", "
+                   << "\"compiles\": "      << r->compiles      << ", "
+                   << "\"launches\": "      << r->launches      << ", "
+                   << "\"compile_time\": "  << r->compile_time  << ", "
+                   << "\"run_time\": "      << r->run_time;
+
+                if (r->has_traffic)
+                    os << ", "
+                       << "\"bytes_read\": "    << r->bytes_read    << ", "
+                       << "\"bytes_written\": " << r->bytes_written << ", "
+                       << "\"flops\": "         << r->flops         << ", "
+                       << "\"elements\": "      << r->elements      << ", "
+                       << "\"bandwidth\": "     << r->bandwidth()   << ", "
+                       << "\"performance\": "   << r->performance();
+
+                os << "}";
+            }
+            os << (records.empty() ? "]" : "\n]") << std::endl;
+        }
+
+        /// Writes the achieved bandwidth and performance of the profiled kernels.
+        /**
+         * The kernels with known traffic are listed in the order of
+         * decreasing total run time.
+         */
+        static void report(std::ostream &os) {
+            std::vector<kernel_record> records = list();
+
+            records.erase(std::remove_if(records.begin(), records.end(),
+                        [](const kernel_record &r) {
+                            return !r.has_traffic || r.run_time <= 0;
+                        }), records.end());
+
+            std::sort(records.begin(), records.end(),
+                    [](const kernel_record &a, const kernel_record &b) {
+                        return a.run_time > b.run_time;
+                    });
+
+            boost::io::ios_all_saver stream_state(os);
+
+            os << std::left
+               << std::setw(16) << "subsystem"
+               << std::setw(24) << "kernel"
+               << std::right
+               << std::setw(10) << "launches"
+               << std::setw(12) << "time, s"
+               << std::setw(10) << "B/elem"
+               << std::setw(10) << "flop/elem"
+               << std::setw(10) << "GB/s"
+               << std::setw(10) << "GFLOP/s"
+               << std::endl;
+
+            for(auto r = records.begin(); r != records.end(); ++r) {
+                os << std::left
+                   << std::setw(16) << r->subsystem
+                   << std::setw(24) << r->name
+                   << std::right << std::fixed
+                   << std::setw(10) << r->launches
+                   << std::setw(12) << std::setprecision(6) << r->run_time
+                   << std::setw(10) << r->bytes_read + r->bytes_written
+                   << std::setw(10) << r->flops
+                   << std::setw(10) << std::setprecision(2) << r->bandwidth()
+                   << std::setw(10) << std::setprecision(2) << r->performance()
+                   << std::endl;
+            }
+        }
+
+        /// Returns the statistics of all registered kernels as a JSON array.
+        static std::string json() {
+            std::ostringstream s;
+            json(s);
+            return s.str();
+        }
+
+        /// Whether the kernel execution time is measured.
+        static bool profiling() {
+            return data::profiling;
+        }
+
+        /// Enables or disables the measurement of the kernel execution time.
+        static void profiling(bool enable) {
+            data::profiling = enable;
+        }
+
+        /// Resets the counters of all registered kernels.
+        static void reset() {
+            boost::lock_guard<boost::mutex> lock(data::mx);
+
+            for(auto e = data::entries.begin(); e != data::entries.end(); ++e) {
+                detail::kernel_stats &s = *e->second.stats;
+
+                s.builds     = 0;
+                s.compiles   = 0;
+                s.launches   = 0;
+                s.elements   = 0;
+                s.compile_ns = 0;
+                s.run_ns     = 0;
+            }
+        }
+
+        /// Returns the registry entry for the kernel built from the source with the given hash.
+        /**
+         * Used by the backends. Counts the build of the kernel.
+         */
+        static std::shared_ptr<detail::kernel_stats> acquire(
+                const std::string &hash, const std::string &name)
+        {
+            boost::lock_guard<boost::mutex> lock(data::mx);
+
+            auto &e = data::entries[std::make_pair(hash, name)];
+            if (!e.stats) e.stats = std::make_shared<detail::kernel_stats>(name, hash);
+
+            ++e.stats->builds;
+            return e.stats;
+        }
+
+        /// Records the compilation of the source with the given hash.
+        /**
+         * Used by the backends. The time is attributed to every kernel
+         * registered with the hash.
+         */
+        static void compiled(const std::string &hash, std::chrono::nanoseconds t) {
+            boost::lock_guard<boost::mutex> lock(data::mx);
+
+            for(auto e = data::entries.lower_bound(std::make_pair(hash, std::string()));
+                    e != data::entries.end() && e->first.first == hash; ++e)
+                e->second.stats->compiled(t);
+        }
+
+        /// Sets the estimated traffic per element of the registered kernel.
+        /**
+         * Used by the kernel generators.
+         */
+        static void traffic(const detail::kernel_stats &stats,
+                size_t bytes_read, size_t bytes_written, size_t flops)
+        {
+            boost::lock_guard<boost::mutex> lock(data::mx);
+
+            auto e = data::entries.find(std::make_pair(stats.hash, stats.name));
+            if (e == data::entries.end()) return;
+
+            e->second.has_traffic   = true;
+            e->second.bytes_read    = bytes_read;
+            e->second.bytes_written = bytes_written;
+            e->second.flops         = flops;
+        }
+
+        /// Sets the subsystem of the registered kernel.
+        /**
+         * Used by the kernel caches.
+         */
+        static void tag(const detail::kernel_stats &stats, const std::string &subsystem) {
+            boost::lock_guard<boost::mutex> lock(data::mx);
+
+            auto e = data::entries.find(std::make_pair(stats.hash, stats.name));
+            if (e != data::entries.end() && e->second.subsystem.empty())
+                e->second.subsystem = subsystem;
+        }
+    private:
+        typedef detail::kernel_registry_data<true> data;
+
+        static std::string quoted(const std::string &s) {
+            std::string q = "\"";
+            for(auto c = s.begin(); c != s.end(); ++c) {
+                switch (*c) {
+                    case '"':  q += "\\\""; break;
+                    case '\\': q += "\\\\"; break;
+                    case '\n': q += "\\n";  break;
+                    default:
+                        if (static_cast<unsigned char>(*c) < 0x20) {
+                            char buf[8];
+                            std::snprintf(buf, sizeof(buf), "\\u%04x", *c);
+                            q += buf;
+                        } else {
+                            q += *c;
+                        }
+                }
+            }
+            return q + "\"";
+        }
+};
+
+namespace detail {
+
+// Enters the subsystem of a kernel into the registry. The kernels of the
+// backends that do not collect the statistics are ignored.
+template <class Kernel>
+auto tag_kernel(const Kernel &k, const std::string &subsystem, int)
+    -> decltype(k.statistics(), void())
+{
+    if (k.statistics()) kernel_registry::tag(*k.statistics(), subsystem);
+}
+
+template <class Kernel>
+void tag_kernel(const Kernel&, const std::string&, long) {}
+
+template <class Kernel>
+void tag_kernel(const Kernel &k, const std::string &subsystem) {
+    tag_kernel(k, subsystem, 0);
+}
+
+// Enters the estimated traffic of a kernel into the registry.
+template <class Kernel>
+auto set_kernel_traffic(const Kernel &k,
+        size_t bytes_read, size_t bytes_written, size_t flops, int)
+    -> decltype(k.statistics(), void())
+{
+    if (k.statistics())
+        kernel_registry::traffic(*k.statistics(), bytes_read, bytes_written, flops);
+}
+
+template <class Kernel>
+void set_kernel_traffic(const Kernel&, size_t, size_t, size_t, long) {}
+
+template <class Kernel>
+void set_kernel_traffic(const Kernel &k,
+        size_t bytes_read, size_t bytes_written, size_t flops)
+{
+    set_kernel_traffic(k, bytes_read, bytes_written, flops, 0);
+}
+
+} // namespace detail
+} // namespace vex
+
+#endif
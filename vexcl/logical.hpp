@@ -99,7 +99,7 @@ class any_of {
                 )
         {
             using namespace detail;
-            static kernel_cache cache;
+            static kernel_cache cache("logical");
 
             auto kernel = cache.find(q);
 
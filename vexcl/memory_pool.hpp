@@ -0,0 +1,101 @@
+#ifndef VEXCL_MEMORY_POOL_HPP
+#define VEXCL_MEMORY_POOL_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2017 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/memory_pool.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Control over the pooled allocation of device memory.
+ */
+
+#include <vector>
+#include <vexcl/backend.hpp>
+#include <vexcl/backend/memory_pool.hpp>
+#include <vexcl/devlist.hpp>
+
+namespace vex {
+
+/// Pooled allocation of device memory.
+/**
+ * When the pool is enabled, the memory released by vex::vector and
+ * backend::device_vector instances (including the temporary buffers of
+ * reductors, sort, scan, etc.) is cached and reused by the subsequent
+ * allocations in the same command queue. This removes the allocation churn
+ * in the loops creating many short-lived vectors.
+ */
+namespace memory_pool {
+
+/// Enables or disables the pool for all command queues.
+/**
+ * This also resets the per-queue settings.
+ */
+inline void enable(bool on = true) {
+    detail::memory_pool::get().enable(on);
+}
+
+/// Enables or disables the pool for the given command queue.
+inline void enable(const backend::command_queue &q, bool on = true) {
+    detail::memory_pool::get().enable(backend::detail::pool_key(q), on);
+}
+
+/// Enables or disables the pool for the given queues.
+inline void enable(const std::vector<backend::command_queue> &queue, bool on = true) {
+    for(auto q = queue.begin(); q != queue.end(); ++q)
+        enable(*q, on);
+}
+
+/// Enables or disables the pool for the queues of the given context.
+inline void enable(const Context &ctx, bool on = true) {
+    enable(ctx.queue(), on);
+}
+
+/// Whether the pool is enabled for the given command queue.
+inline bool enabled(const backend::command_queue &q) {
+    return detail::memory_pool::get().enabled(backend::detail::pool_key(q));
+}
+
+/// Releases all cached memory. Returns the number of released bytes.
+inline size_t trim() {
+    return detail::memory_pool::get().trim();
+}
+
+/// Releases the memory cached for the given queues. Returns the number of released bytes.
+inline size_t trim(const std::vector<backend::command_queue> &queue) {
+    size_t bytes = 0;
+    for(auto q = queue.begin(); q != queue.end(); ++q)
+        bytes += detail::memory_pool::get().trim(backend::detail::pool_key(*q));
+    return bytes;
+}
+
+/// Pool statistics.
+inline memory_pool_stats stats() {
+    return detail::memory_pool::get().stats();
+}
+
+} // namespace memory_pool
+} // namespace vex
+
+#endif
@@ -308,6 +308,19 @@ class multivector : public multivector_terminal_expression {
             for(unsigned i = 0; i < N; i++) vec[i].resize(size);
         }
 
+        /// Moves the data of all components to the given partition.
+        /**
+         * See vex::vector::repartition().
+         */
+        void repartition(const std::vector<size_t> &part) {
+            for(unsigned i = 0; i < N; i++) vec[i].repartition(part);
+        }
+
+        // Returns reference to multivector's partition.
+        const std::vector<size_t>& partition() const {
+            return vec[0].partition();
+        }
+
         /// Fills the multivector with zeros.
         void clear() {
             *this = static_cast<T>(0);
@@ -35,7 +35,14 @@ THE SOFTWARE.
 #include <tuple>
 #include <deque>
 #include <set>
+#include <map>
+#include <vector>
+#include <string>
+#include <sstream>
 #include <memory>
+#include <algorithm>
+#include <typeinfo>
+#include <climits>
 
 #include <boost/proto/proto.hpp>
 #include <boost/mpl/max.hpp>
@@ -105,6 +112,8 @@ inline kernel_generator_state_ptr empty_state() {
     return std::make_shared<kernel_generator_state>();
 }
 
+struct expression_traffic;
+
 } // namespace detail
 
 namespace traits {
@@ -928,6 +937,39 @@ struct get_dimension<Expr, typename std::enable_if<
     const static size_t value = std::tuple_size<typename std::decay<Expr>::type>::value;
 };
 
+// Identity of a terminal for the common subexpression elimination. Terminals
+// of the same type and identity are passed to a kernel once. The terminals
+// without the specialization are never merged. The identity should not depend
+// on the values passed to the kernel (as with scalars), or else the equal
+// values would need separately compiled kernels.
+template <class T, class Enable = void>
+struct terminal_identity : std::false_type {
+    static void get(const T&, std::string&) {}
+};
+
+// Terminal values as seen by the grammars (see proto_terminal_is_value) for
+// the terminals with known identity.
+template <class T>
+struct is_identity_terminal_value : terminal_identity<T> {};
+
+// Terminals that may take part in deferred (fused) element-wise assignments:
+// the ones that are accessed at the current element index only.
+template <class T, class Enable = void>
+struct is_deferrable_terminal : std::integral_constant<bool,
+        is_cl_native<T>::value ||
+        std::is_base_of<builtin_function, T>::value ||
+        std::is_base_of<user_function, T>::value
+    >
+{};
+
+// Device memory traffic of a terminal per element (see
+// detail::expression_traffic). The terminals without the specialization are
+// not accounted for.
+template <class T, class Enable = void>
+struct terminal_traffic {
+    static void get(const T&, detail::expression_traffic&) {}
+};
+
 } // namespace traits
 
 //---------------------------------------------------------------------------
@@ -988,22 +1030,479 @@ struct extract_terminals
     >
 {};
 
+//---------------------------------------------------------------------------
+// Common subexpression elimination
+//---------------------------------------------------------------------------
+// Terminal object as seen by the kernel generator (see
+// traits::terminal_is_value).
+template <class Term, class Enable = void>
+struct terminal_object {
+    typedef
+        typename std::decay<
+            typename boost::proto::result_of::value<Term>::type
+        >::type
+        type;
+
+    static const type& get(const Term &term) {
+        return boost::proto::value(term);
+    }
+};
+
+template <class Term>
+struct terminal_object<Term,
+    typename std::enable_if<traits::terminal_is_value<Term>::value>::type>
+{
+    typedef Term type;
+
+    static const Term& get(const Term &term) {
+        return term;
+    }
+};
+
+template <class Term>
+struct is_cse_terminal
+    : traits::terminal_identity<
+        typename terminal_object<typename std::decay<Term>::type>::type
+      >
+{};
+
+// Subexpressions that may be computed once and reused: the ones made of the
+// terminals with known identity, and of builtin or user-defined functions.
+struct cse_grammar
+    : boost::proto::or_<
+        boost::proto::and_<
+            boost::proto::terminal< boost::proto::_ >,
+            boost::proto::if_< traits::is_identity_terminal_value< boost::proto::_value >() >
+        >,
+        boost::proto::function<
+            boost::proto::terminal< boost::proto::convertible_to< builtin_function > >,
+            boost::proto::vararg< cse_grammar >
+        >,
+        boost::proto::function<
+            boost::proto::terminal< boost::proto::convertible_to< user_function > >,
+            boost::proto::vararg< cse_grammar >
+        >,
+        boost::proto::and_<
+            boost::proto::not_<
+                boost::proto::or_<
+                    boost::proto::terminal< boost::proto::_ >,
+                    boost::proto::function< boost::proto::vararg< boost::proto::_ > >,
+                    boost::proto::pre_inc < boost::proto::_ >,
+                    boost::proto::pre_dec < boost::proto::_ >,
+                    boost::proto::post_inc< boost::proto::_ >,
+                    boost::proto::post_dec< boost::proto::_ >
+                >
+            >,
+            boost::proto::nary_expr<
+                boost::proto::_,
+                boost::proto::vararg< cse_grammar >
+            >
+        >
+    >
+{};
+
+// Plan of the common subexpression elimination for an expression.
+//
+// Terminals and operations of the expression are numbered in the order the
+// kernel generator visits them. Equal terminals (the same vector, equal
+// scalars) are passed to the kernel once, and the repeated subexpressions are
+// computed once per element (see output_common_subexpression()). The layout of
+// the expression only depends on its type and is built once, so that a launch
+// only compares the identities of the terminals that may be equal. The
+// operations are numbered when the kernel is generated. The kernels generated
+// with a plan are cached by the terminal numbering.
+struct cse_plan {
+    struct operation {
+        int  lead;   // First occurrence of the same subexpression.
+        int  nodes;  // Number of operations in the subtree.
+        int  terms;  // Number of terminals in the subtree.
+        bool reused; // The subexpression occurs more than once.
+    };
+
+    std::vector<int> term; // First occurrence of the same terminal.
+
+    cse_plan() : merged(false), layout(nullptr) {}
+
+    template <class Expr>
+    explicit cse_plan(const Expr &expr)
+        : merged(false), layout(&get_layout(expr))
+    {
+        terminals(expr);
+    }
+
+    template <class LHS, class RHS>
+    cse_plan(const LHS &lhs, const RHS &rhs)
+        : merged(false), layout(&get_layout(lhs, rhs))
+    {
+        terminals(lhs, rhs);
+    }
+
+    // True if the plan does not change the generated code.
+    bool empty() const {
+        return !merged;
+    }
+
+    // Operations of the expression, numbered on the first use.
+    const std::vector<operation>& operations() const {
+        if (merged && op.empty()) number_operations();
+        return op;
+    }
+
+    // Kernel generator state that holds the plan for the given prefix.
+    kernel_generator_state_ptr state(const std::string &prefix) const {
+        kernel_generator_state_ptr s = empty_state();
+        if (merged) {
+            operations();
+            (*s)["cse_" + prefix] = this;
+        }
+        return s;
+    }
+
+    static const cse_plan* find(const kernel_generator_state &state,
+            const std::string &prefix)
+    {
+        if (state.empty()) return nullptr;
+        auto s = state.find("cse_" + prefix);
+        return s == state.end() ? nullptr : boost::any_cast<const cse_plan*>(s->second);
+    }
+
+    private:
+        // The part of the plan that only depends on the expression type.
+        struct layout_type {
+            struct node {
+                int nodes;
+                int terms;
+                const std::type_info *type; // Null if not eliminated.
+                bool guarded;               // In a conditional operand.
+                std::vector<int> args;      // Terminal t, or operation -1-i.
+            };
+
+            // Earlier terminals of the same type (candidates for the merge).
+            std::vector< std::vector<int> > same;
+            // Terminals with a candidate pair, their identity is needed.
+            std::vector<char> keyed;
+            bool mergeable;
+
+            std::vector<node> op;
+
+            template <class... Expr>
+            layout_type(const Expr&... expr) : mergeable(false) {
+                terminal_types types;
+
+                using expand = int[];
+                (void)expand{0, ((void)extract_terminals()(boost::proto::as_child(expr), types), 0)...};
+
+                const int n = static_cast<int>(types.type.size());
+                same.resize(n);
+                keyed.resize(n, 0);
+
+                for(int i = 0; i < n; ++i) {
+                    if (!types.type[i]) continue;
+
+                    for(int j = 0; j < i; ++j) {
+                        if (types.type[j] == types.type[i]) {
+                            same[i].push_back(j);
+                            keyed[i] = keyed[j] = 1;
+                            mergeable = true;
+                        }
+                    }
+                }
+
+                if (mergeable) {
+                    builder b(*this);
+                    (void)expand{0, ((void)boost::proto::eval(boost::proto::as_child(expr), b), 0)...};
+                }
+            }
+        };
+
+        bool merged;
+        const layout_type *layout;
+        mutable std::vector<operation> op;
+
+        template <class... Expr>
+        static const layout_type& get_layout(const Expr&... expr) {
+            static const layout_type l(expr...);
+            return l;
+        }
+
+        // Types of the terminals; null type marks a unique terminal.
+        struct terminal_types {
+            mutable std::vector<const std::type_info*> type;
+
+            template <typename Term>
+            void operator()(const Term&) const {
+                typedef typename terminal_object<Term>::type T;
+                type.push_back(is_cse_terminal<Term>::value ? &typeid(T) : nullptr);
+            }
+        };
+
+        // Identities of the terminals that may be merged.
+        struct terminal_keys {
+            const std::vector<char> &keyed;
+            mutable std::vector<std::string> id;
+
+            terminal_keys(const std::vector<char> &keyed) : keyed(keyed) {}
+
+            template <typename Term>
+            void operator()(const Term &term) const {
+                typedef terminal_object<Term> T;
+                id.push_back(std::string());
+                add(T::get(term), is_cse_terminal<Term>());
+            }
+
+            template <class T>
+            void add(const T &term, std::true_type) const {
+                if (keyed[id.size() - 1])
+                    traits::terminal_identity<T>::get(term, id.back());
+            }
+
+            template <class T>
+            void add(const T&, std::false_type) const {}
+        };
+
+        template <class... Expr>
+        void terminals(const Expr&... expr) {
+            const int n = static_cast<int>(layout->same.size());
+            term.resize(n);
+            for(int i = 0; i < n; ++i) term[i] = i;
+
+            if (!layout->mergeable) return;
+
+            terminal_keys keys(layout->keyed);
+
+            using expand = int[];
+            (void)expand{0, ((void)extract_terminals()(boost::proto::as_child(expr), keys), 0)...};
+
+            for(int i = 0; i < n; ++i) {
+                const std::vector<int> &same = layout->same[i];
+
+                for(auto j = same.begin(); j != same.end(); ++j) {
+                    if (keys.id[*j] == keys.id[i]) {
+                        term[i] = *j;
+                        merged = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        // Finds the repeated operations. The value numbers of terminals are
+        // non-negative, the value numbers of operations are negative.
+        void number_operations() const {
+            const int n = static_cast<int>(layout->op.size());
+
+            op.resize(n);
+            for(int i = 0; i < n; ++i) {
+                operation o = {i, layout->op[i].nodes, layout->op[i].terms, false};
+                op[i] = o;
+            }
+
+            std::vector< std::vector<int> > val(n);
+            for(int i = 0; i < n; i += op[i].nodes) number_operation(i, val);
+
+            // The subexpression is only computed in advance if one of its
+            // occurrences is evaluated unconditionally.
+            std::vector<char> eager(n, 0);
+            for(int i = 0; i < n; ++i)
+                if (!layout->op[i].guarded) eager[op[i].lead] = 1;
+
+            mark_reused(eager);
+        }
+
+        void number_operation(int i, std::vector< std::vector<int> > &val) const {
+            const layout_type::node &o = layout->op[i];
+
+            for(auto a = o.args.begin(); a != o.args.end(); ++a) {
+                if (*a < 0) number_operation(-1 - *a, val);
+                val[i].push_back(*a >= 0 ? term[*a] : -1 - op[-1 - *a].lead);
+            }
+
+            if (!o.type) return;
+
+            for(int j = 0; j < i; ++j) {
+                if (layout->op[j].type == o.type && val[j] == val[i]) {
+                    op[i].lead = j;
+                    break;
+                }
+            }
+        }
+
+        // Only the subexpressions actually reused by the generated code get
+        // their variables: the repeated subexpressions nested in another
+        // repeated one are skipped along with it.
+        void mark_reused(const std::vector<char> &eager) const {
+            const int n = static_cast<int>(op.size());
+
+            for(int i = 0; i < n; ) {
+                if (op[i].lead != i && eager[op[i].lead]) {
+                    op[op[i].lead].reused = true;
+                    i += op[i].nodes;
+                } else {
+                    ++i;
+                }
+            }
+        }
+
+        // Numbers the operations in the order of vector_expr_context.
+        // Returns the slot of each subexpression: terminal t, or operation
+        // -1-i.
+        //
+        // The repeated subexpressions are computed before the rest of the
+        // expression, so the operations in the conditionally evaluated
+        // operands (the branches of a ternary operator, and the right operand
+        // of a logical operator) are marked as guarded.
+        struct builder {
+            layout_type &layout;
+            int terms;
+            int guarded; // Depth of the conditional operands.
+
+            builder(layout_type &layout) : layout(layout), terms(0), guarded(0) {}
+
+            // Position of the first conditionally evaluated operand.
+            template <class Tag, class Enable = void>
+            struct conditional : std::integral_constant<int, INT_MAX> {};
+
+            template <class Tag>
+            struct conditional<Tag, typename std::enable_if<
+                std::is_same<Tag, boost::proto::tag::if_else_   >::value ||
+                std::is_same<Tag, boost::proto::tag::logical_and>::value ||
+                std::is_same<Tag, boost::proto::tag::logical_or >::value
+                >::type> : std::integral_constant<int, 1> {};
+
+            struct collect {
+                builder &b;
+                std::vector<int> &args;
+                int cond;
+
+                collect(builder &b, std::vector<int> &args, int cond)
+                    : b(b), args(args), cond(cond) {}
+
+                template <class Expr>
+                void operator()(const Expr &expr) const {
+                    const int g = static_cast<int>(args.size()) >= cond;
+
+                    b.guarded += g;
+                    args.push_back(boost::proto::eval(expr, b));
+                    b.guarded -= g;
+                }
+            };
+
+            template <class Expr, class Children>
+            int operation(const Children &children, bool cse) {
+                const int i = static_cast<int>(layout.op.size());
+                const int t = terms;
+
+                layout.op.push_back(layout_type::node());
+                layout.op[i].type    = cse ? &typeid(Expr) : nullptr;
+                layout.op[i].guarded = guarded > 0;
+
+                std::vector<int> args;
+                boost::fusion::for_each(children, collect(*this, args,
+                            conditional<typename Expr::proto_tag>::value));
+
+                layout.op[i].nodes = static_cast<int>(layout.op.size()) - i;
+                layout.op[i].terms = terms - t;
+                layout.op[i].args.swap(args);
+
+                return -1 - i;
+            }
+
+            template <typename Expr, typename Tag = typename Expr::proto_tag>
+            struct eval {
+                typedef int result_type;
+
+                int operator()(const Expr &expr, builder &b) const {
+                    return b.template operation<Expr>(expr,
+                            boost::proto::matches<Expr, cse_grammar>::value);
+                }
+            };
+
+            template <typename Expr>
+            struct eval<Expr, boost::proto::tag::function> {
+                typedef int result_type;
+
+                int operator()(const Expr &expr, builder &b) const {
+                    return b.template operation<Expr>(boost::fusion::pop_front(expr),
+                            boost::proto::matches<Expr, cse_grammar>::value);
+                }
+            };
+
+            template <typename Expr>
+            struct eval<Expr, boost::proto::tag::terminal> {
+                typedef int result_type;
+
+                int operator()(const Expr&, builder &b) const {
+                    return b.terms++;
+                }
+            };
+        };
+};
+
+// Kernel cache for the kernels generated with common subexpression
+// elimination.
+struct cse_kernel_cache {
+    kernel_cache plain;
+
+    cse_kernel_cache(const std::string &subsystem)
+        : plain(subsystem), subsystem(subsystem) {}
+
+    kernel_cache& operator[](const cse_plan &plan) {
+        if (plan.empty()) return plain;
+
+        boost::lock_guard<boost::mutex> lock(mx);
+
+        std::unique_ptr<kernel_cache> &c = merged[plan.term];
+        if (!c) c.reset(new kernel_cache(subsystem));
+        return *c;
+    }
+
+    private:
+        const std::string subsystem;
+        std::map< std::vector<int>, std::unique_ptr<kernel_cache> > merged;
+        boost::mutex mx;
+};
+
+// Outputs the variable holding the value of a repeated subexpression.
+template <class Expr>
+void output_common_subexpression(backend::source_generator&,
+        const backend::command_queue&, const std::string&,
+        kernel_generator_state_ptr, const Expr&, int, int, std::false_type)
+{}
+
+template <class Expr>
+void output_common_subexpression(backend::source_generator &src,
+        const backend::command_queue &queue, const std::string &prefix,
+        kernel_generator_state_ptr state, const Expr &expr, int op, int prm,
+        std::true_type);
+
 // Base class for stateful expression evaluation contexts .
 struct expression_context {
     backend::source_generator &src;
     const backend::command_queue &queue;
     mutable int prm_idx;
+    mutable int op_idx;
     int fun_idx;
     std::string prefix;
     kernel_generator_state_ptr state;
+    const cse_plan *cse;
 
     expression_context(
             backend::source_generator &src, const backend::command_queue &queue,
             const std::string &prefix, kernel_generator_state_ptr state
             )
-        : src(src), queue(queue), prm_idx(0), fun_idx(0),
-          prefix(prefix), state(state)
+        : src(src), queue(queue), prm_idx(0), op_idx(0), fun_idx(0),
+          prefix(prefix), state(state), cse(cse_plan::find(*state, prefix))
     {}
+
+    // The current terminal is the repeated occurrence of an earlier one.
+    bool repeated_terminal() const {
+        return cse && cse->term[prm_idx - 1] != prm_idx - 1;
+    }
+
+    // Index of the kernel parameter holding the current terminal.
+    int terminal_index() const {
+        return cse ? cse->term[prm_idx - 1] + 1 : prm_idx;
+    }
 };
 
 // Outputs kernel preamble.
@@ -1134,6 +1633,16 @@ struct output_local_preamble : public expression_context {
         : expression_context(src, queue, prefix, state)
     {}
 
+    // Repeated subexpressions are computed once, after the subexpressions
+    // they contain:
+    template <class Expr>
+    void common_subexpression(const Expr &expr, int op, int prm) const {
+        if (cse && cse->operations()[op].reused)
+            output_common_subexpression(src, queue, prefix, state, expr, op, prm,
+                    std::integral_constant<bool,
+                        boost::proto::matches<Expr, cse_grammar>::value>());
+    }
+
     // Any expression except user function or terminal is only interesting
     // for its children:
     template <typename Expr, typename Tag = typename Expr::proto_tag>
@@ -1142,8 +1651,12 @@ struct output_local_preamble : public expression_context {
 
         void operator()(const Expr &expr, output_local_preamble &ctx) const
         {
+            int op = ctx.op_idx++, prm = ctx.prm_idx;
+
             boost::fusion::for_each( expr,
                     do_eval<output_local_preamble>(ctx));
+
+            ctx.common_subexpression(expr, op, prm);
         }
     };
 
@@ -1156,10 +1669,14 @@ struct output_local_preamble : public expression_context {
         template <class FunCall>
         void operator()(const FunCall &expr, output_local_preamble &ctx) const
         {
+            int op = ctx.op_idx++, prm = ctx.prm_idx;
+
             boost::fusion::for_each(
                     boost::fusion::pop_front(expr),
                     do_eval<output_local_preamble>(ctx)
                     );
+
+            ctx.common_subexpression(expr, op, prm);
         }
     };
 
@@ -1175,6 +1692,8 @@ struct output_local_preamble : public expression_context {
             std::ostringstream prm_name;
             prm_name << ctx.prefix << "_" << ++ctx.prm_idx;
 
+            if (ctx.repeated_terminal()) return;
+
             traits::get_local_terminal_init(ctx.src, term, ctx.queue,
                     prm_name.str(), ctx.state);
         }
@@ -1186,6 +1705,8 @@ struct output_local_preamble : public expression_context {
             std::ostringstream prm_name;
             prm_name << ctx.prefix << "_" << ++ctx.prm_idx;
 
+            if (ctx.repeated_terminal()) return;
+
             traits::get_local_terminal_init(ctx.src, boost::proto::value(term),
                     ctx.queue, prm_name.str(), ctx.state);
         }
@@ -1200,9 +1721,30 @@ struct vector_expr_context : public expression_context {
             const std::string &prefix,
             kernel_generator_state_ptr state
             )
-        : expression_context(src, queue, prefix, state)
+        : expression_context(src, queue, prefix, state), defining(-1)
     {}
 
+    // The repeated subexpression being computed.
+    int defining;
+
+    // Replaces a repeated subexpression with the variable holding its value
+    // (see output_common_subexpression()).
+    bool reuse_subexpression() {
+        int op = op_idx++;
+
+        if (!cse || op == defining) return false;
+
+        const cse_plan::operation &o = cse->operations()[op];
+        if (!cse->operations()[o.lead].reused) return false;
+
+        src << prefix << "_cse_" << o.lead + 1;
+
+        op_idx  += o.nodes - 1;
+        prm_idx += o.terms;
+
+        return true;
+    }
+
     template <typename Expr, typename Tag = typename Expr::proto_tag>
     struct eval {};
 
@@ -1210,6 +1752,7 @@ struct vector_expr_context : public expression_context {
   template <typename Expr> struct eval<Expr, boost::proto::tag::the_tag> {     \
     typedef void result_type;                                                  \
     void operator()(const Expr &expr, vector_expr_context &ctx) const {        \
+      if (ctx.reuse_subexpression()) return;                                   \
       ctx.src << "( ";                                                         \
       boost::proto::eval(boost::proto::left(expr), ctx);                       \
       ctx.src << " " #the_op " ";                                              \
@@ -1243,6 +1786,7 @@ struct vector_expr_context : public expression_context {
   template <typename Expr> struct eval<Expr, boost::proto::tag::the_tag> {     \
     typedef void result_type;                                                  \
     void operator()(const Expr &expr, vector_expr_context &ctx) const {        \
+      if (ctx.reuse_subexpression()) return;                                   \
       ctx.src << "( " #the_op "( ";                                            \
       boost::proto::eval(boost::proto::child(expr), ctx);                      \
       ctx.src << " ) )";                                                       \
@@ -1263,6 +1807,7 @@ struct vector_expr_context : public expression_context {
   template <typename Expr> struct eval<Expr, boost::proto::tag::the_tag> {     \
     typedef void result_type;                                                  \
     void operator()(const Expr &expr, vector_expr_context &ctx) const {        \
+      if (ctx.reuse_subexpression()) return;                                   \
       ctx.src << "( ( ";                                                       \
       boost::proto::eval(boost::proto::child(expr), ctx);                      \
       ctx.src << " )" #the_op " )";                                            \
@@ -1278,6 +1823,7 @@ struct vector_expr_context : public expression_context {
     struct eval<Expr, boost::proto::tag::if_else_> {
         typedef void result_type;
         void operator()(const Expr &expr, vector_expr_context &ctx) const {
+            if (ctx.reuse_subexpression()) return;
             ctx.src << "( ";
             boost::proto::eval(boost::proto::child_c<0>(expr), ctx);
             ctx.src << " ? ";
@@ -1292,6 +1838,7 @@ struct vector_expr_context : public expression_context {
     struct eval<Expr, boost::proto::tag::subscript> {
         typedef void result_type;
         void operator()(const Expr &expr, vector_expr_context &ctx) const {
+            if (ctx.reuse_subexpression()) return;
             ctx.src << "( ( ";
             boost::proto::eval(boost::proto::child_c<0>(expr), ctx);
             ctx.src << " )[ ";
@@ -1319,6 +1866,7 @@ struct vector_expr_context : public expression_context {
 
         template <class FunCall>
         void operator()(const FunCall &expr, vector_expr_context &ctx) const {
+            if (ctx.reuse_subexpression()) return;
             ctx.src << boost::proto::value(boost::proto::child_c<0>(expr)).name() << "( ";
             boost::fusion::for_each(
                     boost::fusion::pop_front(expr), do_eval(ctx)
@@ -1334,8 +1882,10 @@ struct vector_expr_context : public expression_context {
         template <typename Term>
         typename std::enable_if<traits::terminal_is_value<Term>::value, void>::type
         operator()(const Term &term, vector_expr_context &ctx) const {
+            ++ctx.prm_idx;
+
             std::ostringstream prm_name;
-            prm_name << ctx.prefix << "_" << ++ctx.prm_idx;
+            prm_name << ctx.prefix << "_" << ctx.terminal_index();
 
             traits::get_partial_vector_expr(ctx.src, term, ctx.queue,
                     prm_name.str(), ctx.state);
@@ -1344,8 +1894,10 @@ struct vector_expr_context : public expression_context {
         template <typename Term>
         typename std::enable_if<!traits::terminal_is_value<Term>::value, void>::type
         operator()(const Term &term, vector_expr_context &ctx) const {
+            ++ctx.prm_idx;
+
             std::ostringstream prm_name;
-            prm_name << ctx.prefix << "_" << ++ctx.prm_idx;
+            prm_name << ctx.prefix << "_" << ctx.terminal_index();
 
             traits::get_partial_vector_expr(ctx.src, boost::proto::value(term),
                     ctx.queue, prm_name.str(), ctx.state);
@@ -1368,6 +1920,8 @@ struct declare_expression_parameter : expression_context {
         std::ostringstream prm_name;
         prm_name << prefix << "_" << ++prm_idx;
 
+        if (repeated_terminal()) return;
+
         traits::get_kernel_param_declaration(src, term, queue,
                 prm_name.str(), state);
     }
@@ -1378,6 +1932,8 @@ struct declare_expression_parameter : expression_context {
         std::ostringstream prm_name;
         prm_name << prefix << "_" << ++prm_idx;
 
+        if (repeated_terminal()) return;
+
         traits::get_kernel_param_declaration(src, boost::proto::value(term),
                 queue, prm_name.str(), state);
     }
@@ -1388,22 +1944,33 @@ struct set_expression_argument {
     unsigned part;
     size_t part_start;
     kernel_generator_state_ptr state;
+    mutable int prm_idx;
+    const cse_plan *cse;
 
     set_expression_argument(backend::kernel &krn, unsigned part, size_t part_start,
-            kernel_generator_state_ptr state
+            kernel_generator_state_ptr state, const cse_plan *cse = nullptr
             )
-        : krn(krn), part(part), part_start(part_start), state(state)
+        : krn(krn), part(part), part_start(part_start), state(state),
+          prm_idx(0), cse(cse)
     {}
 
+    // Repeated terminals are passed to the kernel once.
+    bool repeated_terminal() const {
+        ++prm_idx;
+        return cse && cse->term[prm_idx - 1] != prm_idx - 1;
+    }
+
     template <typename Term>
     typename std::enable_if<traits::terminal_is_value<Term>::value, void>::type
     operator()(const Term &term) const {
+        if (repeated_terminal()) return;
         traits::set_kernel_args(term, krn, part, part_start, state);
     }
 
     template <typename Term>
     typename std::enable_if<!traits::terminal_is_value<Term>::value, void>::type
     operator()(const Term &term) const {
+        if (repeated_terminal()) return;
         traits::set_kernel_args(boost::proto::value(term), krn, part, part_start, state);
     }
 };
@@ -1459,6 +2026,131 @@ struct get_expression_properties {
     }
 };
 
+//---------------------------------------------------------------------------
+// Estimated traffic of a generated kernel
+//---------------------------------------------------------------------------
+// Counts the bytes read from device memory and the arithmetic operations per
+// element of an expression, for the kernel statistics in vex::kernel_registry.
+// The terminals with known identity are only counted once, as in the kernels
+// with common subexpression elimination. Each arithmetic operator and each
+// function call is counted as a single operation.
+struct expression_traffic {
+    size_t bytes_read;
+    size_t bytes_written;
+    size_t flops;
+
+    expression_traffic() : bytes_read(0), bytes_written(0), flops(0) {}
+
+    // Returns true when the terminal with the given identity is seen for the
+    // first time.
+    bool first(const std::string &id) {
+        return seen.insert(id).second;
+    }
+
+    template <class Term>
+    void terminal(const Term &term) {
+        if (traits::terminal_identity<Term>::value) {
+            std::string id;
+            traits::terminal_identity<Term>::get(term, id);
+            if (!first(typeid(Term).name() + id)) return;
+        }
+
+        traits::terminal_traffic<Term>::get(term, *this);
+    }
+
+    template <typename Expr, typename Tag = typename Expr::proto_tag>
+    struct eval {
+        typedef void result_type;
+
+        void operator()(const Expr &expr, expression_traffic &ctx) const {
+            if (
+                    std::is_same<Tag, boost::proto::tag::plus      >::value ||
+                    std::is_same<Tag, boost::proto::tag::minus     >::value ||
+                    std::is_same<Tag, boost::proto::tag::multiplies>::value ||
+                    std::is_same<Tag, boost::proto::tag::divides   >::value ||
+                    std::is_same<Tag, boost::proto::tag::modulus   >::value ||
+                    std::is_same<Tag, boost::proto::tag::negate    >::value
+               ) ++ctx.flops;
+
+            boost::fusion::for_each(expr, do_eval<expression_traffic>(ctx));
+        }
+    };
+
+    template <typename Expr>
+    struct eval<Expr, boost::proto::tag::function> {
+        typedef void result_type;
+
+        void operator()(const Expr &expr, expression_traffic &ctx) const {
+            ++ctx.flops;
+
+            boost::fusion::for_each(
+                    boost::fusion::pop_front(expr),
+                    do_eval<expression_traffic>(ctx)
+                    );
+        }
+    };
+
+    template <typename Expr>
+    struct eval<Expr, boost::proto::tag::terminal> {
+        typedef void result_type;
+
+        void operator()(const Expr &expr, expression_traffic &ctx) const {
+            ctx.terminal(terminal_object<Expr>::get(expr));
+        }
+    };
+
+    private:
+        std::set<std::string> seen;
+};
+
+// Traffic of a kernel with several element-wise assignments and reductions
+// (as in multiexpressions, deferred statements, or fused reductions). The
+// terminals read by several statements are counted once. Compound
+// assignments read the left-hand side as well.
+struct kernel_traffic {
+    expression_traffic read;
+    size_t bytes_written;
+
+    kernel_traffic() : bytes_written(0) {}
+
+    template <class OP, class LHS, class RHS>
+    void assignment(const LHS &lhs, const RHS &rhs) {
+        boost::proto::eval(boost::proto::as_child(rhs), read);
+
+        expression_traffic lhs_traffic;
+        boost::proto::eval(boost::proto::as_child(lhs), lhs_traffic);
+        bytes_written += lhs_traffic.bytes_read;
+
+        if (!std::is_same<OP, assign::SET>::value) {
+            boost::proto::eval(boost::proto::as_child(lhs), read);
+            ++read.flops;
+        }
+    }
+
+    template <class Expr>
+    void reduction(const Expr &expr) {
+        boost::proto::eval(boost::proto::as_child(expr), read);
+        ++read.flops;
+    }
+
+    // Enters the traffic into the registry.
+    template <class Kernel>
+    void set(const Kernel &k) const {
+        set_kernel_traffic(k, read.bytes_read, bytes_written, read.flops);
+    }
+};
+
+// Traffic of the element-wise assignment.
+template <class OP, class LHS, class RHS>
+expression_traffic assignment_traffic(const LHS &lhs, const RHS &rhs) {
+    kernel_traffic t;
+    t.assignment<OP>(lhs, rhs);
+
+    expression_traffic e = t.read;
+    e.bytes_written = t.bytes_written;
+    return e;
+}
+
 //---------------------------------------------------------------------------
 VEXCL_VECTOR_EXPR_EXTRACTOR(extract_vector_expressions,
         vector_expr_grammar,
@@ -1811,6 +2503,227 @@ struct return_type {
         type;
 };
 
+// Outputs the variable holding the value of a repeated subexpression.
+// Repeated subexpressions nested in this one are already computed at this
+// point, and are reused.
+template <class Expr>
+void output_common_subexpression(backend::source_generator &src,
+        const backend::command_queue &queue, const std::string &prefix,
+        kernel_generator_state_ptr state, const Expr &expr, int op, int prm,
+        std::true_type)
+{
+    src.new_line() << type_name< typename return_type<Expr>::type >()
+        << " " << prefix << "_cse_" << op + 1 << " = ";
+
+    vector_expr_context ctx(src, queue, prefix, state);
+    ctx.prm_idx  = prm;
+    ctx.op_idx   = op;
+    ctx.defining = op;
+
+    boost::proto::eval(expr, ctx);
+
+    src << ";";
+}
+
+
+//---------------------------------------------------------------------------
+// Deferred execution (see vexcl/deferred.hpp)
+//---------------------------------------------------------------------------
+// Element-wise assignment recorded for deferred execution.
+struct deferred_statement {
+    std::vector<backend::command_queue> queue;
+    std::vector<size_t> part;
+
+    // Addresses of the terminals held by reference (the vectors).
+    std::vector<const void*> terms;
+
+    deferred_statement(const std::vector<backend::command_queue> &queue,
+            const std::vector<size_t> &part)
+        : queue(queue), part(part)
+    {}
+
+    virtual ~deferred_statement() {}
+
+    bool references(const void *term) const {
+        return std::find(terms.begin(), terms.end(), term) != terms.end();
+    }
+
+    // Identifies the generated code of the statement.
+    virtual std::string signature() const = 0;
+
+    virtual void preamble(backend::source_generator &src, const backend::command_queue &q,
+            const std::string &prefix, kernel_generator_state_ptr state) const = 0;
+
+    virtual void parameters(backend::source_generator &src, const backend::command_queue &q,
+            const std::string &prefix, kernel_generator_state_ptr state) const = 0;
+
+    virtual void body(backend::source_generator &src, const backend::command_queue &q,
+            const std::string &prefix, kernel_generator_state_ptr state) const = 0;
+
+    virtual void arguments(backend::kernel &krn, unsigned d, size_t part_start) const = 0;
+
+    virtual void traffic(kernel_traffic &t) const = 0;
+};
+
+// Collects the deferred statements of the current thread.
+struct deferred_recorder {
+    virtual ~deferred_recorder() noexcept(false) {}
+
+    virtual void record(std::unique_ptr<deferred_statement> s) = 0;
+
+    // Executes the pending statements if any of them references the term
+    // (or unconditionally, if term is null).
+    virtual void flush(const void *term) = 0;
+
+    static deferred_recorder*& current() {
+        static thread_local deferred_recorder *r = nullptr;
+        return r;
+    }
+};
+
+// Executes the pending deferred statements that reference the term.
+inline void flush_deferred(const void *term) {
+    if (deferred_recorder *r = deferred_recorder::current()) r->flush(term);
+}
+
+// Checks that the terminals of an expression may be deferred, and collects
+// the ones held by reference.
+struct deferrable_terminals {
+    mutable bool ok;
+    mutable std::vector<const void*> terms;
+
+    deferrable_terminals() : ok(true) {}
+
+    template <typename Term>
+    typename std::enable_if<traits::terminal_is_value<Term>::value, void>::type
+    operator()(const Term &term) const {
+        check(term);
+    }
+
+    template <typename Term>
+    typename std::enable_if<!traits::terminal_is_value<Term>::value, void>::type
+    operator()(const Term &term) const {
+        check(boost::proto::value(term));
+    }
+
+    template <typename T>
+    void check(const T &term) const {
+        if (!traits::is_deferrable_terminal<T>::value) ok = false;
+        if (traits::hold_terminal_by_reference<T>::value) terms.push_back(std::addressof(term));
+    }
+};
+
+template <class OP, class LHS, class RHS>
+struct deferred_assignment : public deferred_statement {
+    LHS &lhs;
+
+    // Vectors are held by reference, everything else by value (the same
+    // way the expressions hold their terminals).
+    typename std::conditional<
+        traits::hold_terminal_by_reference<RHS>::value, const RHS&, const RHS
+        >::type rhs;
+
+    deferred_assignment(LHS &lhs, const RHS &rhs,
+            const std::vector<backend::command_queue> &queue,
+            const std::vector<size_t> &part,
+            const std::vector<const void*> &terms
+            )
+        : deferred_statement(queue, part), lhs(lhs), rhs(rhs)
+    {
+        this->terms = terms;
+    }
+
+    std::string signature() const {
+        return typeid(deferred_assignment).name();
+    }
+
+    void preamble(backend::source_generator &src, const backend::command_queue &q,
+            const std::string &prefix, kernel_generator_state_ptr state) const
+    {
+        output_terminal_preamble termpream(src, q, prefix, state);
+
+        boost::proto::eval(boost::proto::as_child(lhs), termpream);
+        boost::proto::eval(boost::proto::as_child(rhs), termpream);
+    }
+
+    void parameters(backend::source_generator &src, const backend::command_queue &q,
+            const std::string &prefix, kernel_generator_state_ptr state) const
+    {
+        declare_expression_parameter declare(src, q, prefix, state);
+
+        extract_terminals()(boost::proto::as_child(lhs), declare);
+        extract_terminals()(boost::proto::as_child(rhs), declare);
+    }
+
+    void body(backend::source_generator &src, const backend::command_queue &q,
+            const std::string &prefix, kernel_generator_state_ptr state) const
+    {
+        output_local_preamble loc_init(src, q, prefix, state);
+        boost::proto::eval(boost::proto::as_child(lhs), loc_init);
+        boost::proto::eval(boost::proto::as_child(rhs), loc_init);
+
+        vector_expr_context expr_ctx(src, q, prefix, state);
+
+        src.new_line();
+        boost::proto::eval(boost::proto::as_child(lhs), expr_ctx);
+        src << " " << OP::string() << " ";
+        boost::proto::eval(boost::proto::as_child(rhs), expr_ctx);
+        src << ";";
+    }
+
+    void arguments(backend::kernel &krn, unsigned d, size_t part_start) const {
+        set_expression_argument setarg(krn, d, part_start, empty_state());
+
+        extract_terminals()(boost::proto::as_child(lhs), setarg);
+        extract_terminals()(boost::proto::as_child(rhs), setarg);
+    }
+
+    void traffic(kernel_traffic &t) const {
+        t.assignment<OP>(lhs, rhs);
+    }
+};
+
+template <class OP, class LHS, class RHS>
+bool defer_assignment(LHS&, const RHS&,
+        const std::vector<backend::command_queue>&, const std::vector<size_t>&,
+        std::false_type)
+{
+    return false;
+}
+
+template <class OP, class LHS, class RHS>
+bool defer_assignment(LHS &lhs, const RHS &rhs,
+        const std::vector<backend::command_queue> &queue,
+        const std::vector<size_t> &part,
+        std::true_type)
+{
+    deferrable_terminals check;
+    extract_terminals()(boost::proto::as_child(lhs), check);
+    extract_terminals()(boost::proto::as_child(rhs), check);
+
+    if (!check.ok) return false;
+
+    deferred_recorder::current()->record(std::unique_ptr<deferred_statement>(
+                new deferred_assignment<OP, LHS, RHS>(lhs, rhs, queue, part, check.terms)));
+
+    return true;
+}
+
+// Records the assignment for the deferred execution, if there is an active
+// deferred scope and the assignment is element-wise.
+template <class OP, class LHS, class RHS>
+bool defer_assignment(LHS &lhs, const RHS &rhs,
+        const std::vector<backend::command_queue> &queue,
+        const std::vector<size_t> &part)
+{
+    if (!deferred_recorder::current()) return false;
+
+    return defer_assignment<OP>(lhs, rhs, queue, part,
+            std::integral_constant<bool,
+                traits::hold_terminal_by_reference<LHS>::value &&
+                traits::is_deferrable_terminal<LHS>::value
+            >());
+}
 
 //---------------------------------------------------------------------------
 // Assign expression to lhs
@@ -1821,6 +2734,8 @@ void assign_expression(LHS &lhs, const RHS &rhs,
         const std::vector<size_t> &part
         )
 {
+    if (defer_assignment<OP>(lhs, rhs, queue, part)) return;
+
 #if (VEXCL_CHECK_SIZES > 0)
     {
         get_expression_properties prop;
@@ -1838,7 +2753,10 @@ void assign_expression(LHS &lhs, const RHS &rhs,
                 );
     }
 #endif
-    static kernel_cache cache;
+    cse_plan cse(lhs, rhs);
+
+    static cse_kernel_cache caches("vector");
+    kernel_cache &cache = caches[cse];
 
     for(unsigned d = 0; d < queue.size(); d++) {
         auto kernel = cache.find(queue[d]);
@@ -1848,7 +2766,7 @@ void assign_expression(LHS &lhs, const RHS &rhs,
         if (kernel == cache.end()) {
             backend::source_generator source(queue[d]);
 
-            output_terminal_preamble termpream(source, queue[d], "prm", empty_state());
+            output_terminal_preamble termpream(source, queue[d], "prm", cse.state("prm"));
 
             boost::proto::eval(boost::proto::as_child(lhs), termpream);
             boost::proto::eval(boost::proto::as_child(rhs), termpream);
@@ -1857,19 +2775,19 @@ void assign_expression(LHS &lhs, const RHS &rhs,
             source.begin_kernel_parameters();
             source.parameter<size_t>("n");
 
-            declare_expression_parameter declare(source, queue[d], "prm", empty_state());
+            declare_expression_parameter declare(source, queue[d], "prm", cse.state("prm"));
 
             extract_terminals()(boost::proto::as_child(lhs), declare);
             extract_terminals()(boost::proto::as_child(rhs), declare);
 
             source.end_kernel_parameters();
-            source.grid_stride_loop().open("{");
+            source.elementwise_loop().open("{");
 
-            output_local_preamble loc_init(source, queue[d], "prm", empty_state());
+            output_local_preamble loc_init(source, queue[d], "prm", cse.state("prm"));
             boost::proto::eval(boost::proto::as_child(lhs), loc_init);
             boost::proto::eval(boost::proto::as_child(rhs), loc_init);
 
-            vector_expr_context expr_ctx(source, queue[d], "prm", empty_state());
+            vector_expr_context expr_ctx(source, queue[d], "prm", cse.state("prm"));
 
             source.new_line();
             boost::proto::eval(boost::proto::as_child(lhs), expr_ctx);
@@ -1881,12 +2799,15 @@ void assign_expression(LHS &lhs, const RHS &rhs,
 
             kernel = cache.insert(queue[d], backend::kernel(
                         queue[d], source.str(), "vexcl_vector_kernel"));
+
+            expression_traffic t = assignment_traffic<OP>(lhs, rhs);
+            set_kernel_traffic(kernel->second, t.bytes_read, t.bytes_written, t.flops);
         }
 
         if (size_t psize = part[d + 1] - part[d]) {
             kernel->second.push_arg(psize);
 
-            set_expression_argument setarg(kernel->second, d, part[d], empty_state());
+            set_expression_argument setarg(kernel->second, d, part[d], empty_state(), &cse);
 
             extract_terminals()( boost::proto::as_child(lhs), setarg);
             extract_terminals()( boost::proto::as_child(rhs), setarg);
@@ -1953,6 +2874,21 @@ struct subexpression_assigner {
     }
 };
 
+template <class OP, class LHS, class RHS>
+struct subexpression_traffic {
+    const LHS &lhs;
+    const RHS &rhs;
+    kernel_traffic &t;
+
+    subexpression_traffic(const LHS &lhs, const RHS &rhs, kernel_traffic &t)
+        : lhs(lhs), rhs(rhs), t(t) {}
+
+    template <size_t I>
+    void apply() const {
+        t.assignment<OP>(subexpression<I>::get(lhs), subexpression<I>::get(rhs));
+    }
+};
+
 template <class LHS, class RHS>
 struct preamble_constructor {
     const LHS &lhs;
@@ -1963,9 +2899,10 @@ struct preamble_constructor {
     mutable detail::output_terminal_preamble rhs_ctx;
 
     preamble_constructor(const LHS &lhs, const RHS &rhs,
-            backend::source_generator &source, const backend::command_queue &queue
+            backend::source_generator &source, const backend::command_queue &queue,
+            kernel_generator_state_ptr state = empty_state()
             )
-        : lhs(lhs), rhs(rhs), state(empty_state()),
+        : lhs(lhs), rhs(rhs), state(state),
           lhs_ctx(source, queue, "lhs", state),
           rhs_ctx(source, queue, "rhs", state)
     { }
@@ -2105,7 +3042,7 @@ void assign_multiexpression( LHS &lhs, const RHS &rhs,
 
     typedef traits::get_dimension<LHS> N;
 
-    static kernel_cache cache;
+    static kernel_cache cache("multivector");
 
     // 1. If any device in context is CPU, then do not fuse the kernel,
     //    but assign components individually (this works better with CPU
@@ -2149,7 +3086,7 @@ void assign_multiexpression( LHS &lhs, const RHS &rhs,
                     );
 
             source.end_kernel_parameters();
-            source.grid_stride_loop().open("{");
+            source.elementwise_loop().open("{");
 
             static_for<0, N::value>::loop(expression_init<LHS, RHS>(lhs, rhs, source, queue[d]));
             static_for<0, N::value>::loop(expression_finalize<OP, LHS>(lhs, source, queue[d]));
@@ -2158,6 +3095,10 @@ void assign_multiexpression( LHS &lhs, const RHS &rhs,
 
             kernel = cache.insert(queue[d], backend::kernel(
                         queue[d], source.str(), "vexcl_multivector_kernel") );
+
+            kernel_traffic t;
+            static_for<0, N::value>::loop(subexpression_traffic<OP, LHS, RHS>(lhs, rhs, t));
+            t.set(kernel->second);
         }
 
         if (size_t psize = part[d + 1] - part[d]) {
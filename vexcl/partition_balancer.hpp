@@ -0,0 +1,246 @@
+#ifndef VEXCL_PARTITION_BALANCER_HPP
+#define VEXCL_PARTITION_BALANCER_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2017 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/partition_balancer.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Adaptive runtime repartitioning of multi-device containers.
+ */
+
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+
+#include <boost/thread.hpp>
+
+#include <vexcl/backend.hpp>
+#include <vexcl/util.hpp>
+#include <vexcl/vector.hpp>
+
+namespace vex {
+
+/// Balances the partitioning of multi-device containers at runtime.
+/**
+ * The default partitioning is computed once per device (see
+ * vex::set_partitioning()) and does not account for the actual workload. The
+ * balancer measures the time each device spends on the work submitted
+ * between start() and stop(), estimates the throughput of the devices, and
+ * computes the partition that equalizes the device times. The containers are
+ * migrated to the new partition with rebalance() whenever the measured
+ * imbalance exceeds the given tolerance:
+ * \code
+ * vex::partition_balancer balance(ctx);
+ *
+ * for(int iter = 0; iter < niters; ++iter) {
+ *     balance.start();
+ *     y = 2 * x + sin(y);
+ *     x = y / 2;
+ *     balance.stop(x.partition());
+ *
+ *     // The containers used together are migrated together:
+ *     balance.rebalance(x, y);
+ * }
+ * \endcode
+ * The containers should support repartition() method (vex::vector and
+ * vex::multivector do). Sparse matrices keep no host copy of the data and
+ * should be reconstructed with the balanced partitions (see the vex::SpMat
+ * constructor accepting row and column partitions). The estimated weights are smoothed between the
+ * measurements with the given relaxation factor, so that the partition
+ * follows the drift in the device performance without oscillating.
+ */
+class partition_balancer {
+    public:
+        /// Constructor.
+        /**
+         * \param queue      Command queues of the balanced containers.
+         * \param relaxation Weight of the latest measurement in the device
+         *                   weights (1 means the weights follow the latest
+         *                   measurement exactly).
+         * \param tolerance  Relative imbalance of the device times that
+         *                   triggers repartitioning.
+         */
+        partition_balancer(const std::vector<backend::command_queue> &queue,
+                double relaxation = 0.5, double tolerance = 0.05)
+            : queue(queue), relaxation(relaxation), tolerance(tolerance),
+              weight(queue.size(), 1.0), time(queue.size(), 0.0),
+              measured(false)
+        {
+            precondition(!queue.empty(), "Empty queue list");
+            precondition(relaxation > 0 && relaxation <= 1,
+                    "Relaxation factor should be in (0, 1]");
+        }
+
+        /// Starts the measurement.
+        /**
+         * Waits for the pending work on all queues.
+         */
+        void start() {
+            for(auto q = queue.begin(); q != queue.end(); ++q) q->finish();
+            start_time = std::chrono::high_resolution_clock::now();
+        }
+
+        /// Stops the measurement of the work partitioned with the given partition.
+        /**
+         * Waits for every queue concurrently and records the time it took
+         * each device to complete its work.
+         */
+        void stop(const std::vector<size_t> &part) {
+            std::vector<double> t(queue.size());
+
+            boost::thread_group wait;
+            for(unsigned d = 0; d < queue.size(); ++d) {
+                wait.create_thread([this, d, &t]() {
+                        backend::select_context(queue[d]);
+                        queue[d].finish();
+                        t[d] = std::chrono::duration<double>(
+                            std::chrono::high_resolution_clock::now() - start_time
+                            ).count();
+                    });
+            }
+            wait.join_all();
+
+            record(part, t);
+        }
+
+        /// Records the device times of the work partitioned with the given partition.
+        /**
+         * May be used with the times measured outside of the balancer
+         * (e.g. with the events of the OpenCL backend).
+         */
+        void record(const std::vector<size_t> &part, const std::vector<double> &t) {
+            precondition(part.size() == queue.size() + 1 && t.size() == queue.size(),
+                    "Partition does not match the queue list");
+
+            std::vector<double> speed(queue.size());
+            for(unsigned d = 0; d < queue.size(); ++d) {
+                // The devices without work keep their weights.
+                speed[d] = (part[d + 1] > part[d] && t[d] > 0) ?
+                    (part[d + 1] - part[d]) / t[d] : -1;
+            }
+
+            double wsum = 0, ssum = 0;
+            for(unsigned d = 0; d < queue.size(); ++d) {
+                if (speed[d] < 0) continue;
+                wsum += weight[d];
+                ssum += speed[d];
+            }
+
+            if (ssum > 0) {
+                // Bring the throughput to the scale of the current weights.
+                for(unsigned d = 0; d < queue.size(); ++d) {
+                    if (speed[d] < 0) continue;
+                    weight[d] = (1 - relaxation) * weight[d] +
+                        relaxation * wsum * speed[d] / ssum;
+                }
+            }
+
+            for(unsigned d = 0; d < queue.size(); ++d)
+                time[d] = speed[d] < 0 ? 0 : t[d];
+
+            measured = true;
+        }
+
+        /// Relative imbalance of the latest measured device times.
+        /**
+         * Equals (max(t) - min(t)) / max(t) over the devices with work.
+         */
+        double imbalance() const {
+            if (!measured) return 0;
+
+            double tmin = std::numeric_limits<double>::max(), tmax = 0;
+            for(auto t = time.begin(); t != time.end(); ++t) {
+                if (*t <= 0) continue;
+                tmin = std::min(tmin, *t);
+                tmax = std::max(tmax, *t);
+            }
+
+            return tmax > 0 ? (tmax - tmin) / tmax : 0;
+        }
+
+        /// Whether the latest measurement is within the tolerance.
+        bool balanced() const {
+            return imbalance() <= tolerance;
+        }
+
+        /// Current device weights.
+        const std::vector<double>& weights() const {
+            return weight;
+        }
+
+        /// Balanced partition of the given number of elements.
+        std::vector<size_t> partition(size_t n) const {
+            return detail::weighted_partition(n, weight);
+        }
+
+        /// Migrates the containers to the balanced partition when the devices are imbalanced.
+        /**
+         * Returns true if the containers were repartitioned. The measurement
+         * is reset after the migration.
+         */
+        template <class... Container>
+        bool rebalance(Container&... c) {
+            if (balanced()) return false;
+
+            migrate(c...);
+            measured = false;
+
+            return true;
+        }
+
+        /// Makes the balanced weights the default for the new containers.
+        /**
+         * Updates the device weights used by vex::partition().
+         */
+        void apply() const {
+            for(unsigned d = 0; d < queue.size(); ++d)
+                partitioning_scheme<>::set_weight(queue[d], weight[d]);
+        }
+    private:
+        std::vector<backend::command_queue> queue;
+
+        double relaxation;
+        double tolerance;
+
+        std::vector<double> weight;
+        std::vector<double> time;
+        bool measured;
+
+        std::chrono::high_resolution_clock::time_point start_time;
+
+        void migrate() {}
+
+        template <class Head, class... Tail>
+        void migrate(Head &head, Tail&... tail) {
+            head.repartition(partition(head.size()));
+            migrate(tail...);
+        }
+};
+
+} // namespace vex
+
+#endif
@@ -64,7 +64,7 @@ namespace rbk {
 //---------------------------------------------------------------------------
 template <typename T, class Comp>
 backend::kernel offset_calculation(const backend::command_queue &queue) {
-    static detail::kernel_cache cache;
+    static detail::kernel_cache cache("reduce_by_key");
 
     auto kernel = cache.find(queue);
 
@@ -105,7 +105,7 @@ backend::kernel offset_calculation(const backend::command_queue &queue) {
 //---------------------------------------------------------------------------
 template <int NT, typename T, class Oper>
 backend::kernel block_scan_by_key(const backend::command_queue &queue) {
-    static detail::kernel_cache cache;
+    static detail::kernel_cache cache("reduce_by_key");
 
     auto kernel = cache.find(queue);
 
@@ -188,7 +188,7 @@ backend::kernel block_scan_by_key(const backend::command_queue &queue) {
 template <int NT, typename T, class Oper>
 backend::kernel block_inclusive_scan_by_key(const backend::command_queue &queue)
 {
-    static detail::kernel_cache cache;
+    static detail::kernel_cache cache("reduce_by_key");
 
     auto kernel = cache.find(queue);
 
@@ -311,7 +311,7 @@ backend::kernel block_inclusive_scan_by_key(const backend::command_queue &queue)
 //---------------------------------------------------------------------------
 template <typename T, class Oper>
 backend::kernel block_sum_by_key(const backend::command_queue &queue) {
-    static detail::kernel_cache cache;
+    static detail::kernel_cache cache("reduce_by_key");
 
     auto kernel = cache.find(queue);
 
@@ -358,7 +358,7 @@ backend::kernel block_sum_by_key(const backend::command_queue &queue) {
 //---------------------------------------------------------------------------
 template <typename K, typename V>
 backend::kernel key_value_mapping(const backend::command_queue &queue) {
-    static detail::kernel_cache cache;
+    static detail::kernel_cache cache("reduce_by_key");
 
     auto kernel = cache.find(queue);
 
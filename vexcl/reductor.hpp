@@ -33,13 +33,17 @@ THE SOFTWARE.
 
 #include <vector>
 #include <array>
+#include <tuple>
 #include <string>
 #include <sstream>
 #include <numeric>
 #include <limits>
+#include <algorithm>
+#include <cstring>
 
 #include <vexcl/vector.hpp>
 #include <vexcl/operations.hpp>
+#include <vexcl/device_scalar.hpp>
 
 namespace vex {
 
@@ -280,6 +284,648 @@ struct CombineReductors {
 typedef CombineReductors<MIN, MAX> MIN_MAX;
 #endif
 
+namespace detail {
+
+// Accumulation of a reduction in the generated kernels: the accumulator is
+// declared before the loop over the elements, and is updated with the value
+// of the expression at each element.
+template <typename ScalarType, class RDC>
+struct local_reduction {
+    typedef typename RDC::template impl<ScalarType>::result_type result_type;
+
+    static void declare(backend::source_generator &src, const std::string &sum) {
+        initial_value(src, sum, RDC::template impl<ScalarType>::initial());
+    }
+
+    template <class Expr>
+    static void update(backend::source_generator &src,
+            const backend::command_queue &q, const Expr &expr,
+            const std::string &sum, const std::string &prefix,
+            const cse_plan &cse = cse_plan())
+    {
+        typedef typename RDC::template impl<ScalarType>::device_in fun;
+
+        output_local_preamble loc_init(src, q, prefix, cse.state(prefix));
+        boost::proto::eval(expr, loc_init);
+
+        src.new_line() << sum << " = " << fun::name() << "(" << sum << ", ";
+        vector_expr_context expr_ctx(src, q, prefix, cse.state(prefix));
+        boost::proto::eval(expr, expr_ctx);
+        src << ");";
+    }
+
+    private:
+        template <typename T>
+        static typename std::enable_if<cl_vector_length<T>::value == 1, void>::type
+        initial_value(backend::source_generator &src, const std::string &sum,
+                const T &initial)
+        {
+            src.new_line() << type_name<T>() << " " << sum << " = " << initial << ";";
+        }
+
+        template <typename T>
+        static typename std::enable_if<(cl_vector_length<T>::value > 1), void>::type
+        initial_value(backend::source_generator &src, const std::string &sum,
+                const T &initial)
+        {
+            src.new_line() << type_name<T>() << " " << sum << " = {" << initial.s[0];
+            for(unsigned i = 1; i < cl_vector_length<T>::value; ++i)
+                src << ", " << initial.s[i];
+            src << "};";
+        }
+};
+
+// http://en.wikipedia.org/wiki/Kahan_summation_algorithm
+template <typename ScalarType>
+struct local_reduction<ScalarType, SUM_Kahan> {
+    typedef typename SUM_Kahan::template impl<ScalarType>::result_type result_type;
+
+    static void declare(backend::source_generator &src, const std::string &sum) {
+        src.new_line()
+            << type_name<result_type>() << " " << sum << " = ("
+            << type_name<result_type>() << ")0, " << sum << "_c = ("
+            << type_name<result_type>() << ")0;";
+    }
+
+    template <class Expr>
+    static void update(backend::source_generator &src,
+            const backend::command_queue &q, const Expr &expr,
+            const std::string &sum, const std::string &prefix,
+            const cse_plan &cse = cse_plan())
+    {
+        output_local_preamble loc_init(src, q, prefix, cse.state(prefix));
+        boost::proto::eval(expr, loc_init);
+
+        src.open("{");
+        src.new_line() << type_name<result_type>() << " y = (";
+        vector_expr_context expr_ctx(src, q, prefix, cse.state(prefix));
+        boost::proto::eval(expr, expr_ctx);
+        src << ") - " << sum << "_c;";
+
+        src.new_line() << type_name<result_type>() << " t = " << sum << " + y;";
+        src.new_line() << sum << "_c = (t - " << sum << ") - y;";
+        src.new_line() << sum << " = t;";
+        src.close("}");
+    }
+};
+
+//---------------------------------------------------------------------------
+// Fused reductions
+//---------------------------------------------------------------------------
+// Reduction of an expression in a fused kernel (see vex::reduction()).
+template <typename ScalarType, class RDC, class Expr>
+struct reduction_term {
+    typedef ScalarType scalar_type;
+    typedef RDC        reduction_kind;
+    typedef Expr       expression_type;
+
+    typedef typename RDC::template impl<ScalarType>::result_type result_type;
+
+    // Vectors are held by reference, everything else by value (the same
+    // way the expressions hold their terminals).
+    typename std::conditional<
+        traits::hold_terminal_by_reference<Expr>::value, const Expr&, const Expr
+        >::type expr;
+
+    reduction_term(const Expr &expr) : expr(expr) {}
+
+    static result_type initial() {
+        return RDC::template impl<ScalarType>::initial();
+    }
+
+    static result_type combine(const result_type &a, const result_type &b) {
+        return typename RDC::template impl<ScalarType>()(a, b);
+    }
+};
+
+template <size_t... I>
+struct index_list {};
+
+template <size_t N, size_t... I>
+struct make_index_list : make_index_list<N - 1, N - 1, I...> {};
+
+template <size_t... I>
+struct make_index_list<0, I...> {
+    typedef index_list<I...> type;
+};
+
+// Fused kernel without assignments.
+struct no_assignment {
+    void properties(get_expression_properties&) const {}
+
+    void preamble(backend::source_generator&, const backend::command_queue&,
+            kernel_generator_state_ptr) const
+    {}
+
+    void parameters(backend::source_generator&, const backend::command_queue&) const {}
+
+    void body(backend::source_generator&, const backend::command_queue&) const {}
+
+    void arguments(backend::kernel&, unsigned, size_t) const {}
+
+    void traffic(kernel_traffic&) const {}
+};
+
+// Multiexpression assignment in a fused kernel. The code is generated the
+// same way as in assign_multiexpression(): the new values are computed for
+// all components before any of them is written.
+template <class OP, class LHS, class RHS>
+struct multiexpression_assignment {
+    typedef traits::get_dimension<LHS> N;
+
+    const LHS &lhs;
+    const RHS &rhs;
+
+    multiexpression_assignment(const LHS &lhs, const RHS &rhs)
+        : lhs(lhs), rhs(rhs) {}
+
+    void properties(get_expression_properties &prop) const {
+        extract_terminals()(subexpression<0>::get(lhs), prop);
+    }
+
+    void preamble(backend::source_generator &src, const backend::command_queue &q,
+            kernel_generator_state_ptr state) const
+    {
+        static_for<0, N::value>::loop(
+                preamble_constructor<LHS, RHS>(lhs, rhs, src, q, state));
+    }
+
+    void parameters(backend::source_generator &src, const backend::command_queue &q) const {
+        static_for<0, N::value>::loop(
+                parameter_declarator<LHS, RHS>(lhs, rhs, src, q));
+    }
+
+    void body(backend::source_generator &src, const backend::command_queue &q) const {
+        static_for<0, N::value>::loop(expression_init<LHS, RHS>(lhs, rhs, src, q));
+        static_for<0, N::value>::loop(expression_finalize<OP, LHS>(lhs, src, q));
+    }
+
+    void arguments(backend::kernel &krn, unsigned d, size_t part_start) const {
+        static_for<0, N::value>::loop(
+                kernel_arg_setter<LHS, RHS>(lhs, rhs, krn, d, part_start));
+    }
+
+    void traffic(kernel_traffic &t) const {
+        static_for<0, N::value>::loop(subexpression_traffic<OP, LHS, RHS>(lhs, rhs, t));
+    }
+
+    // The reductions may only read the assigned values at the current
+    // element. Otherwise they have to be computed after the assignment.
+    template <class... R>
+    bool fusable(const R&... red) const {
+        deferrable_terminals check;
+
+        using expand = int[];
+        (void)expand{0, ((void)extract_terminals()(boost::proto::as_child(red.expr), check), 0)...};
+
+        return check.ok;
+    }
+
+    void assign() const {
+        assign_multiexpression<OP>(const_cast<LHS&>(lhs), rhs);
+    }
+};
+
+template <class... R>
+struct fused_result {
+    typedef std::tuple<typename R::result_type...> type;
+
+    static type get(const std::tuple<typename R::result_type...> &r) {
+        return r;
+    }
+};
+
+template <class R>
+struct fused_result<R> {
+    typedef typename R::result_type type;
+
+    static type get(const std::tuple<typename R::result_type> &r) {
+        return std::get<0>(r);
+    }
+};
+
+// Code generation for the reductions of a fused kernel.
+template <class... R>
+struct fused_reductions {
+    static const size_t NR = sizeof...(R);
+
+    typedef std::tuple<typename R::result_type...> result_type;
+
+    std::tuple<const R&...> red;
+
+    fused_reductions(const R&... red) : red(red...) {}
+
+    static std::string prefix(size_t k) {
+        std::ostringstream s;
+        s << "red" << k + 1;
+        return s.str();
+    }
+
+    static std::string sum(size_t k) {
+        std::ostringstream s;
+        s << "mySum" << k + 1;
+        return s.str();
+    }
+
+    // Offset of the partial results of the reduction in the output buffer.
+    static std::string offset(size_t k) {
+        std::ostringstream s;
+        s << "g_offset" << k + 1;
+        return s.str();
+    }
+
+    // Sizes of the partial results of each reduction.
+    static std::vector<size_t> sizes() {
+        std::vector<size_t> s = {sizeof(typename R::result_type)...};
+        return s;
+    }
+
+    // The largest partial result determines the size of the local memory.
+    static size_t max_size() {
+        std::vector<size_t> s = sizes();
+        return *std::max_element(s.begin(), s.end());
+    }
+
+    struct do_properties {
+        const fused_reductions &f;
+        get_expression_properties &prop;
+
+        do_properties(const fused_reductions &f, get_expression_properties &prop)
+            : f(f), prop(prop) {}
+
+        template <size_t I>
+        void apply() const {
+            extract_terminals()(boost::proto::as_child(std::get<I>(f.red).expr), prop);
+        }
+    };
+
+    struct do_preamble {
+        const fused_reductions &f;
+        backend::source_generator &src;
+        const backend::command_queue &q;
+        kernel_generator_state_ptr state;
+
+        do_preamble(const fused_reductions &f, backend::source_generator &src,
+                const backend::command_queue &q, kernel_generator_state_ptr state)
+            : f(f), src(src), q(q), state(state) {}
+
+        template <size_t I>
+        void apply() const {
+            typedef typename std::tuple_element<I, std::tuple<R...>>::type T;
+            typedef typename T::scalar_type    S;
+            typedef typename T::reduction_kind RDC;
+            typedef typename T::result_type    RT;
+
+            typedef typename RDC::template impl<S>::device_in  fun_in;
+            typedef typename RDC::template impl<S>::device_out fun_out;
+
+            output_terminal_preamble termpream(src, q, prefix(I), state);
+            boost::proto::eval(boost::proto::as_child(std::get<I>(f.red).expr), termpream);
+            boost::proto::eval(boost::proto::as_child( fun_in()( RT(), S()) ), termpream);
+            boost::proto::eval(boost::proto::as_child( fun_out()( RT(), RT()) ), termpream);
+        }
+    };
+
+    struct do_parameters {
+        const fused_reductions &f;
+        backend::source_generator &src;
+        const backend::command_queue &q;
+
+        do_parameters(const fused_reductions &f, backend::source_generator &src,
+                const backend::command_queue &q)
+            : f(f), src(src), q(q) {}
+
+        template <size_t I>
+        void apply() const {
+            extract_terminals()(boost::proto::as_child(std::get<I>(f.red).expr),
+                    declare_expression_parameter(src, q, prefix(I), empty_state()));
+        }
+    };
+
+    struct do_declare {
+        backend::source_generator &src;
+
+        do_declare(backend::source_generator &src) : src(src) {}
+
+        template <size_t I>
+        void apply() const {
+            typedef typename std::tuple_element<I, std::tuple<R...>>::type T;
+            local_reduction<typename T::scalar_type, typename T::reduction_kind>::declare(src, sum(I));
+        }
+    };
+
+    struct do_update {
+        const fused_reductions &f;
+        backend::source_generator &src;
+        const backend::command_queue &q;
+
+        do_update(const fused_reductions &f, backend::source_generator &src,
+                const backend::command_queue &q)
+            : f(f), src(src), q(q) {}
+
+        template <size_t I>
+        void apply() const {
+            typedef typename std::tuple_element<I, std::tuple<R...>>::type T;
+            local_reduction<typename T::scalar_type, typename T::reduction_kind>::update(
+                    src, q, std::get<I>(f.red).expr, sum(I), prefix(I));
+        }
+    };
+
+    // Writes the partial results of the work-groups. The results of each
+    // reduction occupy a separate segment of the output buffer. The segment
+    // offsets depend on the number of work-groups of the queue and are
+    // passed as kernel arguments, since the kernel is shared by the queues
+    // of the context.
+    struct do_output {
+        backend::source_generator &src;
+        const backend::command_queue &q;
+
+        do_output(backend::source_generator &src, const backend::command_queue &q)
+            : src(src), q(q) {}
+
+        template <size_t I>
+        void apply() const {
+            typedef typename std::tuple_element<I, std::tuple<R...>>::type T;
+            typedef typename T::scalar_type    S;
+            typedef typename T::reduction_kind RDC;
+            typedef typename T::result_type    RT;
+
+            typedef typename RDC::template impl<S>::device_out fun_out;
+
+            std::ostringstream g_odata;
+            g_odata << "((" << type_name< global_ptr<RT> >() << ")(g_odata + "
+                << offset(I) << "))[" << src.group_id(0) << "]";
+
+            if (backend::is_cpu(q)) {
+                src.new_line() << g_odata.str() << " = " << sum(I) << ";";
+                return;
+            }
+
+            src.open("{");
+            src.new_line() << type_name< shared_ptr<RT> >() << " sdata = ("
+                << type_name< shared_ptr<RT> >() << ")smem;";
+            src.new_line() << "sdata[tid] = " << sum(I) << ";";
+            src.new_line().barrier();
+            for(unsigned bs = 512; bs > 0; bs /= 2) {
+                src.new_line() << "if (block_size >= " << bs * 2 << ")";
+                src.open("{").new_line() << "if (tid < " << bs << ") "
+                    "{ sdata[tid] = " << sum(I) << " = " << fun_out::name()
+                    << "(" << sum(I) << ", sdata[tid + " << bs << "]); }";
+                src.new_line().barrier().close("}");
+            }
+            src.new_line() << "if (tid == 0) " << g_odata.str() << " = sdata[0];";
+            // The local memory is reused by the next reduction:
+            src.new_line().barrier();
+            src.close("}");
+        }
+    };
+
+    struct do_arguments {
+        const fused_reductions &f;
+        backend::kernel &krn;
+        unsigned d;
+        size_t part_start;
+
+        do_arguments(const fused_reductions &f, backend::kernel &krn,
+                unsigned d, size_t part_start)
+            : f(f), krn(krn), d(d), part_start(part_start) {}
+
+        template <size_t I>
+        void apply() const {
+            extract_terminals()(boost::proto::as_child(std::get<I>(f.red).expr),
+                    set_expression_argument(krn, d, part_start, empty_state()));
+        }
+    };
+
+    struct do_traffic {
+        const fused_reductions &f;
+        kernel_traffic &t;
+
+        do_traffic(const fused_reductions &f, kernel_traffic &t) : f(f), t(t) {}
+
+        template <size_t I>
+        void apply() const {
+            t.reduction(std::get<I>(f.red).expr);
+        }
+    };
+
+    struct do_collect {
+        const char *hbuf;
+        size_t ngroups;
+        const std::vector<size_t> &offset;
+        result_type &result;
+
+        do_collect(const char *hbuf, size_t ngroups,
+                const std::vector<size_t> &offset, result_type &result)
+            : hbuf(hbuf), ngroups(ngroups), offset(offset), result(result) {}
+
+        template <size_t I>
+        void apply() const {
+            typedef typename std::tuple_element<I, std::tuple<R...>>::type T;
+            typedef typename T::result_type RT;
+
+            const char *p = hbuf + offset[I];
+            for(size_t i = 0; i < ngroups; ++i, p += sizeof(RT)) {
+                RT v;
+                std::memcpy(&v, p, sizeof(RT));
+                std::get<I>(result) = T::combine(std::get<I>(result), v);
+            }
+        }
+    };
+};
+
+// Buffers for the partial results of a fused reduction. The results of all
+// reductions are read back to the host at once.
+struct fused_reduction_data {
+    std::vector<size_t>             offset;
+    std::vector<char>               hbuf;
+    backend::device_vector<char>    dbuf;
+
+    fused_reduction_data(const backend::command_queue &q,
+            const std::vector<size_t> &sizes)
+        : offset(layout(q, sizes)), hbuf(offset.back()), dbuf(q, offset.back())
+    { }
+
+    // Segment offsets of the reductions (aligned to 16 bytes), followed by
+    // the total size.
+    static std::vector<size_t> layout(const backend::command_queue &q,
+            const std::vector<size_t> &sizes)
+    {
+        const size_t ngroups = backend::kernel::num_workgroups(q);
+
+        std::vector<size_t> offset(1, 0);
+        for(auto s = sizes.begin(); s != sizes.end(); ++s)
+            offset.push_back(alignup(offset.back() + ngroups * (*s), 16));
+
+        return offset;
+    }
+};
+
+// Performs the assignment (if any) and the reductions in a single kernel.
+// The queue list is taken from the expressions unless given explicitly.
+template <class Assign, class... R>
+std::tuple<typename R::result_type...>
+fused_reduce(std::vector<backend::command_queue> queue,
+        const Assign &assign, const R&... red)
+{
+    typedef fused_reductions<R...> F;
+    const size_t NR = F::NR;
+
+    F fused(red...);
+
+    typename F::result_type result(R::initial()...);
+
+    get_expression_properties prop;
+    assign.properties(prop);
+    static_for<0, NR>::loop(typename F::do_properties(fused, prop));
+
+    if (prop.size == 0) return result;
+
+    if (queue.empty()) queue = prop.queue;
+
+    precondition(!queue.empty(),
+            "Can not determine expression size and queue list"
+            );
+
+    if (prop.part.empty())
+        prop.part = vex::partition(prop.size, queue);
+
+    static kernel_cache cache("reductor");
+    static object_cache<index_by_queue, fused_reduction_data> data_cache;
+
+    for(unsigned d = 0; d < queue.size(); ++d) {
+        auto kernel = cache.find(queue[d]);
+
+        backend::select_context(queue[d]);
+
+        auto data = data_cache.find(queue[d]);
+        if (data == data_cache.end())
+            data = data_cache.insert(queue[d], fused_reduction_data(queue[d], F::sizes()));
+
+        if (kernel == cache.end()) {
+            backend::source_generator source(queue[d]);
+
+            auto state = empty_state();
+            assign.preamble(source, queue[d], state);
+            static_for<0, NR>::loop(typename F::do_preamble(fused, source, queue[d], state));
+
+            source.begin_kernel("vexcl_fused_reduction_kernel");
+            source.begin_kernel_parameters();
+            source.template parameter<size_t>("n");
+
+            assign.parameters(source, queue[d]);
+            static_for<0, NR>::loop(typename F::do_parameters(fused, source, queue[d]));
+
+            source.template parameter< global_ptr<char> >("g_odata");
+            for(size_t k = 0; k < NR; ++k)
+                source.template parameter<size_t>(F::offset(k));
+
+            if (!backend::is_cpu(queue[d]))
+                source.template smem_parameter<char>();
+
+            source.end_kernel_parameters();
+
+            static_for<0, NR>::loop(typename F::do_declare(source));
+
+            source.grid_stride_loop().open("{");
+
+            assign.body(source, queue[d]);
+            static_for<0, NR>::loop(typename F::do_update(fused, source, queue[d]));
+
+            source.close("}");
+
+            if (backend::is_cpu(queue[d])) {
+                static_for<0, NR>::loop(typename F::do_output(source, queue[d]));
+                source.end_kernel();
+
+                kernel = cache.insert(queue[d], backend::kernel(
+                            queue[d], source.str(), "vexcl_fused_reduction_kernel"));
+            } else {
+                source.smem_declaration<char>();
+
+                source.new_line() << "size_t tid = " << source.local_id(0) << ";";
+                source.new_line() << "size_t block_size = " << source.local_size(0) << ";";
+
+                static_for<0, NR>::loop(typename F::do_output(source, queue[d]));
+                source.end_kernel();
+
+                kernel = cache.insert(queue[d], backend::kernel(
+                            queue[d], source.str(), "vexcl_fused_reduction_kernel",
+                            F::max_size()));
+            }
+
+            kernel_traffic t;
+            assign.traffic(t);
+            static_for<0, NR>::loop(typename F::do_traffic(fused, t));
+            t.set(kernel->second);
+        }
+
+        if (size_t psize = prop.part_size(d)) {
+            kernel->second.push_arg(psize);
+
+            assign.arguments(kernel->second, d, prop.part_start(d));
+            static_for<0, NR>::loop(typename F::do_arguments(
+                        fused, kernel->second, d, prop.part_start(d)));
+
+            kernel->second.push_arg(data->second.dbuf);
+            for(size_t k = 0; k < NR; ++k)
+                kernel->second.push_arg(data->second.offset[k]);
+
+            if (!backend::is_cpu(queue[d])) {
+                const size_t smem = F::max_size();
+                kernel->second.set_smem(
+                        [smem](size_t wgs){
+                            return wgs * smem;
+                        });
+            }
+
+            kernel->second(queue[d]);
+        }
+    }
+
+    for(unsigned d = 0; d < queue.size(); d++) {
+        if (prop.part_size(d)) {
+            auto data = data_cache.find(queue[d]);
+            data->second.dbuf.read(queue[d], 0, data->second.hbuf.size(), data->second.hbuf.data());
+        }
+    }
+
+    for(unsigned d = 0; d < queue.size(); d++) {
+        if (prop.part_size(d)) {
+            auto data = data_cache.find(queue[d]);
+
+            queue[d].finish();
+
+            static_for<0, NR>::loop(typename F::do_collect(data->second.hbuf.data(),
+                        backend::kernel::num_workgroups(queue[d]),
+                        data->second.offset, result));
+        }
+    }
+
+    return result;
+}
+
+// Assignment and reductions in a single kernel, unless the reductions read
+// the assigned vectors at other elements.
+template <class OP, class LHS, class RHS, class... R>
+typename fused_result<R...>::type
+assign_and_reduce(const LHS &lhs, const RHS &rhs, const R&... red)
+{
+    static_assert(sizeof...(R) > 0, "At least one reduction is expected");
+
+    multiexpression_assignment<OP, LHS, RHS> assign(lhs, rhs);
+
+    if (assign.fusable(red...))
+        return fused_result<R...>::get(
+                fused_reduce(std::vector<backend::command_queue>(), assign, red...));
+
+    assign.assign();
+    return fused_result<R...>::get(
+            fused_reduce(std::vector<backend::command_queue>(), no_assignment(), red...));
+}
+
+} // namespace detail
+
 /// Parallel reduction of arbitrary expression.
 /**
  * Reduction uses small temporary buffer on each device present in the queue
@@ -306,24 +952,111 @@ class Reductor {
                 result_type
             >::type
         {
-            using namespace detail;
+            detail::get_expression_properties prop;
+            detail::extract_terminals()(expr, prop);
 
-            static kernel_cache cache;
+            // If expression is of zero size, then there is nothing to do. Hurray!
+            if (prop.size == 0) return RDC::template impl<ScalarType>::initial();
 
-            auto &data_cache = get_data_cache();
+            // Sometimes the expression only knows its size:
+            if (prop.part.empty())
+                prop.part = vex::partition(prop.size, queue);
 
-            get_expression_properties prop;
-            extract_terminals()(expr, prop);
+            launch(expr, prop);
+            return combine(prop);
+        }
 
-            result_type initial = RDC::template impl<ScalarType>::initial();
+        /// Compute reduction of a vector expression without waiting for the result.
+        /**
+         * The partial results of the work-groups are combined on the device,
+         * so that the returned vex::device_scalar may be used in the
+         * subsequent vector expressions without a host-device
+         * synchronization. With several devices in the queue list the
+         * partial results are combined on the host (which waits for the
+         * reduction to finish), and the result is copied to each device.
+         */
+        template <class Expr>
+        auto async(const Expr &expr) const ->
+            typename std::enable_if<
+                boost::proto::matches<Expr, vector_expr_grammar>::value,
+                device_scalar<result_type>
+            >::type
+        {
+            detail::get_expression_properties prop;
+            detail::extract_terminals()(expr, prop);
 
-            // If expression is of zero size, then there is nothing to do. Hurray!
-            if (prop.size == 0) return initial;
+            if (prop.size == 0)
+                return device_scalar<result_type>(queue,
+                        RDC::template impl<ScalarType>::initial());
 
-            // Sometimes the expression only knows its size:
-            if (prop.size && prop.part.empty())
+            if (prop.part.empty())
                 prop.part = vex::partition(prop.size, queue);
 
+            launch(expr, prop);
+
+            if (queue.size() > 1)
+                return device_scalar<result_type>(queue, combine(prop));
+
+            device_scalar<result_type> result(queue);
+            finalize(result);
+            return result;
+        }
+
+        /// Compute reduction of a multivector expression.
+        template <class Expr>
+#ifdef DOXYGEN
+        std::array<result_type, N>
+#else
+        typename std::enable_if<
+            boost::proto::matches<Expr, multivector_expr_grammar>::value &&
+            !boost::proto::matches<Expr, vector_expr_grammar>::value,
+            std::array<result_type, std::result_of<traits::multiex_dimension(Expr)>::type::value>
+        >::type
+#endif
+        operator()(const Expr &expr) const {
+            const size_t dim = std::result_of<traits::multiex_dimension(Expr)>::type::value;
+
+            // The components are reduced by a single kernel:
+            return reduce_components(expr, typename detail::make_index_list<dim>::type());
+        }
+    private:
+        mutable std::vector<backend::command_queue> queue;
+
+        struct reductor_data {
+            std::vector<result_type>            hbuf;
+            backend::device_vector<result_type> dbuf;
+
+            reductor_data(const backend::command_queue &q)
+                : hbuf(backend::kernel::num_workgroups(q)),
+                  dbuf(q, backend::kernel::num_workgroups(q))
+            { }
+        };
+
+        typedef
+            detail::object_cache<detail::index_by_queue, reductor_data>
+            reductor_data_cache;
+
+        // The scratch buffers are private to the calling thread, so that
+        // concurrent reductions on a shared context do not clobber each
+        // other's partial sums.
+        static reductor_data_cache& get_data_cache() {
+            static thread_local reductor_data_cache cache;
+            return cache;
+        }
+
+        // Launches the reduction kernels. Each work-group writes its partial
+        // result to the scratch buffer of the device.
+        template <class Expr>
+        void launch(const Expr &expr, const detail::get_expression_properties &prop) const {
+            using namespace detail;
+
+            static cse_kernel_cache caches("reductor");
+
+            auto &data_cache = get_data_cache();
+
+            cse_plan cse(expr);
+            kernel_cache &cache = caches[cse];
+
             for(unsigned d = 0; d < queue.size(); ++d) {
                 auto kernel = cache.find(queue[d]);
 
@@ -332,7 +1065,7 @@ class Reductor {
                 if (kernel == cache.end()) {
                     backend::source_generator source(queue[d]);
 
-                    output_terminal_preamble termpream(source, queue[d], "prm", empty_state());
+                    output_terminal_preamble termpream(source, queue[d], "prm", cse.state("prm"));
                     boost::proto::eval(boost::proto::as_child(expr),  termpream);
 
                     typedef typename RDC::template impl<ScalarType>::device_in  fun_in;
@@ -344,7 +1077,7 @@ class Reductor {
                     source.begin_kernel_parameters();
                     source.template parameter<size_t>("n");
 
-                    extract_terminals()( expr, declare_expression_parameter(source, queue[d], "prm", empty_state()) );
+                    extract_terminals()( expr, declare_expression_parameter(source, queue[d], "prm", cse.state("prm")) );
 
                     source.template parameter< global_ptr<result_type> >("g_odata");
 
@@ -353,7 +1086,12 @@ class Reductor {
 
                     source.end_kernel_parameters();
 
-                    local_sum<Expr, RDC>::get(queue[d], expr, source);
+                    local_reduction<ScalarType, RDC>::declare(source, "mySum");
+
+                    source.grid_stride_loop().open("{");
+                    local_reduction<ScalarType, RDC>::update(
+                            source, queue[d], expr, "mySum", "prm", cse);
+                    source.close("}");
 
                     if ( backend::is_cpu(queue[d]) ) {
                         source.new_line() << "g_odata[" << source.group_id(0) << "] = mySum;";
@@ -383,6 +1121,11 @@ class Reductor {
                                     queue[d], source.str(), "vexcl_reductor_kernel",
                                     sizeof(ScalarType)));
                     }
+
+                    // The reduction adds an operation per element:
+                    expression_traffic t;
+                    boost::proto::eval(boost::proto::as_child(expr), t);
+                    set_kernel_traffic(kernel->second, t.bytes_read, 0, t.flops + 1);
                 }
 
                 if (size_t psize = prop.part_size(d)) {
@@ -394,7 +1137,7 @@ class Reductor {
 
                     extract_terminals()(
                             expr,
-                            set_expression_argument(kernel->second, d, prop.part_start(d), empty_state())
+                            set_expression_argument(kernel->second, d, prop.part_start(d), empty_state(), &cse)
                             );
 
                     kernel->second.push_arg(data->second.dbuf);
@@ -408,6 +1151,11 @@ class Reductor {
                     kernel->second(queue[d]);
                 }
             }
+        }
+
+        // Reads the partial results back and combines them on the host.
+        result_type combine(const detail::get_expression_properties &prop) const {
+            auto &data_cache = get_data_cache();
 
             for(unsigned d = 0; d < queue.size(); d++) {
                 if (prop.part_size(d)) {
@@ -417,7 +1165,7 @@ class Reductor {
                 }
             }
 
-            result_type result = initial;
+            result_type result = RDC::template impl<ScalarType>::initial();
             typename RDC::template impl<ScalarType> rdc;
             for(unsigned d = 0; d < queue.size(); d++) {
                 if (prop.part_size(d)) {
@@ -438,131 +1186,185 @@ class Reductor {
             return result;
         }
 
-        /// Compute reduction of a multivector expression.
-        template <class Expr>
-#ifdef DOXYGEN
-        std::array<result_type, N>
-#else
-        typename std::enable_if<
-            boost::proto::matches<Expr, multivector_expr_grammar>::value &&
-            !boost::proto::matches<Expr, vector_expr_grammar>::value,
-            std::array<result_type, std::result_of<traits::multiex_dimension(Expr)>::type::value>
-        >::type
-#endif
-        operator()(const Expr &expr) const {
-            const size_t dim = std::result_of<traits::multiex_dimension(Expr)>::type::value;
-            std::array<result_type, dim> result;
-
-            assign_subexpressions<0, dim, Expr>(result, expr);
-
-            return result;
-        }
-    private:
-        mutable std::vector<backend::command_queue> queue;
-
-        struct reductor_data {
-            std::vector<result_type>            hbuf;
-            backend::device_vector<result_type> dbuf;
+        // Combines the partial results of the single device into the device
+        // scalar. The kernel is launched after the reduction kernel in the
+        // same queue, so no synchronization is needed.
+        void finalize(const device_scalar<result_type> &result) const {
+            using namespace detail;
 
-            reductor_data(const backend::command_queue &q)
-                : hbuf(backend::kernel::num_workgroups(q)),
-                  dbuf(q, backend::kernel::num_workgroups(q))
-            { }
-        };
+            typedef typename RDC::template impl<ScalarType>::device_in  fun_in;
+            typedef typename RDC::template impl<ScalarType>::device_out fun_out;
 
-        typedef
-            detail::object_cache<detail::index_by_queue, reductor_data>
-            reductor_data_cache;
+            static kernel_cache cache("reductor");
 
-        static reductor_data_cache& get_data_cache() {
-            static reductor_data_cache cache;
-            return cache;
-        }
+            const backend::command_queue &q = queue[0];
 
-        template <size_t I, size_t N, class Expr>
-        typename std::enable_if<I == N, void>::type
-        assign_subexpressions(std::array<result_type, N> &, const Expr &) const
-        { }
+            auto data = get_data_cache().find(q);
+            auto kernel = cache.find(q);
 
-        template <size_t I, size_t N, class Expr>
-        typename std::enable_if<(I < N), void>::type
-        assign_subexpressions(std::array<result_type, N> &result, const Expr &expr) const
-        {
-            result[I] = (*this)(detail::extract_subexpression<I>()(expr));
+            backend::select_context(q);
 
-            assign_subexpressions<I + 1, N, Expr>(result, expr);
-        }
+            if (kernel == cache.end()) {
+                backend::source_generator source(q);
 
-        template <typename result_type>
-        static typename std::enable_if<cl_vector_length<result_type>::value == 1, void>::type
-        initial_value(backend::source_generator &src, const result_type &initial) {
-            src.new_line() << type_name<result_type>() << " mySum = " << initial << ";";
-        }
+                // The output function of the combined reductors relies on
+                // the definitions made by the input one.
+                output_terminal_preamble termpream(source, q, "prm", empty_state());
+                boost::proto::eval(boost::proto::as_child( fun_in()( result_type(), ScalarType()) ), termpream);
+                boost::proto::eval(boost::proto::as_child( fun_out()( result_type(), result_type()) ), termpream);
 
-        template <typename result_type>
-        static typename std::enable_if<(cl_vector_length<result_type>::value > 1), void>::type
-        initial_value(backend::source_generator &src, const result_type &initial) {
-            src.new_line() << type_name<result_type>() << " mySum = {" << initial.s[0];
-            for(unsigned i = 1; i < cl_vector_length<result_type>::value; ++i)
-                src << ", " << initial.s[i];
-            src << "};";
-        }
+                source.begin_kernel("vexcl_reductor_finalize");
+                source.begin_kernel_parameters();
+                source.template parameter<size_t>("n");
+                source.template parameter<size_t>("m");
+                source.template parameter< global_ptr<const result_type> >("g_idata");
+                source.template parameter< global_ptr<result_type> >("g_odata");
+                source.end_kernel_parameters();
 
-        template <class Expr, class OP>
-        struct local_sum {
-            static void get(const backend::command_queue &q, const Expr &expr,
-                    backend::source_generator &source)
-            {
-                using namespace detail;
+                // A single work-item (n = 1) combines the m partial results.
+                source.grid_stride_loop().open("{");
+                source.new_line() << type_name<result_type>() << " s = g_idata[0];";
+                source.new_line() << "for(size_t i = 1; i < m; ++i) s = "
+                    << fun_out::name() << "(s, g_idata[i]);";
+                source.new_line() << "g_odata[0] = s;";
+                source.close("}");
+                source.end_kernel();
 
-                typedef typename OP::template impl<ScalarType>::device_in fun;
-                result_type initial = OP::template impl<ScalarType>::initial();
+                kernel = cache.insert(q, backend::kernel(
+                            q, source.str(), "vexcl_reductor_finalize"));
+            }
 
-                initial_value(source, initial);
+            kernel->second.push_arg(static_cast<size_t>(1));
+            kernel->second.push_arg(data->second.hbuf.size());
+            kernel->second.push_arg(data->second.dbuf);
+            kernel->second.push_arg(result(0));
 
-                source.grid_stride_loop().open("{");
+            kernel->second(q);
+        }
 
-                output_local_preamble loc_init(source, q, "prm", empty_state());
-                boost::proto::eval(expr, loc_init);
-                source.new_line() << "mySum = " << fun::name() << "(mySum, ";
-                vector_expr_context expr_ctx(source, q, "prm", empty_state());
-                boost::proto::eval(expr, expr_ctx);
-                source << ");";
+        template <class Expr, size_t... I>
+        std::array<result_type, sizeof...(I)>
+        reduce_components(const Expr &expr, detail::index_list<I...>) const {
+            auto r = detail::fused_reduce(queue, detail::no_assignment(),
+                    detail::reduction_term<ScalarType, RDC,
+                        typename std::decay<
+                            decltype(detail::extract_subexpression<I>()(expr))
+                        >::type
+                    >(detail::extract_subexpression<I>()(expr))...
+                    );
+
+            std::array<result_type, sizeof...(I)> result = {{ std::get<I>(r)... }};
+            return result;
+        }
+};
 
-                source.close("}");
-            }
-        };
+/// Reduction of a vector expression in a fused kernel.
+/**
+ * Describes a reduction for vex::assign_and_reduce(). The reduction kind and
+ * the scalar type have the same meaning as for vex::Reductor. The returned
+ * object refers to the vectors of the expression, and should be used while
+ * the vectors are alive.
+ */
+template <typename ScalarType, class RDC = SUM, class Expr>
+#ifdef DOXYGEN
+reduction_term
+#else
+typename std::enable_if<
+    boost::proto::matches<Expr, vector_expr_grammar>::value,
+    detail::reduction_term<ScalarType, RDC, Expr>
+>::type
+#endif
+reduction(const Expr &expr) {
+    return detail::reduction_term<ScalarType, RDC, Expr>(expr);
+}
 
-        // http://en.wikipedia.org/wiki/Kahan_summation_algorithm
-        template <class Expr>
-        struct local_sum<Expr, SUM_Kahan> {
-            static void get(const backend::command_queue &q, const Expr &expr,
-                    backend::source_generator &source)
-            {
-                using namespace detail;
-
-                source.new_line()
-                    << type_name<result_type>() << " mySum = ("
-                    << type_name<result_type>() << ")0, c = ("
-                    << type_name<result_type>() << ")0;";
-                source.grid_stride_loop().open("{");
+/// Assigns an expression to a vector and reduces the updated values.
+/**
+ * The assignment and the reductions (created with vex::reduction()) are
+ * performed by a single kernel, in a single pass over the data. The
+ * reductions see the updated values of the vector:
+ * \code
+ * // r -= alpha * q; rr = sum(r * r);
+ * double rr = vex::assign_and_reduce<vex::assign::SUB>(r, alpha * q,
+ *         vex::reduction<double>(r * r));
+ * \endcode
+ * Returns the reduced value for a single reduction, and a std::tuple of the
+ * reduced values otherwise.
+ *
+ * The fused kernel is only used when the reductions access the vectors at the
+ * current element (i.e. consist of vectors, scalars, element indices, and
+ * builtin or user-defined functions). Otherwise the assignment is done first,
+ * and the reductions are computed by a separate kernel.
+ */
+template <class OP = assign::SET, typename T, class RHS, class... R>
+#ifdef DOXYGEN
+auto
+#else
+typename std::enable_if<
+    boost::proto::is_expr<RHS>::value &&
+    boost::proto::matches<RHS, vector_expr_grammar>::value,
+    typename detail::fused_result<R...>::type
+>::type
+#endif
+assign_and_reduce(vector<T> &lhs, const RHS &rhs, const R&... red)
+{
+    return detail::assign_and_reduce<OP>(std::tie(lhs), std::tie(rhs), red...);
+}
 
-                output_local_preamble loc_init(source, q, "prm", empty_state());
-                boost::proto::eval(expr, loc_init);
+/// Assigns a multiexpression and reduces the updated values.
+/**
+ * The left-hand side is either a multivector, or a tuple of vectors created
+ * with vex::tie() or std::tie(). The right-hand side is a multivector
+ * expression or a tuple of vector expressions:
+ * \code
+ * double pq, rr;
+ * std::tie(pq, rr) = vex::assign_and_reduce(std::tie(x, r),
+ *         std::make_tuple(x + alpha * p, r - alpha * q),
+ *         vex::reduction<double>(p * q),
+ *         vex::reduction<double>(r * r));
+ * \endcode
+ */
+template <class OP = assign::SET, class LHS, class RHS, class... R>
+typename detail::fused_result<R...>::type
+assign_and_reduce(const LHS &lhs, const RHS &rhs, const R&... red)
+{
+    return detail::assign_and_reduce<OP>(lhs, rhs, red...);
+}
 
-                source.new_line() << type_name<result_type>() << " y = (";
-                vector_expr_context expr_ctx(source, q, "prm", empty_state());
-                boost::proto::eval(expr, expr_ctx);
-                source << ") - c;";
+#ifndef DOXYGEN
+template <class OP = assign::SET, class LHS, class RHS, class... R>
+typename detail::fused_result<R...>::type
+assign_and_reduce(const expression_tuple<LHS> &lhs, const RHS &rhs, const R&... red)
+{
+    return detail::assign_and_reduce<OP>(lhs.lhs, rhs, red...);
+}
+#endif
 
-                source.new_line() << type_name<result_type>() << " t = mySum + y;";
-                source.new_line() << "c = (t - mySum) - y;";
-                source.new_line() << "mySum = t;";
+/// Reduces several independent expressions in a single kernel.
+/**
+ * The reductions (created with vex::reduction()) may have different scalar
+ * types and reduction kinds, but should have the same size and use the same
+ * queues. The results of all reductions are read back to the host at once:
+ * \code
+ * double xy, rmax, rr;
+ * std::tie(xy, rmax, rr) = vex::reduce_all(
+ *         vex::reduction<double>(x * y),
+ *         vex::reduction<double, vex::MAX>(fabs(r)),
+ *         vex::reduction<double>(r * r));
+ * \endcode
+ * Returns the reduced value for a single reduction, and a std::tuple of the
+ * reduced values otherwise.
+ */
+template <class... R>
+typename detail::fused_result<R...>::type
+reduce_all(const R&... red)
+{
+    static_assert(sizeof...(R) > 0, "At least one reduction is expected");
 
-                source.close("}");
-            }
-        };
-};
+    return detail::fused_result<R...>::get(
+            detail::fused_reduce(std::vector<backend::command_queue>(),
+                detail::no_assignment(), red...));
+}
 
 /// Returns an instance of vex::Reductor<T,R>
 /**
@@ -66,7 +66,7 @@ namespace detail {
 template <int NT, typename T, typename Oper>
 backend::kernel block_inclusive_scan(const backend::command_queue &queue)
 {
-    static detail::kernel_cache cache;
+    static detail::kernel_cache cache("scan");
 
     auto kernel = cache.find(queue);
 
@@ -145,7 +145,7 @@ backend::kernel block_inclusive_scan(const backend::command_queue &queue)
 template <int NT, typename T, typename Oper>
 backend::kernel intra_block_inclusive_scan(const backend::command_queue &queue)
 {
-    static detail::kernel_cache cache;
+    static detail::kernel_cache cache("scan");
 
     auto kernel = cache.find(queue);
 
@@ -248,7 +248,7 @@ template <int NT, typename T, typename Oper>
 backend::kernel block_addition(
         const backend::command_queue &queue)
 {
-    static detail::kernel_cache cache;
+    static detail::kernel_cache cache("scan");
 
     auto kernel = cache.find(queue);
 
@@ -76,7 +76,7 @@ struct gcc46_workaround {
 //---------------------------------------------------------------------------
 template <int NT, typename K, typename V, class Comp, class Oper, bool exclusive>
 backend::kernel block_scan_by_key(const backend::command_queue &queue) {
-    static detail::kernel_cache cache;
+    static detail::kernel_cache cache("scan_by_key");
 
     auto kernel = cache.find(queue);
 
@@ -254,7 +254,7 @@ backend::kernel block_scan_by_key(const backend::command_queue &queue) {
 template <int NT, typename K, typename V, class Comp, class Oper>
 backend::kernel block_inclusive_scan_by_key(const backend::command_queue &queue)
 {
-    static detail::kernel_cache cache;
+    static detail::kernel_cache cache("scan_by_key");
 
     auto kernel = cache.find(queue);
 
@@ -425,7 +425,7 @@ backend::kernel block_inclusive_scan_by_key(const backend::command_queue &queue)
 //---------------------------------------------------------------------------
 template <int NT, typename K, typename V, class Comp, class Oper, bool exclusive>
 backend::kernel block_add_by_key(const backend::command_queue &queue) {
-    static detail::kernel_cache cache;
+    static detail::kernel_cache cache("scan_by_key");
 
     auto kernel = cache.find(queue);
     if (kernel == cache.end()) {
@@ -74,7 +74,23 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #  define VEX_SORT_NT_GPU 256
 #endif
 
+// Maximum number of chunks (work-groups) in the radix sort on CPUs.
+#ifndef VEX_SORT_RADIX_BLOCKS
+#  define VEX_SORT_RADIX_BLOCKS 256
+#endif
+
+// Minimum number of keys in a chunk of the radix sort on CPUs.
+#ifndef VEX_SORT_RADIX_CHUNK
+#  define VEX_SORT_RADIX_CHUNK 4096
+#endif
+
 namespace vex {
+
+template <typename T> struct less;
+template <typename T> struct less_equal;
+template <typename T> struct greater;
+template <typename T> struct greater_equal;
+
 namespace detail {
 
 //---------------------------------------------------------------------------
@@ -819,7 +835,7 @@ struct call_shared_to_thread {
 //---------------------------------------------------------------------------
 template <int NT, int VT, typename K, typename V, typename Comp>
 backend::kernel& block_sort_kernel(const backend::command_queue &queue) {
-    static detail::kernel_cache cache;
+    static detail::kernel_cache cache("sort");
 
     auto kernel = cache.find(queue);
 
@@ -992,7 +1008,7 @@ inline void find_mergesort_frame(backend::source_generator &src) {
 //---------------------------------------------------------------------------
 template <int NT, typename T, typename Comp>
 backend::kernel merge_partition_kernel(const backend::command_queue &queue) {
-    static detail::kernel_cache cache;
+    static detail::kernel_cache cache("sort");
 
     auto kernel = cache.find(queue);
 
@@ -1599,7 +1615,7 @@ void device_merge(backend::source_generator &src) {
 //---------------------------------------------------------------------------
 template <int NT, int VT, typename K, typename V, typename Comp>
 backend::kernel merge_kernel(const backend::command_queue &queue) {
-    static detail::kernel_cache cache;
+    static detail::kernel_cache cache("sort");
 
     auto kernel = cache.find(queue);
 
@@ -1869,6 +1885,389 @@ void sort_by_key(const backend::command_queue &queue, KTup &&keys, VTup &&vals,
     }
 }
 
+//---------------------------------------------------------------------------
+// LSD radix sort for CPU queues
+//---------------------------------------------------------------------------
+// The block mergesort above is tuned for GPUs. On CPUs, where the work-group
+// size is one, each work-group of the radix sort handles a contiguous chunk
+// of the keys: it counts the digits of its chunk into its own histogram, the
+// histograms are scanned in digit-major order, and then each work-group
+// scatters its chunk to the offsets it got from the scan. This keeps the
+// sort stable, so that sort_by_key() gives the same results as the
+// mergesort. The keys are mapped to unsigned integers of the same width
+// with an order-preserving transform, and the passes go over 8-bit digits
+// (4-bit digits for one-byte keys, so that the number of passes is always
+// even and the sorted data ends up in the original buffers).
+
+/// Unsigned integer type of the same width as T.
+template <typename T, class Enable = void>
+struct radix_bits_type;
+
+template <typename T>
+struct radix_bits_type<T, typename std::enable_if<sizeof(T) == 1>::type> {
+    typedef cl_uchar type;
+};
+
+template <typename T>
+struct radix_bits_type<T, typename std::enable_if<sizeof(T) == 2>::type> {
+    typedef cl_ushort type;
+};
+
+template <typename T>
+struct radix_bits_type<T, typename std::enable_if<sizeof(T) == 4>::type> {
+    typedef cl_uint type;
+};
+
+template <typename T>
+struct radix_bits_type<T, typename std::enable_if<sizeof(T) == 8>::type> {
+    typedef cl_ulong type;
+};
+
+/// Sort order implied by the comparison functor (0 if not radix-sortable).
+template <class Comp>
+struct radix_order : std::integral_constant<int, 0> {
+    typedef void key_type;
+};
+
+template <typename T>
+struct radix_order< less<T> > : std::integral_constant<int, 1> {
+    typedef T key_type;
+};
+
+template <typename T>
+struct radix_order< less_equal<T> > : std::integral_constant<int, 1> {
+    typedef T key_type;
+};
+
+template <typename T>
+struct radix_order< greater<T> > : std::integral_constant<int, -1> {
+    typedef T key_type;
+};
+
+template <typename T>
+struct radix_order< greater_equal<T> > : std::integral_constant<int, -1> {
+    typedef T key_type;
+};
+
+/// Checks if the keys K may be sorted with comparison functor Comp by radix sort.
+template <class K, class Comp, class Enable = void>
+struct radix_sortable : std::false_type {};
+
+template <class K, class Comp>
+struct radix_sortable<K, Comp,
+    typename std::enable_if<boost::mpl::size<K>::value == 1>::type
+    > : std::integral_constant<bool,
+            std::is_same<
+                typename boost::mpl::at_c<K, 0>::type,
+                typename radix_order<Comp>::key_type
+            >::value &&
+            std::is_arithmetic<typename boost::mpl::at_c<K, 0>::type>::value &&
+            !std::is_same<typename boost::mpl::at_c<K, 0>::type, bool>::value
+        >
+{};
+
+/// Defines the function returning the radix digit of the key.
+template <typename K, bool Descending, int Bits>
+void radix_digit_function(backend::source_generator &src) {
+    typedef typename radix_bits_type<K>::type U;
+
+    const int width = 8 * sizeof(K);
+
+    std::ostringstream sign;
+    sign << "((" << type_name<U>() << ")1 << " << width - 1 << ")";
+
+    src.begin_function<int>("radix_digit");
+    src.begin_function_parameters();
+    src.template parameter<K>("x");
+    src.template parameter<int>("shift");
+    src.end_function_parameters();
+
+    src.new_line() << "union { " << type_name<K>() << " k; "
+        << type_name<U>() << " u; } c;";
+    src.new_line() << "c.k = x;";
+    src.new_line() << type_name<U>() << " u = c.u;";
+
+    // Order-preserving transform to an unsigned integer: negative floats
+    // have all of their bits flipped, and the sign bit of the nonnegative
+    // floats and of the signed integers is set.
+    if (std::is_floating_point<K>::value) {
+        src.new_line() << "u = (u & " << sign.str() << ") ? ("
+            << type_name<U>() << ")~u : (" << type_name<U>() << ")(u | "
+            << sign.str() << ");";
+    } else if (std::is_signed<K>::value) {
+        src.new_line() << "u = (" << type_name<U>() << ")(u ^ " << sign.str() << ");";
+    }
+
+    if (Descending)
+        src.new_line() << "u = (" << type_name<U>() << ")~u;";
+
+    src.new_line() << "return (int)((u >> shift) & " << (1 << Bits) - 1 << ");";
+
+    src.end_function();
+}
+
+/// Counts the digits in each chunk of the keys.
+template <typename K, bool Descending, int Bits>
+backend::kernel& radix_count_kernel(const backend::command_queue &queue) {
+    static detail::kernel_cache cache("sort");
+
+    auto kernel = cache.find(queue);
+
+    if (kernel == cache.end()) {
+        const int radix = 1 << Bits;
+
+        backend::source_generator src(queue);
+
+        radix_digit_function<K, Descending, Bits>(src);
+
+        src.begin_kernel("radix_count");
+        src.begin_kernel_parameters();
+        src.template parameter< int                  >("count");
+        src.template parameter< int                  >("chunk");
+        src.template parameter< int                  >("nblocks");
+        src.template parameter< int                  >("shift");
+        src.template parameter< global_ptr<const K>  >("keys");
+        src.template parameter< global_ptr<int>      >("counts");
+        src.end_kernel_parameters();
+
+        src.new_line() << "int block = " << src.global_id(0) << ";";
+        src.new_line() << "if (block >= nblocks) return;";
+        src.new_line() << "int hist[" << radix << "];";
+        src.new_line() << "for(int d = 0; d < " << radix << "; ++d) hist[d] = 0;";
+        src.new_line() << "int end = min(count, (block + 1) * chunk);";
+        src.new_line() << "for(int i = block * chunk; i < end; ++i) "
+            "++hist[radix_digit(keys[i], shift)];";
+        src.new_line() << "for(int d = 0; d < " << radix << "; ++d) "
+            "counts[d * nblocks + block] = hist[d];";
+
+        src.end_kernel();
+
+        kernel = cache.insert(queue, backend::kernel(
+                    queue, src.str(), "radix_count"));
+    }
+
+    return kernel->second;
+}
+
+/// Replaces the digit counts with the output offsets (exclusive scan).
+/**
+ * The counts array is short (the radix times the number of chunks), so it is
+ * scanned by a single work-item.
+ */
+inline backend::kernel& radix_scan_kernel(const backend::command_queue &queue) {
+    static detail::kernel_cache cache("sort");
+
+    auto kernel = cache.find(queue);
+
+    if (kernel == cache.end()) {
+        backend::source_generator src(queue);
+
+        src.begin_kernel("radix_scan");
+        src.begin_kernel_parameters();
+        src.template parameter< int             >("n");
+        src.template parameter< global_ptr<int> >("counts");
+        src.end_kernel_parameters();
+
+        src.new_line() << "if (" << src.global_id(0) << " != 0) return;";
+        src.new_line() << "int sum = 0;";
+        src.new_line() << "for(int i = 0; i < n; ++i)";
+        src.open("{");
+        src.new_line() << "int c = counts[i];";
+        src.new_line() << "counts[i] = sum;";
+        src.new_line() << "sum += c;";
+        src.close("}");
+
+        src.end_kernel();
+
+        kernel = cache.insert(queue, backend::kernel(
+                    queue, src.str(), "radix_scan"));
+    }
+
+    return kernel->second;
+}
+
+/// Moves keys and values of each chunk to their positions for the digit.
+template <typename K, typename V, bool Descending, int Bits>
+backend::kernel& radix_scatter_kernel(const backend::command_queue &queue) {
+    static detail::kernel_cache cache("sort");
+
+    auto kernel = cache.find(queue);
+
+    if (kernel == cache.end()) {
+        const int radix = 1 << Bits;
+
+        backend::source_generator src(queue);
+
+        radix_digit_function<K, Descending, Bits>(src);
+
+        src.begin_kernel("radix_scatter");
+        src.begin_kernel_parameters();
+        src.template parameter< int                  >("count");
+        src.template parameter< int                  >("chunk");
+        src.template parameter< int                  >("nblocks");
+        src.template parameter< int                  >("shift");
+        src.template parameter< global_ptr<const int>>("offsets");
+        src.template parameter< global_ptr<const K>  >("ikeys");
+        src.template parameter< global_ptr<K>        >("okeys");
+
+        boost::mpl::for_each<V>( pointer_param<global_ptr, true>(src, "ivals") );
+        boost::mpl::for_each<V>( pointer_param<global_ptr>(src, "ovals") );
+
+        src.end_kernel_parameters();
+
+        src.new_line() << "int block = " << src.global_id(0) << ";";
+        src.new_line() << "if (block >= nblocks) return;";
+        src.new_line() << "int pos[" << radix << "];";
+        src.new_line() << "for(int d = 0; d < " << radix << "; ++d) "
+            "pos[d] = offsets[d * nblocks + block];";
+        src.new_line() << "int end = min(count, (block + 1) * chunk);";
+        src.new_line() << "for(int i = block * chunk; i < end; ++i)";
+        src.open("{");
+        src.new_line() << type_name<K>() << " key = ikeys[i];";
+        src.new_line() << "int j = pos[radix_digit(key, shift)]++;";
+        src.new_line() << "okeys[j] = key;";
+        for(int p = 0; p < boost::mpl::size<V>::value; ++p)
+            src.new_line() << "ovals" << p << "[j] = ivals" << p << "[i];";
+        src.close("}");
+
+        src.end_kernel();
+
+        kernel = cache.insert(queue, backend::kernel(
+                    queue, src.str(), "radix_scatter"));
+    }
+
+    return kernel->second;
+}
+
+/// Sorts single partition of a vector with LSD radix sort.
+/**
+ * V is the list of value types (empty when there are no values).
+ */
+template <bool Descending, class V, class KTup, class VTup>
+void radix_sort(const backend::command_queue &queue, KTup &keys, VTup &vals) {
+    typedef typename extract_value_types<KTup>::type K;
+    typedef typename boost::mpl::at_c<K, 0>::type key_type;
+
+    using boost::fusion::at_c;
+
+    backend::select_context(queue);
+
+    const int bits   = sizeof(key_type) == 1 ? 4 : 8;
+    const int radix  = 1 << bits;
+    const int passes = 8 * sizeof(key_type) / bits;
+
+    const int count   = static_cast<int>(at_c<0>(keys).size());
+    const int nblocks = std::max(1, std::min(VEX_SORT_RADIX_BLOCKS, count / VEX_SORT_RADIX_CHUNK));
+    const int chunk   = (count + nblocks - 1) / nblocks;
+
+    temp_storage<K> keys_tmp(queue, count);
+    temp_storage<V> vals_tmp(queue, count);
+
+    backend::device_vector<int> counts(queue, radix * nblocks);
+
+    auto &count_krn   = radix_count_kernel<key_type, Descending, bits>(queue);
+    auto &scan_krn    = radix_scan_kernel(queue);
+    auto &scatter_krn = radix_scatter_kernel<key_type, V, Descending, bits>(queue);
+
+    for(int pass = 0; pass < passes; ++pass) {
+        // The keys and values move back and forth between the input buffers
+        // and the temporary storage.
+        const bool fwd   = !(pass & 1);
+        const int  shift = pass * bits;
+
+        count_krn.push_arg(count);
+        count_krn.push_arg(chunk);
+        count_krn.push_arg(nblocks);
+        count_krn.push_arg(shift);
+        if (fwd)
+            push_args<1>(count_krn, keys);
+        else
+            push_args<1>(count_krn, keys_tmp);
+        count_krn.push_arg(counts);
+
+        count_krn.config(nblocks, 1);
+        count_krn(queue);
+
+        scan_krn.push_arg(radix * nblocks);
+        scan_krn.push_arg(counts);
+
+        scan_krn.config(1, 1);
+        scan_krn(queue);
+
+        scatter_krn.push_arg(count);
+        scatter_krn.push_arg(chunk);
+        scatter_krn.push_arg(nblocks);
+        scatter_krn.push_arg(shift);
+        scatter_krn.push_arg(counts);
+        if (fwd) {
+            push_args<1>(scatter_krn, keys);
+            push_args<1>(scatter_krn, keys_tmp);
+            push_args<boost::mpl::size<V>::value>(scatter_krn, vals);
+            push_args<boost::mpl::size<V>::value>(scatter_krn, vals_tmp);
+        } else {
+            push_args<1>(scatter_krn, keys_tmp);
+            push_args<1>(scatter_krn, keys);
+            push_args<boost::mpl::size<V>::value>(scatter_krn, vals_tmp);
+            push_args<boost::mpl::size<V>::value>(scatter_krn, vals);
+        }
+
+        scatter_krn.config(nblocks, 1);
+        scatter_krn(queue);
+    }
+}
+
+/// Sorts single partition of a vector.
+/**
+ * Uses radix sort on CPUs when the keys and the comparison functor allow it,
+ * and the block mergesort otherwise.
+ */
+template <class KT, class Comp>
+typename std::enable_if<
+    radix_sortable<typename extract_value_types<KT>::type, Comp>::value
+>::type
+sort_partition(const backend::command_queue &queue, KT &keys, Comp comp) {
+    if (is_cpu(queue)) {
+        boost::fusion::vector<> vals;
+        radix_sort<(radix_order<Comp>::value < 0), boost::mpl::vector<> >(queue, keys, vals);
+    } else {
+        sort(queue, keys, comp.device);
+    }
+}
+
+template <class KT, class Comp>
+typename std::enable_if<
+    !radix_sortable<typename extract_value_types<KT>::type, Comp>::value
+>::type
+sort_partition(const backend::command_queue &queue, KT &keys, Comp comp) {
+    sort(queue, keys, comp.device);
+}
+
+/// Sorts single partition of a vector by key.
+template <class KT, class VT, class Comp>
+typename std::enable_if<
+    radix_sortable<typename extract_value_types<KT>::type, Comp>::value
+>::type
+sort_by_key_partition(const backend::command_queue &queue, KT &keys, VT &vals, Comp comp) {
+    if (is_cpu(queue)) {
+        precondition(boost::fusion::at_c<0>(keys).size() == boost::fusion::at_c<0>(vals).size(),
+                "keys and values should have same size"
+                );
+
+        typedef typename extract_value_types<VT>::type V;
+        radix_sort<(radix_order<Comp>::value < 0), V>(queue, keys, vals);
+    } else {
+        sort_by_key(queue, keys, vals, comp.device);
+    }
+}
+
+template <class KT, class VT, class Comp>
+typename std::enable_if<
+    !radix_sortable<typename extract_value_types<KT>::type, Comp>::value
+>::type
+sort_by_key_partition(const backend::command_queue &queue, KT &keys, VT &vals, Comp comp) {
+    sort_by_key(queue, keys, vals, comp.device);
+}
+
 template <class S1, class S2>
 boost::fusion::zip_view< boost::fusion::vector<S1&, S2&> >
 make_zip_view(S1 &s1, S2 &s2) {
@@ -2075,7 +2474,7 @@ void sort_sink(K &&keys, Comp comp) {
     for(unsigned d = 0; d < queue.size(); ++d)
         if (fusion::at_c<0>(keys).part_size(d)) {
             auto part = fusion::transform(keys, extract_device_vector(d));
-            sort(queue[d], part, comp.device);
+            sort_partition(queue[d], part, comp);
         }
 
     if (queue.size() <= 1) return;
@@ -2102,7 +2501,7 @@ void sort_by_key_sink(K &&keys, V &&vals, Comp comp) {
         if (fusion::at_c<0>(keys).part_size(d)) {
             auto kpart = fusion::transform(keys, extract_device_vector(d));
             auto vpart = fusion::transform(vals, extract_device_vector(d));
-            sort_by_key(queue[d], kpart, vpart, comp.device);
+            sort_by_key_partition(queue[d], kpart, vpart, comp);
         }
 
     if (queue.size() <= 1) return;
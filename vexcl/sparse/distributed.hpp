@@ -132,87 +132,49 @@ class distributed {
             }
 
 
-            // Setup exchange.
-            // 1. Build the combined vector of ghost points across all GPUs
-            size_t nrcols = 0;
-            for(size_t d = 0; d < q.size(); ++d)
-                nrcols += rcols[d].size();
-
-            // K-way merge of rcols[...] into rem_cols:
-            std::vector<col_type> rem_cols; rem_cols.reserve(nrcols);
-            {
-                std::vector<typename std::vector<col_type>::const_iterator> rc(q.size());
-                for(size_t d = 0; d < q.size(); ++d) rc[d] = rcols[d].begin();
-
-                while(true) {
-                    bool found = false;
-                    size_t winner;
-
-                    for(size_t d = 0; d < q.size(); ++d) {
-                        if (rc[d] == rcols[d].end()) continue;
-
-                        if (!found) {
-                            found  = true;
-                            winner = d;
-                        } else {
-                            if (*rc[d] < *rc[winner]) winner = d;
-                        }
-                    }
-                    if (!found) break;
-
-                    col_type c = *rc[winner]++;
-
-                    if (rem_cols.empty() || rem_cols.back() != c)
-                        rem_cols.push_back(c);
-                }
-            }
-
-            // 2. Each GPU has to update the global ghost vector with its data,
-            // and each GPU has to get the points it needs from the vector.
+            // Setup exchange. The values sent from p-th device to d-th
+            // device are stored contiguously both in the send buffer of p and
+            // in the receive buffer of d, so that they are transferred with a
+            // single device-to-device copy.
             ex.resize(q.size());
 
-            // See what elements of rem_vals each GPU needs to receive:
+            std::vector<std::vector<col_type>> cols_to_send(q.size());
+
             for(size_t d = 0; d < q.size(); ++d) {
                 size_t nrecv = rcols[d].size();
                 if (!nrecv) continue;
 
-                ex[d].vals_to_recv.resize(nrecv);
                 ex[d].rem_x = backend::device_vector<rhs_type>(q[d], nrecv);
 
-                // See where in rem_vals each element of rcols[d] is placed.
-                ex[d].cols_to_recv.reserve(nrecv);
-                auto rc = std::lower_bound(rem_cols.begin(), rem_cols.end(), rcols[d].front());
-                for(auto c = rcols[d].begin(), e = rcols[d].end(); c != e; ++c) {
-                    while(*rc < *c) ++rc;
-                    assert(*rc == *c);
-                    ex[d].cols_to_recv.push_back(static_cast<col_type>(std::distance(rem_cols.begin(), rc)));
-                }
-            }
+                auto c = rcols[d].begin();
+                auto e = rcols[d].end();
 
-            // See what elements of rem_vals each GPU needs to send:
-            rval_ptr.resize(q.size() + 1);
-            rval_ptr[0] = 0;
-            for(size_t d = 0; d < q.size(); ++d) {
-                col_type col_beg = static_cast<col_type>(col_part[d]);
-                col_type col_end = static_cast<col_type>(col_part[d+1]);
+                for(size_t p = 0; p < q.size() && c != e; ++p) {
+                    col_type col_beg = static_cast<col_type>(col_part[p]);
+                    col_type col_end = static_cast<col_type>(col_part[p+1]);
+
+                    transfer t;
+                    t.dst         = static_cast<unsigned>(d);
+                    t.send_offset = cols_to_send[p].size();
+                    t.recv_offset = std::distance(rcols[d].begin(), c);
 
-                rval_ptr[d+1] = std::distance(rem_cols.begin(),
-                        std::lower_bound(
-                            rem_cols.begin() + rval_ptr[d], rem_cols.end(), col_end)
-                        );
-                for(size_t i = rval_ptr[d]; i < rval_ptr[d+1]; ++i)
-                    rem_cols[i] -= col_beg;
+                    for(; c != e && *c < col_end; ++c)
+                        cols_to_send[p].push_back(*c - col_beg);
 
-                size_t nsend = rval_ptr[d+1] - rval_ptr[d];
+                    t.count = cols_to_send[p].size() - t.send_offset;
 
-                if (nsend) {
-                    ex[d].vals_to_send = backend::device_vector<rhs_type>(q[d], nsend);
-                    ex[d].cols_to_send = backend::device_vector<col_type>(q[d], nsend,
-                            &rem_cols[rval_ptr[d]]);
+                    if (t.count) ex[p].send.push_back(t);
                 }
             }
 
-            rem_vals.resize(rem_cols.size());
+            for(size_t p = 0; p < q.size(); ++p) {
+                if (size_t nsend = cols_to_send[p].size()) {
+                    ex[p].nsend = nsend;
+                    ex[p].vals_to_send = backend::device_vector<rhs_type>(q[p], nsend);
+                    ex[p].cols_to_send = backend::device_vector<col_type>(q[p], nsend,
+                            cols_to_send[p].data());
+                }
+            }
         }
 
         template <class Expr>
@@ -328,12 +290,19 @@ class distributed {
         std::vector<size_t> row_part, col_part;
         std::vector<std::shared_ptr<Matrix>> A_loc, A_rem;
 
-        mutable std::vector<rhs_type> rem_vals;
-        std::vector<size_t>   rval_ptr;
+        // Contiguous chunk of ghost values sent to the dst-th device.
+        struct transfer {
+            unsigned dst;
+            size_t   send_offset;
+            size_t   recv_offset;
+            size_t   count;
+        };
 
         struct exdata {
-            std::vector<col_type> cols_to_recv;
-            mutable std::vector<rhs_type> vals_to_recv;
+            exdata() : nsend(0) {}
+
+            size_t nsend;
+            std::vector<transfer> send;
 
             backend::device_vector<col_type> cols_to_send;
             mutable backend::device_vector<rhs_type> vals_to_send;
@@ -346,13 +315,13 @@ class distributed {
         template <class Expr>
         void exchange(const Expr &expr) const {
             using namespace vex::detail;
-            static kernel_cache cache;
+            static kernel_cache cache("sparse");
 
             if (q.size() == 1) return;
 
             // Gather values to send on the GPUs:
             for(unsigned d = 0; d < q.size(); ++d) {
-                size_t nsend = rval_ptr[d+1] - rval_ptr[d];
+                size_t nsend = ex[d].nsend;
                 if (nsend == 0) continue;
 
                 auto K = cache.find(q[d]);
@@ -410,19 +379,19 @@ class distributed {
                         set_expression_argument(krn, d, col_part[d], empty_state()));
 
                 krn(q[d]);
-
-                ex[d].vals_to_send.read(q[d], 0, nsend, &rem_vals[rval_ptr[d]]);
             }
 
-            for(unsigned d = 0; d < q.size(); ++d)
-                if (rval_ptr[d+1] > rval_ptr[d]) q[d].finish();
-
+            // Send the gathered values straight to the devices that need them.
             for(unsigned d = 0; d < q.size(); ++d) {
-                for(size_t i = 0; i < ex[d].cols_to_recv.size(); ++i)
-                    ex[d].vals_to_recv[i] = rem_vals[ex[d].cols_to_recv[i]];
-
-                ex[d].rem_x.write(q[d], 0, ex[d].cols_to_recv.size(), ex[d].vals_to_recv.data());
+                for(auto t = ex[d].send.begin(); t != ex[d].send.end(); ++t)
+                    backend::copy_peer(
+                            q[d], ex[d].vals_to_send, t->send_offset,
+                            q[t->dst], ex[t->dst].rem_x, t->recv_offset,
+                            t->count);
             }
+
+            for(unsigned d = 0; d < q.size(); ++d)
+                if (ex[d].nsend || ex[d].rem_x.size()) q[d].finish();
         }
 };
 
@@ -347,7 +347,7 @@ class ell {
 
         backend::kernel& csr2ell_kernel() const {
             using namespace vex::detail;
-            static kernel_cache cache;
+            static kernel_cache cache("sparse");
 
             auto kernel = cache.find(q);
             if (kernel == cache.end()) {
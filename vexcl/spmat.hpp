@@ -57,7 +57,7 @@ class SpMat {
         typedef typename cl_scalar_of<val_t>::type scalar_type;
 
         /// Empty constructor.
-        SpMat() : nrows(0), ncols(0), nnz(0) {}
+        SpMat() : ghosts(false), nrows(0), ncols(0), nnz(0) {}
 
         /// Constructor.
         /**
@@ -68,11 +68,29 @@ class SpMat {
         SpMat(const std::vector<backend::command_queue> &queue,
               size_t n, size_t m, const idx_t *row, const col_t *col, const val_t *val
               )
-            : queue(queue), part(partition(n, queue)),
-              mtx(queue.size()), exc(queue.size()),
+            : SpMat(queue, n, m, row, col, val, partition(n, queue), partition(m, queue))
+        {}
+
+        /// Constructor with the explicitly given partitions.
+        /**
+         * The rows of the matrix are split across the devices according to
+         * row_part, and col_part should match the partition of the vectors
+         * the matrix is multiplied with (e.g. after the vectors were
+         * repartitioned with vex::partition_balancer).
+         */
+        SpMat(const std::vector<backend::command_queue> &queue,
+              size_t n, size_t m, const idx_t *row, const col_t *col, const val_t *val,
+              const std::vector<size_t> &row_part, const std::vector<size_t> &col_part
+              )
+            : queue(queue), part(row_part),
+              mtx(queue.size()), exc(queue.size()), ghosts(false),
               nrows(n), ncols(m), nnz(row[n])
         {
-            auto col_part = partition(m, queue);
+            precondition(
+                    row_part.size() == queue.size() + 1 && row_part.back() == n &&
+                    col_part.size() == queue.size() + 1 && col_part.back() == m,
+                    "Partition does not match the matrix"
+                    );
 
             // Create secondary queues.
             for(auto q = queue.begin(); q != queue.end(); q++)
@@ -119,10 +137,10 @@ class SpMat {
         {
             using namespace detail;
 
-            if (rx.size()) {
+            if (ghosts) {
                 // Gather values to send to neighbors.
                 for(unsigned d = 0; d < queue.size(); d++) {
-                    if (cidx[d + 1] > cidx[d]) {
+                    if (exc[d].nsend) {
                         vex::vector<col_t> cols(queue[d], exc[d].cols_to_send);
                         vex::vector<val_t> vals(queue[d], exc[d].vals_to_send);
                         vex::vector<val_t> xloc(queue[d], x(d));
@@ -131,8 +149,10 @@ class SpMat {
                     }
                 }
 
+                // This also makes sure the receive buffers are no longer
+                // used by the previous products.
                 for(unsigned d = 0; d < queue.size(); d++)
-                    if (cidx[d + 1] > cidx[d]) queue[d].finish();
+                    if (exc[d].nsend || exc[d].nrecv) queue[d].finish();
             }
 
             // Start computing contribution from local part of the matrix.
@@ -143,37 +163,22 @@ class SpMat {
                 }
 
 
-            if (rx.size()) {
-                // Meanwhile, get gathered values to host, ...
-                for(unsigned d = 0; d < queue.size(); d++) {
-                    if (cidx[d + 1] > cidx[d]) {
-                        backend::select_context(squeue[d]);
-                        vex::vector<val_t> vals(squeue[d], exc[d].vals_to_send);
-                        vex::copy(vals.begin(), vals.end(), &rx[cidx[d]], /*blocking=*/false);
-                    }
-                }
-
-                for(unsigned d = 0; d < queue.size(); d++)
-                    if (cidx[d + 1] > cidx[d]) squeue[d].finish();
-
-                // ... send ghost points from our neighbors to device, ...
+            if (ghosts) {
+                // Meanwhile, send gathered values straight to the neighbors, ...
                 for(unsigned d = 0; d < queue.size(); d++) {
-                    if (exc[d].cols_to_recv.size()) {
-                        for(size_t i = 0; i < exc[d].cols_to_recv.size(); i++)
-                            exc[d].vals_to_recv[i] = rx[exc[d].cols_to_recv[i]];
-
-                        exc[d].rx.write(squeue[d], 0, exc[d].vals_to_recv.size(),
-                                exc[d].vals_to_recv.data()
-                                );
-                    }
+                    for(auto t = exc[d].send.begin(); t != exc[d].send.end(); ++t)
+                        backend::copy_peer(
+                                squeue[d], exc[d].vals_to_send, t->send_offset,
+                                squeue[t->dst], exc[t->dst].rx, t->recv_offset,
+                                t->count);
                 }
 
                 for(unsigned d = 0; d < queue.size(); d++)
-                    if (exc[d].cols_to_recv.size()) squeue[d].finish();
+                    if (exc[d].nsend || exc[d].nrecv) squeue[d].finish();
 
-                // Compute contribution from remote part of the matrix.
+                // ... and compute contribution from remote part of the matrix.
                 for(unsigned d = 0; d < queue.size(); d++) {
-                    if (exc[d].cols_to_recv.size()) {
+                    if (exc[d].nrecv) {
                         backend::select_context(queue[d]);
                         mtx[d]->mul_remote(exc[d].rx, y(d), alpha);
                     }
@@ -261,9 +266,21 @@ class SpMat {
 #  include <vexcl/backend/cuda/csr.inl>
 #endif
 
+        // Contiguous chunk of ghost values sent to the dst-th device.
+        struct transfer {
+            unsigned dst;
+            size_t   send_offset;
+            size_t   recv_offset;
+            size_t   count;
+        };
+
         struct exdata {
-            std::vector<col_t> cols_to_recv;
-            mutable std::vector<val_t> vals_to_recv;
+            exdata() : nsend(0), nrecv(0) {}
+
+            size_t nsend;
+            size_t nrecv;
+
+            std::vector<transfer> send;
 
             backend::device_vector<col_t> cols_to_send;
             backend::device_vector<val_t> vals_to_send;
@@ -277,8 +294,7 @@ class SpMat {
         std::vector< std::unique_ptr<sparse_matrix> > mtx;
 
         mutable std::vector<exdata> exc;
-        std::vector<size_t> cidx;
-        mutable std::vector<val_t> rx;
+        bool ghosts;
 
         size_t nrows;
         size_t ncols;
@@ -311,65 +327,52 @@ class SpMat {
                 }
             }
 
-            // Complete set of points to be exchanged between devices.
-            std::vector<col_t> cols_to_send;
-            {
-                std::set<col_t> cols_to_send_s;
-                for(unsigned d = 0; d < queue.size(); d++)
-                    cols_to_send_s.insert(ghost_cols[d].begin(), ghost_cols[d].end());
+            // Build local structures to facilitate exchange. The values
+            // sent from p-th device to d-th device are stored contiguously
+            // both in the send buffer of p and in the receive buffer of d, so
+            // that they are transferred with a single device-to-device copy.
+            std::vector<std::vector<col_t>> cols_to_send(queue.size());
 
-                cols_to_send.insert(cols_to_send.begin(), cols_to_send_s.begin(), cols_to_send_s.end());
-            }
+            for(unsigned d = 0; d < queue.size(); d++) {
+                if (ghost_cols[d].empty()) continue;
 
-            // Build local structures to facilitate exchange.
-            if (cols_to_send.size()) {
-#ifdef _OPENMP
-#  pragma omp parallel for schedule(static,1)
-#endif
-                for(int d = 0; d < static_cast<int>(queue.size()); d++) {
-                    if (size_t rcols = ghost_cols[d].size()) {
-                        exc[d].cols_to_recv.resize(rcols);
-                        exc[d].vals_to_recv.resize(rcols);
+                ghosts = true;
 
-                        exc[d].rx = backend::device_vector<val_t>(queue[d], rcols,
-                                static_cast<const val_t*>(0), backend::MEM_READ_ONLY);
+                exc[d].nrecv = ghost_cols[d].size();
+                exc[d].rx = backend::device_vector<val_t>(queue[d], exc[d].nrecv,
+                        static_cast<const val_t*>(0), backend::MEM_READ_ONLY);
 
-                        for(size_t i = 0, j = 0; i < cols_to_send.size(); i++)
-                            if (ghost_cols[d].count(cols_to_send[i]))
-                                exc[d].cols_to_recv[j++] = static_cast<col_t>(i);
-                    }
-                }
+                auto c = ghost_cols[d].begin();
+                auto e = ghost_cols[d].end();
 
-                rx.resize(cols_to_send.size());
-                cidx.resize(queue.size() + 1);
-
-                {
-                    auto beg = cols_to_send.begin();
-                    auto end = cols_to_send.end();
-                    for(unsigned d = 0; d <= queue.size(); d++) {
-                        cidx[d] = std::lower_bound(beg, end, static_cast<col_t>(col_part[d]))
-                                - cols_to_send.begin();
-                        beg = cols_to_send.begin() + cidx[d];
-                    }
-                }
+                for(unsigned p = 0; p < queue.size() && c != e; p++) {
+                    transfer t;
+                    t.dst         = d;
+                    t.send_offset = cols_to_send[p].size();
+                    t.recv_offset = std::distance(ghost_cols[d].begin(), c);
 
-                for(unsigned d = 0; d < queue.size(); d++) {
-                    if (size_t ncols = cidx[d + 1] - cidx[d]) {
-                        exc[d].vals_to_send = backend::device_vector<val_t>(
-                                queue[d], ncols);
+                    for(; c != e && static_cast<size_t>(*c) < col_part[p + 1]; ++c)
+                        cols_to_send[p].push_back(*c - static_cast<col_t>(col_part[p]));
 
-                        for(size_t i = cidx[d]; i < cidx[d + 1]; i++)
-                            cols_to_send[i] -= static_cast<col_t>(col_part[d]);
+                    t.count = cols_to_send[p].size() - t.send_offset;
 
-                        exc[d].cols_to_send = backend::device_vector<col_t>(
-                                queue[d], ncols, &cols_to_send[cidx[d]], backend::MEM_READ_ONLY);
-                    }
+                    if (t.count) exc[p].send.push_back(t);
                 }
+            }
 
-                for(unsigned d = 0; d < queue.size(); d++)
-                    if (cidx[d + 1] > cidx[d]) queue[d].finish();
+            for(unsigned p = 0; p < queue.size(); p++) {
+                if (size_t n = cols_to_send[p].size()) {
+                    exc[p].nsend = n;
+
+                    exc[p].vals_to_send = backend::device_vector<val_t>(queue[p], n);
+                    exc[p].cols_to_send = backend::device_vector<col_t>(
+                            queue[p], n, cols_to_send[p].data(), backend::MEM_READ_ONLY);
+                }
             }
 
+            for(unsigned p = 0; p < queue.size(); p++)
+                if (exc[p].nsend) queue[p].finish();
+
             return ghost_cols;
         }
 };
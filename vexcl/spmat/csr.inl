@@ -141,7 +141,7 @@ struct SpMatCSR : public sparse_matrix {
     {
         using namespace detail;
 
-        static kernel_cache cache;
+        static kernel_cache cache("spmat");
 
         auto kernel = cache.find(queue);
 
@@ -226,7 +226,7 @@ struct SpMatHELL : public sparse_matrix {
     {
         using namespace detail;
 
-        static kernel_cache cache;
+        static kernel_cache cache("spmat");
 
         auto kernel = cache.find(queue);
 
@@ -35,6 +35,7 @@ THE SOFTWARE.
 #include <map>
 #include <sstream>
 #include <cassert>
+#include <utility>
 #include <vexcl/vector.hpp>
 
 namespace vex {
@@ -48,11 +49,26 @@ class stencil_base {
                 unsigned width, unsigned center, Iterator begin, Iterator end
                 );
 
-        void exchange_halos(const vex::vector<T> &x) const;
+        // Halo exchange is split into two phases, so that the interior of
+        // each partition (which does not depend on the halos) could be
+        // processed in between. start_exchange() submits the device-to-device
+        // halo copies to the secondary queues and returns false when there
+        // is nothing to exchange; finish_exchange() waits for the copies.
+        bool start_exchange(const vex::vector<T> &x) const;
+        void finish_exchange() const;
+
+        // Range of the d-th partition that does not depend on the halos.
+        std::pair<size_t, size_t> interior(const vex::vector<T> &x, unsigned d) const;
+
+        // Number of the left and right halo values the d-th partition
+        // receives from its neighbours. The halos crossing the vector
+        // boundaries are shorter; the kernels clamp the reads to the received
+        // values, which gives the boundary values.
+        std::pair<int, int> halo_size(const vex::vector<T> &x, unsigned d) const;
 
         mutable std::vector<backend::command_queue> queue;
+        mutable std::vector<backend::command_queue> squeue;
 
-        mutable std::vector<T>  hbuf;
         std::vector< backend::device_vector<T> > dbuf;
         std::vector< backend::device_vector<T> > s;
 
@@ -65,8 +81,7 @@ stencil_base<T>::stencil_base(
         const std::vector<backend::command_queue> &q,
         unsigned width, unsigned center, Iterator begin, Iterator end
         )
-    : queue(q), hbuf(q.size() * (width - 1)),
-      dbuf(q.size()), s(q.size()),
+    : queue(q), dbuf(q.size()), s(q.size()),
       lhalo(center), rhalo(width - center - 1)
 {
     assert(queue.size());
@@ -76,6 +91,9 @@ stencil_base<T>::stencil_base(
     assert(center < width);
 
     for(unsigned d = 0; d < queue.size(); d++) {
+        // Secondary queues for the halo exchange.
+        squeue.push_back(backend::duplicate_queue(queue[d]));
+
         if (begin != end)
             s[d] = backend::device_vector<T>(queue[d], end - begin, &begin[0], backend::MEM_READ_ONLY);
 
@@ -87,66 +105,84 @@ stencil_base<T>::stencil_base(
 }
 
 template <typename T>
-void stencil_base<T>::exchange_halos(const vex::vector<T> &x) const {
+bool stencil_base<T>::start_exchange(const vex::vector<T> &x) const {
     int width = lhalo + rhalo;
 
-    if ((queue.size() <= 1) || (width <= 0)) return;
+    if ((queue.size() <= 1) || (width <= 0)) return false;
 
-    // Get halos from neighbours.
+    // The halos are copied after the work already submitted to the primary
+    // queues (e.g. the kernels producing x, or the kernels still using the
+    // halos of the previous exchange) is complete.
     for(unsigned d = 0; d < queue.size(); d++) {
-        if (!x.part_size(d)) continue;
+        backend::wait_list ready(1, backend::enqueue_marker(queue[d]));
+        backend::enqueue_barrier(squeue[d], ready);
+    }
 
-        // Get halo from left neighbour.
-        if (d > 0 && lhalo > 0) {
-            size_t end   = x.part_start(d);
-            size_t begin = end >= static_cast<unsigned>(lhalo) ?  end - lhalo : 0;
-            size_t size  = end - begin;
-            x.read_data(begin, size, &hbuf[d * width + lhalo - size], false);
-        }
+    // Copies x[begin, end) straight to the halo buffer of the d-th device.
+    // The range may span several partitions.
+    auto copy = [&](size_t begin, size_t end, unsigned d, size_t offset) {
+        for(unsigned p = 0; p < queue.size(); p++) {
+            size_t b = std::max(begin, x.part_start(p));
+            size_t e = std::min(end,   x.part_start(p) + x.part_size(p));
 
-        // Get halo from right neighbour.
-        if (d + 1 < queue.size() && rhalo > 0) {
-            size_t begin = x.part_start(d + 1);
-            size_t end   = std::min(begin + rhalo, x.size());
-            size_t size  = end - begin;
-            x.read_data(begin, size, &hbuf[d * width + lhalo], false);
+            if (b < e) backend::copy_peer(
+                    squeue[p], x(p), b - x.part_start(p),
+                    squeue[d], dbuf[d], offset + b - begin, e - b);
         }
-    }
+    };
 
-    // Wait for the end of transfer.
-    for(unsigned d = 0; d < queue.size(); d++) queue[d].finish();
-
-    // Write halos to a local buffer.
+    // Get halos from neighbours. The left halo is aligned to the end of its
+    // slot in dbuf, the right one to the beginning of its slot.
     for(unsigned d = 0; d < queue.size(); d++) {
         if (!x.part_size(d)) continue;
 
-        if (d > 0 && lhalo > 0) {
-            size_t end   = x.part_start(d);
-            size_t begin = end >= static_cast<unsigned>(lhalo) ?  end - lhalo : 0;
-            size_t size  = end - begin;
-            if (size)
-                std::fill(&hbuf[d * width], &hbuf[d * width + lhalo - size], hbuf[d * width + lhalo - size]);
-            else
-                std::fill(&hbuf[d * width], &hbuf[d * width + lhalo - size], static_cast<T>(x[0]));
-        }
+        auto h = halo_size(x, d);
 
-        if (d + 1 < queue.size() && rhalo > 0) {
-            size_t begin = x.part_start(d + 1);
-            size_t end   = std::min(begin + rhalo, x.size());
-            size_t size  = end - begin;
-            if (size)
-                std::fill(&hbuf[d * width + lhalo + size], &hbuf[(d + 1) * width], hbuf[d * width + lhalo + size - 1]);
-            else
-                std::fill(&hbuf[d * width + lhalo + size], &hbuf[(d + 1) * width], static_cast<T>(x[x.size()-1]));
+        if (h.first)
+            copy(x.part_start(d) - h.first, x.part_start(d), d, lhalo - h.first);
 
-        }
-
-        if ((d > 0 && lhalo > 0) || (d + 1 < queue.size() && rhalo > 0))
-            dbuf[d].write(queue[d], 0, width, &hbuf[d * width]);
+        if (h.second)
+            copy(x.part_start(d + 1), x.part_start(d + 1) + h.second, d, lhalo);
     }
 
+    return true;
+}
+
+template <typename T>
+void stencil_base<T>::finish_exchange() const {
     // Wait for the end of transfer.
-    for(unsigned d = 0; d < queue.size(); d++) queue[d].finish();
+    for(unsigned d = 0; d < queue.size(); d++) squeue[d].finish();
+}
+
+template <typename T>
+std::pair<size_t, size_t> stencil_base<T>::interior(
+        const vex::vector<T> &x, unsigned d) const
+{
+    size_t n   = x.part_size(d);
+    size_t beg = 0, end = n;
+
+    if (d > 0 && lhalo > 0)
+        beg = std::min<size_t>(lhalo, n);
+
+    if (d + 1 < queue.size() && rhalo > 0)
+        end = std::max(beg, n > static_cast<size_t>(rhalo) ? n - rhalo : 0);
+
+    return std::make_pair(beg, end);
+}
+
+template <typename T>
+std::pair<int, int> stencil_base<T>::halo_size(
+        const vex::vector<T> &x, unsigned d) const
+{
+    int l = 0, r = 0;
+
+    if (d > 0 && lhalo > 0)
+        l = static_cast<int>(std::min<size_t>(lhalo, x.part_start(d)));
+
+    if (d + 1 < queue.size() && rhalo > 0)
+        r = static_cast<int>(std::min<size_t>(rhalo, x.size() - x.part_start(d + 1)));
+
+    return std::make_pair(l, r);
 }
 
 /// Stencil.
@@ -236,7 +272,6 @@ class stencil : private stencil_base<T> {
         typedef stencil_base<T> Base;
 
         using Base::queue;
-        using Base::hbuf;
         using Base::dbuf;
         using Base::s;
         using Base::lhalo;
@@ -247,6 +282,9 @@ class stencil : private stencil_base<T> {
 
         void init(unsigned width);
 
+        void launch(unsigned d, const vex::vector<T> &x, vex::vector<T> &y,
+                T alpha, T beta, size_t start, size_t count) const;
+
         static const backend::kernel& slow_conv(const backend::command_queue &queue);
         static const backend::kernel& fast_conv(const backend::command_queue &queue);
 };
@@ -259,8 +297,8 @@ inline void define_read_x(backend::source_generator &source) {
     source.begin_function_parameters();
     source.template parameter<ptrdiff_t>("g_id");
     source.template parameter<size_t>("n");
-    source.template parameter<char>("has_left");
-    source.template parameter<char>("has_right");
+    source.template parameter<int>("lsize");
+    source.template parameter<int>("rsize");
     source.template parameter<int>("lhalo");
     source.template parameter<int>("rhalo");
     source.template parameter< global_ptr<const T> >("xloc");
@@ -273,14 +311,14 @@ inline void define_read_x(backend::source_generator &source) {
     source.close("}");
     source.new_line() << "else if (g_id < 0)";
     source.open("{");
-    source.new_line() << "if (has_left) "
-        "return (lhalo + g_id >= 0) ? xrem[lhalo + g_id] : 0;";
+    source.new_line() << "if (lsize) "
+        "return xrem[lhalo + (g_id < -lsize ? -lsize : g_id)];";
     source.new_line() << "else return xloc[0];";
     source.close("}");
     source.new_line() << "else";
     source.open("{");
-    source.new_line() << "if (has_right) "
-        "return (g_id < n + rhalo) ? xrem[lhalo + g_id - n] : 0;";
+    source.new_line() << "if (rsize) "
+        "return xrem[lhalo + (g_id - n < rsize ? g_id - n : rsize - 1)];";
     source.new_line() << "else return xloc[n - 1];";
     source.close("}");
     source.end_function();
@@ -292,7 +330,7 @@ template <typename T>
 const backend::kernel& stencil<T>::slow_conv(const backend::command_queue &queue) {
     using namespace detail;
 
-    static kernel_cache cache;
+    static kernel_cache cache("stencil");
 
     auto kernel = cache.find(queue);
 
@@ -306,8 +344,10 @@ const backend::kernel& stencil<T>::slow_conv(const backend::command_queue &queue
         source.begin_kernel("slow_conv");
         source.begin_kernel_parameters();
         source.template parameter<size_t>("n");
-        source.template parameter<char>("has_left");
-        source.template parameter<char>("has_right");
+        source.template parameter<size_t>("start");
+        source.template parameter<size_t>("count");
+        source.template parameter<int>("lsize");
+        source.template parameter<int>("rsize");
         source.template parameter<int>("lhalo");
         source.template parameter<int>("rhalo");
         source.template parameter< global_ptr<const T> >("s");
@@ -318,14 +358,15 @@ const backend::kernel& stencil<T>::slow_conv(const backend::command_queue &queue
         source.template parameter<T>("beta");
         source.end_kernel_parameters();
 
-        source.grid_stride_loop().open("{");
+        source.grid_stride_loop("i", "count").open("{");
 
+        source.new_line() << "size_t idx = start + i;";
         source.new_line() << type_name<T>() << " sum = 0;";
         source.new_line() << "for(int j = -lhalo; j <= rhalo; j++)";
         source.open("{");
         source.new_line() << "sum += s[lhalo + j] * read_x(("
             << type_name<ptrdiff_t>()
-            << ")idx + j, n, has_left, has_right, lhalo, rhalo, xloc, xrem);";
+            << ")idx + j, n, lsize, rsize, lhalo, rhalo, xloc, xrem);";
         source.close("}");
         source.new_line() << "if (alpha) y[idx] = alpha * y[idx] + beta * sum;";
         source.new_line() << "else y[idx] = beta * sum;";
@@ -343,7 +384,7 @@ template <typename T>
 const backend::kernel& stencil<T>::fast_conv(const backend::command_queue &queue) {
     using namespace detail;
 
-    static kernel_cache cache;
+    static kernel_cache cache("stencil");
 
     auto kernel = cache.find(queue);
 
@@ -357,8 +398,10 @@ const backend::kernel& stencil<T>::fast_conv(const backend::command_queue &queue
         source.begin_kernel("fast_conv");
         source.begin_kernel_parameters();
         source.template parameter<size_t>("n");
-        source.template parameter<char>("has_left");
-        source.template parameter<char>("has_right");
+        source.template parameter<size_t>("start");
+        source.template parameter<size_t>("count");
+        source.template parameter<int>("lsize");
+        source.template parameter<int>("rsize");
         source.template parameter<int>("lhalo");
         source.template parameter<int>("rhalo");
         source.template parameter< global_ptr<const T> >("s");
@@ -378,14 +421,14 @@ const backend::kernel& stencil<T>::fast_conv(const backend::command_queue &queue
         source.new_line() << "int l_id = " << source.local_id(0) << ";";
         source.new_line() << "int block_size = " << source.local_size(0) << ";";
         source.new_line() << "for(int i = l_id; i < rhalo + lhalo + 1; i += block_size) S[i] = s[i];";
-        source.new_line() << "for(long g_id = " << source.global_id(0) << ", pos = 0; pos < n; g_id += grid_size, pos += grid_size)";
+        source.new_line() << "for(long g_id = start + " << source.global_id(0) << ", pos = 0; pos < count; g_id += grid_size, pos += grid_size)";
         source.open("{");
         source.new_line() << "for(int i = l_id, j = g_id - lhalo; i < block_size + lhalo + rhalo; i += block_size, j += block_size)";
         source.open("{");
-        source.new_line() << "X[i] = read_x(j, n, has_left, has_right, lhalo, rhalo, xloc, xrem);";
+        source.new_line() << "X[i] = read_x(j, n, lsize, rsize, lhalo, rhalo, xloc, xrem);";
         source.close("}");
         source.new_line().barrier();
-        source.new_line() << "if (g_id < n)";
+        source.new_line() << "if (g_id < start + count)";
         source.open("{");
         source.new_line() << type_name<T>() << " sum = 0;";
         source.new_line() << "for(int j = -lhalo; j <= rhalo; j++)";
@@ -427,35 +470,56 @@ void stencil<T>::init(unsigned width) {
     }
 }
 
+template <typename T>
+void stencil<T>::launch(unsigned d, const vex::vector<T> &x, vex::vector<T> &y,
+        T alpha, T beta, size_t start, size_t count) const
+{
+    if (!count) return;
+
+    auto h = Base::halo_size(x, d);
+
+    conv[d].push_arg(x.part_size(d));
+    conv[d].push_arg(start);
+    conv[d].push_arg(count);
+    conv[d].push_arg(h.first);
+    conv[d].push_arg(h.second);
+    conv[d].push_arg(lhalo);
+    conv[d].push_arg(rhalo);
+    conv[d].push_arg(s[d]);
+    conv[d].push_arg(x(d));
+    conv[d].push_arg(dbuf[d]);
+    conv[d].push_arg(y(d));
+    conv[d].push_arg(beta);
+    conv[d].push_arg(alpha);
+
+    if (smem[d]) conv[d].set_smem([&](size_t){ return smem[d]; });
+
+    conv[d](queue[d]);
+}
+
 template <typename T>
 void stencil<T>::apply(const vex::vector<T> &x, vex::vector<T> &y,
         T alpha, bool append) const
 {
-    Base::exchange_halos(x);
-
     T beta = static_cast<T>(append ? 1 : 0);
 
+    bool exchange = Base::start_exchange(x);
+
+    // The interior of the partitions is processed while the halos are in
+    // flight.
     for(unsigned d = 0; d < queue.size(); d++) {
-        if (size_t psize = x.part_size(d)) {
-            char has_left  = d > 0;
-            char has_right = d + 1 < queue.size();
-
-            conv[d].push_arg(psize);
-            conv[d].push_arg(has_left);
-            conv[d].push_arg(has_right);
-            conv[d].push_arg(lhalo);
-            conv[d].push_arg(rhalo);
-            conv[d].push_arg(s[d]);
-            conv[d].push_arg(x(d));
-            conv[d].push_arg(dbuf[d]);
-            conv[d].push_arg(y(d));
-            conv[d].push_arg(beta);
-            conv[d].push_arg(alpha);
-
-            if (smem[d]) conv[d].set_smem([&](size_t){ return smem[d]; });
-
-            conv[d](queue[d]);
-        }
+        auto r = Base::interior(x, d);
+        launch(d, x, y, alpha, beta, r.first, r.second - r.first);
+    }
+
+    if (!exchange) return;
+
+    Base::finish_exchange();
+
+    for(unsigned d = 0; d < queue.size(); d++) {
+        auto r = Base::interior(x, d);
+        launch(d, x, y, alpha, beta, 0, r.first);
+        launch(d, x, y, alpha, beta, r.second, x.part_size(d) - r.second);
     }
 }
 
@@ -532,7 +596,6 @@ class StencilOperator : private stencil_base<T> {
         typedef stencil_base<T> Base;
 
         using Base::queue;
-        using Base::hbuf;
         using Base::dbuf;
         using Base::lhalo;
         using Base::rhalo;
@@ -552,10 +615,37 @@ void StencilOperator<T, width, center, Impl>::apply(
 
     T beta = append ? 1 : 0;
 
-    static kernel_cache cache;
+    static kernel_cache cache("stencil");
     static std::map<backend::context_id, size_t> lmem;
 
-    Base::exchange_halos(x);
+    auto launch = [&](unsigned d, backend::kernel &krn, size_t start, size_t count) {
+        if (!count) return;
+
+        auto h = Base::halo_size(x, d);
+
+        krn.push_arg(x.part_size(d));
+        krn.push_arg(start);
+        krn.push_arg(count);
+        krn.push_arg(h.first);
+        krn.push_arg(h.second);
+        krn.push_arg(lhalo);
+        krn.push_arg(rhalo);
+        krn.push_arg(x(d));
+        krn.push_arg(dbuf[d]);
+        krn.push_arg(y(d));
+        krn.push_arg(beta);
+        krn.push_arg(alpha);
+
+        size_t smem_bytes = lmem[backend::get_context_id(queue[d])];
+        krn.set_smem([smem_bytes](size_t){ return smem_bytes; });
+
+        krn(queue[d]);
+    };
+
+    bool exchange = Base::start_exchange(x);
+
+    // The interior of the partitions is processed while the halos are in
+    // flight.
 
     for(unsigned d = 0; d < queue.size(); d++) {
         backend::select_context(queue[d]);
@@ -578,8 +668,10 @@ void StencilOperator<T, width, center, Impl>::apply(
             source.begin_kernel("convolve");
             source.begin_kernel_parameters();
             source.template parameter<size_t>("n");
-            source.template parameter<char>("has_left");
-            source.template parameter<char>("has_right");
+            source.template parameter<size_t>("start");
+            source.template parameter<size_t>("count");
+            source.template parameter<int>("lsize");
+            source.template parameter<int>("rsize");
             source.template parameter<int>("lhalo");
             source.template parameter<int>("rhalo");
             source.template parameter< global_ptr<const T> >("xloc");
@@ -596,15 +688,15 @@ void StencilOperator<T, width, center, Impl>::apply(
             source.new_line() << "size_t grid_size = " << source.global_size(0) << ";";
             source.new_line() << "int l_id = " << source.local_id(0) << ";";
             source.new_line() << "int block_size = " << source.local_size(0) << ";";
-            source.new_line() << "for(long g_id = " << source.global_id(0)
-                << ", pos = 0; pos < n; g_id += grid_size, pos += grid_size)";
+            source.new_line() << "for(long g_id = start + " << source.global_id(0)
+                << ", pos = 0; pos < count; g_id += grid_size, pos += grid_size)";
             source.open("{");
             source.new_line() << "for(int i = l_id, j = g_id - lhalo; i < block_size + lhalo + rhalo; i += block_size, j += block_size)";
             source.open("{");
-            source.new_line() << "X[i] = read_x(j, n, has_left, has_right, lhalo, rhalo, xloc, xrem);";
+            source.new_line() << "X[i] = read_x(j, n, lsize, rsize, lhalo, rhalo, xloc, xrem);";
             source.close("}");
             source.new_line().barrier();
-            source.new_line() << "if (g_id < n)";
+            source.new_line() << "if (g_id < start + count)";
             source.open("{");
             source.new_line() << type_name<T>() << " sum = stencil_oper(X + lhalo + l_id);";
             source.new_line() << "if (alpha) y[g_id] = alpha * y[g_id] + beta * sum;";
@@ -622,26 +714,20 @@ void StencilOperator<T, width, center, Impl>::apply(
             lmem[key] = sizeof(T) * (kernel->second.workgroup_size() + width - 1);
         }
 
-        if (size_t psize = x.part_size(d)) {
-            char has_left  = d > 0;
-            char has_right = d + 1 < queue.size();
-
-            kernel->second.push_arg(psize);
-            kernel->second.push_arg(has_left);
-            kernel->second.push_arg(has_right);
-            kernel->second.push_arg(lhalo);
-            kernel->second.push_arg(rhalo);
-            kernel->second.push_arg(x(d));
-            kernel->second.push_arg(dbuf[d]);
-            kernel->second.push_arg(y(d));
-            kernel->second.push_arg(beta);
-            kernel->second.push_arg(alpha);
-
-            size_t smem_bytes = lmem[key];
-            kernel->second.set_smem([smem_bytes](size_t){ return smem_bytes; });
-
-            kernel->second(queue[d]);
-        }
+        auto r = Base::interior(x, d);
+        launch(d, kernel->second, r.first, r.second - r.first);
+    }
+
+    if (!exchange) return;
+
+    Base::finish_exchange();
+
+    for(unsigned d = 0; d < queue.size(); d++) {
+        auto kernel = cache.find(queue[d]);
+        auto r = Base::interior(x, d);
+
+        launch(d, kernel->second, 0, r.first);
+        launch(d, kernel->second, r.second, x.part_size(d) - r.second);
     }
 }
 
@@ -0,0 +1,590 @@
+#ifndef VEXCL_STORAGE_VECTOR_HPP
+#define VEXCL_STORAGE_VECTOR_HPP
+
+/*
+The MIT License
+
+Copyright (c) 2012-2017 Denis Demidov <dennis.demidov@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * \file   vexcl/storage_vector.hpp
+ * \author Denis Demidov <dennis.demidov@gmail.com>
+ * \brief  Vectors with reduced-precision storage.
+ */
+
+#include <vector>
+#include <string>
+#include <set>
+#include <cmath>
+#include <cstring>
+
+#include <vexcl/backend.hpp>
+#include <vexcl/operations.hpp>
+#include <vexcl/vector.hpp>
+
+namespace vex {
+
+/// Storage formats for vex::storage_vector.
+/**
+ * A storage format converts the values between the compute type T and the
+ * storage type both on the host (encode() and decode()) and in the
+ * generated kernels (load() and store()).
+ */
+namespace storage {
+
+/// Values are stored as a narrower type S, e.g. float for double compute.
+template <typename S>
+struct narrow {
+    typedef S type;
+
+    template <typename T>
+    type encode(const T &v) const { return static_cast<S>(v); }
+
+    template <typename T>
+    T decode(const type &v) const { return static_cast<T>(v); }
+
+    void define(backend::source_generator&, detail::kernel_generator_state_ptr) const {}
+
+    template <typename T>
+    void parameters(backend::source_generator&, const std::string&) const {}
+
+    template <typename T>
+    void arguments(backend::kernel&) const {}
+
+    template <typename T>
+    void load(backend::source_generator &src, const std::string &prm_name) const {
+        src << "((" << type_name<T>() << ")" << prm_name << "[idx])";
+    }
+
+    template <typename T>
+    void store_begin(backend::source_generator &src, const std::string&) const {
+        src << "((" << type_name<S>() << ")(";
+    }
+
+    template <typename T>
+    void store_end(backend::source_generator &src, const std::string&) const {
+        src << "))";
+    }
+};
+
+/// Values are stored as bfloat16 numbers (the upper half of a float).
+/**
+ * The values are rounded to the nearest bfloat16 number on store. Infinities
+ * and NaNs are not treated specially.
+ */
+struct bfloat16 {
+    typedef cl_ushort type;
+
+    template <typename T>
+    type encode(const T &v) const {
+        float f = static_cast<float>(v);
+        cl_uint u;
+        std::memcpy(&u, &f, sizeof(u));
+        return static_cast<type>((u + 0x7FFFu + ((u >> 16) & 1u)) >> 16);
+    }
+
+    template <typename T>
+    T decode(const type &v) const {
+        cl_uint u = static_cast<cl_uint>(v) << 16;
+        float f;
+        std::memcpy(&f, &u, sizeof(f));
+        return static_cast<T>(f);
+    }
+
+    // The conversion functions are defined once per kernel.
+    void define(backend::source_generator &src, detail::kernel_generator_state_ptr state) const {
+        auto s = state->find("user_functions");
+        if (s == state->end()) {
+            s = state->insert(std::make_pair(
+                        std::string("user_functions"),
+                        boost::any( std::set<std::string>() )
+                        )).first;
+        }
+        auto &seen = boost::any_cast< std::set<std::string>& >(s->second);
+
+        if (!seen.insert("vexcl_bf16_load").second) return;
+        seen.insert("vexcl_bf16_store");
+
+        src.begin_function<float>("vexcl_bf16_load");
+        src.begin_function_parameters();
+        src.parameter<cl_ushort>("v");
+        src.end_function_parameters();
+        src.new_line() << "union { unsigned int u; float f; } c;";
+        src.new_line() << "c.u = ((unsigned int)v) << 16;";
+        src.new_line() << "return c.f;";
+        src.end_function();
+
+        src.begin_function<cl_ushort>("vexcl_bf16_store");
+        src.begin_function_parameters();
+        src.parameter<float>("v");
+        src.end_function_parameters();
+        src.new_line() << "union { unsigned int u; float f; } c;";
+        src.new_line() << "c.f = v;";
+        src.new_line() << "return (" << type_name<cl_ushort>() << ")("
+            "(c.u + 0x7FFFu + ((c.u >> 16) & 1u)) >> 16);";
+        src.end_function();
+    }
+
+    template <typename T>
+    void parameters(backend::source_generator&, const std::string&) const {}
+
+    template <typename T>
+    void arguments(backend::kernel&) const {}
+
+    template <typename T>
+    void load(backend::source_generator &src, const std::string &prm_name) const {
+        src << "((" << type_name<T>() << ")vexcl_bf16_load(" << prm_name << "[idx]))";
+    }
+
+    template <typename T>
+    void store_begin(backend::source_generator &src, const std::string&) const {
+        src << "vexcl_bf16_store((float)(";
+    }
+
+    template <typename T>
+    void store_end(backend::source_generator &src, const std::string&) const {
+        src << "))";
+    }
+};
+
+/// Values are stored as integers S scaled by a constant factor.
+/**
+ * A value v is stored as rint(v / scale). The stored values should fit into
+ * the range of S.
+ */
+template <typename S>
+struct scaled {
+    typedef S type;
+
+    double scale;
+
+    scaled(double scale = 1) : scale(scale) {}
+
+    template <typename T>
+    type encode(const T &v) const {
+        return static_cast<S>(std::rint(v / scale));
+    }
+
+    template <typename T>
+    T decode(const type &v) const {
+        return static_cast<T>(scale * v);
+    }
+
+    void define(backend::source_generator&, detail::kernel_generator_state_ptr) const {}
+
+    template <typename T>
+    void parameters(backend::source_generator &src, const std::string &prm_name) const {
+        src.parameter<T>(prm_name + "_scale");
+    }
+
+    template <typename T>
+    void arguments(backend::kernel &kernel) const {
+        kernel.push_arg(static_cast<T>(scale));
+    }
+
+    template <typename T>
+    void load(backend::source_generator &src, const std::string &prm_name) const {
+        src << "(" << prm_name << "_scale * " << prm_name << "[idx])";
+    }
+
+    template <typename T>
+    void store_begin(backend::source_generator &src, const std::string&) const {
+        src << "((" << type_name<S>() << ")rint((";
+    }
+
+    template <typename T>
+    void store_end(backend::source_generator &src, const std::string &prm_name) const {
+        src << ") / " << prm_name << "_scale))";
+    }
+};
+
+} // namespace storage
+
+struct storage_vector_terminal {};
+
+typedef vector_expression<
+    typename boost::proto::terminal< storage_vector_terminal >::type
+    > storage_vector_terminal_expression;
+
+namespace traits {
+
+// Hold storage vector terminals by reference:
+template <class T>
+struct hold_terminal_by_reference< T,
+        typename std::enable_if<
+            boost::proto::matches<
+                typename boost::proto::result_of::as_expr< T >::type,
+                boost::proto::terminal< storage_vector_terminal >
+            >::value
+        >::type
+    >
+    : std::true_type
+{ };
+
+} // namespace traits
+
+struct encoded_terminal {};
+
+typedef vector_expression<
+    typename boost::proto::terminal< encoded_terminal >::type
+    > encoded_terminal_expression;
+
+namespace detail {
+
+// Expression converted to the storage format.
+template <typename T, class Storage, class Expr>
+struct encoded_expression : public encoded_terminal_expression {
+    typedef typename Storage::type value_type;
+
+    const Storage storage;
+    const Expr    expr;
+
+    encoded_expression(const Storage &storage, const Expr &expr)
+        : storage(storage), expr(expr) {}
+};
+
+} // namespace detail
+
+/// Vector that stores the values in a reduced-precision format.
+/**
+ * The values are stored in device memory as Storage::type, and are converted
+ * to (from) the compute type T inside the generated kernels whenever they
+ * are read (written). Since most vector expressions are memory bound, a
+ * narrower storage type directly translates into a faster execution:
+ * \code
+ * vex::storage_vector<double, vex::storage::narrow<float>> x(ctx, n);
+ * vex::storage_vector<float,  vex::storage::bfloat16>      y(ctx, n);
+ * vex::storage_vector<double, vex::storage::scaled<cl_short>> z(ctx, n,
+ *         vex::storage::scaled<cl_short>(1e-3));
+ *
+ * x = sin(vex::element_index());
+ * y = 2 * x;
+ * z += x * y;
+ * \endcode
+ * Host transfers (vex::copy()) convert the values on the host.
+ */
+template <typename T, class Storage>
+class storage_vector : public storage_vector_terminal_expression {
+    public:
+        typedef T value_type;
+        typedef typename Storage::type storage_type;
+
+        /// Empty constructor.
+        storage_vector() {}
+
+        /// Allocates the vector on the given queues.
+        storage_vector(const std::vector<backend::command_queue> &queue,
+                size_t size, const Storage &storage = Storage())
+            : data(queue, size), storage(storage)
+        {}
+
+        /// Allocates the vector and copies the host data into it.
+        storage_vector(const std::vector<backend::command_queue> &queue,
+                const std::vector<T> &host, const Storage &storage = Storage())
+            : data(queue, host.size()), storage(storage)
+        {
+            write(host);
+        }
+
+        /// Copies the host data into the vector.
+        void write(const std::vector<T> &host) {
+            precondition(host.size() == size(), "Vector sizes differ");
+
+            std::vector<storage_type> buf(host.size());
+            for(size_t i = 0; i < host.size(); ++i)
+                buf[i] = storage.template encode<T>(host[i]);
+
+            vex::copy(buf, data);
+        }
+
+        /// Copies the vector into the host memory.
+        void read(std::vector<T> &host) const {
+            precondition(host.size() == size(), "Vector sizes differ");
+
+            std::vector<storage_type> buf(host.size());
+            vex::copy(data, buf);
+
+            for(size_t i = 0; i < host.size(); ++i)
+                host[i] = storage.template decode<T>(buf[i]);
+        }
+
+        /// Returns the underlying vector of the stored values.
+        const vector<storage_type>& stored() const {
+            return data;
+        }
+
+        /// Returns the storage format.
+        const Storage& format() const {
+            return storage;
+        }
+
+        /// Returns the size of the vector.
+        size_t size() const {
+            return data.size();
+        }
+
+        /// Returns the queue list of the vector.
+        const std::vector<backend::command_queue>& queue_list() const {
+            return data.queue_list();
+        }
+
+        /// Returns the partitioning of the vector.
+        const std::vector<size_t>& partition() const {
+            return data.partition();
+        }
+
+        /// Returns the device memory of the given partition.
+        const backend::device_vector<storage_type>& operator()(unsigned d = 0) const {
+            return data(d);
+        }
+
+#define VEXCL_STORAGE_ASSIGNMENT(op, expr)                                     \
+        /** Expression assignment operator. */                                 \
+        template <class Expr>                                                  \
+        auto operator op(const Expr &e) ->                                     \
+            typename std::enable_if<                                           \
+                boost::proto::matches<                                         \
+                    typename boost::proto::result_of::as_expr<Expr>::type,     \
+                    vector_expr_grammar                                        \
+                >::value,                                                      \
+                const storage_vector&                                          \
+            >::type                                                            \
+        {                                                                      \
+            assign(expr);                                                      \
+            return *this;                                                      \
+        }
+
+        VEXCL_STORAGE_ASSIGNMENT(=,  e)
+        VEXCL_STORAGE_ASSIGNMENT(+=, *this + e)
+        VEXCL_STORAGE_ASSIGNMENT(-=, *this - e)
+        VEXCL_STORAGE_ASSIGNMENT(*=, *this * e)
+        VEXCL_STORAGE_ASSIGNMENT(/=, *this / e)
+
+#undef VEXCL_STORAGE_ASSIGNMENT
+    private:
+        vector<storage_type> data;
+        Storage storage;
+
+        // The expression is converted to the storage format and assigned
+        // to the underlying vector.
+        template <class Expr>
+        void assign(const Expr &expr) {
+            typedef typename boost::proto::result_of::as_child<const Expr, vector_domain>::type child;
+
+            data = detail::encoded_expression<T, Storage, child>(
+                    storage, boost::proto::as_child<vector_domain>(expr));
+        }
+};
+
+/// Copies host vector into a storage vector.
+template <typename T, class Storage>
+void copy(const std::vector<T> &hv, storage_vector<T, Storage> &dv) {
+    dv.write(hv);
+}
+
+/// Copies a storage vector into host vector.
+template <typename T, class Storage>
+void copy(const storage_vector<T, Storage> &dv, std::vector<T> &hv) {
+    dv.read(hv);
+}
+
+namespace traits {
+
+template <>
+struct is_vector_expr_terminal< storage_vector_terminal > : std::true_type {};
+
+template <>
+struct proto_terminal_is_value< storage_vector_terminal > : std::true_type {};
+
+template <typename T, class Storage>
+struct terminal_preamble< storage_vector<T, Storage> > {
+    static void get(backend::source_generator &src,
+            const storage_vector<T, Storage> &term,
+            const backend::command_queue&, const std::string&,
+            detail::kernel_generator_state_ptr state)
+    {
+        term.format().define(src, state);
+    }
+};
+
+template <typename T, class Storage>
+struct terminal_traffic< storage_vector<T, Storage> > {
+    static void get(const storage_vector<T, Storage>&, detail::expression_traffic &ctx) {
+        ctx.bytes_read += sizeof(typename Storage::type);
+    }
+};
+
+template <typename T, class Storage>
+struct kernel_param_declaration< storage_vector<T, Storage> > {
+    static void get(backend::source_generator &src,
+            const storage_vector<T, Storage> &term,
+            const backend::command_queue&, const std::string &prm_name,
+            detail::kernel_generator_state_ptr)
+    {
+        src.parameter< global_ptr<const typename Storage::type> >(prm_name);
+        term.format().template parameters<T>(src, prm_name);
+    }
+};
+
+template <typename T, class Storage>
+struct partial_vector_expr< storage_vector<T, Storage> > {
+    static void get(backend::source_generator &src,
+            const storage_vector<T, Storage> &term,
+            const backend::command_queue&, const std::string &prm_name,
+            detail::kernel_generator_state_ptr)
+    {
+        term.format().template load<T>(src, prm_name);
+    }
+};
+
+template <typename T, class Storage>
+struct kernel_arg_setter< storage_vector<T, Storage> > {
+    static void set(const storage_vector<T, Storage> &term,
+            backend::kernel &kernel, unsigned device, size_t/*index_offset*/,
+            detail::kernel_generator_state_ptr)
+    {
+        kernel.push_arg(term(device));
+        term.format().template arguments<T>(kernel);
+    }
+};
+
+template <typename T, class Storage>
+struct expression_properties< storage_vector<T, Storage> > {
+    static void get(const storage_vector<T, Storage> &term,
+            std::vector<backend::command_queue> &queue_list,
+            std::vector<size_t> &partition,
+            size_t &size
+            )
+    {
+        queue_list = term.queue_list();
+        partition  = term.partition();
+        size       = term.size();
+    }
+};
+
+template <>
+struct is_vector_expr_terminal< encoded_terminal > : std::true_type {};
+
+template <>
+struct proto_terminal_is_value< encoded_terminal > : std::true_type {};
+
+template <typename T, class Storage, class Expr>
+struct terminal_preamble< detail::encoded_expression<T, Storage, Expr> > {
+    static void get(backend::source_generator &src,
+            const detail::encoded_expression<T, Storage, Expr> &term,
+            const backend::command_queue &queue, const std::string &prm_name,
+            detail::kernel_generator_state_ptr state)
+    {
+        term.storage.define(src, state);
+
+        detail::output_terminal_preamble termpream(src, queue, prm_name, state);
+        boost::proto::eval(boost::proto::as_child(term.expr), termpream);
+    }
+};
+
+// The encoded expression is only used as the right-hand side of the
+// assignment to the stored values.
+template <typename T, class Storage, class Expr>
+struct terminal_traffic< detail::encoded_expression<T, Storage, Expr> > {
+    static void get(const detail::encoded_expression<T, Storage, Expr> &term,
+            detail::expression_traffic &ctx)
+    {
+        boost::proto::eval(boost::proto::as_child(term.expr), ctx);
+    }
+};
+
+template <typename T, class Storage, class Expr>
+struct kernel_param_declaration< detail::encoded_expression<T, Storage, Expr> > {
+    static void get(backend::source_generator &src,
+            const detail::encoded_expression<T, Storage, Expr> &term,
+            const backend::command_queue &queue, const std::string &prm_name,
+            detail::kernel_generator_state_ptr state)
+    {
+        detail::declare_expression_parameter declare(src, queue, prm_name, state);
+        detail::extract_terminals()(boost::proto::as_child(term.expr), declare);
+
+        term.storage.template parameters<T>(src, prm_name);
+    }
+};
+
+template <typename T, class Storage, class Expr>
+struct local_terminal_init< detail::encoded_expression<T, Storage, Expr> > {
+    static void get(backend::source_generator &src,
+            const detail::encoded_expression<T, Storage, Expr> &term,
+            const backend::command_queue &queue, const std::string &prm_name,
+            detail::kernel_generator_state_ptr state)
+    {
+        detail::output_local_preamble init_ctx(src, queue, prm_name, state);
+        boost::proto::eval(boost::proto::as_child(term.expr), init_ctx);
+    }
+};
+
+template <typename T, class Storage, class Expr>
+struct partial_vector_expr< detail::encoded_expression<T, Storage, Expr> > {
+    static void get(backend::source_generator &src,
+            const detail::encoded_expression<T, Storage, Expr> &term,
+            const backend::command_queue &queue, const std::string &prm_name,
+            detail::kernel_generator_state_ptr state)
+    {
+        term.storage.template store_begin<T>(src, prm_name);
+
+        detail::vector_expr_context expr_ctx(src, queue, prm_name, state);
+        boost::proto::eval(boost::proto::as_child(term.expr), expr_ctx);
+
+        term.storage.template store_end<T>(src, prm_name);
+    }
+};
+
+template <typename T, class Storage, class Expr>
+struct kernel_arg_setter< detail::encoded_expression<T, Storage, Expr> > {
+    static void set(const detail::encoded_expression<T, Storage, Expr> &term,
+            backend::kernel &kernel, unsigned device, size_t index_offset,
+            detail::kernel_generator_state_ptr state)
+    {
+        detail::set_expression_argument setarg(kernel, device, index_offset, state);
+        detail::extract_terminals()(boost::proto::as_child(term.expr), setarg);
+
+        term.storage.template arguments<T>(kernel);
+    }
+};
+
+template <typename T, class Storage, class Expr>
+struct expression_properties< detail::encoded_expression<T, Storage, Expr> > {
+    static void get(const detail::encoded_expression<T, Storage, Expr> &term,
+            std::vector<backend::command_queue> &queue_list,
+            std::vector<size_t> &partition,
+            size_t &size
+            )
+    {
+        detail::get_expression_properties prop;
+        detail::extract_terminals()(boost::proto::as_child(term.expr), prop);
+
+        queue_list = prop.queue;
+        partition  = prop.part;
+        size       = prop.size;
+    }
+};
+
+} // namespace traits
+} // namespace vex
+
+#endif
@@ -112,6 +112,17 @@ struct terminal_preamble< tagged_terminal<Tag, Term> > {
     }
 };
 
+// The terminals with the same tag are read once.
+template <size_t Tag, class Term>
+struct terminal_traffic< tagged_terminal<Tag, Term> > {
+    static void get(const tagged_terminal<Tag, Term> &term,
+            detail::expression_traffic &ctx)
+    {
+        if (ctx.first("tag_" + std::to_string(Tag)))
+            boost::proto::eval(boost::proto::as_child(term.term), ctx);
+    }
+};
+
 template <size_t Tag, class Term>
 struct kernel_param_declaration< tagged_terminal<Tag, Term> > {
     static void get(backend::source_generator &src,
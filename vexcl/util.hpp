@@ -43,6 +43,8 @@ THE SOFTWARE.
 #include <iostream>
 #include <string>
 #include <vector>
+#include <cstdlib>
+#include <cerrno>
 #include <array>
 #include <tuple>
 #include <map>
@@ -166,6 +168,21 @@ inline const char* getenv(const char *name, const char *defval = NULL) {
     return val ? val : (defval ? defval : NULL);
 }
 
+/// Integer value of the environment variable.
+/**
+ * Returns defval when the variable is not set or does not hold a number.
+ */
+inline long getenv_int(const char *name, long defval) {
+    const char *val = vex::getenv(name);
+    if (!val) return defval;
+
+    char *end;
+    errno = 0;
+    long v = std::strtol(val, &end, 10);
+
+    return (end == val || *end || errno) ? defval : v;
+}
+
 } // namespace vex
 
 #endif
@@ -50,6 +50,7 @@ THE SOFTWARE.
 #include <vexcl/operations.hpp>
 #include <vexcl/profiler.hpp>
 #include <vexcl/devlist.hpp>
+#include <vexcl/calibration.hpp>
 
 #ifdef BOOST_NO_NOEXCEPT
 #  define noexcept throw()
@@ -67,7 +68,9 @@ namespace vex {
  a = b + c;
  \endcode
  * where a, b and c are device vectors. Each device gets portion of the vector
- * proportional to the performance of this operation.
+ * proportional to the performance of this operation. The result (together
+ * with the achieved bandwidth) is kept in vex::calibration, so that the
+ * benchmark is only run on the first use of the device.
  */
 inline double device_vector_perf(const backend::command_queue&);
 
@@ -79,6 +82,38 @@ inline double equal_weights(const backend::command_queue&) {
     return 1;
 }
 
+namespace detail {
+
+// Splits n elements between the devices proportionally to the given weights.
+inline std::vector<size_t> weighted_partition(size_t n,
+        const std::vector<double> &weight)
+{
+    std::vector<size_t> part;
+    part.reserve(weight.size() + 1);
+    part.push_back(0);
+
+    if (weight.size() > 1) {
+        std::vector<double> cumsum;
+        cumsum.reserve(weight.size() + 1);
+        cumsum.push_back(0);
+
+        for(auto w = weight.begin(); w != weight.end(); ++w)
+            cumsum.push_back(cumsum.back() + *w);
+
+        for(unsigned d = 1; d < weight.size(); d++)
+            part.push_back(
+                    std::min(n,
+                        alignup(static_cast<size_t>(n * cumsum[d] / cumsum.back()))
+                        )
+                    );
+    }
+
+    part.push_back(n);
+    return part;
+}
+
+} // namespace detail
+
 template <bool dummy = true>
 struct partitioning_scheme {
     static_assert(dummy, "dummy parameter should be true");
@@ -101,6 +136,12 @@ struct partitioning_scheme {
 
     static std::vector<size_t> get(size_t n, const std::vector<backend::command_queue> &queue);
 
+    // Overrides the weight of the device (used by vex::partition_balancer).
+    static void set_weight(const backend::command_queue &q, double w) {
+        boost::lock_guard<boost::mutex> lock(mx);
+        device_weight[backend::get_device_id(q)] = w;
+    }
+
     private:
         static bool is_set;
         static weight_function weight;
@@ -133,36 +174,34 @@ std::vector<size_t> partitioning_scheme<dummy>::get(size_t n,
     static const bool once = init_weight_function();
     (void)once; // do not warn about unused variable
 
-    std::vector<size_t> part;
-    part.reserve(queue.size() + 1);
-    part.push_back(0);
-
-    if (queue.size() > 1) {
-        std::vector<double> cumsum;
-        cumsum.reserve(queue.size() + 1);
-        cumsum.push_back(0);
+    if (queue.size() <= 1) return detail::weighted_partition(n,
+            std::vector<double>(queue.size(), 1.0));
 
-        for(auto q = queue.begin(); q != queue.end(); q++) {
-            auto dev_id = backend::get_device_id(*q);
-            auto dw = device_weight.find(dev_id);
+    std::vector<double> w;
+    w.reserve(queue.size());
 
-            double w = (dw == device_weight.end()) ?
-                (device_weight[dev_id] = weight(*q)) :
-                dw->second;
+    for(auto q = queue.begin(); q != queue.end(); q++) {
+        auto dev_id = backend::get_device_id(*q);
 
-            cumsum.push_back(cumsum.back() + w);
+        {
+            boost::lock_guard<boost::mutex> lock(mx);
+            auto dw = device_weight.find(dev_id);
+            if (dw != device_weight.end()) {
+                w.push_back(dw->second);
+                continue;
+            }
         }
 
-        for(unsigned d = 1; d < queue.size(); d++)
-            part.push_back(
-                    std::min(n,
-                        alignup(static_cast<size_t>(n * cumsum[d] / cumsum.back()))
-                        )
-                    );
+        // The weight function may run benchmarks, so it is called without
+        // holding the lock. A weight set concurrently (e.g. by
+        // vex::partition_balancer) takes precedence.
+        double dw = weight(*q);
+
+        boost::lock_guard<boost::mutex> lock(mx);
+        w.push_back(device_weight.insert(std::make_pair(dev_id, dw)).first->second);
     }
 
-    part.push_back(n);
-    return part;
+    return detail::weighted_partition(n, w);
 }
 
 template <bool dummy>
@@ -313,6 +352,7 @@ class vector : public vector_terminal_expression {
                 }
 
                 reference dereference() const {
+                    detail::flush_deferred(vec);
                     return element_type(
                             vec->queue[part], vec->buf[part],
                             pos - vec->part[part]
@@ -379,6 +419,11 @@ class vector : public vector_terminal_expression {
             swap(v);
         }
 
+        ~vector() {
+            // Pending deferred statements may reference the vector.
+            detail::flush_deferred(this);
+        }
+
         /// Wraps a native buffer without owning it.
         /**
          * May be used to apply VexCL functions to buffers allocated and
@@ -479,6 +524,7 @@ class vector : public vector_terminal_expression {
             vector<U> r;
             r.queue = queue;
             r.part  = part;
+            r.flags = flags;
             r.buf.reserve(buf.size());
             for(size_t i = 0; i < buf.size(); ++i) {
                 r.buf.push_back(buf[i].template reinterpret<U>());
@@ -489,9 +535,13 @@ class vector : public vector_terminal_expression {
 
         /// Swap function.
         void swap(vector &v) {
+            detail::flush_deferred(this);
+            detail::flush_deferred(&v);
+
             std::swap(queue,   v.queue);
             std::swap(part,    v.part);
             std::swap(buf,     v.buf);
+            std::swap(flags,   v.flags);
         }
 
         /// Resizes the vector.
@@ -547,6 +597,27 @@ class vector : public vector_terminal_expression {
             vector(size, host, flags).swap(*this);
         }
 
+        /// Moves the vector data to the given partition.
+        /**
+         * The new partition should cover the vector on the same set of
+         * devices. The data is preserved (it is staged through the host
+         * memory). Used by vex::partition_balancer.
+         */
+        void repartition(const std::vector<size_t> &p) {
+            precondition(
+                    p.size() == queue.size() + 1 && p.front() == 0 && p.back() == size(),
+                    "Partition does not match the vector"
+                    );
+
+            if (p == part) return;
+
+            std::vector<T> host(size());
+            read_data(0, size(), host.data(), true);
+
+            part = p;
+            allocate_buffers(flags, host.data());
+        }
+
         /// Fills vector with zeros.
         /** This does not change the vector size! */
         void clear() {
@@ -555,11 +626,13 @@ class vector : public vector_terminal_expression {
 
         /// Returns memory buffer located on the given device.
         const backend::device_vector<T>& operator()(unsigned d = 0) const {
+            detail::flush_deferred(this);
             return buf[d];
         }
 
         /// Returns memory buffer located on the given device.
         backend::device_vector<T>& operator()(unsigned d = 0) {
+            detail::flush_deferred(this);
             return buf[d];
         }
 
@@ -585,6 +658,7 @@ class vector : public vector_terminal_expression {
 
         /// Access vector element.
         const element operator[](size_t index) const {
+            detail::flush_deferred(this);
             size_t d = std::upper_bound(
                     part.begin(), part.end(), index) - part.begin() - 1;
             return element(queue[d], buf[d], index - part[d]);
@@ -592,6 +666,7 @@ class vector : public vector_terminal_expression {
 
         /// Access vector element.
         element operator[](size_t index) {
+            detail::flush_deferred(this);
             unsigned d = static_cast<unsigned>(
                 std::upper_bound(part.begin(), part.end(), index) - part.begin() - 1
                 );
@@ -636,6 +711,7 @@ class vector : public vector_terminal_expression {
          * upon destruction */
         typename backend::device_vector<T>::mapped_array
         map(unsigned d = 0) {
+            detail::flush_deferred(this);
             return buf[d].map(queue[d]);
         }
 
@@ -645,6 +721,7 @@ class vector : public vector_terminal_expression {
          * upon destruction */
         typename backend::device_vector<T>::mapped_array
         map(unsigned d = 0) const {
+            detail::flush_deferred(this);
             return buf[d].map(queue[d]);
         }
 
@@ -791,6 +868,8 @@ class vector : public vector_terminal_expression {
         {
             if (!size) return;
 
+            detail::flush_deferred(this);
+
             for(unsigned d = 0; d < queue.size(); d++) {
                 size_t start = std::max(offset,        part[d]);
                 size_t stop  = std::min(offset + size, part[d + 1]);
@@ -817,6 +896,8 @@ class vector : public vector_terminal_expression {
 
             if (!size) return;
 
+            detail::flush_deferred(this);
+
             for(unsigned d = 0; d < q.size(); d++) {
                 precondition(
                         backend::get_context_id(q[d]) == backend::get_context_id(queue[d]),
@@ -845,6 +926,8 @@ class vector : public vector_terminal_expression {
         {
             if (!size) return;
 
+            detail::flush_deferred(this);
+
             for(unsigned d = 0; d < queue.size(); d++) {
                 size_t start = std::max(offset,        part[d]);
                 size_t stop  = std::min(offset + size, part[d + 1]);
@@ -872,6 +955,8 @@ class vector : public vector_terminal_expression {
 
             if (!size) return;
 
+            detail::flush_deferred(this);
+
             for(unsigned d = 0; d < q.size(); d++) {
                 precondition(
                         backend::get_context_id(q[d]) == backend::get_context_id(queue[d]),
@@ -899,8 +984,11 @@ class vector : public vector_terminal_expression {
         mutable std::vector<backend::command_queue> queue;
         std::vector<size_t>                      part;
         std::vector< backend::device_vector<T> > buf;
+        backend::mem_flags                       flags = backend::MEM_READ_WRITE;
+
+        void allocate_buffers(backend::mem_flags f, const T *hostptr) {
+            flags = f;
 
-        void allocate_buffers(backend::mem_flags flags, const T *hostptr) {
             buf.clear();
             buf.reserve(queue.size());
 
@@ -908,7 +996,7 @@ class vector : public vector_terminal_expression {
                 buf.push_back(
                         backend::device_vector<T>(
                             queue[d], part[d + 1] - part[d],
-                            hostptr ? hostptr + part[d] : 0, flags)
+                            hostptr ? hostptr + part[d] : 0, f)
                         );
         }
 
@@ -930,6 +1018,27 @@ struct is_vector_expr_terminal< vector_terminal > : std::true_type {};
 template <>
 struct proto_terminal_is_value< vector_terminal > : std::true_type {};
 
+template <typename T>
+struct is_deferrable_terminal< vector<T> > : std::true_type {};
+
+template <>
+struct is_identity_terminal_value< vector_terminal > : std::true_type {};
+
+template <typename T>
+struct terminal_identity< vector<T> > : std::true_type {
+    static void get(const vector<T> &term, std::string &id) {
+        const vector<T> *p = std::addressof(term);
+        id.assign(reinterpret_cast<const char*>(&p), sizeof(p));
+    }
+};
+
+template <typename T>
+struct terminal_traffic< vector<T> > {
+    static void get(const vector<T>&, detail::expression_traffic &ctx) {
+        ctx.bytes_read += sizeof(T);
+    }
+};
+
 template <typename T>
 struct kernel_param_declaration< vector<T> > {
     static void get(backend::source_generator &src,
@@ -1147,23 +1256,30 @@ void swap(vector<T> &x, vector<T> &y) {
 
 /// Returns device weight after simple bandwidth test
 inline double device_vector_perf(const backend::command_queue &q) {
-    static const size_t test_size = 1024U * 1024U;
-    std::vector<backend::command_queue> queue(1, q);
-
-    // Allocate test vectors on current device and measure execution
-    // time of a simple kernel.
-    vex::vector<float> a(queue, test_size);
-    vex::vector<float> b(queue, test_size);
-    vex::vector<float> c(queue, test_size);
-
-    // Skip the first run.
-    a = b + c;
-
-    // Measure the second run.
-    profiler<> prof(queue);
-    prof.tic_cl("");
-    a = b + c;
-    return 1.0 / prof.toc("");
+    return calibration::get(q, "vector_perf", [&q]() {
+            static const size_t test_size = 1024U * 1024U;
+            std::vector<backend::command_queue> queue(1, q);
+
+            // Allocate test vectors on current device and measure execution
+            // time of a simple kernel.
+            vex::vector<float> a(queue, test_size);
+            vex::vector<float> b(queue, test_size);
+            vex::vector<float> c(queue, test_size);
+
+            // Skip the first run.
+            a = b + c;
+
+            // Measure the second run.
+            profiler<> prof(queue);
+            prof.tic_cl("");
+            a = b + c;
+            double time = prof.toc("");
+
+            // Two reads and a write per element, in GB/s:
+            calibration::set(q, "bandwidth", 3e-9 * sizeof(float) * test_size / time);
+
+            return 1.0 / time;
+            });
 }
 
 
@@ -113,6 +113,22 @@ struct terminal_preamble< vector_view<Expr, Slice> > {
     }
 };
 
+// The base expression is gathered at the sliced positions, so its terminals
+// are counted apart from the ones read at the current element.
+template <typename Expr, class Slice>
+struct terminal_traffic< vector_view<Expr, Slice> > {
+    static void get(const vector_view<Expr, Slice> &term,
+            detail::expression_traffic &ctx)
+    {
+        detail::expression_traffic base;
+        boost::proto::eval(boost::proto::as_child(term.expr), base);
+        term.slice.traffic(base);
+
+        ctx.bytes_read += base.bytes_read;
+        ctx.flops      += base.flops;
+    }
+};
+
 template <typename Expr, class Slice>
 struct kernel_param_declaration< vector_view<Expr, Slice> > {
     static void get(backend::source_generator &src,
@@ -378,6 +394,9 @@ struct gslice {
         src << ", idx)";
     }
 
+    // The indices are computed in place.
+    void traffic(detail::expression_traffic&) const {}
+
     void setArgs(backend::kernel &kernel, unsigned/*part*/, size_t/*index_offset*/,
             detail::kernel_generator_state_ptr) const
     {
@@ -643,6 +662,11 @@ struct expr_permutation {
         boost::proto::eval(boost::proto::as_child(expr), ctx);
     }
 
+    // The index expression is read at the current element.
+    void traffic(detail::expression_traffic &ctx) const {
+        boost::proto::eval(boost::proto::as_child(expr), ctx);
+    }
+
     void setArgs(backend::kernel &kernel, unsigned part, size_t index_offset,
             detail::kernel_generator_state_ptr state) const
     {
@@ -815,6 +839,24 @@ struct local_terminal_init< reduced_vector_view<Expr, NDIM, NR, RDC> > {
     }
 };
 
+// Each element reduces the base expression over the reduced dimensions.
+template <typename Expr, size_t NDIM, size_t NR, class RDC>
+struct terminal_traffic< reduced_vector_view<Expr, NDIM, NR, RDC> > {
+    static void get(const reduced_vector_view<Expr, NDIM, NR, RDC> &term,
+            detail::expression_traffic &ctx)
+    {
+        detail::expression_traffic base;
+        boost::proto::eval(boost::proto::as_child(term.expr), base);
+
+        size_t n = 1;
+        for(size_t k = 0; k < NR; ++k)
+            n *= term.slice.length[term.reduce_dims[k]];
+
+        ctx.bytes_read += n * base.bytes_read;
+        ctx.flops      += n * (base.flops + 1);
+    }
+};
+
 template <typename Expr, size_t NDIM, size_t NR, class RDC>
 struct kernel_param_declaration< reduced_vector_view<Expr, NDIM, NR, RDC> > {
     static void get(backend::source_generator &src,
@@ -34,6 +34,8 @@ THE SOFTWARE.
 #include <vexcl/backend.hpp>
 
 #include <vexcl/devlist.hpp>
+#include <vexcl/memory_pool.hpp>
+#include <vexcl/calibration.hpp>
 #include <vexcl/constants.hpp>
 #include <vexcl/element_index.hpp>
 #include <vexcl/vector.hpp>
@@ -45,6 +47,8 @@ THE SOFTWARE.
 #include <vexcl/cast.hpp>
 #include <vexcl/multivector.hpp>
 #include <vexcl/reductor.hpp>
+#include <vexcl/device_scalar.hpp>
+#include <vexcl/storage_vector.hpp>
 #include <vexcl/spmat.hpp>
 #include <vexcl/sparse/distributed.hpp>
 #include <vexcl/sparse/matrix.hpp>
@@ -65,6 +69,8 @@ THE SOFTWARE.
 #include <vexcl/enqueue.hpp>
 #include <vexcl/image.hpp>
 #include <vexcl/eval.hpp>
+#include <vexcl/deferred.hpp>
+#include <vexcl/partition_balancer.hpp>
 
 #ifndef VEXCL_BACKEND_CUDA
 #include <vexcl/constant_address_space.hpp>